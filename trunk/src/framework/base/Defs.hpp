@@ -45,12 +45,18 @@ namespace FW
 #   define FW_DEBUG 0
 #endif
 
-#ifdef _M_X64
+#if defined(_M_X64) || defined(__x86_64__) || defined(__LP64__)
 #   define FW_64    1
 #else
 #   define FW_64    0
 #endif
 
+#ifdef _WIN32
+#   define FW_WIN32 1
+#else
+#   define FW_WIN32 0
+#endif
+
 #ifdef __CUDACC__
 #   define FW_CUDA 1
 #else
@@ -90,7 +96,7 @@ typedef float               F32;
 typedef double              F64;
 typedef void                (*FuncPtr)(void);
 
-#if FW_CUDA
+#if FW_CUDA || !defined(_MSC_VER)
 typedef unsigned long long  U64;
 typedef signed long long    S64;
 #else
@@ -101,9 +107,12 @@ typedef signed __int64      S64;
 #if FW_64
 typedef S64                 SPTR;
 typedef U64                 UPTR;
-#else
+#elif defined(_MSC_VER)
 typedef __w64 S32           SPTR;
 typedef __w64 U32           UPTR;
+#else
+typedef S32                 SPTR;
+typedef U32                 UPTR;
 #endif
 
 //------------------------------------------------------------------------
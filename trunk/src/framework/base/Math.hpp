@@ -216,7 +216,7 @@ public:
 template <class T, int L> class Vector : public VectorBase<T, L, Vector<T, L> >
 {
 public:
-    FW_CUDA_FUNC                    Vector      (void)                      { setZero(); }
+    FW_CUDA_FUNC                    Vector      (void)                      { this->setZero(); }
     FW_CUDA_FUNC                    Vector      (T a)                       { set(a); }
 
     FW_CUDA_FUNC    const T*        getPtr      (void) const                { return m_values; }
@@ -609,7 +609,7 @@ public:
 template <class T, int L> class Matrix : public MatrixBase<T, L, Matrix<T, L> >
 {
 public:
-    FW_CUDA_FUNC                    Matrix      (void)                      { setIdentity(); }
+    FW_CUDA_FUNC                    Matrix      (void)                      { this->setIdentity(); }
     FW_CUDA_FUNC    explicit        Matrix      (T a)                       { set(a); }
 
     FW_CUDA_FUNC    const T*        getPtr      (void) const                { return m_values; }
@@ -27,14 +27,434 @@
 
 #include "io/File.hpp"
 
+#if !FW_WIN32
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   if defined(__linux__) && defined(__has_include)
+#       if __has_include(<linux/io_uring.h>)
+#           include <linux/io_uring.h>
+#           include <sys/syscall.h>
+#           define FW_USE_IO_URING 1
+#       endif
+#   endif
+#endif
+
+#ifndef FW_USE_IO_URING
+#   define FW_USE_IO_URING 0
+#endif
+
 using namespace FW;
 
+//------------------------------------------------------------------------
+// Process-wide queue that executes File::AsyncOps on POSIX systems.
+// Created on first use and kept alive until the process exits.
+//------------------------------------------------------------------------
+
+#if !FW_WIN32
+namespace FW
+{
+
+class FileIOQueue
+{
+public:
+    enum
+    {
+        RingEntries     = 256,
+        NumPoolThreads  = 4,
+    };
+
+public:
+    static FileIOQueue& get             (void);
+
+    void                submit          (File::AsyncOp* op);
+    void                wait            (File::AsyncOp* op);
+
+private:
+                        FileIOQueue     (void);
+
+    static void         create          (void);
+    static void         finish          (File::AsyncOp* op);
+
+#if FW_USE_IO_URING
+    bool                initRing        (void);
+    void                submitRing      (File::AsyncOp* op);
+    void                reapRing        (void);
+    static void*        ringThread      (void* arg);
+#endif
+    static void*        poolThread      (void* arg);
+
+private:
+                        FileIOQueue     (const FileIOQueue&); // forbidden
+    FileIOQueue&        operator=       (const FileIOQueue&); // forbidden
+
+private:
+    static pthread_once_t s_once;
+    static FileIOQueue* s_queue;
+
+    pthread_mutex_t     m_lock;
+    pthread_cond_t      m_doneCond;         // signaled when ops finish
+    pthread_cond_t      m_queueCond;        // signaled when ops are added to the pool queue
+    bool                m_useRing;
+
+#if FW_USE_IO_URING
+    int                 m_ringFD;
+    U32                 m_ringEntries;
+    S32                 m_ringInFlight;
+    U32*                m_sqHead;
+    U32*                m_sqTail;
+    U32*                m_sqMask;
+    U32*                m_sqArray;
+    io_uring_sqe*       m_sqes;
+    U32*                m_cqHead;
+    U32*                m_cqTail;
+    U32*                m_cqMask;
+    io_uring_cqe*       m_cqes;
+#endif
+
+    File::AsyncOp*      m_queueFirst;       // NULL if none
+    File::AsyncOp*      m_queueLast;        // NULL if none
+};
+
+}
+
+//------------------------------------------------------------------------
+
+pthread_once_t  FileIOQueue::s_once     = PTHREAD_ONCE_INIT;
+FileIOQueue*    FileIOQueue::s_queue    = NULL;
+
+//------------------------------------------------------------------------
+
+FileIOQueue& FileIOQueue::get(void)
+{
+    pthread_once(&s_once, create);
+    return *s_queue;
+}
+
+//------------------------------------------------------------------------
+
+void FileIOQueue::submit(File::AsyncOp* op)
+{
+    FW_ASSERT(op && !op->m_done);
+    op->m_pending       = 1;
+    op->m_transferred   = 0;
+    op->m_errno         = 0;
+    op->m_queueNext     = NULL;
+
+    pthread_mutex_lock(&m_lock);
+
+#if FW_USE_IO_URING
+    if (m_useRing)
+    {
+        submitRing(op);
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+#endif
+
+    if (m_queueLast)
+        m_queueLast->m_queueNext = op;
+    else
+        m_queueFirst = op;
+    m_queueLast = op;
+
+    pthread_cond_signal(&m_queueCond);
+    pthread_mutex_unlock(&m_lock);
+}
+
+//------------------------------------------------------------------------
+
+void FileIOQueue::wait(File::AsyncOp* op)
+{
+    FW_ASSERT(op);
+    if (!__atomic_load_n(&op->m_pending, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_mutex_lock(&m_lock);
+    while (__atomic_load_n(&op->m_pending, __ATOMIC_ACQUIRE))
+        pthread_cond_wait(&m_doneCond, &m_lock);
+    pthread_mutex_unlock(&m_lock);
+}
+
+//------------------------------------------------------------------------
+
+FileIOQueue::FileIOQueue(void)
+:   m_useRing       (false),
+    m_queueFirst    (NULL),
+    m_queueLast     (NULL)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_doneCond, NULL);
+    pthread_cond_init(&m_queueCond, NULL);
+
+    // Try io_uring first, fall back to the thread pool.
+
+    pthread_t thread;
+#if FW_USE_IO_URING
+    m_useRing = initRing();
+    if (m_useRing && pthread_create(&thread, NULL, ringThread, this) == 0)
+    {
+        pthread_detach(thread);
+        return;
+    }
+    m_useRing = false;
+#endif
+
+    for (int i = 0; i < NumPoolThreads; i++)
+        if (pthread_create(&thread, NULL, poolThread, this) == 0)
+            pthread_detach(thread);
+}
+
+//------------------------------------------------------------------------
+
+void FileIOQueue::create(void)
+{
+    s_queue = new FileIOQueue;
+}
+
+//------------------------------------------------------------------------
+
+void FileIOQueue::finish(File::AsyncOp* op)
+{
+    // Caller must hold m_lock and broadcast m_doneCond afterwards.
+
+    FW_ASSERT(op);
+    __atomic_store_n(&op->m_pending, 0, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------
+
+#if FW_USE_IO_URING
+bool FileIOQueue::initRing(void)
+{
+    // Create the ring. IORING_OP_READ/WRITE appeared in the same kernel
+    // version (5.6) as IORING_FEAT_RW_CUR_POS, so use it as a version check.
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ringFD = (int)syscall(__NR_io_uring_setup, (U32)RingEntries, &params);
+    if (m_ringFD < 0)
+        return false;
+
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+    {
+        close(m_ringFD);
+        return false;
+    }
+
+    // Map the submission queue, completion queue, and SQE array.
+
+    size_t sqSize   = params.sq_off.array + params.sq_entries * sizeof(U32);
+    size_t cqSize   = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    size_t sqeSize  = params.sq_entries * sizeof(io_uring_sqe);
+
+    U8* sq = (U8*)mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFD, IORING_OFF_SQ_RING);
+    U8* cq = (U8*)mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFD, IORING_OFF_CQ_RING);
+    m_sqes = (io_uring_sqe*)mmap(NULL, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFD, IORING_OFF_SQES);
+
+    if (sq == MAP_FAILED || cq == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+        if (sq != MAP_FAILED)
+            munmap(sq, sqSize);
+        if (cq != MAP_FAILED)
+            munmap(cq, cqSize);
+        if (m_sqes != MAP_FAILED)
+            munmap(m_sqes, sqeSize);
+        close(m_ringFD);
+        return false;
+    }
+
+    m_sqHead        = (U32*)(sq + params.sq_off.head);
+    m_sqTail        = (U32*)(sq + params.sq_off.tail);
+    m_sqMask        = (U32*)(sq + params.sq_off.ring_mask);
+    m_sqArray       = (U32*)(sq + params.sq_off.array);
+    m_cqHead        = (U32*)(cq + params.cq_off.head);
+    m_cqTail        = (U32*)(cq + params.cq_off.tail);
+    m_cqMask        = (U32*)(cq + params.cq_off.ring_mask);
+    m_cqes          = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    m_ringEntries   = params.sq_entries;
+    m_ringInFlight  = 0;
+    return true;
+}
+#endif
+
+//------------------------------------------------------------------------
+
+#if FW_USE_IO_URING
+void FileIOQueue::submitRing(File::AsyncOp* op)
+{
+    // Caller must hold m_lock. The completion queue has room for twice
+    // the submission queue, so limiting the number of requests in flight
+    // to m_ringEntries guarantees that no completions are dropped.
+
+    FW_ASSERT(op);
+    while (m_ringInFlight >= (S32)m_ringEntries)
+        pthread_cond_wait(&m_doneCond, &m_lock);
+
+    U32 tail = *m_sqTail;
+    U32 idx = tail & *m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    U8* ptr         = (U8*)((op->m_readPtr) ? op->m_readPtr : op->m_writePtr);
+    sqe->opcode     = (U8)((op->m_readPtr) ? IORING_OP_READ : IORING_OP_WRITE);
+    sqe->fd         = op->m_fileHandle;
+    sqe->off        = (U64)(op->m_offset + op->m_transferred);
+    sqe->addr       = (U64)(UPTR)(ptr + op->m_transferred);
+    sqe->len        = (U32)(op->m_numBytes - op->m_transferred);
+    sqe->user_data  = (U64)(UPTR)op;
+
+    m_sqArray[idx] = idx;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_ringInFlight++;
+
+    // Submit. If the kernel refuses outright, take the entry back.
+
+    for (;;)
+    {
+        if (syscall(__NR_io_uring_enter, m_ringFD, 1, 0, 0, NULL, 0) >= 0)
+            break;
+
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        {
+            sched_yield();
+            continue;
+        }
+
+        if (__atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == tail)
+        {
+            __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+            m_ringInFlight--;
+            op->m_errno = errno;
+            finish(op);
+            pthread_cond_broadcast(&m_doneCond);
+        }
+        break;
+    }
+}
+#endif
+
+//------------------------------------------------------------------------
+
+#if FW_USE_IO_URING
+void FileIOQueue::reapRing(void)
+{
+    // Caller must hold m_lock.
+
+    U32 head = *m_cqHead;
+    U32 tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return;
+
+    while (head != tail)
+    {
+        const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+        File::AsyncOp* op = (File::AsyncOp*)(UPTR)cqe.user_data;
+        int res = cqe.res;
+        head++;
+        m_ringInFlight--;
+
+        // Interrupted or transferred partially => resubmit the rest.
+
+        if (res > 0)
+            op->m_transferred += res;
+
+        if (res == -EINTR || res == -EAGAIN || (res > 0 && op->m_transferred < op->m_numBytes))
+        {
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            submitRing(op);
+            continue;
+        }
+
+        if (res < 0)
+            op->m_errno = -res;
+        finish(op);
+    }
+
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&m_doneCond);
+}
+#endif
+
+//------------------------------------------------------------------------
+
+#if FW_USE_IO_URING
+void* FileIOQueue::ringThread(void* arg)
+{
+    FileIOQueue* queue = (FileIOQueue*)arg;
+    for (;;)
+    {
+        syscall(__NR_io_uring_enter, queue->m_ringFD, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        pthread_mutex_lock(&queue->m_lock);
+        queue->reapRing();
+        pthread_mutex_unlock(&queue->m_lock);
+    }
+    return NULL;
+}
+#endif
+
+//------------------------------------------------------------------------
+
+void* FileIOQueue::poolThread(void* arg)
+{
+    FileIOQueue* queue = (FileIOQueue*)arg;
+    pthread_mutex_lock(&queue->m_lock);
+    for (;;)
+    {
+        // Pop an op.
+
+        while (!queue->m_queueFirst)
+            pthread_cond_wait(&queue->m_queueCond, &queue->m_lock);
+
+        File::AsyncOp* op = queue->m_queueFirst;
+        queue->m_queueFirst = op->m_queueNext;
+        if (!queue->m_queueFirst)
+            queue->m_queueLast = NULL;
+        pthread_mutex_unlock(&queue->m_lock);
+
+        // Transfer until done, end of file, or error.
+
+        while (op->m_transferred < op->m_numBytes)
+        {
+            ssize_t res;
+            if (op->m_readPtr)
+                res = pread(op->m_fileHandle, (U8*)op->m_readPtr + op->m_transferred, op->m_numBytes - op->m_transferred, op->m_offset + op->m_transferred);
+            else
+                res = pwrite(op->m_fileHandle, (const U8*)op->m_writePtr + op->m_transferred, op->m_numBytes - op->m_transferred, op->m_offset + op->m_transferred);
+
+            if (res > 0)
+                op->m_transferred += (S32)res;
+            else if (res == 0)
+                break;
+            else if (errno != EINTR && errno != EAGAIN)
+            {
+                op->m_errno = errno;
+                break;
+            }
+        }
+
+        // Signal completion.
+
+        pthread_mutex_lock(&queue->m_lock);
+        finish(op);
+        pthread_cond_broadcast(&queue->m_doneCond);
+    }
+    return NULL;
+}
+#endif
+
 //------------------------------------------------------------------------
 
 File::AsyncOp::~AsyncOp(void)
 {
     wait();
+#if FW_WIN32
     CloseHandle(m_overlapped.hEvent);
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -44,8 +464,13 @@ bool File::AsyncOp::isDone(void)
     if (m_done)
         return true;
 
+#if FW_WIN32
     if (!HasOverlappedIoCompleted(&m_overlapped))
         return false;
+#else
+    if (__atomic_load_n(&m_pending, __ATOMIC_ACQUIRE))
+        return false;
+#endif
 
     wait();
     return true;
@@ -58,6 +483,7 @@ void File::AsyncOp::wait(void)
     if (m_done)
         return;
 
+#if FW_WIN32
     DWORD numBytes = 0;
     if (!GetOverlappedResult(m_fileHandle, &m_overlapped, &numBytes, TRUE))
     {
@@ -73,11 +499,28 @@ void File::AsyncOp::wait(void)
     {
         done();
     }
+#else
+    FileIOQueue::get().wait(this);
+    if (m_errno)
+    {
+        setError("Async %s failed: %s!", (m_readPtr) ? "read" : "write", strerror(m_errno));
+        failed();
+    }
+    else if (m_transferred != m_expectedBytes)
+    {
+        setError("Async %s returned %d bytes, expected %d!", (m_readPtr) ? "read" : "write", m_transferred, m_expectedBytes);
+        failed();
+    }
+    else
+    {
+        done();
+    }
+#endif
 }
 
 //------------------------------------------------------------------------
 
-File::AsyncOp::AsyncOp(HANDLE fileHandle)
+File::AsyncOp::AsyncOp(Handle fileHandle)
 :   m_offset        (0),
     m_numBytes      (0),
     m_expectedBytes (0),
@@ -91,9 +534,16 @@ File::AsyncOp::AsyncOp(HANDLE fileHandle)
     m_freePtr       (NULL),
 
     m_fileHandle    (fileHandle),
+#if !FW_WIN32
+    m_pending       (0),
+    m_transferred   (0),
+    m_errno         (0),
+    m_queueNext     (NULL),
+#endif
     m_done          (false),
     m_failed        (false)
 {
+#if FW_WIN32
     memset(&m_overlapped, 0, sizeof(m_overlapped));
 
     // Create event object. Without one, GetOverlappedResult()
@@ -102,6 +552,7 @@ File::AsyncOp::AsyncOp(HANDLE fileHandle)
     m_overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     if (!m_overlapped.hEvent)
         failWin32Error("CreateEvent");
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -124,12 +575,21 @@ File::File(const String& name, Mode mode, bool disableCache)
 :   m_name          (name),
     m_mode          (mode),
     m_disableCache  (disableCache),
+#if FW_WIN32
     m_handle        (NULL),
+#else
+    m_handle        (-1),
+#endif
     m_align         (1),
+#if FW_WIN32
+    m_mapping       (NULL),
+#endif
+    m_mapPtr        (NULL),
 
     m_size          (0),
     m_offset        (0)
 {
+#if FW_WIN32
     static bool privilegeSet = false;
     if (!privilegeSet)
     {
@@ -199,6 +659,53 @@ File::File(const String& name, Mode mode, bool disableCache)
             failWin32Error("GetDiskFreeSpace");
         m_align = bytesPerSector;
     }
+#else
+
+    // Select mode.
+
+    const char* modeName;
+    int flags;
+
+    switch (mode)
+    {
+    case Read:      modeName = "read"; flags = O_RDONLY; break;
+    case Create:    modeName = "create"; flags = O_RDWR | O_CREAT | O_TRUNC; break;
+    case Modify:    modeName = "modify"; flags = O_RDWR | O_CREAT; break;
+    default:        FW_ASSERT(false); return;
+    }
+
+    // Open. Some file systems (e.g. tmpfs) reject O_DIRECT => open without.
+
+    flags |= O_CLOEXEC;
+#ifdef O_DIRECT
+    if (disableCache)
+        m_handle = open(name.getPtr(), flags | O_DIRECT, 0666);
+#endif
+    if (m_handle < 0)
+    {
+        m_disableCache = false;
+        m_handle = open(name.getPtr(), flags, 0666);
+    }
+
+    if (m_handle < 0)
+        setError("Cannot open file '%s' for %s!", m_name.getPtr(), modeName);
+
+    // Get size and alignment.
+
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (m_handle >= 0 && fstat(m_handle, &st) != 0)
+        setError("fstat() failed on '%s'!", m_name.getPtr());
+    m_size = st.st_size;
+    m_actualSize = st.st_size;
+
+    if (m_disableCache)
+    {
+        m_align = 4096;
+        if (st.st_blksize >= 512 && (st.st_blksize & (st.st_blksize - 1)) == 0)
+            m_align = (S32)st.st_blksize;
+    }
+#endif
     FW_ASSERT((m_align & (m_align - 1)) == 0);
 }
 
@@ -206,12 +713,26 @@ File::File(const String& name, Mode mode, bool disableCache)
 
 File::~File(void)
 {
-    if (!m_handle)
+#if FW_WIN32
+    if (m_mapPtr)
+        UnmapViewOfFile(m_mapPtr);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+#else
+    if (m_mapPtr)
+        munmap((void*)m_mapPtr, (size_t)m_size);
+#endif
+
+    if (!hasHandle())
         return;
 
     fixSize();
+#if FW_WIN32
     CancelIo(m_handle);
     CloseHandle(m_handle);
+#else
+    close(m_handle);
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -238,7 +759,7 @@ void File::seek(S64 ofs)
 
 void File::setSize(S64 size)
 {
-    if (!checkWritable() || !m_handle)
+    if (!checkWritable() || !hasHandle())
         return;
     if (size >= 0)
         m_size = size;
@@ -250,9 +771,10 @@ void File::setSize(S64 size)
 
 void File::allocateSpace(S64 size)
 {
-    if (m_mode == Read || !m_handle || m_actualSize >= size)
+    if (m_mode == Read || !hasHandle() || m_actualSize >= size)
         return;
 
+#if FW_WIN32
     LARGE_INTEGER ofs;
     ofs.QuadPart = (size + m_align - 1) & -m_align;
     if (SetFilePointerEx(m_handle, ofs, NULL, FILE_BEGIN) && SetEndOfFile(m_handle))
@@ -260,6 +782,11 @@ void File::allocateSpace(S64 size)
         SetFileValidData(m_handle, ofs.QuadPart);
         m_actualSize = ofs.QuadPart;
     }
+#else
+    S64 ofs = (size + m_align - 1) & -m_align;
+    if (ftruncate(m_handle, ofs) == 0)
+        m_actualSize = ofs;
+#endif
 }
 
 //------------------------------------------------------------------------
@@ -284,12 +811,17 @@ void File::write(const void* ptr, int size)
 
 void File::flush(void)
 {
-    if (m_mode == Read || !m_handle)
+    if (m_mode == Read || !hasHandle())
         return;
 
     profilePush("Flush file");
+#if FW_WIN32
     if (!FlushFileBuffers(m_handle))
         setError("FlushFileBuffers() failed on '%s'!", m_name.getPtr());
+#else
+    if (fsync(m_handle) != 0)
+        setError("fsync() failed on '%s'!", m_name.getPtr());
+#endif
     profilePop();
     fixSize();
 }
@@ -305,7 +837,7 @@ File::AsyncOp* File::readAsync(void* ptr, int size)
 
     AsyncOp* op = new AsyncOp(m_handle);
     op->m_userBytes = max((int)min((S64)size, m_size - m_offset), 0);
-    if (!m_handle)
+    if (!hasHandle())
         op->m_userBytes = 0;
 
     int mask = m_align - 1;
@@ -364,7 +896,7 @@ File::AsyncOp* File::writeAsync(const void* ptr, int size)
 
     AsyncOp* op = new AsyncOp(m_handle);
     op->m_userBytes = size;
-    if (op->m_userBytes < 0 || !checkWritable() || !m_handle)
+    if (op->m_userBytes < 0 || !checkWritable() || !hasHandle())
         op->m_userBytes = 0;
 
     // Aligned => write directly.
@@ -418,15 +950,56 @@ File::AsyncOp* File::writeAsync(const void* ptr, int size)
 
 //------------------------------------------------------------------------
 
+const U8* File::mapReadOnly(void)
+{
+    FW_ASSERT(m_mode == Read);
+    if (m_mapPtr || !hasHandle() || !m_size)
+        return m_mapPtr;
+
+    // Failure is not an error; the caller falls back to regular reads,
+    // e.g. when the address space is too small for the file.
+
+#if FW_WIN32
+    m_mapping = CreateFileMapping(m_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping)
+        m_mapPtr = (const U8*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!m_mapPtr && m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+#else
+    void* ptr = mmap(NULL, (size_t)m_size, PROT_READ, MAP_SHARED, m_handle, 0);
+    if (ptr != MAP_FAILED)
+        m_mapPtr = (const U8*)ptr;
+#endif
+    return m_mapPtr;
+}
+
+//------------------------------------------------------------------------
+
+bool File::hasHandle(void) const
+{
+#if FW_WIN32
+    return (m_handle != NULL);
+#else
+    return (m_handle >= 0);
+#endif
+}
+
+//------------------------------------------------------------------------
+
 void File::fixSize(void)
 {
-    if (m_mode == Read || !m_handle || m_actualSize == m_size)
+    if (m_mode == Read || !hasHandle() || m_actualSize == m_size)
         return;
 
-    // Size is not aligned properly => reopen with buffering.
-
     profilePush("Resize file");
 
+#if FW_WIN32
+    // Size is not aligned properly => reopen with buffering.
+
     bool reopen = ((m_size & (m_align - 1)) != 0);
     if (reopen)
     {
@@ -472,6 +1045,14 @@ void File::fixSize(void)
         if (!m_handle)
             setError("CreateFile() failed on '%s'!", m_name.getPtr());
     }
+#else
+    // O_DIRECT does not restrict the file size => truncate directly.
+
+    if (ftruncate(m_handle, m_size) != 0)
+        setError("ftruncate() failed on '%s'!", m_name.getPtr());
+    else
+        m_actualSize = m_size;
+#endif
 
     profilePop();
 }
@@ -517,6 +1098,7 @@ void File::startOp(AsyncOp* op)
 
         // Queue the op.
 
+#if FW_WIN32
         BOOL ok;
         const char* funcName;
         blockOp->m_overlapped.Offset = (DWORD)blockOp->m_offset;
@@ -542,6 +1124,9 @@ void File::startOp(AsyncOp* op)
             setError("%s() failed on '%s'!", funcName, m_name.getPtr());
             blockOp->failed();
         }
+#else
+        FileIOQueue::get().submit(blockOp);
+#endif
 
         // Last op => done.
 
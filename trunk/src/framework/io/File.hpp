@@ -27,15 +27,32 @@
 
 #pragma once
 #include "io/Stream.hpp"
-#include "base/DLLImports.hpp"
+#if FW_WIN32
+#   include "base/DLLImports.hpp"
+#endif
 
 namespace FW
 {
 
+//------------------------------------------------------------------------
+// On Win32, async operations use overlapped I/O. Elsewhere, they go
+// through FileIOQueue, which uses io_uring when the kernel supports it
+// and a pool of pread()/pwrite() threads otherwise.
+//------------------------------------------------------------------------
+
+class FileIOQueue;
+
 //------------------------------------------------------------------------
 
 class File : public InputStream, public OutputStream
 {
+private:
+#if FW_WIN32
+    typedef HANDLE          Handle;
+#else
+    typedef int             Handle;                 // file descriptor, -1 if none
+#endif
+
 public:
     enum
     {
@@ -54,6 +71,7 @@ public:
     class AsyncOp
     {
         friend class File;
+        friend class FileIOQueue;
 
     public:
                             ~AsyncOp                (void);
@@ -64,7 +82,7 @@ public:
         int                 getNumBytes             (void) const    { FW_ASSERT(m_done); return (m_failed) ? 0 : m_userBytes; }
 
     private:
-                            AsyncOp                 (HANDLE fileHandle);
+                            AsyncOp                 (Handle fileHandle);
 
         void                done                    (void);
         void                failed                  (void)          { m_failed = true; done(); }
@@ -86,8 +104,15 @@ public:
         void*               m_copyDst;              // Pointer to copy to.
         void*               m_freePtr;              // Pointer to free afterwards.
 
-        HANDLE              m_fileHandle;
+        Handle              m_fileHandle;
+#if FW_WIN32
         OVERLAPPED          m_overlapped;
+#else
+        volatile S32        m_pending;              // Nonzero while queued or in flight.
+        S32                 m_transferred;          // Number of bytes transferred so far.
+        S32                 m_errno;                // Nonzero if the request failed.
+        AsyncOp*            m_queueNext;            // Next op in the FileIOQueue thread pool queue.
+#endif
         bool                m_done;
         bool                m_failed;
     };
@@ -114,10 +139,14 @@ public:
     AsyncOp*                readAsync               (void* ptr, int size);
     AsyncOp*                writeAsync              (const void* ptr, int size);
 
+    const U8*               mapReadOnly             (void);         // Read mode only. NULL if the mapping fails. Valid until the File is destroyed.
+    const U8*               getMappedPtr            (void) const    { return m_mapPtr; }
+
 private:
                             File                    (const File&); // forbidden
     File&                   operator=               (const File&); // forbidden
 
+    bool                    hasHandle               (void) const;
     void                    fixSize                 (void);
     void                    startOp                 (AsyncOp* op);
 
@@ -128,8 +157,12 @@ private:
     String                  m_name;
     Mode                    m_mode;
     bool                    m_disableCache;
-    HANDLE                  m_handle;
+    Handle                  m_handle;
     S32                     m_align;
+#if FW_WIN32
+    HANDLE                  m_mapping;
+#endif
+    const U8*               m_mapPtr;
 
     S64                     m_size;
     S64                     m_actualSize;
@@ -333,8 +333,9 @@ void AmbientProcessor::processSlice(OctreeSlice* slice, const Array<NodeInfo>& n
     if (!attachData)
     {
         // reconstruct slice
-        OctreeSlice src = *slice; // take a copy
-        if (nodes.getSize() != slice->getNumSplitNodes())
+        OctreeSlice src;
+        src.swap(*slice); // take over the data
+        if (nodes.getSize() != src.getNumSplitNodes())
             fail("Node count mismatch");
         slice->init(src.getNumChildEntries(), src.getNumAttach()+1, src.getNumNodes(), src.getNumSplitNodes());
         slice->setID(src.getID());
@@ -348,7 +349,7 @@ void AmbientProcessor::processSlice(OctreeSlice* slice, const Array<NodeInfo>& n
         for (int i=0; i < src.getNumAttach(); i++)
         {
             slice->startAttach(src.getAttachType(i));
-            slice->getData().add(src.getData().getPtr(src.getAttachOfs(i)), src.getAttachSize(i));
+            slice->getData().add(src.getAttachPtr(i), src.getAttachSize(i));
             slice->endAttach();
         }
         // create the new attachment
@@ -33,6 +33,8 @@
 #include "build/MeshBuilder.hpp"
 #include "AmbientProcessor.hpp"
 #include "Benchmark.hpp"
+#include "render/RayQuery.hpp"
+#include "base/Sort.hpp"
 
 #include <stdio.h>
 #include <conio.h>
@@ -72,6 +74,8 @@ static const char* const s_commandHelpText =
     "\n"
     "   interactive             View octree files interactively.\n"
     "   build                   Build octree file.\n"
+    "   build-job               Build one part of an octree file split by \"build --jobs\".\n"
+    "   merge                   Merge the parts built by \"build-job\" into the octree file.\n"
     "   inspect                 Print info about octree file.\n"
     "   ambient                 Augment octree file with ambient occlusion data.\n"
     "   optimize                Reconstruct octree file to improve performance.\n"
@@ -98,6 +102,22 @@ static const char* const s_commandHelpText =
     "   --normal-error=<value>  Max normal error. Default is \"0.01\" units.\n"
     "   --contour-error=<value> Max contour error. Default is \"15\" levels.\n"
     "   --max-threads=<num>     Maximum concurrent builder threads. Default is \"4\".\n"
+    "   --compression=<codec>   none, lz4, zlib-low, zlib-medium, or zlib-high. Default is \"none\".\n"
+    "   --split-levels=<value>  Build only the given number of levels and split the rest into jobs.\n"
+    "   --jobs=<num>            Number of jobs to split into. Default is \"1\" (no split).\n"
+    "\n"
+    "Options for \"octree build-job\":\n"
+    "\n"
+    "   --in=<file.oct>         Octree file split by \"build\". Writes <file.oct>.job<index>.\n"
+    "   --levels=<value>        Max octree levels, same as for \"build\".\n"
+    "   --jobs=<num>            Number of jobs, same as for \"build\".\n"
+    "   --job=<index>           Job to build, 0 to <num>-1.\n"
+    "   --max-threads=<num>     Maximum concurrent builder threads. Default is \"4\".\n"
+    "\n"
+    "Options for \"octree merge\":\n"
+    "\n"
+    "   --in=<file.oct>         Octree file split by \"build\". Modified in place.\n"
+    "   --jobs=<num>            Number of jobs, same as for \"build\".\n"
     "\n"
     "Options for \"octree inspect\":\n"
     "\n"
@@ -115,6 +135,8 @@ static const char* const s_commandHelpText =
     "   --out=<file.oct>        Output octree file.\n"
     "   --levels=<value>        Include only the given number of levels.\n"
     "   --include-mesh=<1/0>    Include/exclude original mesh. Default is \"1\".\n"
+    "   --bake-runtime=<1/0>    Include/exclude pre-baked runtime blocks. Default is \"1\".\n"
+    "   --compression=<codec>   none, lz4, zlib-low, zlib-medium, or zlib-high. Default is \"none\".\n"
     "\n"
     "Options for \"octree benchmark\":\n"
     "\n"
@@ -125,6 +147,7 @@ static const char* const s_commandHelpText =
     "   --warmup-launches=<v>   Launches prior to starting the measurement. Default is \"4\".\n"
     "   --measure-frames=<v>    Total number of frames to measure. Default is \"2000\".\n"
     "   --camera=\"<v>\"        Camera signature. Can specify multiple times.\n"
+    "   --cpu=<1/0>             Raycast on the CPU; no CUDA device or window needed. Default is \"0\".\n"
 ;
 
 //------------------------------------------------------------------------
@@ -177,6 +200,7 @@ App::App(void)
     m_disablePostProcessFiltering   (false),
     m_enableAntialias               (false),
     m_enableLargeAAFilter           (false),
+    m_raycastOnCpu                  (false),
     m_maxVoxelSize                  (1.0f),
     m_brightness                    (1.7f),
 
@@ -352,6 +376,10 @@ bool App::handleEvent(const Window::Event& ev)
         waitKey();
         break;
 
+    case Action_QueryViewCenter:
+        queryViewCenter();
+        break;
+
     default:
         FW_ASSERT(false);
         break;
@@ -383,6 +411,7 @@ void App::readState(StateDump& d)
     d.get(m_disablePostProcessFiltering,    "m_disablePostProcessFiltering");
     d.get(m_enableAntialias,                "m_enableAntialias");
     d.get(m_enableLargeAAFilter,            "m_enableLargeAAFilter");
+    d.get(m_raycastOnCpu,                   "m_raycastOnCpu");
     d.get(m_maxVoxelSize,                   "m_maxVoxelSize");
     d.get(m_brightness,                     "m_brightness");
 
@@ -409,6 +438,7 @@ void App::writeState(StateDump& d) const
     d.set(m_disablePostProcessFiltering,    "m_disablePostProcessFiltering");
     d.set(m_enableAntialias,                "m_enableAntialias");
     d.set(m_enableLargeAAFilter,            "m_enableLargeAAFilter");
+    d.set(m_raycastOnCpu,                   "m_raycastOnCpu");
     d.set(m_maxVoxelSize,                   "m_maxVoxelSize");
     d.set(m_brightness,                     "m_brightness");
 
@@ -485,6 +515,7 @@ void App::rebuildGui(void)
     cc.addToggle(&m_disablePostProcessFiltering,                FW_KEY_C,           "Disable post-process filtering [C]");
     cc.addToggle(&m_enableAntialias,                            FW_KEY_V,           "Enable 4x antialiasing [V]");
     cc.addToggle(&m_enableLargeAAFilter,                        FW_KEY_B,           "Enable large antialias filter [B]");
+    cc.addToggle(&m_raycastOnCpu,                               FW_KEY_N,           "Raycast on CPU instead of CUDA [N]");
     cc.beginSliderStack();
     cc.addSlider(&m_maxVoxelSize, 0.1f, 10.0f, true, FW_KEY_NONE, FW_KEY_NONE,      "Maximum voxel size = %g pixels");
     cc.addSlider(&m_brightness, 0.0f, 5.0f, false, FW_KEY_NONE, FW_KEY_NONE,        "Brightness coefficient = %g");
@@ -504,6 +535,7 @@ void App::rebuildGui(void)
     cc.addButton((S32*)&m_action, Action_NewOctreeFromMesh,     FW_KEY_M,           "New octree from mesh... [M]");
     cc.addButton((S32*)&m_action, Action_RebuildOctree,         FW_KEY_BACKSPACE,   "Rebuild octree [Backspace]");
     cc.addButton((S32*)&m_action, Action_PrintStats,            FW_KEY_P,           "Print octree stats... [P]");
+    cc.addButton((S32*)&m_action, Action_QueryViewCenter,       FW_KEY_NONE,        "Query voxel at view center");
     cc.addSlider(&m_maxOctreeLevels, 1, OctreeFile::UnitScale, false, FW_KEY_NONE, FW_KEY_NONE, "Maximum octree levels to load/build = %d levels");
 
     cc.setControlVisibility(m_showManagementControls);
@@ -584,10 +616,22 @@ void App::render(GLContext* gl)
         return;
     }
 
+    if (m_raycastOnCpu && renderMode == OctreeManager::RenderMode_Cuda)
+        renderMode = OctreeManager::RenderMode_Cpu;
+
+    CpuRenderer::Params cpuParams;
+    cpuParams.visualization                 = (CpuRenderer::Visualization)cudaParams.visualization;
+    cpuParams.enableContours                = cudaParams.enableContours;
+    cpuParams.enableAntialias               = cudaParams.enableAntialias;
+    cpuParams.enableBeamOptimization        = cudaParams.enableBeamOptimization;
+    cpuParams.maxVoxelSize                  = cudaParams.maxVoxelSize;
+    cpuParams.brightness                    = cudaParams.brightness;
+
     // Set parameters.
 
     m_manager.setRenderMode(renderMode);
     m_manager.setMaxLevels(m_maxOctreeLevels);
+    m_manager.setMaxVoxelSize(m_maxVoxelSize);
 
     CudaRenderer* cuda = m_manager.getCudaRenderer();
     if (cuda)
@@ -596,6 +640,10 @@ void App::render(GLContext* gl)
         cuda->setWindow(&m_window);
     }
 
+    CpuRenderer* cpu = m_manager.getCpuRenderer();
+    if (cpu)
+        cpu->setParams(cpuParams);
+
     // Render.
 
     Mat4f projection = gl->xformFitToView(Vec2f(-1.0f, -1.0f), Vec2f(2.0f, 2.0f)) * m_cameraCtrl.getCameraToClip();
@@ -611,6 +659,7 @@ void App::render(GLContext* gl)
     OctreeRuntime* runtime = m_manager.getRuntime();
     m_commonCtrl.message((runtime) ? runtime->getStats() : "", "OctreeRuntimeStats");
     m_commonCtrl.message((cuda) ? cuda->getStats() : "", "CudaRendererStats");
+    m_commonCtrl.message((cpu) ? cpu->getStats() : "", "CpuRendererStats");
     m_commonCtrl.message(m_manager.getStats(), "OctreeManagerStats");
 
     // Show help.
@@ -654,6 +703,81 @@ void App::renderGuiHelp(GLContext* gl)
 
 //------------------------------------------------------------------------
 
+void App::queryViewCenter(void)
+{
+    OctreeRuntime* runtime = m_manager.getRuntime();
+    if (!runtime || runtime->getMode() != MemoryManager::Mode_CPU || !m_manager.getFile()->getNumObjects())
+    {
+        m_commonCtrl.message("Voxel queries require raycasting on CPU [N]");
+        return;
+    }
+
+    // Query each loaded object with the camera ray in its octree space,
+    // and keep the hit nearest to the camera in world space.
+
+    RayQuery query;
+    int bestObject = -1;
+    F32 bestDist = FW_F32_MAX;
+    Vec3f bestPos;
+    S32 bestLevel = 0;
+    Vec4f bestColor;
+
+    for (int i = 0; i < m_manager.getFile()->getNumObjects(); i++)
+    {
+        if (!runtime->hasObject(i))
+            continue;
+
+        const OctreeFile::Object& obj = m_manager.getFile()->getObject(i);
+        Mat4f octreeToWorld = obj.objectToWorld * obj.octreeToObject;
+        Mat4f worldToOctree = octreeToWorld.inverted();
+        Vec3f orig = (worldToOctree * Vec4f(m_cameraCtrl.getPosition(), 1.0f)).getXYZ();
+        Vec3f dir = (worldToOctree * Vec4f(m_cameraCtrl.getForward(), 0.0f)).getXYZ();
+
+        RayQuery::Rays rays;
+        rays.numRays = 1;
+        rays.orig = &orig;
+        rays.dir = &dir;
+
+        F32 t;
+        Vec3f pos;
+        S32 level;
+        Vec4f color;
+        RayQuery::Hits hits;
+        hits.t = &t;
+        hits.pos = &pos;
+        hits.level = &level;
+        hits.color = &color;
+
+        String error = query.query(runtime, i, rays, hits);
+        if (error.getLength())
+        {
+            m_commonCtrl.message(error);
+            return;
+        }
+
+        if (t == FW_F32_MAX)
+            continue;
+
+        F32 dist = (octreeToWorld * Vec4f(dir * t, 0.0f)).getXYZ().length();
+        if (dist < bestDist)
+        {
+            bestObject = i;
+            bestDist = dist;
+            bestPos = pos;
+            bestLevel = level;
+            bestColor = color;
+        }
+    }
+
+    if (bestObject == -1)
+        m_commonCtrl.message("No voxel at view center");
+    else
+        m_commonCtrl.message(sprintf("Voxel at view center: object %d, level %d, octree pos (%.4f, %.4f, %.4f), color (%.2f, %.2f, %.2f), distance %g",
+            bestObject, bestLevel, bestPos.x, bestPos.y, bestPos.z, bestColor.x, bestColor.y, bestColor.z, bestDist));
+}
+
+//------------------------------------------------------------------------
+
 BuilderBase::Params App::getBuilderParams(void)
 {
     BuilderBase::Params params;
@@ -716,9 +840,9 @@ void App::firstTimeInit(void)
 
     if (needToBuild)
     {
-        runBuild(s_defaultMeshFile, s_tempOctreeFile, 11, true, 16.0f, 0.01f, 15.0f, 4);
+        runBuild(s_defaultMeshFile, s_tempOctreeFile, 11, true, 16.0f, 0.01f, 15.0f, 4, ClusteredFile::Compression_None, 0, 1);
         runAmbient(s_tempOctreeFile, 0.15f, false);
-        runOptimize(s_tempOctreeFile, s_defaultOctreeFile, 0, true);
+        runOptimize(s_tempOctreeFile, s_defaultOctreeFile, 0, true, true, ClusteredFile::Compression_None);
     }
 
     // Setup default state.
@@ -779,7 +903,108 @@ void FW::runInteractive(const Vec2i& frameSize, const String& stateFile, const S
 
 //------------------------------------------------------------------------
 
-void FW::runBuild(const String& inFile, const String& outFile, int numLevels, bool buildContours, F32 colorError, F32 normalError, F32 contourError, int maxThreads)
+static String getJobFileName(const String& file, int jobIdx)
+{
+    return FW::sprintf("%s.job%d", file.getPtr(), jobIdx);
+}
+
+//------------------------------------------------------------------------
+// Finds the slices on the level where "octree build --split-levels"
+// stopped and assigns them to jobs so that each job gets roughly the
+// same number of bytes of build data. roots receives (sliceID, jobIdx)
+// pairs and depth the slice level. Slices on that level that have
+// already been merged are still returned, but their build data is gone,
+// so jobIdx is -1 for every root unless all of them are unbuilt.
+
+static void collectBuildJobs(Array<Vec2i>& roots, int& depth, OctreeFile& file, int numJobs)
+{
+    roots.clear();
+    depth = -1;
+    if (hasError())
+        return;
+
+    if (!file.getNumObjects() || file.getSliceState(file.getObject(0).rootSlice) == OctreeFile::SliceState_Unused)
+    {
+        setError("No octree found in '%s'!", file.getName().getPtr());
+        return;
+    }
+
+    // Walk the built part of the octree level by level, and stop at the
+    // first level that has unbuilt slices. Merged subtrees below it are
+    // not entered.
+
+    Array<S32> level(file.getObject(0).rootSlice);
+    int numUnbuilt = 0;
+
+    for (int levelIdx = 0; level.getSize() && !hasError(); levelIdx++)
+    {
+        for (int i = 0; i < level.getSize(); i++)
+            if (file.getSliceState(level[i]) == OctreeFile::SliceState_Unbuilt)
+                numUnbuilt++;
+
+        if (numUnbuilt)
+        {
+            depth = levelIdx;
+            break;
+        }
+
+        Array<S32> next;
+        for (int i = 0; i < level.getSize() && !hasError(); i++)
+        {
+            OctreeSlice slice;
+            file.readSlice(level[i], slice);
+            for (int j = 0; j < slice.getNumChildEntries(); j++)
+                if (slice.getChildEntry(j) >= 0)
+                    next.add(slice.getChildEntry(j));
+        }
+        level = next;
+    }
+
+    if (!hasError() && !numUnbuilt)
+        setError("No unbuilt slices in '%s'!", file.getName().getPtr());
+    if (hasError())
+    {
+        depth = -1;
+        return;
+    }
+
+    // Partially merged => no assignment.
+
+    if (numUnbuilt != level.getSize())
+    {
+        for (int i = 0; i < level.getSize(); i++)
+            roots.add(Vec2i(level[i], -1));
+        return;
+    }
+
+    Array<Vec2i> items; // (size, sliceID)
+    for (int i = 0; i < level.getSize(); i++)
+        items.add(Vec2i(file.getSliceSize(level[i]), level[i]));
+
+    // Largest first, each to the job with the least data so far.
+
+    FW_SORT_ARRAY(items, Vec2i, a.x > b.x || (a.x == b.x && a.y < b.y));
+
+    Array<S64> load;
+    load.reset(numJobs);
+    for (int i = 0; i < numJobs; i++)
+        load[i] = 0;
+
+    for (int i = 0; i < items.getSize(); i++)
+    {
+        int jobIdx = 0;
+        for (int j = 1; j < numJobs; j++)
+            if (load[j] < load[jobIdx])
+                jobIdx = j;
+
+        load[jobIdx] += items[i].x;
+        roots.add(Vec2i(items[i].y, jobIdx));
+    }
+}
+
+//------------------------------------------------------------------------
+
+void FW::runBuild(const String& inFile, const String& outFile, int numLevels, bool buildContours, F32 colorError, F32 normalError, F32 contourError, int maxThreads, ClusteredFile::Compression compression, int splitLevels, int numJobs)
 {
     if (hasError())
         return;
@@ -810,6 +1035,7 @@ void FW::runBuild(const String& inFile, const String& outFile, int numLevels, bo
 
     printf("Building octree to '%s'...\n", outFile.getPtr());
     OctreeFile file(outFile, File::Create);
+    file.setCompression(compression);
     int objectID = file.addObject();
 
     if (!hasError())
@@ -828,9 +1054,154 @@ void FW::runBuild(const String& inFile, const String& outFile, int numLevels, bo
     params.setContourDeviationForLevels(contourError);
     params.shaper = (buildContours) ? BuilderBase::Shaper_Hull : BuilderBase::Shaper_None;
 
+    bool split = (numJobs > 1 && splitLevels > 0 && splitLevels < numLevels);
+    {
+        MeshBuilder builder(&file);
+        builder.setMaxConcurrency(maxThreads);
+        builder.buildObject(objectID, (split) ? splitLevels : numLevels, params);
+    }
+
+    // Split => print the remaining steps.
+
+    if (split && !hasError())
+    {
+        printf("Built %d of %d levels. Run the following jobs, in any order and on any machine:\n", splitLevels, numLevels);
+        for (int i = 0; i < numJobs; i++)
+            printf("    octree build-job --in=%s --levels=%d --jobs=%d --job=%d\n", outFile.getPtr(), numLevels, numJobs, i);
+        printf("Then merge the results:\n");
+        printf("    octree merge --in=%s --jobs=%d\n", outFile.getPtr(), numJobs);
+    }
+}
+
+//------------------------------------------------------------------------
+
+void FW::runBuildJob(const String& inFile, int numLevels, int numJobs, int jobIdx, int maxThreads)
+{
+    if (hasError())
+        return;
+
+    // Find the subtrees of this job.
+
+    OctreeFile base(inFile, File::Read);
+    Array<Vec2i> assignment;
+    int depth;
+    collectBuildJobs(assignment, depth, base, numJobs);
+
+    Array<S32> roots;
+    for (int i = 0; i < assignment.getSize(); i++)
+        if (assignment[i].y == jobIdx)
+            roots.add(assignment[i].x);
+
+    if (!hasError() && assignment.getSize() && assignment[0].y == -1)
+        setError("'%s' has already been partially merged!", inFile.getPtr());
+    if (hasError())
+        return;
+
+    // Create job file. Slice IDs are interleaved between the jobs so
+    // that merging does not need to remap them.
+
+    String jobFile = getJobFileName(inFile, jobIdx);
+    printf("Building %d subtrees to '%s'...\n", roots.getSize(), jobFile.getPtr());
+
+    OctreeFile file(jobFile, File::Create);
+    file.setCompression(base.getCompression());
+    file.setSliceIDStride(base.getNumSliceIDs() + jobIdx, numJobs);
+
+    OctreeFile::Object obj = base.getObject(0);
+    obj.rootSlice = -1;
+    int objectID = file.addObject();
+    file.setObject(objectID, obj);
+    if (!hasError())
+        file.setMesh(objectID, base.getMeshCopy(0));
+
+    for (int i = 0; i < roots.getSize() && !hasError(); i++)
+    {
+        OctreeSlice slice;
+        base.readSlice(roots[i], slice);
+        file.writeSlice(slice);
+    }
+
+    if (hasError())
+        return;
+
+    // Build.
+
     MeshBuilder builder(&file);
     builder.setMaxConcurrency(maxThreads);
-    builder.buildObject(objectID, numLevels, params);
+    builder.buildSlices(roots, numLevels - depth);
+}
+
+//------------------------------------------------------------------------
+
+void FW::runMerge(const String& inFile, int numJobs)
+{
+    if (hasError())
+        return;
+
+    OctreeFile file(inFile, File::Modify);
+    Array<OctreeFile*> parts;
+    for (int i = 0; i < numJobs && !hasError(); i++)
+        parts.add(new OctreeFile(getJobFileName(inFile, i), File::Read));
+
+    // Every part built something and all of its slices are already in
+    // the file => merged before. The unbuilt leaves of the merged
+    // subtrees would otherwise be taken for the roots of unfinished jobs.
+
+    bool merged = !hasError();
+    for (int i = 0; i < parts.getSize() && merged; i++)
+    {
+        bool hasSlices = false;
+        bool hasBuilt = false;
+        for (int j = 0; j < parts[i]->getNumSliceIDs() && merged; j++)
+        {
+            OctreeFile::SliceState state = parts[i]->getSliceState(j);
+            if (state == OctreeFile::SliceState_Unused)
+                continue;
+
+            hasSlices = true;
+            hasBuilt = (hasBuilt || state == OctreeFile::SliceState_Complete);
+            merged = (file.getSliceState(j) == state);
+        }
+        merged = (merged && (hasBuilt || !hasSlices));
+    }
+
+    if (merged)
+        printf("'%s' has already been merged.\n", inFile.getPtr());
+
+    // Check the roots of every part before merging any, so that a
+    // missing or unfinished job leaves the file untouched. Each job file
+    // contains its roots from the start, which tells the owner even if
+    // the assignment cannot be recomputed after an interrupted merge.
+
+    Array<Vec2i> assignment;
+    int depth;
+    if (!merged)
+        collectBuildJobs(assignment, depth, file, numJobs);
+
+    for (int i = 0; i < assignment.getSize() && !hasError(); i++)
+    {
+        int sliceID = assignment[i].x;
+        int owner = -1;
+        for (int j = 0; j < parts.getSize() && owner == -1; j++)
+            if (parts[j]->getSliceState(sliceID) != OctreeFile::SliceState_Unused)
+                owner = j;
+
+        if (owner == -1)
+            setError("No job has built slice %d of '%s'!", sliceID, inFile.getPtr());
+        else if (parts[owner]->getSliceState(sliceID) != OctreeFile::SliceState_Complete)
+            setError("Job %d has not finished building '%s'!", owner, parts[owner]->getName().getPtr());
+    }
+
+    // Merge.
+
+    for (int i = 0; i < parts.getSize() && !hasError() && !merged; i++)
+    {
+        printf("Merging '%s'...\n", parts[i]->getName().getPtr());
+        file.mergeSlices(*parts[i]);
+    }
+
+    for (int i = 0; i < parts.getSize(); i++)
+        delete parts[i];
 }
 
 //------------------------------------------------------------------------
@@ -872,7 +1243,7 @@ void FW::runAmbient(const String& inFile, F32 aoRadius, bool flipNormals)
 
 //------------------------------------------------------------------------
 
-void FW::runOptimize(const String& inFile, const String& outFile, int numLevels, bool includeMesh)
+void FW::runOptimize(const String& inFile, const String& outFile, int numLevels, bool includeMesh, bool bakeRuntime, ClusteredFile::Compression compression)
 {
     if (hasError())
         return;
@@ -887,6 +1258,7 @@ void FW::runOptimize(const String& inFile, const String& outFile, int numLevels,
     OctreeFile dst(outFile, File::Create);
     if (hasError())
         return;
+    dst.setCompression(compression);
 
     // Print original size.
 
@@ -898,6 +1270,35 @@ void FW::runOptimize(const String& inFile, const String& outFile, int numLevels,
     if (hasError())
         return;
 
+    // Bake runtime blocks for the attachments that the renderers select.
+
+    if (bakeRuntime && dst.getNumObjects())
+    {
+        OctreeRuntime runtime(MemoryManager::Mode_CPU);
+        CpuRenderer renderer;
+
+        for (int i = 0; i < dst.getNumObjects() && !hasError(); i++)
+        {
+            printf("Baking runtime blocks... %d/%d\r", i + 1, dst.getNumObjects());
+            Array<AttachIO::AttachType> attach;
+            renderer.selectAttachments(attach, dst.getObject(i).runtimeAttachTypes);
+            runtime.bakeRuntimeBlocks(dst, i, attach);
+        }
+
+        if (!hasError())
+            printf("Baking runtime blocks... Done.%-8s", "");
+        printf("\n");
+        if (hasError())
+            return;
+    }
+
+    // Place slices that are loaded together next to each other.
+
+    printf("Reordering chunks...\n");
+    dst.relayout();
+    if (hasError())
+        return;
+
     printf("Flushing...\n");
     dst.flush();
     if (hasError())
@@ -910,14 +1311,14 @@ void FW::runOptimize(const String& inFile, const String& outFile, int numLevels,
 
 //------------------------------------------------------------------------
 
-void FW::runBenchmark(const String& inFile, int numLevels, const Vec2i& frameSize, int framesPerLaunch, int warmupLaunches, int measureFrames, const Array<String>& cameras)
+void FW::runBenchmark(const String& inFile, int numLevels, const Vec2i& frameSize, int framesPerLaunch, int warmupLaunches, int measureFrames, const Array<String>& cameras, bool cpu)
 {
     if (hasError())
         return;
 
     // Set parameters.
 
-    Benchmark bench;
+    Benchmark bench((cpu) ? BenchmarkContext::RendererType_Cpu : BenchmarkContext::RendererType_Cuda);
     bench.setFrameSize(frameSize);
     bench.setFramesPerLaunch(framesPerLaunch);
     bench.setWarmupLaunches(warmupLaunches);
@@ -925,6 +1326,22 @@ void FW::runBenchmark(const String& inFile, int numLevels, const Vec2i& frameSiz
     bench.loadOctree(inFile, (numLevels) ? numLevels : OctreeFile::UnitScale);
     bench.setCameras(cameras);
 
+    // Benchmark on the CPU.
+
+    if (cpu)
+    {
+        CpuRenderer::Params params;
+        params.enableRayPackets = false;
+        params.enableBeamOptimization = false;
+        bench.measure("Single ray", params);
+        params.enableRayPackets = true;
+        bench.measure("Packets", params);
+        params.enableBeamOptimization = true;
+        bench.measure("Beam opt.", params);
+        bench.printResults("CPU raycast performance", "");
+        return;
+    }
+
     // Benchmark.
 
     CudaRenderer::Params params;
@@ -946,6 +1363,8 @@ void FW::init(void)
 
     bool modeInteractive = false;
     bool modeBuild       = false;
+    bool modeBuildJob    = false;
+    bool modeMerge       = false;
     bool modeInspect     = false;
     bool modeAmbient     = false;
     bool modeOptimize    = false;
@@ -962,6 +1381,8 @@ void FW::init(void)
         String mode = argv[1];
         if (mode == "interactive")      modeInteractive = true;
         else if (mode == "build")       modeBuild = true;
+        else if (mode == "build-job")   modeBuildJob = true;
+        else if (mode == "merge")       modeMerge = true;
         else if (mode == "inspect")     modeInspect = true;
         else if (mode == "ambient")     modeAmbient = true;
         else if (mode == "optimize")    modeOptimize = true;
@@ -985,9 +1406,15 @@ void FW::init(void)
     F32     aoRadius        = 0.05f;
     bool    flipNormals     = false;
     bool    includeMesh     = true;
+    bool    bakeRuntime     = true;
+    ClusteredFile::Compression compression = ClusteredFile::Compression_None;
+    S32     splitLevels     = 0;
+    S32     numJobs         = 1;
+    S32     jobIdx          = -1;
     S32     framesPerLaunch = 10;
     S32     warmupLaunches  = 4;
     S32     measureFrames   = 2000;
+    bool    benchmarkCpu    = false;
     Array<String> cameras;
 
     for (int i = 2; i < argc; i++)
@@ -1015,13 +1442,13 @@ void FW::init(void)
                 setError("Invalid state file '%s'!", argv[i]);
             stateFile = ptr;
         }
-        else if ((modeInteractive || modeBuild || modeInspect || modeAmbient || modeOptimize || modeBenchmark) && parseLiteral(ptr, "--in="))
+        else if ((modeInteractive || modeBuild || modeBuildJob || modeMerge || modeInspect || modeAmbient || modeOptimize || modeBenchmark) && parseLiteral(ptr, "--in="))
         {
             if (!*ptr)
                 setError("Invalid input file '%s'!", argv[i]);
             inFile = ptr;
         }
-        else if ((modeInteractive || modeBuild) && parseLiteral(ptr, "--max-threads="))
+        else if ((modeInteractive || modeBuild || modeBuildJob) && parseLiteral(ptr, "--max-threads="))
         {
             if (!parseInt(ptr, maxThreads) || *ptr || maxThreads < 1)
                 setError("Invalid number of builder threads '%s'!", argv[i]);
@@ -1032,7 +1459,7 @@ void FW::init(void)
                 setError("Invalid input file '%s'!", argv[i]);
             outFile = ptr;
         }
-        else if ((modeBuild || modeOptimize || modeBenchmark) && parseLiteral(ptr, "--levels="))
+        else if ((modeBuild || modeBuildJob || modeOptimize || modeBenchmark) && parseLiteral(ptr, "--levels="))
         {
             if (!parseInt(ptr, numLevels) || *ptr || numLevels < 1 || numLevels > OctreeFile::UnitScale)
                 setError("Invalid number of levels '%s'!", argv[i]);
@@ -1078,6 +1505,41 @@ void FW::init(void)
                 setError("Invalid contour include/exclude '%s'!", argv[i]);
             includeMesh = (value != 0);
         }
+        else if (modeOptimize && parseLiteral(ptr, "--bake-runtime="))
+        {
+            int value = 0;
+            if (!parseInt(ptr, value) || *ptr || value < 0 || value > 1)
+                setError("Invalid runtime block include/exclude '%s'!", argv[i]);
+            bakeRuntime = (value != 0);
+        }
+        else if ((modeBuild || modeOptimize) && parseLiteral(ptr, "--compression="))
+        {
+            int value = 0;
+            while (value < ClusteredFile::Compression_Max && String(ptr) != ClusteredFile::getCompressionName((ClusteredFile::Compression)value))
+                value++;
+
+            if (value == ClusteredFile::Compression_Max)
+                setError("Invalid compression '%s'!", argv[i]);
+            else if (!ClusteredFile::isCompressionSupported((ClusteredFile::Compression)value))
+                setError("Compression '%s' is not supported by this build!", argv[i]);
+            else
+                compression = (ClusteredFile::Compression)value;
+        }
+        else if (modeBuild && parseLiteral(ptr, "--split-levels="))
+        {
+            if (!parseInt(ptr, splitLevels) || *ptr || splitLevels < 1 || splitLevels > OctreeFile::UnitScale)
+                setError("Invalid number of split levels '%s'!", argv[i]);
+        }
+        else if ((modeBuild || modeBuildJob || modeMerge) && parseLiteral(ptr, "--jobs="))
+        {
+            if (!parseInt(ptr, numJobs) || *ptr || numJobs < 1)
+                setError("Invalid number of jobs '%s'!", argv[i]);
+        }
+        else if (modeBuildJob && parseLiteral(ptr, "--job="))
+        {
+            if (!parseInt(ptr, jobIdx) || *ptr || jobIdx < 0)
+                setError("Invalid job index '%s'!", argv[i]);
+        }
         else if (modeBenchmark && parseLiteral(ptr, "--frames-per-launch="))
         {
             if (!parseInt(ptr, framesPerLaunch) || *ptr || framesPerLaunch < 1)
@@ -1099,6 +1561,13 @@ void FW::init(void)
                 setError("Invalid camera signature '%s'!", argv[i]);
             cameras.add(ptr);
         }
+        else if (modeBenchmark && parseLiteral(ptr, "--cpu="))
+        {
+            int value = 0;
+            if (!parseInt(ptr, value) || *ptr || value < 0 || value > 1)
+                setError("Invalid CPU enable/disable '%s'!", argv[i]);
+            benchmarkCpu = (value != 0);
+        }
         else
         {
             setError("Invalid option '%s'!", argv[i]);
@@ -1122,12 +1591,22 @@ void FW::init(void)
 
     // Validate options.
 
-    if ((modeBuild || modeInspect || modeAmbient || modeOptimize || modeBenchmark) && !inFile.getLength())
+    if ((modeBuild || modeBuildJob || modeMerge || modeInspect || modeAmbient || modeOptimize || modeBenchmark) && !inFile.getLength())
         setError("Input file (--in) not specified!");
     if ((modeBuild || modeOptimize) && !outFile.getLength())
         setError("Output file (--out) not specified!");
-    if (modeBuild && !numLevels)
+    if ((modeBuild || modeBuildJob) && !numLevels)
         setError("Number of levels (--levels) not specified!");
+    if (modeBuild && splitLevels && numJobs < 2)
+        setError("Number of jobs (--jobs) not specified for --split-levels!");
+    if (modeBuild && !splitLevels && numJobs > 1)
+        setError("Split levels (--split-levels) not specified for --jobs!");
+    if (modeBuild && splitLevels >= numLevels && numJobs > 1)
+        setError("Split levels (--split-levels) must be less than --levels!");
+    if ((modeBuildJob || modeMerge) && numJobs < 2)
+        setError("Number of jobs (--jobs) not specified!");
+    if (modeBuildJob && (jobIdx < 0 || jobIdx >= numJobs))
+        setError("Job index (--job) not specified or out of range!");
     if (modeBenchmark && !cameras.getSize())
         setError("No camera signatures specified!");
 
@@ -1137,7 +1616,13 @@ void FW::init(void)
         runInteractive(frameSize, stateFile, inFile, maxThreads);
 
     if (modeBuild)
-        runBuild(inFile, outFile, numLevels, buildContours, colorError, normalError, contourError, maxThreads);
+        runBuild(inFile, outFile, numLevels, buildContours, colorError, normalError, contourError, maxThreads, compression, splitLevels, numJobs);
+
+    if (modeBuildJob)
+        runBuildJob(inFile, numLevels, numJobs, jobIdx, maxThreads);
+
+    if (modeMerge)
+        runMerge(inFile, numJobs);
 
     if (modeInspect)
         runInspect(inFile);
@@ -1146,10 +1631,10 @@ void FW::init(void)
         runAmbient(inFile, aoRadius, flipNormals);
 
     if (modeOptimize)
-        runOptimize(inFile, outFile, numLevels, includeMesh);
+        runOptimize(inFile, outFile, numLevels, includeMesh, bakeRuntime, compression);
 
     if (modeBenchmark)
-        runBenchmark(inFile, numLevels, frameSize, framesPerLaunch, warmupLaunches, measureFrames, cameras);
+        runBenchmark(inFile, numLevels, frameSize, framesPerLaunch, warmupLaunches, measureFrames, cameras, benchmarkCpu);
 
     // Handle errors.
 
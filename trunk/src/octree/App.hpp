@@ -55,6 +55,7 @@ private:
         Action_NewOctreeFromMesh,
         Action_RebuildOctree,
         Action_PrintStats,
+        Action_QueryViewCenter,
     };
 
     enum View
@@ -89,6 +90,7 @@ private:
     void                        render              (GLContext* gl);
     void                        renderGuiHelp       (GLContext* gl);
     BuilderBase::Params         getBuilderParams    (void);
+    void                        queryViewCenter     (void);
 
     void                        firstTimeInit       (void);
 
@@ -111,6 +113,7 @@ private:
     bool                        m_disablePostProcessFiltering;
     bool                        m_enableAntialias;
     bool                        m_enableLargeAAFilter;
+    bool                        m_raycastOnCpu;
     F32                         m_maxVoxelSize;
     F32                         m_brightness;
 
@@ -132,11 +135,13 @@ private:
 //------------------------------------------------------------------------
 
 void    runInteractive  (const Vec2i& frameSize, const String& stateFile, const String& inFile, int maxThreads);
-void    runBuild        (const String& inFile, const String& outFile, int numLevels, bool buildContours, F32 colorError, F32 normalError, F32 contourError, int maxThreads);
+void    runBuild        (const String& inFile, const String& outFile, int numLevels, bool buildContours, F32 colorError, F32 normalError, F32 contourError, int maxThreads, ClusteredFile::Compression compression, int splitLevels, int numJobs);
+void    runBuildJob     (const String& inFile, int numLevels, int numJobs, int jobIdx, int maxThreads);
+void    runMerge        (const String& inFile, int numJobs);
 void    runInspect      (const String& inFile);
 void    runAmbient      (const String& inFile, F32 aoRadius, bool flipNormals);
-void    runOptimize     (const String& inFile, const String& outFile, int numLevels, bool includeMesh);
-void    runBenchmark    (const String& inFile, int numLevels, const Vec2i& frameSize, int framesPerLaunch, int warmupLaunches, int measureFrames, const Array<String>& cameras);
+void    runOptimize     (const String& inFile, const String& outFile, int numLevels, bool includeMesh, bool bakeRuntime, ClusteredFile::Compression compression);
+void    runBenchmark    (const String& inFile, int numLevels, const Vec2i& frameSize, int framesPerLaunch, int warmupLaunches, int measureFrames, const Array<String>& cameras, bool cpu);
 
 //------------------------------------------------------------------------
 }
@@ -33,8 +33,9 @@ using namespace FW;
 
 //------------------------------------------------------------------------
 
-Benchmark::Benchmark(void)
-:   m_frameSize         (1024, 768),
+Benchmark::Benchmark(BenchmarkContext::RendererType rendererType)
+:   m_ctx               (rendererType),
+    m_frameSize         (1024, 768),
     m_framesPerLaunch   (10),
     m_warmupLaunches    (4),
     m_measureFrames     (2000)
@@ -62,6 +63,7 @@ void Benchmark::measure(const String& columnTitle, const CudaRenderer::Params& r
     m_ctx.setWindowTitle(fullTitle);
     Image frame(m_frameSize);
     CudaRenderer* renderer = m_ctx.getRenderer();
+    FW_ASSERT(renderer);
 
     // Initialize measurements.
 
@@ -171,6 +173,93 @@ void Benchmark::measure(const String& columnTitle, const CudaRenderer::Params& r
 
 //------------------------------------------------------------------------
 
+void Benchmark::measure(const String& columnTitle, const CpuRenderer::Params& renderParams)
+{
+    int frameDenom = m_cameras.getSize() * m_framesPerLaunch;
+    int framesPerCamera = (m_measureFrames + frameDenom - 1) / frameDenom;
+    int repeatsPerCamera = framesPerCamera * m_framesPerLaunch;
+
+    // Initialize system.
+
+    printf("Measuring CPU raycast perf: %s\n", columnTitle.getPtr());
+    Image frame(m_frameSize);
+    CpuRenderer* renderer = m_ctx.getCpuRenderer();
+    FW_ASSERT(renderer);
+
+    // Initialize measurements.
+
+    F32 launchTime  = 0.0f;
+    F32 coarseTime  = 0.0f;
+    F32 totalTime   = 0.0f;
+
+    Array<F32> counters;
+    for (int i = 0; i < PerfCounter_Max; i++)
+        counters.add(0.0f);
+
+    // Measure at each camera position.
+
+    for (int cameraIdx = 0; cameraIdx < m_cameras.getSize(); cameraIdx++)
+    {
+        // Warm up performance.
+
+        CpuRenderer::Params params = renderParams;
+        params.numFrameRepeats = m_framesPerLaunch;
+        renderer->setParams(params);
+        m_ctx.setCamera(m_cameras[cameraIdx]);
+        for (int i = 0; i < m_warmupLaunches; i++)
+            m_ctx.renderOctree(frame);
+
+        // Measure performance.
+
+        Timer timer;
+        timer.start();
+        renderer->clearResults();
+        for (int i = 0; i < framesPerCamera; i++)
+            m_ctx.renderOctree(frame);
+
+        launchTime  += renderer->getResults().launchTime;
+        coarseTime  += renderer->getResults().coarseTime;
+        totalTime   += timer.getElapsed();
+
+        // Measure counters.
+
+        params.enablePerfCounters = true;
+        params.numFrameRepeats = 1;
+        renderer->setParams(params);
+        renderer->clearResults();
+        m_ctx.renderOctree(frame);
+
+        for (int i = 0; i < PerfCounter_Max; i++)
+            counters[i] += (F32)renderer->getResults().perfCounters[i] * (F32)repeatsPerCamera;
+    }
+
+    // Output results. There is no simulated throughput or SIMD
+    // efficiency on the CPU; those are reported as zero.
+
+    F32 raysPerFrame = (F32)m_frameSize.x * (F32)m_frameSize.y * (F32)m_framesPerLaunch;
+    F32 framesTotal  = (F32)m_cameras.getSize() * (F32)framesPerCamera;
+    F32 raysTotal    = framesTotal * raysPerFrame;
+    F32 mraysTotal   = raysTotal * 1.0e-6f;
+
+    Result& res = m_results.add();
+    res.title = columnTitle;
+    res.mraysPerSecActual = mraysTotal / launchTime;
+    res.mraysPerSecWallclock = mraysTotal / totalTime;
+    res.mraysPerSecSimulated = 0.0f;
+    res.gigsPerSec = (counters[PerfCounter_GlobalBytes] + counters[PerfCounter_LocalBytes]) / launchTime * exp2(-30);
+    res.renderWarps = 0.0f;
+    res.coarseWarps = 0.0f;
+    res.coarsePassPct = coarseTime / launchTime * 100.0f;
+
+    for (int i = 0; i < PerfCounter_Max; i++)
+    {
+        res.threadCountersPerRay[i] = counters[i] / raysTotal;
+        res.warpCountersPerRay[i] = 0.0f;
+    }
+}
+
+//------------------------------------------------------------------------
+
 void Benchmark::printResults(const String& majorTitle, const String& minorTitle)
 {
     static const char* const s_perfCounterNames[] =
@@ -201,12 +290,18 @@ void Benchmark::printResults(const String& majorTitle, const String& minorTitle)
 
     printf("%-24s", "Simulated MRays/sec");
     for (int i = 0; i < m_results.getSize(); i++)
-        printf("| %-8.2f%-6s", m_results[i].mraysPerSecSimulated, "-");
+        if (m_results[i].mraysPerSecSimulated <= 0.0f)
+            printf("| %-8s%-6s", "-", "-");
+        else
+            printf("| %-8.2f%-6s", m_results[i].mraysPerSecSimulated, "-");
     printf("\n");
 
     printf("%-24s", "Measured % of simulated");
     for (int i = 0; i < m_results.getSize(); i++)
-        printf("| %-8.1f%-6s", m_results[i].mraysPerSecActual / m_results[i].mraysPerSecSimulated * 100.0f, "-");
+        if (m_results[i].mraysPerSecSimulated <= 0.0f)
+            printf("| %-8s%-6s", "-", "-");
+        else
+            printf("| %-8.1f%-6s", m_results[i].mraysPerSecActual / m_results[i].mraysPerSecSimulated * 100.0f, "-");
     printf("\n");
 
     printf("%-24s", "Bandwidth GB/sec");
@@ -50,7 +50,7 @@ public:
     };
 
 public:
-                        Benchmark               (void);
+                        Benchmark               (BenchmarkContext::RendererType rendererType = BenchmarkContext::RendererType_Cuda);
                         ~Benchmark              (void);
 
     void                setFrameSize            (const Vec2i& value)            { m_frameSize = value; }
@@ -63,6 +63,7 @@ public:
 
     void                clearResults            (void)                          { m_results.clear(); }
     void                measure                 (const String& columnTitle, const CudaRenderer::Params& renderParams);
+    void                measure                 (const String& columnTitle, const CpuRenderer::Params& renderParams);
     void                printResults            (const String& majorTitle, const String& minorTitle);
 
 private:
@@ -32,16 +32,28 @@ using namespace FW;
 
 //------------------------------------------------------------------------
 
-BenchmarkContext::BenchmarkContext(void)
-:   m_file          (NULL),
+BenchmarkContext::BenchmarkContext(RendererType rendererType)
+:   m_rendererType  (rendererType),
+    m_file          (NULL),
     m_runtime       (NULL),
     m_renderer      (NULL),
+    m_cpuRenderer   (NULL),
 
     m_numLevels     (0),
 
     m_window        (NULL),
     m_image         (NULL)
 {
+    // CPU => no window.
+
+    if (m_rendererType == RendererType_Cpu)
+    {
+        m_runtime = new OctreeRuntime(MemoryManager::Mode_CPU);
+        m_cpuRenderer = new CpuRenderer;
+        failIfError();
+        return;
+    }
+
     m_runtime = new OctreeRuntime(MemoryManager::Mode_Cuda);
     m_renderer = new CudaRenderer;
     failIfError();
@@ -60,6 +72,7 @@ BenchmarkContext::~BenchmarkContext(void)
     delete m_file;
     delete m_runtime;
     delete m_renderer;
+    delete m_cpuRenderer;
     delete m_window;
     delete m_image;
 }
@@ -104,7 +117,10 @@ void BenchmarkContext::clearRuntime(void)
             continue;
 
         Array<AttachIO::AttachType> attach;
-        m_renderer->selectAttachments(attach, obj.runtimeAttachTypes);
+        if (m_cpuRenderer)
+            m_cpuRenderer->selectAttachments(attach, obj.runtimeAttachTypes);
+        else
+            m_renderer->selectAttachments(attach, obj.runtimeAttachTypes);
         m_runtime->addObject(i, obj.rootSlice, attach);
     }
 }
@@ -213,8 +229,13 @@ Mat4f BenchmarkContext::getProjection(const Vec2i& frameSize) const
 
 void BenchmarkContext::renderOctree(Image& image, int objectID) const
 {
-    String error = m_renderer->renderObject(image, m_runtime, objectID,
-        getOctreeToWorld(), getWorldToCamera(), getProjection(image.getSize()));
+    String error;
+    if (m_cpuRenderer)
+        error = m_cpuRenderer->renderObject(image, m_runtime, objectID,
+            getOctreeToWorld(), getWorldToCamera(), getProjection(image.getSize()));
+    else
+        error = m_renderer->renderObject(image, m_runtime, objectID,
+            getOctreeToWorld(), getWorldToCamera(), getProjection(image.getSize()));
 
     if (error.getLength())
         fail("%s", error.getPtr());
@@ -224,6 +245,9 @@ void BenchmarkContext::renderOctree(Image& image, int objectID) const
 
 void BenchmarkContext::showImage(Image& image)
 {
+    if (!m_window)
+        return;
+
     if (m_image)
         delete m_image;
     m_image = new Image(image.getSize(), ImageFormat::R8_G8_B8_A8);
@@ -241,6 +265,9 @@ void BenchmarkContext::showImage(Image& image)
 
 void BenchmarkContext::showOctree(const Vec2i& frameSize, int objectID)
 {
+    if (!m_window)
+        return;
+
     Image image(frameSize, ImageFormat::ABGR_8888);
     renderOctree(image, objectID);
     showImage(image);
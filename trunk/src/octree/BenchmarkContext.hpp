@@ -29,6 +29,7 @@
 #include "io/OctreeFile.hpp"
 #include "io/OctreeRuntime.hpp"
 #include "render/CudaRenderer.hpp"
+#include "render/CpuRenderer.hpp"
 #include "build/BuilderBase.hpp"
 #include "base/Timer.hpp"
 #include "gui/Window.hpp"
@@ -47,13 +48,21 @@ public:
         MaxPrefetchBytesTotal   = OctreeFile::MaxPrefetchBytesTotal
     };
 
+    enum RendererType
+    {
+        RendererType_Cuda = 0,
+        RendererType_Cpu,       // headless, no CUDA device or window required
+    };
+
 public:
-                        BenchmarkContext    (void);
+                        BenchmarkContext    (RendererType rendererType = RendererType_Cuda);
     virtual             ~BenchmarkContext   (void);
 
+    RendererType        getRendererType     (void) const                { return m_rendererType; }
     OctreeFile*         getFile             (void) const                { return m_file; }
     OctreeRuntime*      getRuntime          (void) const                { return m_runtime; }
     CudaRenderer*       getRenderer         (void) const                { return m_renderer; }
+    CpuRenderer*        getCpuRenderer      (void) const                { return m_cpuRenderer; }
 
     void                setFile             (const String& fileName);
     void                clearRuntime        (void);
@@ -65,7 +74,7 @@ public:
     Mat4f               getProjection       (const Vec2i& frameSize) const;
     void                renderOctree        (Image& image, int objectID = 0) const;
 
-    void                setWindowTitle      (const String& title)       { m_window->setTitle(title); }
+    void                setWindowTitle      (const String& title)       { if (m_window) m_window->setTitle(title); }
     void                showImage           (Image& image);
     void                showOctree          (const Vec2i& frameSize, int objectID = 0);
     void                hideWindow          (void);
@@ -79,9 +88,11 @@ private:
     BenchmarkContext&   operator=           (const BenchmarkContext&); // forbidden
 
 private:
+    RendererType        m_rendererType;
     OctreeFile*         m_file;
     OctreeRuntime*      m_runtime;
     CudaRenderer*       m_renderer;
+    CpuRenderer*        m_cpuRenderer;
 
     S32                 m_numLevels;
 
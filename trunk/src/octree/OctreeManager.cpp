@@ -45,6 +45,7 @@ OctreeManager::OctreeManager(RenderMode renderMode)
     m_dynamicLoad           (true),
     m_dynamicBuild          (true),
     m_maxLevels             (OctreeFile::UnitScale),
+    m_maxVoxelSize          (1.0f),
 
     m_tmpFileID             (-1),
     m_file                  (NULL),
@@ -52,10 +53,10 @@ OctreeManager::OctreeManager(RenderMode renderMode)
     m_cpuRuntime            (NULL),
     m_cudaRuntime           (NULL),
     m_cudaRenderer          (NULL),
+    m_cpuRenderer           (NULL),
 
-    m_loadSliceID           (-1),
-    m_loadSliceBytesDisk    (0),
-    m_loadSliceBytesMemory  (0),
+    m_importAbort           (false),
+    m_importSem             (0, FW_S32_MAX),
 
     m_loadBytesTotal        (0.0f),
 
@@ -73,9 +74,11 @@ OctreeManager::OctreeManager(RenderMode renderMode)
 
 OctreeManager::~OctreeManager(void)
 {
+    cancelImports();
     unloadFile(true);
     destroyRuntime();
     delete m_cudaRenderer;
+    delete m_cpuRenderer;
 }
 
 //------------------------------------------------------------------------
@@ -86,7 +89,7 @@ void OctreeManager::setRenderMode(RenderMode renderMode)
         return;
 
     m_renderMode = renderMode;
-    m_loadSliceID = -1;
+    cancelImports();
 }
 
 //------------------------------------------------------------------------
@@ -110,6 +113,11 @@ OctreeRuntime* OctreeManager::getRuntime(void)
     case RenderMode_Mesh:
         return NULL;
 
+    case RenderMode_Cpu:
+        if (!m_cpuRuntime)
+            m_cpuRuntime = new OctreeRuntime(MemoryManager::Mode_CPU);
+        return m_cpuRuntime;
+
     case RenderMode_Cuda:
         if (!m_cudaRuntime && CudaModule::isAvailable())
             m_cudaRuntime = new OctreeRuntime(MemoryManager::Mode_Cuda);
@@ -134,6 +142,17 @@ CudaRenderer* OctreeManager::getCudaRenderer(void)
 
 //------------------------------------------------------------------------
 
+CpuRenderer* OctreeManager::getCpuRenderer(void)
+{
+    if (m_renderMode != RenderMode_Cpu)
+        return NULL;
+    if (!m_cpuRenderer)
+        m_cpuRenderer = new CpuRenderer;
+    return m_cpuRenderer;
+}
+
+//------------------------------------------------------------------------
+
 BuilderBase* OctreeManager::getBuilder(BuilderType type)
 {
     FW_ASSERT(type >= 0 && type < BuilderType_Max);
@@ -162,18 +181,18 @@ void OctreeManager::clearRuntime(void)
         m_cpuRuntime->clear();
     if (m_cudaRuntime)
         m_cudaRuntime->clear();
-    m_loadSliceID = -1;
+    cancelImports();
 }
 
 //------------------------------------------------------------------------
 
 void OctreeManager::destroyRuntime(void)
 {
+    cancelImports();
     delete m_cpuRuntime;
     delete m_cudaRuntime;
     m_cpuRuntime = NULL;
     m_cudaRuntime = NULL;
-    m_loadSliceID = -1;
 }
 
 //------------------------------------------------------------------------
@@ -218,6 +237,7 @@ void OctreeManager::saveFile(const String& fileName, bool edit)
         OctreeFile* oldFile = m_file;
         m_file = new OctreeFile(fileName, File::Create);
         m_file->set(*oldFile);
+        cancelImports(); // queued slices may be views into oldFile
         delete oldFile;
     }
 
@@ -380,6 +400,10 @@ void OctreeManager::freeTmpFileID(int id)
 
 void OctreeManager::unloadFile(bool freeID)
 {
+    // Queued imports may hold views into the file, including one
+    // that the caller has already detached from m_file.
+
+    cancelImports();
     for (int i = 0; i < BuilderType_Max; i++)
     {
         delete m_builders[i];
@@ -429,6 +453,18 @@ void OctreeManager::renderInternal(GLContext* gl, int objectID, const Mat4f& wor
         profilePush("Update runtime");
         octreeToCamera = worldToCamera * obj.objectToWorld * obj.octreeToObject;
         Vec3f cameraInOctree = Vec4f(octreeToCamera.inverted().col(3)).getXYZ();
+
+        // Frustum and focal length for the *InView find modes.
+
+        Vec2f viewSize = Vec2f(gl->getViewSize());
+        Mat4f viewportToCamera = projection.inverted() * Mat4f::translate(Vec3f(-1.0f, -1.0f, 0.0f)) * Mat4f::scale(Vec3f(Vec2f(2.0f) / viewSize, 1.0f));
+        OctreeRuntime::FindView view;
+        view.viewportToOctreeN  = (viewportToCamera.inverted() * octreeToCamera).transposed();
+        view.viewSize           = viewSize;
+        view.focalLength        = abs(projection.m11) * viewSize.y * 0.5f;
+        view.minVoxelPixels     = m_maxVoxelSize * 0.5f; // renderer descends into voxels larger than m_maxVoxelSize
+        runtime->setFindView(view);
+
         F32 timeLimit = min(frameDelta * (F32)UpdateTimePct / 100.0f, (F32)UpdateTimeMaxMillis / 1000.0f);
         m_updateTimer.start();
         updateRuntime(obj.rootSlice, cameraInOctree, timeLimit);
@@ -479,6 +515,25 @@ void OctreeManager::renderInternal(GLContext* gl, int objectID, const Mat4f& wor
         }
         break;
 
+    case RenderMode_Cpu:
+        if (!getRuntime()->getRootNodeCPU(obj.rootSlice))
+        {
+            if (m_dynamicLoad && m_dynamicBuild && isEditable())
+                gl->drawModalMessage("Building root slice...");
+            else
+                gl->drawModalMessage("No slices loaded!");
+        }
+        else
+        {
+            m_renderTimer.start();
+            glDisable(GL_DEPTH_TEST);
+            String error = getCpuRenderer()->renderObject(gl, runtime, objectID, obj.objectToWorld * obj.octreeToObject, worldToCamera, projection);
+            if (error.getLength())
+                gl->drawModalMessage(error);
+            m_renderTimer.end();
+        }
+        break;
+
     default:
         FW_ASSERT(false);
         break;
@@ -503,18 +558,25 @@ void OctreeManager::updateRuntime(int objectID, const Vec3f& cameraInOctree, F32
     Array<AttachIO::AttachType> attach;
     if (m_renderMode == RenderMode_Cuda)
         m_cudaRenderer->selectAttachments(attach, obj.runtimeAttachTypes);
+    else if (m_renderMode == RenderMode_Cpu)
+        getCpuRenderer()->selectAttachments(attach, obj.runtimeAttachTypes);
     else
         attach = obj.runtimeAttachTypes;
 
     if (runtime->hasObject(objectID) && attach != runtime->getAttachTypes(objectID))
     {
         runtime->removeObject(objectID);
-        m_loadSliceID = -1;
+        cancelImports();
     }
 
     if (!runtime->hasObject(objectID))
         runtime->addObject(objectID, obj.rootSlice, attach);
 
+    // Track which slices are visible for the eviction policy.
+
+    runtime->beginFrame();
+    runtime->updateVisibility(objectID);
+
     // Unload slices exceeding the level limit.
 
     while (timer.getElapsed() < timeLimit)
@@ -536,14 +598,16 @@ void OctreeManager::updateRuntime(int objectID, const Vec3f& cameraInOctree, F32
     // Load and build slices while we still have time.
 
     bool build = (m_dynamicBuild && isEditable());
+    const Set<S32>* visibleSlices = (m_renderMode == RenderMode_Cpu && m_cpuRenderer) ? m_cpuRenderer->getVisibilityFeedback(objectID) : NULL;
+
     while (timer.getElapsed() < timeLimit)
     {
-        // Find slices.
+        // Find slices, restricted to the ones that the last frame needed if known.
 
         Array<OctreeRuntime::FindResult> slices;
         runtime->findSlices(slices,
-            (build) ? OctreeRuntime::FindMode_LoadOrBuild : OctreeRuntime::FindMode_Load,
-            objectID, cam, cam, m_maxLevels, MaxPrefetchSlices);
+            (build) ? OctreeRuntime::FindMode_LoadOrBuildInView : OctreeRuntime::FindMode_LoadInView,
+            objectID, cam, cam, m_maxLevels, MaxPrefetchSlices, visibleSlices);
 
         // Refresh state and prefetch.
 
@@ -579,17 +643,20 @@ void OctreeManager::prefetchSlices(const Array<OctreeRuntime::FindResult>& slice
         if (sliceID == -1)
             continue;
 
-        int size = file->getSliceSize(sliceID);
+        bool hasBlocks = file->hasRuntimeBlocks(sliceID);
+        int size = file->getSliceSize(sliceID) + ((hasBlocks) ? file->getRuntimeBlocksSize(sliceID) : 0);
         bytesTotal += size;
         if (i && bytesTotal > MaxPrefetchBytesTotal)
             break;
 
-        if (!file->readSliceIsReady(sliceID))
+        if (!file->readSliceIsReady(sliceID) || (hasBlocks && !file->readRuntimeBlocksIsReady(sliceID)))
         {
             bytesPending += size;
             if (i && bytesPending > MaxPrefetchBytesPending)
                 break;
             file->readSlicePrefetch(sliceID);
+            if (hasBlocks)
+                file->readRuntimeBlocksPrefetch(sliceID);
         }
     }
 
@@ -609,51 +676,110 @@ bool OctreeManager::loadSlices(const Array<OctreeRuntime::FindResult>& slices, T
     FW_ASSERT(file && runtime);
     profilePush("Load slices");
 
+    // Collect imports that have been prepared on the import threads.
+
+    m_importLock.enter();
+    for (int i = 0; i < m_importsFinished.getSize(); i++)
+    {
+        m_importsPending.removeItem(m_importsFinished[i]);
+        m_importsReady.add(m_importsFinished[i]);
+    }
+    m_importsFinished.clear();
+    m_importLock.leave();
+
+    // Drop the ones that have not been wanted for a while. Keeping them
+    // around briefly avoids redoing the work when a slice drops out of
+    // the list for a frame or two as the camera moves.
+
+    int frameIndex = runtime->getFrameIndex();
+    for (int i = m_importsReady.getSize() - 1; i >= 0; i--)
+    {
+        OctreeRuntime::SliceImport* imp = m_importsReady[i];
+        for (int j = 0; j < slices.getSize(); j++)
+            if (slices[j].sliceID == imp->sliceID)
+                imp->lastWantedFrame = frameIndex;
+        if (frameIndex - imp->lastWantedFrame > MaxIdleImportFrames)
+            delete m_importsReady.removeSwap(i);
+    }
+
+    // Commit in the order of the scores. Once a slice is not prepared
+    // yet, the remaining ones are only queued for preparation so that a
+    // less important slice never takes the memory of a more important one.
+
+    bool commitBlocked = false;
     for (int i = 0; i < slices.getSize() && timer.getElapsed() < timeLimit; i++)
     {
         int sliceID = slices[i].sliceID;
         if (sliceID == -1)
             continue;
 
-        if (!file->readSliceIsReady(sliceID) ||
-            slices[i].score <= scoreRequired ||
+        if (slices[i].score <= scoreRequired ||
             file->getSliceState(sliceID) != OctreeFile::SliceState_Complete)
         {
             break;
         }
 
-        // Prepare to load slice.
+        // Not prepared yet => decode and start preparing in the background.
+
+        OctreeRuntime::SliceImport* imp = NULL;
+        bool pending = false;
+        for (int j = 0; j < m_importsReady.getSize() && !imp; j++)
+            if (m_importsReady[j]->sliceID == sliceID)
+                imp = m_importsReady[j];
+        for (int j = 0; j < m_importsPending.getSize() && !pending; j++)
+            pending = (m_importsPending[j]->sliceID == sliceID);
 
-        if (m_loadSliceID != sliceID)
+        if (!imp)
         {
-            profilePush("Decode");
-            OctreeSlice slice;
-            file->readSlice(sliceID, slice);
-            m_loadSliceID = sliceID;
-            m_loadSliceBytesDisk = slice.getSize() * sizeof(S32);
-            m_loadSliceBytesMemory = runtime->setSliceToLoad(slice);
-            profilePop();
+            commitBlocked = true;
+            bool hasBlocks = file->hasRuntimeBlocks(sliceID);
+            bool ready = (file->readSliceIsReady(sliceID) && (!hasBlocks || file->readRuntimeBlocksIsReady(sliceID)));
+            if (!pending && ready && m_importsPending.getSize() < MaxAsyncImports)
+            {
+                profilePush("Decode");
+                OctreeSlice* sliceData = new OctreeSlice;
+                file->readSlice(sliceID, *sliceData);
+                imp = runtime->beginImport(sliceData);
+                if (imp)
+                {
+                    imp->diskBytes = file->getSliceSize(sliceID);
+                    if (hasBlocks)
+                    {
+                        file->readRuntimeBlocks(sliceID, imp->runtimeBlocks);
+                        imp->diskBytes += file->getRuntimeBlocksSize(sliceID);
+                    }
+                    imp->lastWantedFrame = runtime->getFrameIndex();
+                    pushImport(imp);
+                }
+                profilePop();
+            }
+            continue;
         }
 
-        // Try to load, unloading slices as necessary.
+        if (commitBlocked)
+            continue;
+
+        // Try to commit, unloading slices as necessary.
 
         while (timer.getElapsed() < timeLimit)
         {
             profilePush("Upload");
             bool loaded = false;
-            if (runtime->getFreeBytes() - m_loadSliceBytesMemory >= RuntimeSlackBytes)
-                loaded = runtime->loadSlice();
+            if (runtime->getFreeBytes() - imp->memDelta >= RuntimeSlackBytes)
+                loaded = runtime->commitImport(imp);
             profilePop();
 
             if (loaded)
             {
-                m_loadSliceID = -1;
-                m_loadBytesTotal += (F32)m_loadSliceBytesDisk;
+                if (runtime->isSliceLoaded(sliceID))
+                    m_loadBytesTotal += (F32)(imp->sliceData->getSize() * sizeof(S32));
+                m_importsReady.removeItem(imp);
+                delete imp;
                 retry = true;
                 break;
             }
 
-            OctreeRuntime::FindResult unload = runtime->findSlice(OctreeRuntime::FindMode_Unload,
+            OctreeRuntime::FindResult unload = runtime->findSlice(OctreeRuntime::FindMode_UnloadInView,
                 objectID, cam, cam, OctreeFile::UnitScale);
 
             if (unload.sliceID == -1 || unload.score >= slices[i].score)
@@ -675,6 +801,83 @@ bool OctreeManager::loadSlices(const Array<OctreeRuntime::FindResult>& slices, T
 
 //------------------------------------------------------------------------
 
+void OctreeManager::pushImport(OctreeRuntime::SliceImport* imp)
+{
+    FW_ASSERT(imp);
+
+    // Start the threads on first use.
+
+    if (!m_importThreads.getSize())
+    {
+        for (int i = 0; i < NumImportThreads; i++)
+            m_importThreads.add(new Thread);
+        for (int i = 0; i < NumImportThreads; i++)
+            m_importThreads[i]->start(importThreadFunc, this);
+    }
+
+    // Queue.
+
+    m_importsPending.add(imp);
+    m_importLock.enter();
+    m_importQueue.add(imp);
+    m_importLock.leave();
+    m_importSem.release();
+}
+
+//------------------------------------------------------------------------
+
+void OctreeManager::importThreadFunc(void* param)
+{
+    OctreeManager* m = (OctreeManager*)param;
+    for (;;)
+    {
+        m->m_importSem.acquire();
+        if (m->m_importAbort)
+            break;
+
+        m->m_importLock.enter();
+        OctreeRuntime::SliceImport* imp = (m->m_importQueue.getSize()) ? m->m_importQueue.remove(0) : NULL;
+        m->m_importLock.leave();
+        if (!imp)
+            continue;
+
+        OctreeRuntime::prepareImport(imp);
+
+        m->m_importLock.enter();
+        m->m_importsFinished.add(imp);
+        m->m_importLock.leave();
+    }
+}
+
+//------------------------------------------------------------------------
+
+void OctreeManager::cancelImports(void)
+{
+    // Stop the threads. Each one finishes its current import first.
+
+    m_importAbort = true;
+    for (int i = 0; i < m_importThreads.getSize(); i++)
+        m_importSem.release();
+    for (int i = 0; i < m_importThreads.getSize(); i++)
+        delete m_importThreads[i]; // joins
+    m_importThreads.reset();
+    m_importAbort = false;
+
+    // Delete remaining imports. Everything in m_importQueue and
+    // m_importsFinished is also in m_importsPending.
+
+    for (int i = 0; i < m_importsPending.getSize(); i++)
+        delete m_importsPending[i];
+    for (int i = 0; i < m_importsReady.getSize(); i++)
+        delete m_importsReady[i];
+    m_importsPending.reset();
+    m_importsReady.reset();
+    m_importQueue.reset();
+    m_importsFinished.reset();
+}
+
+//------------------------------------------------------------------------
+
 bool OctreeManager::buildSlices(const Array<OctreeRuntime::FindResult>& slices, Timer& timer, F32 timeLimit)
 {
     OctreeFile*     file    = getFile();
@@ -30,6 +30,7 @@
 #include "io/OctreeRuntime.hpp"
 #include "build/BuilderBase.hpp"
 #include "render/CudaRenderer.hpp"
+#include "render/CpuRenderer.hpp"
 #include "base/Timer.hpp"
 
 namespace FW
@@ -47,12 +48,16 @@ public:
         MaxPrefetchSlices       = OctreeFile::MaxPrefetchSlices,
         MaxPrefetchBytesTotal   = OctreeFile::MaxPrefetchBytesTotal,
         MaxPrefetchBytesPending = 8 << 20,
-        MaxAsyncBuildSlices     = BuilderBase::MaxAsyncBuildSlices
+        MaxAsyncBuildSlices     = BuilderBase::MaxAsyncBuildSlices,
+        MaxAsyncImports         = 8,
+        MaxIdleImportFrames     = 4,          // Prepared imports are kept this long after they stop being wanted.
+        NumImportThreads        = 2,
     };
 
     enum RenderMode
     {
         RenderMode_Mesh = 0,
+        RenderMode_Cpu  = 1,
         RenderMode_Cuda = 2,
     };
 
@@ -73,10 +78,12 @@ public:
     void                setDynamicLoad      (bool dynamicLoad)  { m_dynamicLoad = dynamicLoad; }
     void                setDynamicBuild     (bool dynamicBuild) { m_dynamicBuild = dynamicBuild; }
     void                setMaxLevels        (int maxLevels)     { m_maxLevels = maxLevels; }
+    void                setMaxVoxelSize     (F32 maxVoxelSize)  { m_maxVoxelSize = maxVoxelSize; } // in pixels, as in CudaRenderer::Params
 
     OctreeFile*         getFile             (void);
     OctreeRuntime*      getRuntime          (void);
     CudaRenderer*       getCudaRenderer     (void);
+    CpuRenderer*        getCpuRenderer      (void);
     BuilderBase*        getBuilder          (BuilderType type);
 
     void                clearRuntime        (void);
@@ -106,6 +113,9 @@ private:
     void                updateRuntime       (int objectID, const Vec3f& cameraInOctree, F32 timeLimit);
     void                prefetchSlices      (const Array<OctreeRuntime::FindResult>& slices, Timer& timer, F32 timeLimit);
     bool                loadSlices          (const Array<OctreeRuntime::FindResult>& slices, Timer& timer, F32 timeLimit, int objectID, const Vec3f& cameraInOctree);
+    void                pushImport          (OctreeRuntime::SliceImport* imp);
+    static void         importThreadFunc    (void* param);
+    void                cancelImports       (void);
     bool                buildSlices         (const Array<OctreeRuntime::FindResult>& slices, Timer& timer, F32 timeLimit);
 
 private:
@@ -123,6 +133,7 @@ private:
     bool                m_dynamicLoad;
     bool                m_dynamicBuild;
     S32                 m_maxLevels;
+    F32                 m_maxVoxelSize;
 
     S32                 m_tmpFileID;        // -1 if none
     OctreeFile*         m_file;
@@ -131,10 +142,16 @@ private:
     OctreeRuntime*      m_cpuRuntime;
     OctreeRuntime*      m_cudaRuntime;
     CudaRenderer*       m_cudaRenderer;
-
-    S32                 m_loadSliceID;
-    S32                 m_loadSliceBytesDisk;
-    S32                 m_loadSliceBytesMemory;
+    CpuRenderer*        m_cpuRenderer;
+
+    Array<Thread*>      m_importThreads;    // dedicated => imports do not queue up behind renderer tiles in MulticoreLauncher
+    volatile bool       m_importAbort;
+    Semaphore           m_importSem;        // released once per queued import
+    Spinlock            m_importLock;
+    Array<OctreeRuntime::SliceImport*> m_importQueue;    // protected by m_importLock
+    Array<OctreeRuntime::SliceImport*> m_importsFinished; // protected by m_importLock
+    Array<OctreeRuntime::SliceImport*> m_importsPending; // being prepared by m_importThreads
+    Array<OctreeRuntime::SliceImport*> m_importsReady;   // waiting for commitImport()
 
     Timer               m_frameDeltaTimer;
     Timer               m_frameTimer;
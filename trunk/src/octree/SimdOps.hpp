@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "base/Defs.hpp"
+
+#include <xmmintrin.h>
+
+//------------------------------------------------------------------------
+// Set to 0 for compilers without AVX intrinsics (before VS2010 SP1).
+// The SIMD kernels then always use SSE.
+//------------------------------------------------------------------------
+
+#ifndef ENABLE_AVX
+#   define ENABLE_AVX 1
+#endif
+
+#if ENABLE_AVX
+#   include <immintrin.h>
+#endif
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// Thin wrappers over SSE and AVX float operations, used as the template
+// argument of kernels that are written once for both widths. Kernels
+// pick AvxOps at runtime when hasAVX() returns true.
+//------------------------------------------------------------------------
+
+bool hasAVX(void); // CPU and OS support AVX
+
+//------------------------------------------------------------------------
+
+struct SseOps
+{
+    typedef __m128 V;
+    enum { Width = 4 };
+
+    static __forceinline V      set1    (F32 a)         { return _mm_set1_ps(a); }
+    static __forceinline V      load    (const F32* p)  { return _mm_loadu_ps(p); }
+    static __forceinline void   store   (F32* p, V a)   { _mm_storeu_ps(p, a); }
+    static __forceinline V      add     (V a, V b)      { return _mm_add_ps(a, b); }
+    static __forceinline V      sub     (V a, V b)      { return _mm_sub_ps(a, b); }
+    static __forceinline V      mul     (V a, V b)      { return _mm_mul_ps(a, b); }
+    static __forceinline V      div     (V a, V b)      { return _mm_div_ps(a, b); }
+    static __forceinline V      min     (V a, V b)      { return _mm_min_ps(a, b); }
+    static __forceinline V      max     (V a, V b)      { return _mm_max_ps(a, b); }
+    static __forceinline V      abs     (V a)           { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static __forceinline V      gt      (V a, V b)      { return _mm_cmpgt_ps(a, b); }
+    static __forceinline V      lt      (V a, V b)      { return _mm_cmplt_ps(a, b); }
+    static __forceinline V      ge      (V a, V b)      { return _mm_cmpge_ps(a, b); }
+    static __forceinline V      le      (V a, V b)      { return _mm_cmple_ps(a, b); }
+    static __forceinline V      bor     (V a, V b)      { return _mm_or_ps(a, b); }
+    static __forceinline V      bandnot (V a, V b)      { return _mm_andnot_ps(a, b); } // ~a & b
+    static __forceinline U32    mask    (V a)           { return _mm_movemask_ps(a); }
+    static __forceinline void   finish  (void)          {}
+};
+
+//------------------------------------------------------------------------
+
+#if ENABLE_AVX
+struct AvxOps
+{
+    typedef __m256 V;
+    enum { Width = 8 };
+
+    static __forceinline V      set1    (F32 a)         { return _mm256_set1_ps(a); }
+    static __forceinline V      load    (const F32* p)  { return _mm256_loadu_ps(p); }
+    static __forceinline void   store   (F32* p, V a)   { _mm256_storeu_ps(p, a); }
+    static __forceinline V      add     (V a, V b)      { return _mm256_add_ps(a, b); }
+    static __forceinline V      sub     (V a, V b)      { return _mm256_sub_ps(a, b); }
+    static __forceinline V      mul     (V a, V b)      { return _mm256_mul_ps(a, b); }
+    static __forceinline V      div     (V a, V b)      { return _mm256_div_ps(a, b); }
+    static __forceinline V      min     (V a, V b)      { return _mm256_min_ps(a, b); }
+    static __forceinline V      max     (V a, V b)      { return _mm256_max_ps(a, b); }
+    static __forceinline V      abs     (V a)           { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static __forceinline V      gt      (V a, V b)      { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static __forceinline V      lt      (V a, V b)      { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static __forceinline V      ge      (V a, V b)      { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static __forceinline V      le      (V a, V b)      { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static __forceinline V      bor     (V a, V b)      { return _mm256_or_ps(a, b); }
+    static __forceinline V      bandnot (V a, V b)      { return _mm256_andnot_ps(a, b); } // ~a & b
+    static __forceinline U32    mask    (V a)           { return _mm256_movemask_ps(a); }
+    static __forceinline void   finish  (void)          { _mm256_zeroupper(); } // avoid AVX-SSE transition penalty
+};
+#endif
+
+//------------------------------------------------------------------------
+}
@@ -26,6 +26,9 @@
  */
 
 #include "Util.hpp"
+#include "SimdOps.hpp"
+
+#include <intrin.h>
 
 using namespace FW;
 
@@ -594,6 +597,125 @@ bool FW::isectsDeltaTriangleBox(const Vec3d& p, const Vec3d& pu, const Vec3d& pv
     return isectsDeltaTriangleBox<F64, Vec3d>(p, pu, pv, boxHalfSize);
 }
 
+//------------------------------------------------------------------------
+// SIMD counterpart of isectsDeltaTriangleBox<F32>, one box per lane.
+// Each lane performs the same float operations as the scalar code, so
+// the results are identical. Quantities that depend only on the triangle
+// and the common box size are computed once and broadcast.
+//------------------------------------------------------------------------
+
+#define SIMD_AXISTEST(a, b, s0, t0, s1, t1, rad)                            \
+    q0 = O::sub(O::mul(O::set1(a), s0), O::mul(O::set1(b), t0));            \
+    q1 = O::sub(O::mul(O::set1(a), s1), O::mul(O::set1(b), t1));            \
+    sep = O::bor(sep, O::gt(O::min(q0, q1), O::set1(rad)));                 \
+    sep = O::bor(sep, O::lt(O::max(q0, q1), O::set1(-(rad))));
+
+#define SIMD_MINMAXTEST(x0, x1, x2, hs)                                     \
+    sep = O::bor(sep, O::gt(O::min(O::min(x0, x1), x2), O::set1(hs)));     \
+    sep = O::bor(sep, O::lt(O::max(O::max(x0, x1), x2), O::set1(-(hs))));
+
+template <class O> static __forceinline U32 isectsDeltaTriangleBoxesSIMD(const Vec3f& p, const Vec3f& pu, const Vec3f& pv, const DeltaBoxSet& boxes)
+{
+    typedef typename O::V V;
+    const Vec3f& h = boxes.halfSize;
+
+    // Separating axes from the edges: rad = fa * boxHalfSize + fb * boxHalfSize.
+
+    Vec3f e = pv - pu;
+    F32 radU[3] = { FW::abs(pu.z) * h.y + FW::abs(pu.y) * h.z, FW::abs(pu.z) * h.x + FW::abs(pu.x) * h.z, FW::abs(pu.y) * h.x + FW::abs(pu.x) * h.y };
+    F32 radE[3] = { FW::abs(e.z)  * h.y + FW::abs(e.y)  * h.z, FW::abs(e.z)  * h.x + FW::abs(e.x)  * h.z, FW::abs(e.y)  * h.x + FW::abs(e.x)  * h.y };
+    F32 radV[3] = { FW::abs(pv.z) * h.y + FW::abs(pv.y) * h.z, FW::abs(pv.z) * h.x + FW::abs(pv.x) * h.z, FW::abs(pv.y) * h.x + FW::abs(pv.x) * h.y };
+
+    // Plane of the triangle, see planeBoxOverlap().
+
+    Vec3f normal = pv.cross(pu);
+    Vec3f vmin, vmax;
+    for (int q = 0; q <= 2; q++)
+    {
+        vmin[q] = (normal[q] > 0.0f) ? -h[q] : h[q];
+        vmax[q] = -vmin[q];
+    }
+    F32 dmin = normal.dot(vmin);
+    F32 dmax = normal.dot(vmax);
+
+    // Test the boxes Width at a time.
+
+    U32 res = 0;
+    for (int base = 0; base < boxes.numBoxes; base += O::Width)
+    {
+        V v0x = O::sub(O::set1(p.x), O::load(boxes.midX + base));
+        V v0y = O::sub(O::set1(p.y), O::load(boxes.midY + base));
+        V v0z = O::sub(O::set1(p.z), O::load(boxes.midZ + base));
+        V v1x = O::add(v0x, O::set1(pu.x));
+        V v1y = O::add(v0y, O::set1(pu.y));
+        V v1z = O::add(v0z, O::set1(pu.z));
+        V v2x = O::add(v0x, O::set1(pv.x));
+        V v2y = O::add(v0y, O::set1(pv.y));
+        V v2z = O::add(v0z, O::set1(pv.z));
+        V sep = O::set1(0.0f);
+        V q0, q1;
+
+        // Bullet 3: AXISTEST_X01, AXISTEST_Y02, AXISTEST_Z12, etc.
+
+        SIMD_AXISTEST(pu.z,  pu.y,  v0y, v0z, v2y, v2z, radU[0]);
+        SIMD_AXISTEST(pu.x,  pu.z,  v0z, v0x, v2z, v2x, radU[1]);
+        SIMD_AXISTEST(pu.y,  pu.x,  v1x, v1y, v2x, v2y, radU[2]);
+
+        SIMD_AXISTEST(e.z,   e.y,   v0y, v0z, v2y, v2z, radE[0]);
+        SIMD_AXISTEST(e.x,   e.z,   v0z, v0x, v2z, v2x, radE[1]);
+        SIMD_AXISTEST(e.y,   e.x,   v0x, v0y, v1x, v1y, radE[2]);
+
+        SIMD_AXISTEST(-pv.z, -pv.y, v0y, v0z, v1y, v1z, radV[0]);
+        SIMD_AXISTEST(-pv.x, -pv.z, v0z, v0x, v1z, v1x, radV[1]);
+        SIMD_AXISTEST(-pv.y, -pv.x, v1x, v1y, v2x, v2y, radV[2]);
+
+        // Bullet 1: bounds of the triangle.
+
+        SIMD_MINMAXTEST(v0x, v1x, v2x, h.x);
+        SIMD_MINMAXTEST(v0y, v1y, v2y, h.y);
+        SIMD_MINMAXTEST(v0z, v1z, v2z, h.z);
+
+        // Bullet 2: plane of the triangle, d = -normal.dot(v0).
+
+        V nv0 = O::add(O::add(O::mul(O::set1(normal.x), v0x), O::mul(O::set1(normal.y), v0y)), O::mul(O::set1(normal.z), v0z));
+        sep = O::bor(sep, O::gt(O::sub(O::set1(dmin), nv0), O::set1(0.0f)));
+        V hit = O::bandnot(sep, O::ge(O::sub(O::set1(dmax), nv0), O::set1(0.0f)));
+        res |= O::mask(hit) << base;
+    }
+
+    O::finish();
+    return res & ((1u << boxes.numBoxes) - 1);
+}
+
+#undef SIMD_AXISTEST
+#undef SIMD_MINMAXTEST
+
+//------------------------------------------------------------------------
+
+bool FW::hasAVX(void)
+{
+#if ENABLE_AVX
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) // OSXSAVE, AVX
+        return false;
+    return ((_xgetbv(0) & 6) == 6); // OS saves XMM and YMM registers
+#else
+    return false;
+#endif
+}
+
+static const bool s_useAVX = hasAVX(); // before any threads are started
+
+U32 FW::isectsDeltaTriangleBoxes(const Vec3f& p, const Vec3f& pu, const Vec3f& pv, const DeltaBoxSet& boxes)
+{
+#if ENABLE_AVX
+    if (s_useAVX)
+        return isectsDeltaTriangleBoxesSIMD<AvxOps>(p, pu, pv, boxes);
+#endif
+    return isectsDeltaTriangleBoxesSIMD<SseOps>(p, pu, pv, boxes);
+}
+
 //------------------------------------------------------------------------
 
 template <class S, class V2, class V3> __forceinline int FW::clipDeltaTriangleToBox(
@@ -32,6 +32,29 @@
 
 namespace FW
 {
+//------------------------------------------------------------------------
+// Up to 8 boxes of the same size, typically the children of one octree
+// node. The centers are kept as separate arrays so that
+// isectsDeltaTriangleBoxes() can test all of the boxes at once.
+//------------------------------------------------------------------------
+
+struct DeltaBoxSet
+{
+    enum
+    {
+        MaxBoxes = 8
+    };
+
+    F32                 midX[MaxBoxes];
+    F32                 midY[MaxBoxes];
+    F32                 midZ[MaxBoxes];
+    Vec3f               halfSize;
+    S32                 numBoxes;
+
+                        DeltaBoxSet     (const Vec3f& boxHalfSize) : halfSize(boxHalfSize), numBoxes(0) { for (int i = 0; i < MaxBoxes; i++) midX[i] = midY[i] = midZ[i] = 0.0f; }
+    void                add             (const Vec3f& mid)  { FW_ASSERT(numBoxes < MaxBoxes); midX[numBoxes] = mid.x; midY[numBoxes] = mid.y; midZ[numBoxes] = mid.z; numBoxes++; }
+};
+
 //------------------------------------------------------------------------
 
 Vec3i               getCubeChildPos         (const Vec3i& parentPos, int parentScale, int childIdx);
@@ -55,6 +78,7 @@ void                decodeDXTNormals        (Vec3f* normals, const U64& blockA,
 
 bool                isectsDeltaTriangleBox  (const Vec3f& p, const Vec3f& pu, const Vec3f& pv, const Vec3f& boxHalfSize);
 bool                isectsDeltaTriangleBox  (const Vec3d& p, const Vec3d& pu, const Vec3d& pv, const Vec3d& boxHalfSize);
+U32                 isectsDeltaTriangleBoxes(const Vec3f& p, const Vec3f& pu, const Vec3f& pv, const DeltaBoxSet& boxes); // bit i = isectsDeltaTriangleBox(p - mid[i], ...), uses AVX if available
 int                 clipDeltaTriangleToBox  (Vec2f baryOut[9], const Vec3f& p, const Vec3f& pu, const Vec3f& pv, const Vec3f& boxHalfSize);
 int                 clipDeltaTriangleToBox  (Vec2d baryOut[9], const Vec3d& p, const Vec3d& pu, const Vec3d& pv, const Vec3d& boxHalfSize);
 F32                 quadrancePointToTri     (const Vec3f& p, const Vec3f& a, const Vec3f& b);
@@ -171,18 +171,22 @@ void BuilderBase::ThreadState::runTask(Task& task)
     // Construct unbuilt child slices.
 
     task.children.reset(m_childSlices.getSize());
+    task.childWork.reset(m_childSlices.getSize());
     for (int i = 0; i < m_childSlices.getSize(); i++)
     {
         ChildSlice& cs = m_childSlices[i];
+        task.childWork[i] = 0.0f;
         if (cs.isSplit)
         {
             slice.setChildEntry(i, OctreeSlice::ChildEntry_Split);
             continue;
         }
 
+        F32 workOut = m_workOut;
         pushMemOwner("Builder subclass state");
         endChildSlice(cs);
         popMemOwner();
+        task.childWork[i] = m_workOut - workOut;
         if (!cs.nodes.getSize() || cs.nodeScale < 1)
             continue;
 
@@ -199,9 +203,10 @@ void BuilderBase::ThreadState::runTask(Task& task)
         childData.startAttach(AttachIO::BuildDataAttach);
         BitWriter bitWriter(&childData.getData());
 
-        bitWriter.write(32, 1); // version
+        bitWriter.write(32, 2); // version
         bitWriter.write(32, task.objectID); // objectID
         bitWriter.write(32, cs.nodes.getSize()); // numNodes
+        bitWriter.write(32, floatToBits(task.childWork[i])); // workEstimate
         for (int j = 0; j < 8; j++)
             bitWriter.write(8, task.idString[j]); // subclassIDString[j]
 
@@ -332,8 +337,11 @@ BuilderBase::BuilderBase(OctreeFile* file)
 :   m_file          (file),
     m_maxThreads    (FW_S32_MAX),
     m_serialState   (NULL),
-    m_numRunning    (0),
-    m_abort         (false)
+    m_abort         (false),
+    m_workSem       (0, FW_S32_MAX),
+    m_nextThread    (0),
+    m_numSpawned    (0),
+    m_finishedSem   (0, FW_S32_MAX)
 {
     FW_ASSERT(file);
 }
@@ -349,13 +357,6 @@ BuilderBase::~BuilderBase(void)
 
 void BuilderBase::buildObject(int objectID, int numLevels, const Params& params, bool enablePrints)
 {
-    struct QueueEntry
-    {
-        S32 sliceID;
-        F32 timeTotal;  // Before building the slice.
-        F32 workTotal;  // Before building the slice.
-    };
-
     FW_ASSERT(numLevels >= 0);
 
     // Create root slice.
@@ -368,9 +369,28 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
         return;
     }
 
-    // No levels requested => done.
+    // Build.
 
-    if (!numLevels)
+    buildSlices(Array<S32>(rootSlice.getID()), numLevels, enablePrints);
+}
+
+//------------------------------------------------------------------------
+
+void BuilderBase::buildSlices(const Array<S32>& sliceIDs, int numLevels, bool enablePrints)
+{
+    struct QueueEntry
+    {
+        S32 sliceID;
+        S32 level;
+        F32 timeTotal;  // Before building the slice.
+        F32 workTotal;  // Before building the slice.
+    };
+
+    FW_ASSERT(numLevels >= 0);
+
+    // No slices or no levels requested => done.
+
+    if (!sliceIDs.getSize() || !numLevels)
         return;
 
     // Print table header.
@@ -387,16 +407,20 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
 
     int     level       = 0;
     int     levelStart  = 0;
-    int     levelEnd    = 1;
+    int     levelEnd    = sliceIDs.getSize();
     Timer   timeLevel   (true);
-    F32     workLevel   = 1.0f; // Total work on current level.
+    F32     workLevel   = (F32)sliceIDs.getSize(); // Total work on current level.
     F32     workDone    = 0.0f; // Work done on current level.
     F32     workNext    = 0.0f; // Total work on next level.
     Timer   timeTotal   (true);
     F32     workTotal   = 0.0f;
 
     Array<QueueEntry> queue;
-    queue.add().sliceID = rootSlice.getID();
+    for (int i = 0; i < sliceIDs.getSize(); i++)
+    {
+        queue.add().sliceID = sliceIDs[i];
+        queue.getLast().level = 0;
+    }
 
     // Build slices.
 
@@ -439,7 +463,12 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
 
         for (int i = queueIdx; i < endIdx; i++)
         {
+            // Spawned by the parent => already building.
+
             int sliceID = queue[i].sliceID;
+            if (asyncIsPending(sliceID))
+                continue;
+
             int size = m_file->getSliceSize(sliceID);
             bytesTotal += size;
             if (bytesTotal > MaxPrefetchBytesTotal)
@@ -447,11 +476,11 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
 
             if (!m_file->readSliceIsReady(sliceID))
                 m_file->readSlicePrefetch(sliceID);
-            else if (!asyncIsPending(sliceID) && asyncGetNumPending() < MaxAsyncBuildSlices)
+            else if (asyncGetNumPending() < MaxAsyncBuildSlices)
             {
                 OctreeSlice* slice = new OctreeSlice;
                 m_file->readSlice(sliceID, *slice);
-                asyncBuildSlice(slice);
+                asyncBuildSlice(slice, numLevels - 1 - queue[i].level);
             }
         }
 
@@ -462,7 +491,7 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
         {
             OctreeSlice* slice = new OctreeSlice;
             m_file->readSlice(sliceID, *slice);
-            asyncBuildSlice(slice);
+            asyncBuildSlice(slice, numLevels - 1 - queue[queueIdx].level);
         }
 
         // Finish async build.
@@ -476,9 +505,16 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
         workTotal += workIn;
 
         if (level < numLevels - 1)
+        {
             for (int i = 0; i < slice->getNumChildEntries(); i++)
+            {
                 if (slice->getChildEntry(i) >= 0)
+                {
                     queue.add().sliceID = slice->getChildEntry(i);
+                    queue.getLast().level = level + 1;
+                }
+            }
+        }
 
         delete slice;
 
@@ -498,6 +534,10 @@ void BuilderBase::buildObject(int objectID, int numLevels, const Params& params,
                 "-",
                 "100%");
 
+        // Slices on the finished level will not be rewritten => defragment them.
+
+        m_file->defragment();
+
         // Move to the next level.
 
         level++;
@@ -542,7 +582,7 @@ bool BuilderBase::buildSlice(OctreeSlice* slice, F32* workIn, F32* workOut)
 
 //------------------------------------------------------------------------
 
-bool BuilderBase::asyncBuildSlice(OctreeSlice* slice)
+bool BuilderBase::asyncBuildSlice(OctreeSlice* slice, int spawnLevels)
 {
     // No data => ignore.
 
@@ -560,14 +600,15 @@ bool BuilderBase::asyncBuildSlice(OctreeSlice* slice)
     const S32* buildData = NULL;
     for (int i = 0; i < slice->getNumAttach(); i++)
         if (slice->getAttachType(i) == AttachIO::BuildDataAttach)
-            buildData = slice->getData().getPtr(slice->getAttachOfs(i));
+            buildData = slice->getAttachPtr(i);
 
     if (!buildData)
         return false;
 
     // Read build data header.
 
-    if (*buildData++ != 1) // version
+    int version = *buildData++; // version
+    if (version != 1 && version != 2)
         fail("BuilderBase: Unsupported build data version!");
 
     int objectID = *buildData++; // objectID
@@ -578,6 +619,12 @@ bool BuilderBase::asyncBuildSlice(OctreeSlice* slice)
     if (numNodes <= 0)
         return false;
 
+    // v1 has no workEstimate => every node produces at least one unit of workOut.
+
+    F32 workEstimate = (F32)numNodes;
+    if (version >= 2)
+        workEstimate = bitsToFloat(*buildData++); // workEstimate
+
     String idString = getIDString();
     FW_ASSERT(idString.getLength() == 8);
     const char* idBytes = (const char*)buildData;
@@ -600,16 +647,17 @@ bool BuilderBase::asyncBuildSlice(OctreeSlice* slice)
             m_serialState = createThreadState(0);
         else
         {
-            m_numRunning = numThreads;
-            m_threads.reset(numThreads);
             for (int i = 0; i < numThreads; i++)
             {
-                ThreadEntry& t  = m_threads[i];
-                t.builder       = this;
-                t.state         = createThreadState(i);
-                t.thread        = new Thread;
-                t.thread->start(threadFunc, &t);
+                ThreadEntry* t  = new ThreadEntry;
+                t->builder      = this;
+                t->idx          = i;
+                t->state        = createThreadState(i);
+                t->thread       = new Thread;
+                m_threads.add(t);
             }
+            for (int i = 0; i < numThreads; i++)
+                m_threads[i]->thread->start(threadFunc, m_threads[i]);
         }
     }
 
@@ -617,28 +665,32 @@ bool BuilderBase::asyncBuildSlice(OctreeSlice* slice)
 
     Task* task          = new Task;
     task->slice         = slice;
+    task->sliceID       = slice->getID();
     task->idString      = idString;
     task->buildData     = buildData;
     task->objectID      = objectID;
     task->numNodes      = numNodes;
     task->attachTypes   = m_file->getObject(task->objectID).runtimeAttachTypes;
+    task->workEstimate  = workEstimate;
+    task->spawnLevels   = (m_serialState) ? 0 : max(spawnLevels, 0);
+    task->isSpawned     = false;
 
     prepareTask(*task);
-    m_tasks.add(slice->getID(), task);
+    m_tasks.add(task->sliceID, task);
 
     // Queue task.
 
     if (m_serialState)
     {
         m_serialState->runTask(*task);
+        m_finishedLock.enter();
         m_finishedTasks.add(task);
+        m_finishedLock.leave();
     }
     else
     {
-        m_monitor.enter();
-        m_pendingTasks.add(task);
-        m_monitor.notifyAll();
-        m_monitor.leave();
+        pushTask(task, m_nextThread);
+        m_nextThread = (m_nextThread + 1) % m_threads.getSize();
     }
     return true;
 }
@@ -654,19 +706,21 @@ OctreeSlice* BuilderBase::asyncFinishSlice(bool wait, int sliceID, F32* workIn,
         return NULL;
 
     // Get finished task.
+    // Spawned tasks without a slice ID must wait for their parent.
 
     Task* task = NULL;
-    m_monitor.enter();
     for (;;)
     {
+        m_finishedLock.enter();
         for (int i = 0; i < m_finishedTasks.getSize() && !task; i++)
-            if (sliceID == -1 || m_finishedTasks[i]->slice->getID() == sliceID)
+            if (m_finishedTasks[i]->sliceID != -1 && (sliceID == -1 || m_finishedTasks[i]->sliceID == sliceID))
                 task = m_finishedTasks.remove(i);
+        m_finishedLock.leave();
+
         if (task || !wait)
             break;
-        m_monitor.wait();
+        m_finishedSem.acquire();
     }
-    m_monitor.leave();
 
     // No task => done.
 
@@ -674,8 +728,11 @@ OctreeSlice* BuilderBase::asyncFinishSlice(bool wait, int sliceID, F32* workIn,
         return NULL;
 
     // Write resulting slices to the file.
+    // Spawned children get their slice IDs here, and will be rewritten
+    // once they have been finished.
 
     OctreeSlice* slice = task->slice;
+    slice->setID(task->sliceID);
     for (int i = 0; i < task->children.getSize(); i++)
     {
         OctreeSlice& child = task->children[i];
@@ -686,6 +743,13 @@ OctreeSlice* BuilderBase::asyncFinishSlice(bool wait, int sliceID, F32* workIn,
         child.setState(OctreeFile::SliceState_Unbuilt);
         slice->setChildEntry(i, child.getID());
         m_file->writeSlice(child);
+
+        Task* spawned = (task->spawned.getSize()) ? task->spawned[i] : NULL;
+        if (spawned)
+        {
+            spawned->sliceID = child.getID();
+            m_tasks.add(spawned->sliceID, spawned);
+        }
     }
 
     m_file->writeSlice(*slice);
@@ -699,7 +763,14 @@ OctreeSlice* BuilderBase::asyncFinishSlice(bool wait, int sliceID, F32* workIn,
 
     // Remove task.
 
-    m_tasks.remove(slice->getID());
+    if (task->isSpawned)
+    {
+        m_spawnLock.enter();
+        m_numSpawned--;
+        m_spawnLock.leave();
+    }
+
+    m_tasks.remove(task->sliceID);
     delete task;
     return slice;
 }
@@ -708,38 +779,163 @@ OctreeSlice* BuilderBase::asyncFinishSlice(bool wait, int sliceID, F32* workIn,
 
 void BuilderBase::asyncAbort(void)
 {
-    m_monitor.enter();
+    // Stop the threads. Each one finishes its current task first.
+
     m_abort = true;
-    m_monitor.notifyAll();
-    while (m_numRunning)
-        m_monitor.wait();
-    m_abort = false;
-    m_monitor.leave();
+    for (int i = 0; i < m_threads.getSize(); i++)
+        m_workSem.release();
 
+    Array<Task*> tasks;
     for (int i = 0; i < m_threads.getSize(); i++)
     {
-        delete m_threads[i].state;
-        delete m_threads[i].thread;
+        ThreadEntry* t = m_threads[i];
+        delete t->thread; // joins
+        delete t->state;
+        tasks.add(t->queue);
+        delete t;
     }
 
     m_threads.clear();
+    m_abort = false;
+
+    // Drop the releases of the tasks that were never fetched.
+
+    while (m_workSem.acquire(0)) {}
     delete m_serialState;
     m_serialState = NULL;
 
-    for (int i = 0; i < m_pendingTasks.getSize(); i++)
-    {
-        delete m_pendingTasks[i]->slice;
-        delete m_pendingTasks[i];
-    }
-    for (int i = 0; i < m_finishedTasks.getSize(); i++)
+    // Delete remaining tasks, including spawned ones.
+
+    tasks.add(m_finishedTasks);
+    for (int i = 0; i < tasks.getSize(); i++)
     {
-        delete m_finishedTasks[i]->slice;
-        delete m_finishedTasks[i];
+        delete tasks[i]->slice;
+        delete tasks[i];
     }
 
     m_tasks.clear();
-    m_pendingTasks.clear();
     m_finishedTasks.clear();
+    m_nextThread = 0;
+    m_numSpawned = 0;
+}
+
+//------------------------------------------------------------------------
+
+void BuilderBase::pushTask(Task* task, int threadIdx)
+{
+    FW_ASSERT(task);
+    ThreadEntry* t = m_threads[threadIdx];
+    t->lock.enter();
+
+    int idx = t->queue.getSize();
+    while (idx > 0 && t->queue[idx - 1]->workEstimate > task->workEstimate)
+        idx--;
+    t->queue.insert(idx, task);
+
+    t->lock.leave();
+    m_workSem.release();
+}
+
+//------------------------------------------------------------------------
+
+BuilderBase::Task* BuilderBase::fetchTask(int threadIdx)
+{
+    // Own queue not empty => take the biggest task.
+
+    ThreadEntry* own = m_threads[threadIdx];
+    Task* task = NULL;
+    own->lock.enter();
+    if (own->queue.getSize())
+        task = own->queue.removeLast();
+    own->lock.leave();
+
+    // Otherwise => steal the biggest task from the other queues.
+    // The queue may have changed between the passes, so retry until
+    // all of them are empty.
+
+    while (!task && !m_abort)
+    {
+        ThreadEntry* victim = NULL;
+        F32 best = -1.0f;
+        for (int i = 1; i < m_threads.getSize(); i++)
+        {
+            ThreadEntry* t = m_threads[(threadIdx + i) % m_threads.getSize()];
+            t->lock.enter();
+            if (t->queue.getSize() && t->queue.getLast()->workEstimate > best)
+            {
+                victim = t;
+                best = t->queue.getLast()->workEstimate;
+            }
+            t->lock.leave();
+        }
+
+        if (!victim)
+            break;
+
+        victim->lock.enter();
+        if (victim->queue.getSize())
+            task = victim->queue.removeLast();
+        victim->lock.leave();
+    }
+    return task;
+}
+
+//------------------------------------------------------------------------
+
+void BuilderBase::spawnChildren(Task& task, int threadIdx)
+{
+    if (task.spawnLevels <= 0)
+        return;
+
+    // Biggest children first, as long as the limit allows.
+
+    Array<S32> order;
+    for (int i = 0; i < task.children.getSize(); i++)
+    {
+        if (!task.children[i].getSize())
+            continue;
+
+        int j = order.getSize();
+        order.add(i);
+        for (; j > 0 && task.childWork[order[j - 1]] < task.childWork[i]; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    task.spawned.reset(task.children.getSize());
+    for (int i = 0; i < task.spawned.getSize(); i++)
+        task.spawned[i] = NULL;
+
+    int maxSpawned = m_threads.getSize() * MaxSpawnedPerThread;
+    for (int i = 0; i < order.getSize(); i++)
+    {
+        m_spawnLock.enter();
+        bool ok = (m_numSpawned < maxSpawned);
+        if (ok)
+            m_numSpawned++;
+        m_spawnLock.leave();
+        if (!ok)
+            break;
+
+        // The only attachment is BuildDataAttach, see runTask().
+        // Skip version, objectID, numNodes, workEstimate and subclassIDString.
+
+        int childIdx    = order[i];
+        Task* t         = new Task;
+        t->slice        = new OctreeSlice(task.children[childIdx]);
+        t->sliceID      = -1;
+        t->idString     = task.idString;
+        t->buildData    = t->slice->getAttachPtr(0) + 6;
+        t->objectID     = task.objectID;
+        t->numNodes     = t->slice->getAttachPtr(0)[2];
+        t->attachTypes  = task.attachTypes;
+        t->workEstimate = task.childWork[childIdx];
+        t->spawnLevels  = task.spawnLevels - 1;
+        t->isSpawned    = true;
+
+        task.spawned[childIdx] = t;
+        pushTask(t, threadIdx);
+    }
 }
 
 //------------------------------------------------------------------------
@@ -772,9 +968,10 @@ bool BuilderBase::createRootSlice(OctreeSlice& slice, int objectID, const Params
     String id = getIDString();
     FW_ASSERT(id.getLength() == 8);
 
-    bitWriter.write(32, 1); // version
+    bitWriter.write(32, 2); // version
     bitWriter.write(32, objectID); // objectID
     bitWriter.write(32, 1); // numNodes
+    bitWriter.write(32, floatToBits(1.0f)); // workEstimate
     for (int i = 0; i < 8; i++)
         bitWriter.write(8, id[i]); // subclassIDString[i]
 
@@ -805,29 +1002,31 @@ void BuilderBase::threadFunc(void* param)
     FW_ASSERT(Thread::getCurrent() == entry->thread);
 
     entry->thread->setPriority(Thread::Priority_Min);
-    b->m_monitor.enter();
 
     while (!b->m_abort)
     {
-        if (!b->m_pendingTasks.getSize())
-        {
-            b->m_monitor.wait();
-            continue;
-        }
+        // Claim one queued task, whether it ends up popped or stolen.
+        // Every claim is backed by a task that is already in some queue.
+
+        b->m_workSem.acquire();
+        Task* task = NULL;
+        while (!task && !b->m_abort)
+            task = b->fetchTask(entry->idx);
+        if (!task)
+            break;
 
-        Task* task = b->m_pendingTasks.remove(0);
-        b->m_monitor.leave();
+        // Run the task and queue its children before reporting it,
+        // so that asyncFinishSlice() sees all of the spawned tasks.
 
         entry->state->runTask(*task);
+        b->spawnChildren(*task, entry->idx);
 
-        b->m_monitor.enter();
+        b->m_finishedLock.enter();
         b->m_finishedTasks.add(task);
-        b->m_monitor.notifyAll();
+        b->m_finishedLock.leave();
+        b->m_finishedSem.release();
     }
 
-    b->m_numRunning--;
-    b->m_monitor.notifyAll();
-    b->m_monitor.leave();
     popMemOwner();
 }
 
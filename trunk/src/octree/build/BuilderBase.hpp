@@ -33,6 +33,19 @@
 namespace FW
 {
 //------------------------------------------------------------------------
+// Each worker thread owns a task queue, kept sorted by the expected
+// amount of work so that the biggest slices start first. A worker takes
+// the biggest task from its own queue, and once the queue runs dry,
+// steals the biggest task that is queued anywhere.
+//
+// A task that is allowed to spawn (see asyncBuildSlice) pushes the
+// children it produced to the queue of its own worker, so the next level
+// starts right away instead of waiting for asyncFinishSlice() to write
+// the children and read them back. A spawned task gets its slice ID once
+// its parent has been finished, and only then can it be finished itself.
+// The number of spawned tasks alive at a time is limited, and the
+// children that do not fit are built from the file as usual.
+//------------------------------------------------------------------------
 
 class BuilderBase
 {
@@ -46,7 +59,8 @@ public:
         // buildObject()
         MaxPrefetchSlices       = OctreeFile::MaxPrefetchSlices,
         MaxPrefetchBytesTotal   = OctreeFile::MaxPrefetchBytesTotal,
-        MaxAsyncBuildSlices     = 8
+        MaxAsyncBuildSlices     = 8,
+        MaxSpawnedPerThread     = 4
     };
 
     enum FilterType
@@ -112,13 +126,19 @@ protected:
     struct Task
     {
         OctreeSlice*        slice;
+        S32                 sliceID;            // -1 until the parent of a spawned task has been finished
         String              idString;
         const S32*          buildData;
         S32                 objectID;
         S32                 numNodes;
         Array<AttachIO::AttachType> attachTypes;
+        F32                 workEstimate;       // workOut of the parent, numNodes for v1 build data
+        S32                 spawnLevels;        // levels of descendants to spawn
+        bool                isSpawned;          // counts towards m_numSpawned
 
         Array<OctreeSlice>  children;
+        Array<F32>          childWork;          // workOut of each child
+        Array<Task*>        spawned;            // per child, NULL if not spawned
         F32                 workIn;
         F32                 workOut;
     };
@@ -175,8 +195,11 @@ private:
     struct ThreadEntry
     {
         BuilderBase*        builder;
+        S32                 idx;
         ThreadState*        state;
         Thread*             thread;
+        Spinlock            lock;
+        Array<Task*>        queue;              // ascending workEstimate
     };
 
 public:
@@ -191,9 +214,10 @@ public:
     virtual bool            supportsConcurrency (void) const            { return false; }
 
     void                    buildObject         (int objectID, int numLevels, const Params& params, bool enablePrints = true);
+    void                    buildSlices         (const Array<S32>& sliceIDs, int numLevels, bool enablePrints = true); // existing unbuilt slices and numLevels - 1 levels below them
     bool                    buildSlice          (OctreeSlice* slice, F32* workIn = NULL, F32* workOut = NULL);
 
-    bool                    asyncBuildSlice     (OctreeSlice* slice);
+    bool                    asyncBuildSlice     (OctreeSlice* slice, int spawnLevels = 0); // takes ownership; spawn tasks for up to spawnLevels levels of children
     OctreeSlice*            asyncFinishSlice    (bool wait, int sliceID = -1, F32* workIn = NULL, F32* workOut = NULL);
     int                     asyncGetNumPending  (void) const            { return m_tasks.getSize(); }
     bool                    asyncIsPending      (int sliceID) const     { return m_tasks.contains(sliceID); }
@@ -212,6 +236,9 @@ protected:
 private:
     bool                    createRootSlice     (OctreeSlice& slice, int objectID, const Params& params);
 
+    void                    pushTask            (Task* task, int threadIdx);
+    Task*                   fetchTask           (int threadIdx);
+    void                    spawnChildren       (Task& task, int threadIdx);
     static void             threadFunc          (void* param);
 
 private:
@@ -220,28 +247,33 @@ private:
 
 private:
     OctreeFile*             m_file;
-    Monitor                 m_monitor;
     S32                     m_maxThreads;
 
-    Array<ThreadEntry>      m_threads;
+    Array<ThreadEntry*>     m_threads;
     ThreadState*            m_serialState;
-    volatile S32            m_numRunning;
     volatile bool           m_abort;
+    Semaphore               m_workSem;          // released once per queued task, acquired once per fetched task
+    S32                     m_nextThread;       // queue for the next task from asyncBuildSlice()
+
+    Spinlock                m_spawnLock;
+    S32                     m_numSpawned;       // spawned tasks that have not been finished yet
 
-    Hash<S32, Task*>        m_tasks;
-    Array<Task*>            m_pendingTasks;
+    Hash<S32, Task*>        m_tasks;            // excludes spawned tasks without a slice ID
+    Spinlock                m_finishedLock;
+    Semaphore               m_finishedSem;      // released once per finished task
     Array<Task*>            m_finishedTasks;
 };
 
 //------------------------------------------------------------------------
 /*
 
-BuildDataAttach format v1
+BuildDataAttach format v2
 -------------------------
 
-writeBits(32, version); // must be 1
+writeBits(32, version); // 2, or 1 without workEstimate
 writeBits(32, objectID);
 writeBits(32, numNodes);
+writeBits(32, floatToBits(workEstimate)); // workOut spent by the parent on this slice
 
 for (int i = 0; i < 8; i++)
     writeBits(8, subclassIDString[i]);
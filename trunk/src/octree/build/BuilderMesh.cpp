@@ -206,17 +206,12 @@ BuilderMesh::BuilderMesh(const MeshBase* foreignMesh)
     // Set globals.
 
     m_numTris = numTris;
-    m_batchLRUHead = 0;
-    m_batchLRUTail = 0;
-    m_numExpandedBatches = 0;
-    m_lockedBatches.reset(MaxThreads);
-    for (int i=0; i < MaxThreads; i++)
+    m_preExpanded = false;
+    for (int i=0; i < NumLRUShards; i++)
     {
-        LockedBatches& le = m_lockedBatches[i];
-        le.list.reset(MaxLockedBatchesPerThread);
-        le.count = 0;
-        le.head  = 0;
-        le.tail  = 0;
+        m_shards[i].head = 0;
+        m_shards[i].tail = 0;
+        m_shards[i].numExpanded = 0;
     }
 
     // Go to simple mode if few enough batches.
@@ -224,10 +219,8 @@ BuilderMesh::BuilderMesh(const MeshBase* foreignMesh)
     {
         FW::printf("BuilderMesh: Few enough batches, pre-expanding everything\n");
         for (int i=0; i < m_batches.getSize(); i++)
-        {
             expandBatch(m_batches[i]);
-            m_batches[i]->lockMask = (U32)(-1);
-        }
+        m_preExpanded = true;
     }
     popMemOwner();
 }
@@ -335,12 +328,13 @@ void BuilderMesh::constructBatch(int firstTri, int numTris)
     m_batches.add(batch);
 
     batch->expanded = false;
+    batch->index = m_batches.getSize() - 1;
     batch->numDispTris = numDispTris;
     batch->prevLRU = 0;
     batch->nextLRU = 0;
     batch->firstTri = firstTri;
     batch->numTris  = numTris;
-    batch->lockMask = 0;
+    batch->pinCount = 0;
     for (int i = 0; i < numTris; i++)
     {
         int idx = i + firstTri;
@@ -357,7 +351,7 @@ void BuilderMesh::expandBatch(Batch* batch)
     if (batch->expanded)
         return;
 
-    m_numExpandedBatches++;
+    getShard(batch).numExpanded++;
 
     pushMemOwner("BuilderMesh.expand");
     batch->expanded = true;
@@ -461,15 +455,9 @@ void BuilderMesh::collapseBatch(Batch* batch)
     if (!batch->expanded)
         return;
 
-    m_numExpandedBatches--;
-
-    // remove from LRU list
-    if (batch->prevLRU) batch->prevLRU->nextLRU = batch->nextLRU;
-    if (batch->nextLRU) batch->nextLRU->prevLRU = batch->prevLRU;
-    if (m_batchLRUHead == batch) m_batchLRUHead = batch->nextLRU;
-    if (m_batchLRUTail == batch) m_batchLRUTail = batch->prevLRU;
-    batch->prevLRU = 0;
-    batch->nextLRU = 0;
+    LRUShard& shard = getShard(batch);
+    shard.numExpanded--;
+    removeFromLRU(shard, batch);
 
     // collapse
     batch->expanded = false;
@@ -479,20 +467,36 @@ void BuilderMesh::collapseBatch(Batch* batch)
 
 //------------------------------------------------------------------------
 
+void BuilderMesh::removeFromLRU(LRUShard& shard, Batch* batch)
+{
+    if (batch->prevLRU) batch->prevLRU->nextLRU = batch->nextLRU;
+    if (batch->nextLRU) batch->nextLRU->prevLRU = batch->prevLRU;
+    if (shard.head == batch) shard.head = batch->nextLRU;
+    if (shard.tail == batch) shard.tail = batch->prevLRU;
+    batch->prevLRU = 0;
+    batch->nextLRU = 0;
+}
+
 void BuilderMesh::validateLRUList(void) const
 {
-    Batch* p = m_batchLRUHead;
-    while (p)
+    for (int i=0; i < NumLRUShards; i++)
     {
-        Batch* q = p->nextLRU;
-        if (q)
+        const LRUShard& shard = m_shards[i];
+        Batch* p = shard.head;
+        while (p)
         {
-            if (q->prevLRU != p)
-                fail("LRU list fail 1");
-        } else
-            if (p != m_batchLRUTail)
-                fail("LRU list fail 2");
-        p = q;
+            Batch* q = p->nextLRU;
+            if (q)
+            {
+                if (q->prevLRU != p)
+                    fail("LRU list fail 1");
+            } else
+                if (p != shard.tail)
+                    fail("LRU list fail 2");
+            if ((p->index & (NumLRUShards - 1)) != i || p->pinCount)
+                fail("LRU list fail 3");
+            p = q;
+        }
     }
 }
 
@@ -524,84 +528,87 @@ void BuilderMesh::validateTextures(void) const
 
 //------------------------------------------------------------------------
 
-void BuilderMesh::lockBatch(int tid, Batch* batch)
+void BuilderMesh::initPins(PinnedBatches& pins) const
 {
-    if (!batch)
-        return;
+    pins.list.reset(MaxPinnedBatchesPerThread);
+    pins.count = 0;
+    pins.head  = 0;
+    pins.tail  = 0;
+
+    // in simple mode, all batches count as pinned
+    pins.mask.reset((m_batches.getSize() + 31) >> 5);
+    for (int i=0; i < pins.mask.getSize(); i++)
+        pins.mask[i] = (m_preExpanded) ? (U32)(-1) : 0;
+}
 
-    if (batch->lockMask == 0)
-    {
-        // remove from LRU list to avoid collapse
-        if (batch->prevLRU) batch->prevLRU->nextLRU = batch->nextLRU;
-        if (batch->nextLRU) batch->nextLRU->prevLRU = batch->prevLRU;
-        if (m_batchLRUHead == batch) m_batchLRUHead = batch->nextLRU;
-        if (m_batchLRUTail == batch) m_batchLRUTail = batch->prevLRU;
-        batch->prevLRU = 0;
-        batch->nextLRU = 0;
-    }
+void BuilderMesh::releasePins(PinnedBatches& pins)
+{
+    // unpin all pinned batches
+    while (pins.count)
+        unpinBatch(pins);
+}
 
-    LockedBatches& le = m_lockedBatches[tid];
-    le.list[le.head++] = batch;
-    le.count++;
-    if (le.head == MaxLockedBatchesPerThread)
-        le.head = 0;
-    batch->lockMask |= (1<<tid);
+void BuilderMesh::pinBatch(PinnedBatches& pins, Batch* batch)
+{
+    // caller holds the shard lock; remove from LRU list to avoid collapse
+    if (batch->pinCount++ == 0)
+        removeFromLRU(getShard(batch), batch);
+
+    pins.list[pins.head++] = batch;
+    pins.count++;
+    if (pins.head == MaxPinnedBatchesPerThread)
+        pins.head = 0;
+    pins.mask[batch->index >> 5] |= 1u << (batch->index & 31);
 }
 
-void BuilderMesh::unlockBatch(int tid)
+void BuilderMesh::unpinBatch(PinnedBatches& pins)
 {
-    LockedBatches& le = m_lockedBatches[tid];
-    if (le.count == 0)
+    if (pins.count == 0)
         return;
 
-    Batch* batch = le.list[le.tail++];
-    le.count--;
-    if (le.tail == MaxLockedBatchesPerThread)
-        le.tail = 0;
+    Batch* batch = pins.list[pins.tail++];
+    pins.count--;
+    if (pins.tail == MaxPinnedBatchesPerThread)
+        pins.tail = 0;
+    pins.mask[batch->index >> 5] &= ~(1u << (batch->index & 31));
 
-    batch->lockMask &= ~(1<<tid);
-    if (batch->lockMask == 0)
+    LRUShard& shard = getShard(batch);
+    shard.lock.enter();
+    if (--batch->pinCount == 0)
     {
         // place in head of LRU list
-        batch->nextLRU = m_batchLRUHead;
-        if (m_batchLRUHead)  m_batchLRUHead->prevLRU = batch;
-        if (!m_batchLRUTail) m_batchLRUTail = batch;
-        m_batchLRUHead = batch;
+        batch->nextLRU = shard.head;
+        if (shard.head)  shard.head->prevLRU = batch;
+        if (!shard.tail) shard.tail = batch;
+        shard.head = batch;
     }
+    shard.lock.leave();
 }
 
-const BuilderMesh::Triangle& BuilderMesh::getTriProper(Batch* batch, int i, int tid)
+const BuilderMesh::Triangle& BuilderMesh::getTriProper(Batch* batch, int i, PinnedBatches& pins)
 {
-    // enter critical section, unlock currently locked batch if at limit
-    m_lock.enter();
-    if (m_lockedBatches[tid].count == MaxLockedBatchesPerThread)
-        unlockBatch(tid);
+    // unpin our oldest batch if at limit
+    if (pins.count == MaxPinnedBatchesPerThread)
+        unpinBatch(pins);
+
+    // enter critical section of the batch's shard only
+    LRUShard& shard = getShard(batch);
+    shard.lock.enter();
 
     // if our batch is not expanded, we need to expand it
     if (!batch->expanded)
     {
-        // if we're out of space, collapse the LRU batch (if any unlocked batches exist)
-        if (m_numExpandedBatches >= MaxExpandedBatches && m_batchLRUTail)
-            collapseBatch(m_batchLRUTail);
+        // if the shard is out of space, collapse its LRU batch (if any unpinned batches exist)
+        if (shard.numExpanded >= MaxExpandedBatches / NumLRUShards && shard.tail)
+            collapseBatch(shard.tail);
         // now expand our batch
         expandBatch(batch);
     }
 
-    // lock the batch for us now
-    lockBatch(tid, batch);
-    m_lock.leave();
+    // pin the batch for us now
+    pinBatch(pins, batch);
+    shard.lock.leave();
 
     // access!
     return batch->tris[i];
 }
-
-void BuilderMesh::freeThreadSlot(int tid)
-{
-    m_lock.enter();
-
-    // unlock all locked batches
-    while (m_lockedBatches[tid].count)
-        unlockBatch(tid);
-
-    m_lock.leave();
-}
@@ -39,6 +39,13 @@ namespace FW
 
 #define FW_MIN_ATTRIB_WEIGHT    1.0e-8f
 
+//------------------------------------------------------------------------
+// Triangles are expanded in batches on demand. Each accessing thread
+// pins the batches it has used recently in its own PinnedBatches, which
+// it can test without locking. Unpinned batches that are still expanded
+// go to an LRU list, split into shards by batch index so that threads
+// expanding different batches rarely contend for the same lock. A batch
+// is collapsed only by its own shard, and only when no thread pins it.
 //------------------------------------------------------------------------
 
 class BuilderMesh
@@ -47,9 +54,9 @@ public:
     enum
     {
         MaxTriangleBatchSize        = 1024,
-        MaxThreads                  = 32,       // cannot be more than 32, used in a bit mask
-        MaxLockedBatchesPerThread   = 128,
-        MaxExpandedBatches          = 1024
+        MaxPinnedBatchesPerThread   = 128,
+        MaxExpandedBatches          = 1024,
+        NumLRUShards                = 16        // must be a power of two
     };
 
     struct Triangle
@@ -86,6 +93,7 @@ private:
     struct Batch
     {
         bool                        expanded;
+        int                         index;          // in m_batches
         int                         firstTri;
         int                         numTris;
         int                         numDispTris;
@@ -93,12 +101,32 @@ private:
         Array<DisplacedTriangle>    dispTris;
         Batch*                      nextLRU;
         Batch*                      prevLRU;
-        U32                         lockMask;
+        S32                         pinCount;       // number of threads that have pinned the batch
+    };
+
+    struct LRUShard
+    {
+        Spinlock                    lock;
+        Batch*                      head;           // most recently used
+        Batch*                      tail;           // least recently used
+        S32                         numExpanded;
+    };
+
+public:
+    struct PinnedBatches // owned by one accessing thread
+    {
+        Array<Batch*>               list;           // ring buffer, oldest at tail
+        S32                         count;
+        S32                         head;
+        S32                         tail;
+        Array<U32>                  mask;           // one bit per batch
     };
 
-    void                    lockBatch           (int tid, Batch* batch);
-    void                    unlockBatch         (int tid);
-    const Triangle&         getTriProper        (Batch* batch, int i, int tid);
+private:
+    LRUShard&               getShard            (const Batch* batch)    { return m_shards[batch->index & (NumLRUShards - 1)]; }
+    void                    pinBatch            (PinnedBatches& pins, Batch* batch);
+    void                    unpinBatch          (PinnedBatches& pins);
+    const Triangle&         getTriProper        (Batch* batch, int i, PinnedBatches& pins);
 
 public:
                             BuilderMesh         (const MeshBase* foreignMesh); // acquires ownership of foreignMesh
@@ -108,22 +136,23 @@ public:
     int                     getBitsPerTri       (void) const    { return m_bitsPerTri; }
 
     int                     getNumTris          (void) const    { return m_numTris; }
-    void                    freeThreadSlot      (int tid);
-    const Triangle&         getTri              (int i, int tid)
+    void                    initPins            (PinnedBatches& pins) const;
+    void                    releasePins         (PinnedBatches& pins);
+    const Triangle&         getTri              (int i, PinnedBatches& pins)
     {
         const TriangleEntry& te = m_triMap[i];
         Batch* batch = te.batch;
         i -= batch->firstTri; // triangle index within batch
 
-        // fast path if we have locked this
-        if (batch->lockMask & (1<<tid))
+        // fast path if we have pinned this
+        if (pins.mask[batch->index >> 5] & (1u << (batch->index & 31)))
             return batch->tris[i];
 
         // hoax HOAX! not safe when running out of cache!
 //      if (batch->expanded)
 //          return batch->tris[i];
 
-        return getTriProper(batch, i, tid);
+        return getTriProper(batch, i, pins);
     }
 
 private:
@@ -132,6 +161,7 @@ private:
     void                    constructBatch      (int firstTri, int numTris);
     void                    expandBatch         (Batch* batch);
     void                    collapseBatch       (Batch* batch);
+    void                    removeFromLRU       (LRUShard& shard, Batch* batch);
     void                    validateLRUList     (void) const;
     void                    validateTextures    (void) const;
 
@@ -154,14 +184,6 @@ private:
         void    setBoundaryMask(U32 bmask) { combo &= ~7; combo |= (bmask & 7); }
     };
 
-    struct LockedBatches
-    {
-        Array<Batch*>       list;
-        int                 count;
-        int                 head;
-        int                 tail;
-    };
-
     Mesh<VertexPNT>*        m_mesh;
     Mat4f                   m_xform;            // mesh to octree space
     Mat4f                   m_octreeToObject;
@@ -173,25 +195,23 @@ private:
     Hash<const Image*, S32> m_dispHash;
     int                     m_numTris;          // total number of triangles
     Array<Batch*>           m_batches;
-    Batch*                  m_batchLRUHead;     // most recently used
-    Batch*                  m_batchLRUTail;     // least recently used
-    int                     m_numExpandedBatches;
-    mutable Spinlock        m_lock;
-    Array<LockedBatches>    m_lockedBatches;    // batches locked by each accessing thread
+    bool                    m_preExpanded;      // all batches expanded and implicitly pinned
+    LRUShard                m_shards[NumLRUShards];
     int                     m_dummy;
 };
 
 class BuilderMeshAccessor
 {
 public:
-                            BuilderMeshAccessor (const BuilderMesh* mesh, int threadIdx) : m_mesh(const_cast<BuilderMesh*>(mesh)), m_threadIdx(threadIdx) {}
-                            ~BuilderMeshAccessor(void) {}
+                            BuilderMeshAccessor (const BuilderMesh* mesh) : m_mesh(const_cast<BuilderMesh*>(mesh)) { m_mesh->initPins(m_pins); }
+                            ~BuilderMeshAccessor(void) { m_mesh->releasePins(m_pins); }
 
+    const BuilderMesh*      getMesh             (void) const    { return m_mesh; }
     const Mat4f&            getOctreeToObject   (void) const    { return m_mesh->getOctreeToObject(); }
     int                     getBitsPerTri       (void) const    { return m_mesh->getBitsPerTri(); }
 
     int                             getNumTris  (void) const    { return m_mesh->getNumTris(); }
-    const BuilderMesh::Triangle&    getTri      (int i) const   { return m_mesh->getTri(i, m_threadIdx); }
+    const BuilderMesh::Triangle&    getTri      (int i) const   { return m_mesh->getTri(i, m_pins); }
 
 private:
                             BuilderMeshAccessor (BuilderMeshAccessor&); // forbidden
@@ -199,7 +219,7 @@ private:
 
 private:
     BuilderMesh*            m_mesh;
-    int                     m_threadIdx;
+    mutable BuilderMesh::PinnedBatches m_pins;
 };
 
 //------------------------------------------------------------------------
@@ -81,11 +81,16 @@ void MeshBuilder::ThreadState::beginParentSlice(const Vec3i& cubePos, int cubeSc
     if (!mesh)
         fail("MeshBuilder: Invalid object!");
 
-    // Construct new mesh accessor.
+    // Construct new mesh accessor, unless the mesh is the same.
+    // Keeping the accessor keeps its batches pinned between tasks.
 
-    if (m_mesh)
+    if (m_mesh && m_mesh->getMesh() != mesh)
+    {
         delete m_mesh;
-    m_mesh = new BuilderMeshAccessor(mesh, m_threadIdx);
+        m_mesh = NULL;
+    }
+    if (!m_mesh)
+        m_mesh = new BuilderMeshAccessor(mesh);
 
     // Read header.
 
@@ -235,6 +240,23 @@ void MeshBuilder::ThreadState::beginParentSlice(const Vec3i& cubePos, int cubeSc
         while (readBits(1))
             m_parentAuxContours.add(readBits(32));
 
+        // Test each triangle against all child voxels at once.
+
+        if ((parentFlags & (Voxel_RefineGeometry | Voxel_RefineAttribs)) != 0)
+        {
+            Vec3f halfSize = m_voxelSize * 0.5f;
+            DeltaBoxSet boxes(halfSize);
+            for (int childIdx = 0; childIdx < 8; childIdx++)
+                boxes.add(Vec3f(getCubeChildPos(parentPos, m_nodeScale, childIdx)) + halfSize);
+
+            m_parentTriChildMasks.resize(m_parentTris.getSize());
+            for (int i = 0; i < m_parentTris.getSize(); i++)
+            {
+                const BuilderMesh::Triangle& tri = m_mesh->getTri(m_parentTris[i]);
+                m_parentTriChildMasks[i] = (U8)((tri.dispTri) ? 0xFF : isectsDeltaTriangleBoxes(tri.p, tri.pu, tri.pv, boxes));
+            }
+        }
+
         // Create each child voxel.
 
         int firstChild = numVoxels;
@@ -299,6 +321,7 @@ void MeshBuilder::ThreadState::endParentSlice(void)
 
     m_gridHash.reset();
     m_parentTris.reset();
+    m_parentTriChildMasks.reset();
 
     if (m_filter)
         m_filter->init(m_mesh, m_voxelSize, voxelCap);
@@ -532,7 +555,7 @@ void MeshBuilder::ThreadState::createVoxel(
 
         else
         {
-            if (!isectsDeltaTriangleBox(tri.p - mid, tri.pu, tri.pv, halfSize))
+            if ((m_parentTriChildMasks[triIdx] & (1 << childIdx)) == 0) // isectsDeltaTriangleBox(tri.p - mid, tri.pu, tri.pv, halfSize)
                 continue;
 
             if (tri.plo.x < lo.x || tri.phi.x > hi.x ||
@@ -1273,7 +1296,7 @@ bool MeshBuilder::createRootSlice(
 
     // Use dummy mesh accessor.
 
-    BuilderMeshAccessor* mesh = new BuilderMeshAccessor(bareMesh, 0);
+    BuilderMeshAccessor* mesh = new BuilderMeshAccessor(bareMesh);
 
     // Write header.
 
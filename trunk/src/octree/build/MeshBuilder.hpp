@@ -204,6 +204,7 @@ private:
 
         Array<S32>          m_parentTris;
         Array<S32>          m_parentDispIsect;
+        Array<U8>           m_parentTriChildMasks; // Bit per child voxel for each entry of m_parentTris.
         Array<S32>          m_parentAuxContours;
         DisplacedTriangle::Temp m_dispTemp;
     };
@@ -563,7 +563,7 @@ const S32* AttachIO::findSliceAttachData(const OctreeSlice* slice, AttachType ty
     if (slice)
         for (int i = slice->getNumAttach() - 1; i >= 0; i--)
             if (slice->getAttachType(i) == type)
-                return slice->getData().getPtr(slice->getAttachOfs(i));
+                return slice->getAttachPtr(i);
     return NULL;
 }
 
@@ -26,6 +26,8 @@
  */
 
 #include "ClusteredFile.hpp"
+#include "base/Hash.hpp"
+#include "base/Sort.hpp"
 
 #define FW_USE_ZLIB 0
 #if FW_USE_ZLIB
@@ -36,25 +38,34 @@ using namespace FW;
 
 //------------------------------------------------------------------------
 
+Spinlock ClusteredFile::s_refLock;
+
+//------------------------------------------------------------------------
+
 ClusteredFile::ClusteredFile(const String& fileName, File::Mode mode, int clusterSize, bool disableCache)
 :   m_file                  (fileName, mode, disableCache),
     m_clusterSize           (clusterSize),
     m_defaultCompression    ((Compression)DefaultCompression),
+    m_numClusters           (0),
+    m_unloadedFree          (0),
+    m_freePageCursor        (0),
     m_dirty                 (false),
 
-    m_firstCached           (NULL),
-    m_lastCached            (NULL),
-    m_cacheUsed             (0),
+    m_evictShard            (0),
     m_cacheSize             (DefaultCacheSize),
-    m_asyncBytesPending     (0)
+    m_asyncBytesPending     (0),
+    m_codecAbort            (false),
+    m_numMappedViews        (0)
 {
-    FW_ASSERT(clusterSize > 0);
+    setClusterSize(clusterSize);
 
     switch (mode)
     {
     case File::Read:
         if (!readMasterChunk())
             clearInternal();
+        else if (m_file.mapReadOnly())
+            mapChunks();
         break;
 
     case File::Create:
@@ -76,7 +87,9 @@ ClusteredFile::ClusteredFile(const String& fileName, File::Mode mode, int cluste
 
 ClusteredFile::~ClusteredFile(void)
 {
+    FW_ASSERT(!m_numMappedViews);
     flush();
+    codecStop();
     clearInternal();
 }
 
@@ -101,7 +114,7 @@ F32 ClusteredFile::getFragmentsPerChunk(void) const
                 if (cluster != prev + 1)
                     fragments++;
                 prev = cluster;
-                cluster = m_clusters[prev].next;
+                cluster = getCluster(prev).next;
             }
         }
     }
@@ -124,13 +137,48 @@ void ClusteredFile::setCompression(Compression compression)
 
 //------------------------------------------------------------------------
 
+const char* ClusteredFile::getCompressionName(Compression compression)
+{
+    switch (compression)
+    {
+    case Compression_None:          return "none";
+    case Compression_ZLibLow:       return "zlib-low";
+    case Compression_ZLibMedium:    return "zlib-medium";
+    case Compression_ZLibHigh:      return "zlib-high";
+    case Compression_LZ4:           return "lz4";
+    default:                        FW_ASSERT(false); return "";
+    }
+}
+
+//------------------------------------------------------------------------
+
+bool ClusteredFile::isCompressionSupported(Compression compression)
+{
+    switch (compression)
+    {
+    case Compression_None:
+    case Compression_LZ4:
+        return true;
+
+    case Compression_ZLibLow:
+    case Compression_ZLibMedium:
+    case Compression_ZLibHigh:
+        return (FW_USE_ZLIB != 0);
+
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------
+
 void ClusteredFile::clear(void)
 {
     if (!checkWritable())
         return;
 
     clearInternal();
-    m_clusters.add().next = FW_S32_MAX;
+    getCluster(addCluster()).next = FW_S32_MAX;
     m_file.seek(0);
     Array<U8> cluster(NULL, m_clusterSize);
     m_file.write(cluster.getPtr(), m_clusterSize);
@@ -181,15 +229,195 @@ void ClusteredFile::flush(bool clearCache)
         m_dirty = false;
     }
 
-    while (m_asyncOps.getSize())
+    asyncWaitAll();
+    cacheEvict();
+    for (int i = 0; i < NumCacheShards && clearCache; i++)
+        while (m_cacheShards[i].first)
+            cacheEvict(m_cacheShards[i].first);
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::relayout(const Array<Vec2i>& order)
+{
+    if (!checkWritable())
+        return;
+
+    // Cluster lists must be final.
+
+    asyncWaitAll();
+    loadAllPages();
+
+    // Collect chunks in the requested order, followed by the rest.
+
+    Array<Chunk*> chunks;
+    Set<Vec2i> listed;
+    for (int i = 0; i < order.getSize(); i++)
     {
-        asyncWait(m_asyncOps.getLast());
-        asyncFinish();
+        const Vec2i& id = order[i];
+        if (id.x != GroupID_Private && exists(id.x, id.y) && !listed.contains(id))
+        {
+            chunks.add(get(id.x, id.y));
+            listed.add(id);
+        }
     }
 
-    cacheEvict();
-    while (clearCache && m_firstCached)
-        cacheEvict(m_firstCached);
+    for (int i = GroupID_Default; i < getNumGroups(); i++)
+        for (int j = 0; j < getNumIDs(i); j++)
+            if (exists(i, j) && !listed.contains(Vec2i(i, j)))
+                chunks.add(get(i, j));
+
+    // Find out which chunk owns each cluster.
+
+    Array<Chunk*> owners;
+    owners.reset(m_numClusters);
+    for (int i = 0; i < owners.getSize(); i++)
+        owners[i] = NULL;
+    for (int i = 0; i < getNumGroups(); i++)
+        for (int j = 0; j < getNumIDs(i); j++)
+            if (exists(i, j))
+                setClusterOwner(owners, get(i, j), get(i, j));
+
+    // Leave room for the MasterChunk to grow without displacing the first chunk.
+
+    Chunk* master = get(GroupID_Private, PrivateChunkID_Master);
+    int cursor = (max(getMasterSize(), master->uncompressedSize) + m_clusterSize - 1) / m_clusterSize;
+
+    // Place chunks one after another.
+
+    for (int i = 0; i < chunks.getSize() && !hasError(); i++)
+    {
+        Chunk* c = chunks[i];
+        int numClusters = getNumClusters(c);
+
+        // Already in place => skip.
+
+        int cluster = c->firstCluster;
+        int idx = 0;
+        while (cluster == cursor + idx)
+        {
+            cluster = getCluster(cluster).next;
+            idx++;
+        }
+
+        if (cluster == FW_S32_MAX && idx == numClusters)
+        {
+            cursor += numClusters;
+            continue;
+        }
+
+        // Move other chunks out of the way, to the end of the file.
+
+        for (int j = cursor; j < cursor + numClusters && j < owners.getSize(); j++)
+        {
+            Chunk* other = owners[j];
+            if (!other || other == c)
+                continue;
+
+            setClusterOwner(owners, other, NULL);
+            relocateChunk(other, m_numClusters);
+            setClusterOwner(owners, other, other);
+            cacheEvict();
+        }
+
+        // Move the chunk.
+
+        setClusterOwner(owners, c, NULL);
+        relocateChunk(c, cursor);
+        setClusterOwner(owners, c, c);
+        cacheEvict();
+        cursor += numClusters;
+    }
+
+    // Drop free clusters from the end of the file.
+
+    asyncWaitAll();
+    while (m_numClusters && getCluster(m_numClusters - 1).next == -1)
+        removeLastCluster();
+    m_file.setSize((S64)m_numClusters * m_clusterSize);
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------
+
+int ClusteredFile::defragment(F32 maxFragmentsPerChunk, S64 maxBytes)
+{
+    struct Entry
+    {
+        S32     fragments;
+        Chunk*  chunk;
+    };
+
+    if (!checkWritable() || getFragmentsPerChunk() <= maxFragmentsPerChunk)
+        return 0;
+
+    // Cluster lists must be final.
+
+    asyncFinishCompress();
+    loadAllPages();
+
+    // Collect fragmented chunks, most fragmented first.
+
+    Array<Entry> entries;
+    for (int i = GroupID_Default; i < getNumGroups(); i++)
+    {
+        for (int j = 0; j < getNumIDs(i); j++)
+        {
+            if (!exists(i, j))
+                continue;
+
+            int fragments = 0;
+            int cluster = get(i, j)->firstCluster;
+            while (getCluster(cluster).next != FW_S32_MAX)
+            {
+                if (getCluster(cluster).next != cluster + 1)
+                    fragments++;
+                cluster = getCluster(cluster).next;
+            }
+
+            if (fragments)
+            {
+                Entry& e = entries.add();
+                e.fragments = fragments;
+                e.chunk = get(i, j);
+            }
+        }
+    }
+    FW_SORT_ARRAY(entries, Entry, a.fragments > b.fragments);
+
+    // Move each chunk to the first run of free clusters that is long
+    // enough, or to the end of the file.
+
+    S64 bytesMoved = 0;
+    int numMoved = 0;
+    for (int i = 0; i < entries.getSize() && !hasError(); i++)
+    {
+        Chunk* c = entries[i].chunk;
+        int numClusters = getNumClusters(c);
+        if (numMoved && bytesMoved + (S64)numClusters * m_clusterSize > maxBytes)
+            break;
+
+        int first = m_numClusters;
+        int runStart = 0;
+        for (int j = 0; j < m_numClusters; j++)
+        {
+            if (getCluster(j).next != -1)
+                runStart = j + 1;
+            else if (j - runStart + 1 == numClusters)
+            {
+                first = runStart;
+                break;
+            }
+        }
+
+        relocateChunk(c, first);
+        cacheEvict();
+        bytesMoved += (S64)numClusters * m_clusterSize;
+        numMoved++;
+    }
+
+    m_dirty = true;
+    return numMoved;
 }
 
 //------------------------------------------------------------------------
@@ -209,7 +437,11 @@ int ClusteredFile::getFreeID(int groupID) const
     if (groupID >= m_groups.getSize())
         return 0;
 
+    // The free list only covers loaded ChunkInfo pages.
+
     const Group* g = m_groups[groupID];
+    for (int i = 0; i < g->pages.getSize() && i * m_chunksPerPage < g->chunks.getSize(); i++)
+        loadChunkPage(m_groups[groupID], i);
     return (g->firstFree) ? g->firstFree->id : g->chunks.getSize();
 }
 
@@ -247,7 +479,12 @@ int ClusteredFile::getSizeOnDisk(int groupID, int chunkID)
 {
     int size = 0;
     if (getSize(groupID, chunkID))
+    {
+        m_ioLock.enter();
+        asyncFinishCompress(get(groupID, chunkID));
         size = get(groupID, chunkID)->compressedSize;
+        m_ioLock.leave();
+    }
     return ((max(size, 1) + m_clusterSize - 1) / m_clusterSize) * m_clusterSize;
 }
 
@@ -263,8 +500,46 @@ void ClusteredFile::read(int groupID, int chunkID, void* data, int size)
     if (!size)
         return;
 
-    memcpy(data, cacheRead(get(groupID, chunkID), size), size);
+    Chunk* c = get(groupID, chunkID);
+    if (cacheReadFast(c, data, size))
+        return;
+
+    m_ioLock.enter();
+    memcpy(data, cacheRead(c, size), size);
+    cacheEvict();
+    m_ioLock.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::readView(int groupID, int chunkID, View& view)
+{
+    FW_ASSERT(groupID >= 0 && chunkID >= 0);
+    view.reset();
+
+    int size = getSize(groupID, chunkID);
+    if (!size)
+        return;
+
+    Chunk* c = get(groupID, chunkID);
+    if (cacheReadFast(c, NULL, size, &view))
+        return;
+
+    // Reference the buffer before cacheEvict() gets a chance to free it.
+
+    m_ioLock.enter();
+    cacheRead(c, size);
+    setView(view, c);
     cacheEvict();
+    m_ioLock.leave();
+}
+
+//------------------------------------------------------------------------
+
+const void* ClusteredFile::readMapped(int groupID, int chunkID) const
+{
+    FW_ASSERT(groupID >= 0 && chunkID >= 0);
+    return (exists(groupID, chunkID)) ? get(groupID, chunkID)->mappedData : NULL;
 }
 
 //------------------------------------------------------------------------
@@ -278,8 +553,14 @@ void ClusteredFile::readPrefetch(int groupID, int chunkID, int size)
     if (!size)
         return;
 
-    cacheReadPrefetch(get(groupID, chunkID), size);
+    Chunk* c = get(groupID, chunkID);
+    if (cacheReadFast(c, NULL, size))
+        return;
+
+    m_ioLock.enter();
+    cacheReadPrefetch(c, size);
     cacheEvict();
+    m_ioLock.leave();
 }
 
 //------------------------------------------------------------------------
@@ -293,8 +574,14 @@ bool ClusteredFile::readIsReady(int groupID, int chunkID, int size)
     if (!size)
         return true;
 
-    bool ready = cacheReadIsReady(get(groupID, chunkID), size);
+    Chunk* c = get(groupID, chunkID);
+    if (cacheReadFast(c, NULL, size))
+        return true;
+
+    m_ioLock.enter();
+    bool ready = cacheReadIsReady(c, size);
     cacheEvict();
+    m_ioLock.leave();
     return ready;
 }
 
@@ -424,11 +711,8 @@ void ClusteredFile::move(int dstGroupID, int dstChunkID, int srcGroupID, int src
 
     if (src->cachedData.size)
     {
-        dst->cachedData = src->cachedData;
-        dst->cachedDataCompressed = src->cachedDataCompressed;
-        initBuffer(src->cachedData);
-        removeChunkFromList(src, m_firstCached, m_lastCached);
-        addChunkToList(dst, m_firstCached, m_lastCached);
+        bool compressed = src->cachedDataCompressed;
+        cacheInsert(dst, cacheRemove(src), compressed);
     }
 
     if (src->asyncOp)
@@ -461,9 +745,10 @@ void ClusteredFile::allocBuffer(Buffer& buffer, int size)
     pushMemOwner("ClusteredFile buffers");
     buffer.size  = max(size, 1) + m_clusterSize - 1;
     buffer.size -= buffer.size % m_clusterSize;
-    buffer.base  = (U8*)malloc(buffer.size + m_clusterSize - 1);
-    buffer.ptr   = buffer.base + m_clusterSize - 1;
+    buffer.base  = (U8*)malloc(buffer.size + sizeof(BufferHeader) + m_clusterSize - 1);
+    buffer.ptr   = buffer.base + sizeof(BufferHeader) + m_clusterSize - 1;
     buffer.ptr  -= (UPTR)buffer.ptr % (UPTR)m_clusterSize;
+    ((BufferHeader*)buffer.base)->refCount = 1;
     popMemOwner();
 }
 
@@ -471,27 +756,127 @@ void ClusteredFile::allocBuffer(Buffer& buffer, int size)
 
 void ClusteredFile::freeBuffer(Buffer& buffer)
 {
-    free(buffer.base);
+    // Still referenced by a View => let the View free it.
+
+    if (buffer.base)
+    {
+        s_refLock.enter();
+        bool last = (--((BufferHeader*)buffer.base)->refCount == 0);
+        s_refLock.leave();
+
+        if (last)
+            free(buffer.base);
+    }
     initBuffer(buffer);
 }
 
 //------------------------------------------------------------------------
 
+void ClusteredFile::setView(View& view, const Chunk* c) const
+{
+    FW_ASSERT(!view.m_ptr);
+    FW_ASSERT(c && (c->mappedData || (c->cachedData.size >= c->uncompressedSize && !c->cachedDataCompressed)));
+
+    s_refLock.enter();
+    if (c->mappedData)
+    {
+        view.m_file = this;
+        view.m_ptr = c->mappedData;
+        m_numMappedViews++;
+    }
+    else
+    {
+        view.m_buffer = c->cachedData.base;
+        view.m_ptr = c->cachedData.ptr;
+        ((BufferHeader*)view.m_buffer)->refCount++;
+    }
+    view.m_size = c->uncompressedSize;
+    s_refLock.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::View::reset(void)
+{
+    if (m_file || m_buffer)
+    {
+        s_refLock.enter();
+        if (m_file)
+            m_file->m_numMappedViews--;
+        bool last = (m_buffer && --((BufferHeader*)m_buffer)->refCount == 0);
+        s_refLock.leave();
+
+        if (last)
+            free(m_buffer);
+    }
+    init();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::View::set(const View& other)
+{
+    if (&other == this)
+        return;
+
+    if (other.m_file || other.m_buffer)
+    {
+        s_refLock.enter();
+        if (other.m_file)
+            other.m_file->m_numMappedViews++;
+        if (other.m_buffer)
+            ((BufferHeader*)other.m_buffer)->refCount++;
+        s_refLock.leave();
+    }
+
+    reset();
+    m_file   = other.m_file;
+    m_buffer = other.m_buffer;
+    m_ptr    = other.m_ptr;
+    m_size   = other.m_size;
+}
+
+//------------------------------------------------------------------------
+
 void ClusteredFile::clearInternal(void)
 {
     m_freeClusters.reset();
-    m_clusters.reset();
+    for (int i = 0; i < m_clusterPages.getSize(); i++)
+        delete m_clusterPages[i];
+    m_clusterPages.reset();
+    m_numClusters = 0;
+    m_unloadedFree = 0;
+    m_freePageCursor = 0;
+
     for (int i = 0; i < m_groups.getSize(); i++)
     {
         Group* g = m_groups[i];
         for (int j = 0; j < g->chunks.getSize(); j++)
         {
-            cacheEvict(g->chunks[j]);
-            delete g->chunks[j];
+            if (g->chunks[j])
+            {
+                cacheEvict(g->chunks[j]);
+                delete g->chunks[j];
+            }
         }
+        for (int j = 0; j < g->pages.getSize(); j++)
+            delete g->pages[j];
         delete g;
     }
     m_groups.reset();
+
+    m_journalIndex.reset();
+    m_journalData.reset();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::setClusterSize(int clusterSize)
+{
+    FW_ASSERT(clusterSize >= MinClusterSize);
+    m_clusterSize       = clusterSize;
+    m_clustersPerPage   = clusterSize / (int)sizeof(S32);
+    m_chunksPerPage     = clusterSize / (int)(4 * sizeof(S32));
 }
 
 //------------------------------------------------------------------------
@@ -501,6 +886,143 @@ bool ClusteredFile::readMasterChunk(void)
     if (!m_file.getSize())
         return false;
 
+    // Finish or load the journal of an interrupted flush().
+
+    readJournal();
+
+    // MasterHeader. Version 2 files are read as a whole.
+
+    S32 header[7];
+    const S32* journaled = m_journalIndex.search(0);
+    if (journaled)
+        memcpy(header, m_journalData.getPtr(*journaled), sizeof(header));
+    else
+    {
+        m_file.seek(0);
+        m_file.readFully(header, sizeof(header));
+    }
+
+    if (hasError() || memcmp(header, "Clusters", 8) != 0)
+        setError("Not a clustered file!");
+    else if (header[2] == 2)
+        return readMasterChunkV2();
+    else if (header[2] != 3)
+        setError("Unsupported clustered file version!");
+
+    S32 numClusters         = header[3];
+    S32 clusterSize         = header[4];
+    S32 numGroups           = header[5];
+    S32 defaultCompression  = header[6];
+    if (!hasError() && (numClusters <= 0 || clusterSize < MinClusterSize || numGroups <= GroupID_Private || defaultCompression < 0 || defaultCompression >= Compression_Max))
+        setError("Corrupt master header!");
+
+    if (hasError())
+        return false;
+    setClusterSize(clusterSize);
+
+    // Read the rest of the MasterChunk. Its size depends on the array of GroupInfo.
+
+    int numClusterPages = (numClusters + m_clustersPerPage - 1) / m_clustersPerPage;
+    S64 masterSize = (S64)(7 + numGroups + numClusterPages * 2) * sizeof(S32);
+    Array<U8> data;
+    for (bool sized = false;; sized = true)
+    {
+        if (masterSize > (S64)numClusters * m_clusterSize)
+        {
+            setError("Corrupt master chunk!");
+            return false;
+        }
+
+        while (data.getSize() < masterSize)
+        {
+            int cluster = data.getSize() / m_clusterSize;
+            readIndexCluster(cluster, data.add(NULL, m_clusterSize));
+        }
+
+        if (sized || hasError())
+            break;
+
+        const S32* groupInfo = (const S32*)data.getPtr() + 7;
+        for (int i = GroupID_Default; i < numGroups; i++)
+            masterSize += (S64)((max(groupInfo[i], 0) + m_chunksPerPage - 1) / m_chunksPerPage) * sizeof(S32);
+    }
+
+    const S32* ptr = (const S32*)data.getPtr() + 7;
+    const S32* groupInfo = ptr;
+    ptr += numGroups;
+    int masterClusters = (int)((masterSize + m_clusterSize - 1) / m_clusterSize);
+    m_numClusters = numClusters;
+
+    // Array of ClusterPageInfo.
+
+    for (int i = 0; i < numClusterPages && !hasError(); i++)
+    {
+        IndexPage* p    = m_clusterPages.add(new IndexPage);
+        p->cluster      = *ptr++;
+        p->numFree      = *ptr++;
+        m_unloadedFree += p->numFree;
+
+        if (p->cluster < masterClusters || p->cluster >= numClusters || p->numFree < 0 || p->numFree > m_clustersPerPage)
+            setError("Corrupt index page info!");
+    }
+
+    // Array of ChunkPageInfo for each group. The ChunkInfo of
+    // MasterChunk and IndexChunk is implied.
+
+    for (int i = 0; i < numGroups && !hasError(); i++)
+    {
+        Group* g        = m_groups.add(new Group);
+        g->id           = i;
+        g->firstFree    = NULL;
+        g->lastFree     = NULL;
+
+        if (groupInfo[i] < 0 || (i == GroupID_Private && groupInfo[i] != PrivateChunkID_Index + 1))
+        {
+            setError("Corrupt group info!");
+            break;
+        }
+
+        g->chunks.reset(groupInfo[i]);
+        for (int j = 0; j < g->chunks.getSize(); j++)
+            g->chunks[j] = NULL;
+
+        for (int j = 0; j * m_chunksPerPage < g->chunks.getSize() && i != GroupID_Private; j++)
+        {
+            IndexPage* p = g->pages.add(new IndexPage);
+            p->cluster = *ptr++;
+            if (p->cluster < masterClusters || p->cluster >= numClusters)
+                setError("Corrupt index page info!");
+        }
+    }
+
+    if (hasError())
+        return false;
+
+    // MasterChunk and IndexChunk.
+
+    Group* g                    = m_groups[GroupID_Private];
+    Chunk* master               = g->chunks[PrivateChunkID_Master] = allocChunk(g, PrivateChunkID_Master);
+    master->firstCluster        = 0;
+    master->compressedSize      = (S32)masterSize;
+    master->uncompressedSize    = (S32)masterSize;
+
+    Array<IndexPage*> pages;
+    getIndexPages(pages);
+    Chunk* index                = g->chunks[PrivateChunkID_Index] = allocChunk(g, PrivateChunkID_Index);
+    index->firstCluster         = pages[0]->cluster;
+    index->compressedSize       = pages.getSize() * m_clusterSize;
+    index->uncompressedSize     = pages.getSize() * m_clusterSize;
+
+    // Set rest of the members.
+
+    m_defaultCompression = (Compression)defaultCompression;
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+bool ClusteredFile::readMasterChunkV2(void)
+{
     m_file.seek(0);
     BufferedInputStream in(m_file);
 
@@ -519,8 +1041,10 @@ bool ClusteredFile::readMasterChunk(void)
 
     S32 numClusters, clusterSize, numChunks, defaultCompression;
     in >> numClusters >> clusterSize >> numChunks >> defaultCompression;
-    if (numClusters < 0 || clusterSize <= 0 || numChunks < 0 || defaultCompression < 0 || defaultCompression >= Compression_Max)
+    if (numClusters < 0 || clusterSize < MinClusterSize || numChunks < 0 || defaultCompression < 0 || defaultCompression >= Compression_Max)
         setError("Corrupt master header!");
+    else
+        setClusterSize(clusterSize);
 
     // Array of ChunkInfo.
 
@@ -553,11 +1077,11 @@ bool ClusteredFile::readMasterChunk(void)
 
     if (!hasError())
     {
-        m_clusters.reset(numClusters);
         for (int i = 0; i < numClusters; i++)
         {
-            in >> m_clusters[i].next;
-            if (m_clusters[i].next == -1)
+            Cluster& c = getCluster(addCluster());
+            in >> c.next;
+            if (c.next == -1)
                 m_freeClusters.add(i, i);
         }
     }
@@ -574,7 +1098,7 @@ bool ClusteredFile::readMasterChunk(void)
 
         int masterClusters = (master->uncompressedSize + clusterSize - 1) / clusterSize;
         for (int i = 0; i < masterClusters; i++)
-            if (i >= numClusters || m_clusters[i].next != ((i < masterClusters - 1) ? i + 1 : FW_S32_MAX))
+            if (i >= numClusters || getCluster(i).next != ((i < masterClusters - 1) ? i + 1 : FW_S32_MAX))
                 setError("Corrupt master chunk!");
     }
 
@@ -585,7 +1109,6 @@ bool ClusteredFile::readMasterChunk(void)
 
     // Set rest of the members.
 
-    m_clusterSize = clusterSize;
     m_defaultCompression = (Compression)defaultCompression;
     return true;
 }
@@ -594,80 +1117,81 @@ bool ClusteredFile::readMasterChunk(void)
 
 void ClusteredFile::writeMasterChunk(void)
 {
+    // Chunk sizes and cluster lists must be final, and the chunks must
+    // be on disk before the index refers to them.
+
+    asyncWaitAll();
+
     // Get the previous MasterChunk.
 
     FW_ASSERT(exists(GroupID_Private, PrivateChunkID_Master));
     Chunk* master = get(GroupID_Private, PrivateChunkID_Master);
     FW_ASSERT(master->firstCluster == 0);
     int masterClusters = (master->uncompressedSize + m_clusterSize - 1) / m_clusterSize;
-    FW_ASSERT(masterClusters <= m_clusters.getSize());
+    FW_ASSERT(masterClusters <= m_numClusters);
 
-    // Calculate current MasterChunk size.
+    // Place the index pages and grow the MasterChunk until it fits.
+    // Both may add clusters, which in turn may add ClusterInfo pages.
 
-    int numChunks = 0;
-    for (int i = 0; i < m_groups.getSize(); i++)
-        for (int j = 0; j < m_groups[i]->chunks.getSize(); j++)
-            if (get(i, j)->firstCluster != -1)
-                numChunks++;
-    master->uncompressedSize = (7 + numChunks * 6 + m_clusters.getSize()) * sizeof(S32);
+    for (;;)
+    {
+        updateIndexChunk();
+        master->uncompressedSize = getMasterSize();
+        if (master->uncompressedSize <= masterClusters * m_clusterSize)
+            break;
 
-    // MasterChunk has grown => allocate additional clusters.
+        // Free cluster => allocate.
 
-    if (master->uncompressedSize > masterClusters * m_clusterSize)
-    {
-        Array<Backlink> backlinks;
-        gatherBacklinks(backlinks);
-        for (; master->uncompressedSize > masterClusters * m_clusterSize; masterClusters++)
+        if (masterClusters < m_numClusters && getCluster(masterClusters).next == -1)
         {
-            // Free cluster => allocate.
+            m_freeClusters.remove(masterClusters);
+            getCluster(masterClusters).next = FW_S32_MAX;
+            masterClusters++;
+            continue;
+        }
 
-            if (masterClusters < m_clusters.getSize() && m_clusters[masterClusters].next == -1)
-            {
-                m_freeClusters.remove(masterClusters);
-                continue;
-            }
+        // Allocate a new cluster.
 
-            // Allocate a new cluster.
+        Array<Backlink> backlinks;
+        gatherBacklinks(backlinks);
 
-            int free;
-            if (!m_freeClusters.isEmpty())
-                free = m_freeClusters.removeMin();
-            else
-            {
-                free = m_clusters.getSize();
-                m_clusters.add();
-                master->uncompressedSize += sizeof(S32);
-                backlinks.add();
-            }
+        int free;
+        if (!m_freeClusters.isEmpty())
+            free = m_freeClusters.removeMin();
+        else
+        {
+            free = addCluster();
+            backlinks.add();
+        }
 
-            // Move the offending cluster.
+        // Move the offending cluster.
 
-            Array<U8> clusterData(NULL, m_clusterSize);
+        Array<U8> clusterData(NULL, m_clusterSize);
 
-            if (free == masterClusters)
-                memset(clusterData.getPtr(), 0, m_clusterSize);
+        if (free == masterClusters)
+            memset(clusterData.getPtr(), 0, m_clusterSize);
+        else
+        {
+            FW_ASSERT(getCluster(masterClusters).next >= 0);
+            m_file.seek((S64)masterClusters * m_clusterSize);
+            m_file.readFully(clusterData.getPtr(), m_clusterSize);
+
+            const Backlink& bl = backlinks[masterClusters];
+            if (bl.cluster == -1)
+                bl.chunk->firstCluster = free;
             else
-            {
-                FW_ASSERT(m_clusters[masterClusters].next >= 0);
-                m_file.seek((S64)masterClusters * m_clusterSize);
-                m_file.readFully(clusterData.getPtr(), m_clusterSize);
+                getCluster(bl.cluster).next = free;
+            getCluster(free).next = getCluster(masterClusters).next;
+        }
 
-                const Backlink& bl = backlinks[masterClusters];
-                if (bl.cluster == -1)
-                    bl.chunk->firstCluster = free;
-                else
-                    m_clusters[bl.cluster].next = free;
-                backlinks[free] = backlinks[masterClusters];
+        m_file.seek((S64)free * m_clusterSize);
+        m_file.write(clusterData.getPtr(), m_clusterSize);
+        getCluster(masterClusters).next = FW_S32_MAX;
+        masterClusters++;
 
-                int next = m_clusters[masterClusters].next;
-                m_clusters[free].next = next;
-                if (next != FW_S32_MAX)
-                    backlinks[next].cluster = free;
-            }
+        // The cluster may have held an index page.
 
-            m_file.seek((S64)free * m_clusterSize);
-            m_file.write(clusterData.getPtr(), m_clusterSize);
-        }
+        assignIndexClusters();
     }
 
     // MasterChunk has shrunk => free unused clusters.
@@ -675,7 +1199,7 @@ void ClusteredFile::writeMasterChunk(void)
     while (master->uncompressedSize <= (masterClusters - 1) * m_clusterSize)
     {
         masterClusters--;
-        m_clusters[masterClusters].next = -1;
+        getCluster(masterClusters).next = -1;
         m_freeClusters.add(masterClusters, masterClusters);
     }
 
@@ -683,44 +1207,113 @@ void ClusteredFile::writeMasterChunk(void)
 
     master->compressedSize = master->uncompressedSize;
     for (int i = 0; i < masterClusters - 1; i++)
-        m_clusters[i].next = i + 1;
-    m_clusters[masterClusters - 1].next = FW_S32_MAX;
+        getCluster(i).next = i + 1;
+    getCluster(masterClusters - 1).next = FW_S32_MAX;
+
+    // Collect the index pages that have changed. Pages that were never
+    // loaded cannot have changed.
+
+    Array<S32> clusters;
+    Array<U8> data;
+    Array<U8> contents(NULL, m_clusterSize);
+
+    for (int i = 0; i < m_clusterPages.getSize(); i++)
+    {
+        if (m_clusterPages[i]->loaded)
+        {
+            serializeClusterPage(contents.getPtr(), i);
+            stageIndexPage(m_clusterPages[i], contents, clusters, data);
+        }
+    }
+
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+    {
+        Group* g = m_groups[i];
+        for (int j = 0; j < g->pages.getSize(); j++)
+        {
+            if (g->pages[j]->loaded)
+            {
+                serializeChunkPage(contents.getPtr(), g, j);
+                stageIndexPage(g->pages[j], contents, clusters, data);
+            }
+        }
+    }
 
     // MasterHeader.
 
-    m_file.seek(0);
-    BufferedOutputStream out(m_file);
+    MemoryOutputStream out(masterClusters * m_clusterSize);
     out.write("Clusters", 8);
-    out << (S32)2 << m_clusters.getSize() << m_clusterSize << (S32)numChunks << (S32)m_defaultCompression;
+    out << (S32)3 << m_numClusters << m_clusterSize << (S32)m_groups.getSize() << (S32)m_defaultCompression;
 
-    // Array of ChunkInfo.
+    // Array of GroupInfo.
 
     for (int i = 0; i < m_groups.getSize(); i++)
+        out << (S32)m_groups[i]->chunks.getSize();
+
+    // Array of ClusterPageInfo.
+
+    for (int i = 0; i < m_clusterPages.getSize(); i++)
     {
-        for (int j = 0; j < m_groups[i]->chunks.getSize(); j++)
+        const IndexPage* p = m_clusterPages[i];
+        S32 numFree = p->numFree;
+        if (p->loaded)
         {
-            const Chunk* chunk = get(i, j);
-            if (chunk->firstCluster != -1)
-                out << (S32)i << (S32)j << chunk->firstCluster << (S32)chunk->compression << chunk->compressedSize << chunk->uncompressedSize;
+            numFree = 0;
+            for (int j = i * m_clustersPerPage; j < min((i + 1) * m_clustersPerPage, m_numClusters); j++)
+                if (p->clusters[j - i * m_clustersPerPage].next == -1)
+                    numFree++;
         }
+        out << p->cluster << numFree;
     }
 
-    // Array of ClusterInfo.
+    // Array of ChunkPageInfo for each group.
 
-    for (int i = 0; i < m_clusters.getSize(); i++)
-        out << m_clusters[i].next;
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+        for (int j = 0; j < m_groups[i]->pages.getSize(); j++)
+            out << m_groups[i]->pages[j]->cluster;
 
-    // Flush MasterChunk.
+    // Pad MasterChunk to whole clusters.
 
-    out.flush();
-    FW_ASSERT(hasError() || m_file.getOffset() == master->uncompressedSize);
+    Array<U8>& masterData = out.getData();
+    FW_ASSERT(masterData.getSize() == master->uncompressedSize);
+    masterData.resize(masterClusters * m_clusterSize);
+    memset(masterData.getPtr(master->uncompressedSize), 0, masterData.getSize() - master->uncompressedSize);
+
+    for (int i = 0; i < masterClusters; i++)
+        clusters.add(i);
+    data.add(masterData);
+
+    // Write the journal, then the same clusters in place.
+
+    writeJournal(clusters, data);
+    for (int i = 0; i < clusters.getSize(); i++)
+    {
+        m_file.seek((S64)clusters[i] * m_clusterSize);
+        m_file.write(data.getPtr(i * m_clusterSize), m_clusterSize);
+    }
+
+    // The in-place writes must reach the disk before the journal is dropped.
+    // The caller flushes the truncation.
+
+    m_file.flush();
+    m_file.setSize((S64)m_numClusters * m_clusterSize);
+}
+
+//------------------------------------------------------------------------
+
+int ClusteredFile::getMasterSize(void) const
+{
+    int size = 7 + m_groups.getSize() + (m_numClusters + m_clustersPerPage - 1) / m_clustersPerPage * 2;
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+        size += (m_groups[i]->chunks.getSize() + m_chunksPerPage - 1) / m_chunksPerPage;
+    return size * (int)sizeof(S32);
 }
 
 //------------------------------------------------------------------------
 
 void ClusteredFile::gatherBacklinks(Array<Backlink>& backlinks)
 {
-    backlinks.reset(m_clusters.getSize());
+    backlinks.reset(m_numClusters);
     for (int i = 0; i < m_groups.getSize(); i++)
     {
         for (int j = 0; j < m_groups[i]->chunks.getSize(); j++)
@@ -728,12 +1321,12 @@ void ClusteredFile::gatherBacklinks(Array<Backlink>& backlinks)
             int prev = -1;
             Chunk* chunk = get(i, j);
             int cluster = chunk->firstCluster;
-            while (cluster != FW_S32_MAX)
+            while (cluster != -1 && cluster != FW_S32_MAX)
             {
                 backlinks[cluster].cluster  = prev;
                 backlinks[cluster].chunk    = (prev == -1) ? chunk : NULL;
                 prev                        = cluster;
-                cluster                     = m_clusters[prev].next;
+                cluster                     = getCluster(prev).next;
             }
         }
     }
@@ -741,6 +1334,496 @@ void ClusteredFile::gatherBacklinks(Array<Backlink>& backlinks)
 
 //------------------------------------------------------------------------
 
+void ClusteredFile::mapChunks(void)
+{
+    for (int i = 0; i < m_groups.getSize(); i++)
+        for (int j = 0; j < m_groups[i]->chunks.getSize(); j++)
+            if (m_groups[i]->chunks[j])
+                mapChunk(m_groups[i]->chunks[j]);
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::mapChunk(Chunk* c) const
+{
+    const U8* base = m_file.getMappedPtr();
+    FW_ASSERT(base && c);
+
+    if (c->firstCluster < 0 || c->compression != Compression_None || !c->uncompressedSize)
+        return;
+
+    // Consecutive clusters that lie entirely within the file?
+
+    int numClusters = (c->uncompressedSize + m_clusterSize - 1) / m_clusterSize;
+    int cluster = c->firstCluster;
+    for (int k = 1; k < numClusters && cluster != FW_S32_MAX; k++)
+        cluster = (getCluster(cluster).next == cluster + 1) ? cluster + 1 : FW_S32_MAX;
+
+    S64 ofs = (S64)c->firstCluster * m_clusterSize;
+    if (cluster != FW_S32_MAX && ofs + c->uncompressedSize <= m_file.getSize())
+        c->mappedData = base + ofs;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::readJournal(void)
+{
+    // JournalTrailer.
+
+    S64 fileSize = m_file.getSize();
+    if (fileSize < JournalTrailerSize)
+        return;
+
+    S32 trailer[JournalTrailerSize / sizeof(S32)];
+    m_file.seek(fileSize - JournalTrailerSize);
+    m_file.readFully(trailer, JournalTrailerSize);
+
+    S32 clusterSize = trailer[2];
+    S32 numEntries = trailer[3];
+    S64 journalSize = (S64)numEntries * (clusterSize + sizeof(S32)) + JournalTrailerSize;
+    if (hasError() || memcmp(trailer, "Journal!", 8) != 0 || clusterSize < MinClusterSize || numEntries <= 0 ||
+        journalSize > fileSize || (S64)numEntries * clusterSize > FW_S32_MAX)
+    {
+        return;
+    }
+
+    // Entries. A mismatching checksum means that the journal itself was
+    // interrupted, and nothing was modified in place.
+
+    S64 journalOfs = fileSize - journalSize;
+    Array<U8> data(NULL, numEntries * clusterSize);
+    Array<S32> clusters(NULL, numEntries);
+    m_file.seek(journalOfs);
+    m_file.readFully(data.getPtr(), data.getNumBytes());
+    m_file.readFully(clusters.getPtr(), clusters.getNumBytes());
+
+    U32 checksum = hashArray(clusters.getPtr(), clusters.getSize());
+    for (int i = 0; i < numEntries; i++)
+        checksum = hashBits(checksum, hashBuffer(data.getPtr(i * clusterSize), clusterSize));
+
+    if (hasError() || checksum != (U32)trailer[4])
+        return;
+
+    for (int i = 0; i < numEntries; i++)
+        if (clusters[i] < 0 || (S64)(clusters[i] + 1) * clusterSize > journalOfs)
+            return;
+
+    // Read-only => serve the journaled clusters from memory.
+
+    if (m_file.getMode() == File::Read)
+    {
+        m_journalData = data;
+        for (int i = 0; i < numEntries; i++)
+            if (!m_journalIndex.contains(clusters[i]))
+                m_journalIndex.add(clusters[i], i * clusterSize);
+        return;
+    }
+
+    // Otherwise, finish the interrupted flush().
+
+    for (int i = 0; i < numEntries; i++)
+    {
+        m_file.seek((S64)clusters[i] * clusterSize);
+        m_file.write(data.getPtr(i * clusterSize), clusterSize);
+    }
+    m_file.flush();
+    m_file.setSize(journalOfs);
+    m_file.flush();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::writeJournal(const Array<S32>& clusters, const Array<U8>& data)
+{
+    FW_ASSERT(data.getSize() == clusters.getSize() * m_clusterSize);
+
+    U32 checksum = hashArray(clusters.getPtr(), clusters.getSize());
+    for (int i = 0; i < clusters.getSize(); i++)
+        checksum = hashBits(checksum, hashBuffer(data.getPtr(i * m_clusterSize), m_clusterSize));
+
+    // Append after the last cluster.
+
+    S64 ofs = max(m_file.getSize(), (S64)m_numClusters * m_clusterSize);
+    m_file.setSize(ofs);
+    m_file.seek(ofs);
+
+    BufferedOutputStream out(m_file);
+    out.write(data.getPtr(), data.getNumBytes());
+    out.write(clusters.getPtr(), clusters.getNumBytes());
+    out.write("Journal!", 8);
+    out << m_clusterSize << (S32)clusters.getSize() << (S32)checksum;
+    out.flush();
+
+    // Must reach the disk before anything is modified in place.
+
+    m_file.flush();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::readIndexCluster(int cluster, void* ptr) const
+{
+    FW_ASSERT(ptr);
+
+    const S32* journaled = m_journalIndex.search(cluster);
+    if (journaled)
+        memcpy(ptr, m_journalData.getPtr(*journaled), m_clusterSize);
+    else if (cluster < 0 || (S64)(cluster + 1) * m_clusterSize > m_file.getSize())
+    {
+        setError("Index page outside the file!");
+        memset(ptr, 0xFF, m_clusterSize);
+    }
+    else
+    {
+        m_file.seek((S64)cluster * m_clusterSize);
+        m_file.readFully(ptr, m_clusterSize);
+    }
+}
+
+//------------------------------------------------------------------------
+
+ClusteredFile::Chunk* ClusteredFile::loadChunk(int groupID, int chunkID) const
+{
+    Group* g = m_groups[groupID];
+    loadChunkPage(g, chunkID / m_chunksPerPage);
+    return g->chunks[chunkID];
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::loadChunkPage(Group* g, int page) const
+{
+    FW_ASSERT(g && g->id != GroupID_Private);
+    IndexPage* p = g->pages[page];
+    if (p->loaded)
+        return;
+
+    // Another thread may get there first.
+
+    m_ioLock.enter();
+    if (!p->loaded)
+    {
+        p->image.reset(m_clusterSize);
+        readIndexCluster(p->cluster, p->image.getPtr());
+
+        const S32* info = (const S32*)p->image.getPtr();
+        int first = page * m_chunksPerPage;
+        int end = min(first + m_chunksPerPage, g->chunks.getSize());
+        for (int i = first; i < end; i++, info += 4)
+        {
+            Chunk* c = allocChunk(g, i);
+            if (info[0] != -1)
+            {
+                if (info[0] < 0 || info[0] >= m_numClusters ||
+                    info[1] < 0 || info[1] >= Compression_Max ||
+                    info[2] < 0 ||
+                    info[3] < 0 ||
+                    (info[1] == Compression_None && info[2] != info[3]))
+                {
+                    setError("Corrupt chunk info!");
+                }
+                else
+                {
+                    c->firstCluster     = info[0];
+                    c->compression      = (Compression)info[1];
+                    c->compressedSize   = info[2];
+                    c->uncompressedSize = info[3];
+                }
+            }
+
+            if (c->firstCluster == -1)
+                addChunkToList(c, g->firstFree, g->lastFree);
+            else if (m_file.getMappedPtr())
+                mapChunk(c);
+            g->chunks[i] = c;
+        }
+
+        if (m_file.getMode() == File::Read)
+            p->image.reset();
+        p->loaded = true;
+    }
+    m_ioLock.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::loadClusterPage(int page) const
+{
+    IndexPage* p = m_clusterPages[page];
+    if (p->loaded)
+        return;
+
+    // Another thread may get there first.
+
+    m_ioLock.enter();
+    if (!p->loaded)
+    {
+        p->image.reset(m_clusterSize);
+        readIndexCluster(p->cluster, p->image.getPtr());
+        p->clusters.reset(m_clustersPerPage);
+
+        const S32* info = (const S32*)p->image.getPtr();
+        int first = page * m_clustersPerPage;
+        int end = min(first + m_clustersPerPage, m_numClusters);
+        for (int i = first; i < end; i++)
+        {
+            S32 next = info[i - first];
+            if (next < -1 || (next >= m_numClusters && next != FW_S32_MAX))
+            {
+                setError("Corrupt cluster info!");
+                next = FW_S32_MAX;
+            }
+
+            p->clusters[i - first].next = next;
+            if (next == -1)
+                m_freeClusters.add(i, i);
+        }
+
+        if (m_file.getMode() == File::Read)
+            p->image.reset();
+        m_unloadedFree -= p->numFree;
+        p->loaded = true;
+    }
+    m_ioLock.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::loadAllPages(void) const
+{
+    for (int i = 0; i < m_clusterPages.getSize(); i++)
+        loadClusterPage(i);
+
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+        for (int j = 0; j * m_chunksPerPage < m_groups[i]->chunks.getSize(); j++)
+            loadChunkPage(m_groups[i], j);
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::loadFreeClusters(int num)
+{
+    while (m_freeClusters.numItems() < num && m_unloadedFree > 0)
+    {
+        while (m_clusterPages[m_freePageCursor]->loaded || !m_clusterPages[m_freePageCursor]->numFree)
+            m_freePageCursor++;
+        loadClusterPage(m_freePageCursor);
+    }
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::updateIndexChunk(void)
+{
+    // Free the clusters of pages that are no longer needed.
+
+    Array<IndexPage*> dropped;
+    int numClusterPages = (m_numClusters + m_clustersPerPage - 1) / m_clustersPerPage;
+    while (m_clusterPages.getSize() > numClusterPages)
+        dropped.add(m_clusterPages.removeLast());
+
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+    {
+        Group* g = m_groups[i];
+        int numPages = (g->chunks.getSize() + m_chunksPerPage - 1) / m_chunksPerPage;
+        while (g->pages.getSize() > numPages)
+            dropped.add(g->pages.removeLast());
+    }
+
+    for (int i = 0; i < dropped.getSize(); i++)
+    {
+        int cluster = dropped[i]->cluster;
+        if (cluster != -1)
+        {
+            getCluster(cluster).next = -1;
+            m_freeClusters.add(cluster, cluster);
+        }
+        delete dropped[i];
+    }
+
+    // Allocate clusters for new pages. Growing the file may add ClusterInfo pages.
+
+    Array<IndexPage*> pages;
+    for (bool allocated = true; allocated;)
+    {
+        getIndexPages(pages);
+        allocated = false;
+        for (int i = 0; i < pages.getSize(); i++)
+        {
+            if (pages[i]->cluster == -1)
+            {
+                pages[i]->cluster = allocClusters(m_clusterSize);
+                pages[i]->image.reset();
+                allocated = true;
+            }
+        }
+    }
+
+    // Link the pages into IndexChunk.
+
+    for (int i = 0; i < pages.getSize(); i++)
+        getCluster(pages[i]->cluster).next = (i < pages.getSize() - 1) ? pages[i + 1]->cluster : FW_S32_MAX;
+
+    Chunk* index;
+    if (exists(GroupID_Private, PrivateChunkID_Index))
+    {
+        index = get(GroupID_Private, PrivateChunkID_Index);
+        cacheEvict(index);
+    }
+    else
+        index = createChunk(GroupID_Private, PrivateChunkID_Index);
+
+    index->firstCluster     = pages[0]->cluster;
+    index->compression      = Compression_None;
+    index->compressedSize   = pages.getSize() * m_clusterSize;
+    index->uncompressedSize = pages.getSize() * m_clusterSize;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::getIndexPages(Array<IndexPage*>& pages) const
+{
+    pages.clear();
+    pages.add(m_clusterPages);
+    for (int i = GroupID_Default; i < m_groups.getSize(); i++)
+        pages.add(m_groups[i]->pages);
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::assignIndexClusters(void)
+{
+    if (!exists(GroupID_Private, PrivateChunkID_Index))
+        return;
+
+    // Pages that have a cluster appear in IndexChunk in the same order.
+
+    Array<IndexPage*> pages;
+    getIndexPages(pages);
+    int cluster = get(GroupID_Private, PrivateChunkID_Index)->firstCluster;
+
+    for (int i = 0; i < pages.getSize(); i++)
+    {
+        IndexPage* p = pages[i];
+        if (p->cluster == -1)
+            continue;
+
+        FW_ASSERT(cluster != FW_S32_MAX);
+        if (p->cluster != cluster)
+        {
+            p->cluster = cluster;
+            p->image.reset();
+        }
+        cluster = getCluster(cluster).next;
+    }
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::serializeChunkPage(U8* out, const Group* g, int page) const
+{
+    FW_ASSERT(out && g && g->pages[page]->loaded);
+    memset(out, 0, m_clusterSize);
+
+    S32* info = (S32*)out;
+    for (int i = page * m_chunksPerPage; i < (page + 1) * m_chunksPerPage; i++, info += 4)
+    {
+        const Chunk* c = (i < g->chunks.getSize()) ? g->chunks[i] : NULL;
+        if (!c || c->firstCluster == -1)
+            info[0] = -1;
+        else
+        {
+            info[0] = c->firstCluster;
+            info[1] = c->compression;
+            info[2] = c->compressedSize;
+            info[3] = c->uncompressedSize;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::serializeClusterPage(U8* out, int page) const
+{
+    const IndexPage* p = m_clusterPages[page];
+    FW_ASSERT(out && p->loaded);
+    memset(out, 0, m_clusterSize);
+
+    S32* info = (S32*)out;
+    int first = page * m_clustersPerPage;
+    for (int i = 0; i < m_clustersPerPage; i++)
+        info[i] = (first + i < m_numClusters) ? p->clusters[i].next : -1;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::stageIndexPage(IndexPage* p, const Array<U8>& contents, Array<S32>& clusters, Array<U8>& data)
+{
+    FW_ASSERT(p && p->cluster != -1);
+    if (p->image.getSize() == contents.getSize() && memcmp(p->image.getPtr(), contents.getPtr(), contents.getSize()) == 0)
+        return;
+
+    p->image = contents;
+    clusters.add(p->cluster);
+    data.add(contents);
+}
+
+//------------------------------------------------------------------------
+
+int ClusteredFile::addCluster(void)
+{
+    // Appending to a partially filled ClusterInfo page => load it first.
+
+    int idx = m_numClusters;
+    int page = idx / m_clustersPerPage;
+    if (page < m_clusterPages.getSize())
+        loadClusterPage(page);
+    else
+    {
+        IndexPage* p = m_clusterPages.add(new IndexPage);
+        p->clusters.reset(m_clustersPerPage);
+        p->loaded = true;
+    }
+
+    m_clusterPages[page]->clusters[idx % m_clustersPerPage] = Cluster();
+    m_numClusters++;
+    return idx;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::removeLastCluster(void)
+{
+    FW_ASSERT(m_numClusters && getCluster(m_numClusters - 1).next == -1);
+    m_numClusters--;
+    m_freeClusters.remove(m_numClusters);
+}
+
+//------------------------------------------------------------------------
+
+ClusteredFile::Chunk* ClusteredFile::allocChunk(Group* g, int chunkID)
+{
+    Chunk* c                = new Chunk;
+    c->id                   = chunkID;
+    c->group                = g;
+    c->prev                 = NULL;
+    c->next                 = NULL;
+
+    c->firstCluster         = -1;
+    c->compression          = Compression_None;
+    c->compressedSize       = 0;
+    c->uncompressedSize     = 0;
+
+    c->cachedData           = Buffer();
+    c->cachedDataCompressed = false;
+    c->asyncOp              = NULL;
+    c->mappedData           = NULL;
+    c->mappedResident       = false;
+    return c;
+}
+
+//------------------------------------------------------------------------
+
 ClusteredFile::Chunk* ClusteredFile::createChunk(int groupID, int chunkID)
 {
     FW_ASSERT(!exists(groupID, chunkID));
@@ -753,29 +1836,24 @@ ClusteredFile::Chunk* ClusteredFile::createChunk(int groupID, int chunkID)
         g->lastFree     = NULL;
     }
 
+    // Appending to a partially filled ChunkInfo page => load it first.
+
     Group* g = m_groups[groupID];
+    if (g->chunks.getSize() && g->chunks.getSize() <= chunkID)
+        get(groupID, g->chunks.getSize() - 1);
+
     while (g->chunks.getSize() <= chunkID)
     {
-        Chunk* c            = g->chunks.add(new Chunk);
-
-        c->id               = g->chunks.getSize() - 1;
-        c->group            = g;
-        c->prev             = NULL;
-        c->next             = NULL;
-
-        c->firstCluster     = 0;
-        c->compression      = Compression_None;
-        c->compressedSize   = 0;
-        c->uncompressedSize = 0;
-
-        initBuffer(c->cachedData);
-        c->cachedDataCompressed = false;
-        c->asyncOp          = NULL;
+        int id = g->chunks.getSize();
+        if (groupID != GroupID_Private && id == g->pages.getSize() * m_chunksPerPage)
+            g->pages.add(new IndexPage)->loaded = true;
 
+        Chunk* c = g->chunks.add(allocChunk(g, id));
+        c->firstCluster = 0;
         addChunkToList(c, g->firstFree, g->lastFree);
     }
 
-    Chunk* c = g->chunks[chunkID];
+    Chunk* c = get(groupID, chunkID);
     removeChunkFromList(c, g->firstFree, g->lastFree);
     return c;
 }
@@ -795,8 +1873,8 @@ void ClusteredFile::removeChunk(Chunk* c, bool freeClusters)
         do
         {
             S32 prev = cluster;
-            cluster = m_clusters[prev].next;
-            m_clusters[prev].next = -1;
+            cluster = getCluster(prev).next;
+            getCluster(prev).next = -1;
             m_freeClusters.add(prev, prev);
         }
         while (cluster != FW_S32_MAX);
@@ -805,7 +1883,7 @@ void ClusteredFile::removeChunk(Chunk* c, bool freeClusters)
 
     Group* g = c->group;
     addChunkToList(c, g->firstFree, g->lastFree);
-    while (g->chunks.getSize() && g->chunks.getLast()->firstCluster == -1)
+    while (g->chunks.getSize() && get(g->id, g->chunks.getSize() - 1)->firstCluster == -1)
     {
         Chunk* last = g->chunks.removeLast();
         removeChunkFromList(last, g->firstFree, g->lastFree);
@@ -848,13 +1926,203 @@ void ClusteredFile::removeChunkFromList(Chunk* c, Chunk*& first, Chunk*& last)
 
 //------------------------------------------------------------------------
 
+void ClusteredFile::relocateChunk(Chunk* c, int firstCluster)
+{
+    FW_ASSERT(c && c->firstCluster >= 0);
+    FW_ASSERT(firstCluster >= 0);
+
+    // Get the data as stored. Decompressed copies must be re-read.
+
+    for (;;)
+    {
+        if (c->compression != Compression_None && c->cachedData.size && !c->cachedDataCompressed)
+            cacheEvict(c);
+
+        cacheRead(c, c->uncompressedSize, false);
+        while (c->asyncOp)
+        {
+            asyncWait(c->asyncOp);
+            asyncFinish();
+        }
+
+        if (c->compression == Compression_None || c->cachedDataCompressed)
+            break;
+    }
+
+    int numClusters = getNumClusters(c);
+    FW_ASSERT(c->cachedData.size == numClusters * m_clusterSize);
+
+    // Free the old clusters.
+
+    S32 cluster = c->firstCluster;
+    do
+    {
+        S32 prev = cluster;
+        cluster = getCluster(prev).next;
+        getCluster(prev).next = -1;
+        m_freeClusters.add(prev, prev);
+    }
+    while (cluster != FW_S32_MAX);
+
+    // Allocate the new ones, growing the file if needed.
+
+    for (int i = 0; i < numClusters; i++)
+    {
+        int idx = firstCluster + i;
+        while (idx >= m_numClusters)
+        {
+            m_freeClusters.add(m_numClusters, m_numClusters);
+            addCluster();
+        }
+
+        FW_ASSERT(getCluster(idx).next == -1);
+        m_freeClusters.remove(idx);
+        getCluster(idx).next = (i < numClusters - 1) ? idx + 1 : FW_S32_MAX;
+    }
+    c->firstCluster = firstCluster;
+
+    // IndexChunk => move the index pages along.
+
+    if (c->group->id == GroupID_Private && c->id == PrivateChunkID_Index)
+        assignIndexClusters();
+
+    // Write directly from the cached data.
+
+    AsyncOp* op = new AsyncOp;
+    op->data = c->cachedData;
+    op->dataOwner = c;
+    c->asyncOp = op;
+    asyncStartChain(op, firstCluster, true);
+    m_asyncOps.add(op);
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::setClusterOwner(Array<Chunk*>& owners, const Chunk* c, Chunk* owner) const
+{
+    FW_ASSERT(c);
+    for (int cluster = c->firstCluster; cluster != FW_S32_MAX; cluster = getCluster(cluster).next)
+    {
+        while (cluster >= owners.getSize())
+            owners.add(NULL);
+        owners[cluster] = owner;
+    }
+}
+
+//------------------------------------------------------------------------
+
+S64 ClusteredFile::getCacheUsed(void) const
+{
+    S64 used = 0;
+    for (int i = 0; i < NumCacheShards; i++)
+        used += m_cacheShards[i].used;
+    return used;
+}
+
+//------------------------------------------------------------------------
+
+bool ClusteredFile::cacheReadFast(Chunk* c, void* data, int size, View* view)
+{
+    FW_ASSERT(c);
+    FW_ASSERT(size >= 0 && size <= c->uncompressedSize);
+
+    // Mapped => no locking needed. Prefetch and readiness queries must
+    // wait until the pages have been read in, see cacheReadPrefetch().
+
+    if (c->mappedData && (data || view || c->mappedResident))
+    {
+        if (data)
+            memcpy(data, c->mappedData, size);
+        if (view)
+            setView(*view, c);
+        return true;
+    }
+
+    // Cached => copy and move to the end of the shard's list (most recently used).
+
+    CacheShard& s = getShard(c);
+    s.lock.enter();
+
+    bool hit = (c->cachedData.size >= size && !c->cachedDataCompressed);
+    if (hit && (data || view))
+    {
+        if (data)
+            memcpy(data, c->cachedData.ptr, size);
+        if (view)
+            setView(*view, c);
+        removeChunkFromList(c, s.first, s.last);
+        addChunkToList(c, s.first, s.last);
+    }
+
+    s.lock.leave();
+    return hit;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::cacheInsert(Chunk* c, const Buffer& data, bool compressed)
+{
+    FW_ASSERT(c && !c->cachedData.size);
+    CacheShard& s = getShard(c);
+    s.lock.enter();
+
+    c->cachedData = data;
+    c->cachedDataCompressed = compressed;
+    s.used += data.size;
+    addChunkToList(c, s.first, s.last);
+
+    s.lock.leave();
+}
+
+//------------------------------------------------------------------------
+
+ClusteredFile::Buffer ClusteredFile::cacheRemove(Chunk* c)
+{
+    FW_ASSERT(c);
+    Buffer data = c->cachedData;
+    if (!data.size)
+        return data;
+
+    CacheShard& s = getShard(c);
+    s.lock.enter();
+
+    s.used -= data.size;
+    removeChunkFromList(c, s.first, s.last);
+    initBuffer(c->cachedData);
+    c->cachedDataCompressed = false;
+
+    s.lock.leave();
+    return data;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::cacheTouch(Chunk* c)
+{
+    FW_ASSERT(c && c->cachedData.size);
+    CacheShard& s = getShard(c);
+    s.lock.enter();
+
+    removeChunkFromList(c, s.first, s.last);
+    addChunkToList(c, s.first, s.last);
+
+    s.lock.leave();
+}
+
+//------------------------------------------------------------------------
+
 const U8* ClusteredFile::cacheRead(Chunk* c, int size, bool needUncompressed)
 {
     FW_ASSERT(c);
 
-    // Prefetch and wait for the AsyncOp.
+    // Mapped => read in place.
+
+    if (c->mappedData)
+        return c->mappedData;
+
+    // Prefetch and wait for the AsyncOp, including decompression.
 
-    if (!cacheReadPrefetch(c, size))
+    while (!cacheReadPrefetch(c, size, needUncompressed))
     {
         asyncWait(c->asyncOp);
         asyncFinish();
@@ -869,27 +2137,76 @@ const U8* ClusteredFile::cacheRead(Chunk* c, int size, bool needUncompressed)
         allocBuffer(tmp, c->uncompressedSize);
         decompress(tmp.ptr, c->uncompressedSize, c->cachedData.ptr, c->compressedSize, c->compression);
 
-        m_cacheUsed += tmp.size - c->cachedData.size;
-        freeBuffer(c->cachedData);
-        c->cachedDataCompressed = false;
+        // Being written => let the AsyncOp release the compressed data.
+
+        Buffer old = cacheRemove(c);
+        if (c->asyncOp && c->asyncOp->dataOwner == c)
+        {
+            c->asyncOp->dataOwner = NULL;
+            c->asyncOp = NULL;
+        }
+        else
+            freeBuffer(old);
+
+        cacheInsert(c, tmp, false);
     }
     return c->cachedData.ptr;
 }
 
 //------------------------------------------------------------------------
 
-bool ClusteredFile::cacheReadPrefetch(Chunk* c, int size)
+bool ClusteredFile::cacheReadPrefetch(Chunk* c, int size, bool needUncompressed)
 {
     FW_ASSERT(c);
     FW_ASSERT(size >= 0 && size <= c->uncompressedSize);
 
+    // Mapped => read the chunk through the file once in the background.
+    // The mapping shares the OS file cache, so touching the pages later
+    // only causes soft faults instead of blocking the caller on disk.
+
+    if (c->mappedData)
+    {
+        if (c->mappedResident)
+            return true;
+        if (c->asyncOp)
+            return false;
+
+        c->asyncOp = new AsyncOp;
+        allocBuffer(c->asyncOp->data, c->uncompressedSize);
+        c->asyncOp->dataOwner = NULL;
+        c->asyncOp->readTarget = c;
+        c->asyncOp->dataCompressed = false;
+        c->asyncOp->inflate = false;
+
+        FW_ASSERT(c->firstCluster >= 0 && c->firstCluster < m_numClusters);
+        asyncStartChain(c->asyncOp, c->firstCluster, false);
+        m_asyncOps.add(c->asyncOp);
+        return false;
+    }
+
     // Already cached => move to the end of the cached chunk list (most recently used).
 
-    if (cacheReadIsReady(c, size))
+    asyncFinish();
+    if (c->cachedData.size >= size || (c->cachedData.size && c->compression != Compression_None))
     {
-        removeChunkFromList(c, m_firstCached, m_lastCached);
-        addChunkToList(c, m_firstCached, m_lastCached);
-        return true;
+        cacheTouch(c);
+
+        // Compressed and not being written => inflate in the background.
+        // Otherwise, cacheRead() falls back to decompressing in place.
+
+        if (!needUncompressed || !c->cachedDataCompressed || c->asyncOp)
+            return true;
+
+        AsyncOp* op         = new AsyncOp;
+        op->data            = cacheRemove(c);
+        op->dataCompressed  = true;
+        op->inflate         = true;
+        op->readTarget      = c;
+        c->asyncOp          = op;
+
+        codecStart(op, false);
+        m_asyncOps.add(op);
+        return false;
     }
 
     // Already loading => done.
@@ -897,6 +2214,7 @@ bool ClusteredFile::cacheReadPrefetch(Chunk* c, int size)
     if (c->asyncOp && c->asyncOp->readTarget &&
         (c->asyncOp->data.size >= size || c->compression != Compression_None))
     {
+        c->asyncOp->inflate |= needUncompressed;
         return false;
     }
 
@@ -904,38 +2222,19 @@ bool ClusteredFile::cacheReadPrefetch(Chunk* c, int size)
 
     cacheEvict(c);
 
-    // Create AsyncOp.
+    // Create AsyncOp. Compressed data must be read as a whole.
 
     c->asyncOp = new AsyncOp;
-    allocBuffer(c->asyncOp->data, size);
+    allocBuffer(c->asyncOp->data, (c->compression != Compression_None) ? c->compressedSize : size);
     c->asyncOp->dataOwner = NULL;
     c->asyncOp->readTarget = c;
+    c->asyncOp->dataCompressed = (c->compression != Compression_None);
+    c->asyncOp->inflate = needUncompressed;
 
     // Start async reads.
 
-    FW_ASSERT(c->firstCluster >= 0 && c->firstCluster < m_clusters.getSize());
-    int startCluster    = c->firstCluster;
-    int startOfs        = 0;
-    int currCluster     = startCluster;
-    int currOfs         = 0;
-
-    while (currOfs < c->asyncOp->data.size)
-    {
-        FW_ASSERT(currCluster != FW_S32_MAX);
-        int prevCluster = currCluster;
-        currCluster = m_clusters[prevCluster].next;
-        currOfs += m_clusterSize;
-
-        if (currOfs == c->asyncOp->data.size ||
-            currCluster != prevCluster + 1 ||
-            currOfs - startOfs + m_clusterSize > File::MaxBytesPerSysCall)
-        {
-            asyncStartRange(c->asyncOp, startOfs, startCluster, prevCluster - startCluster + 1, false);
-            startCluster = currCluster;
-            startOfs = currOfs;
-        }
-    }
-
+    FW_ASSERT(c->firstCluster >= 0 && c->firstCluster < m_numClusters);
+    asyncStartChain(c->asyncOp, c->firstCluster, false);
     m_asyncOps.add(c->asyncOp);
     return false;
 }
@@ -948,8 +2247,16 @@ bool ClusteredFile::cacheReadIsReady(Chunk* c, int size)
     FW_ASSERT(size >= 0 && size <= c->uncompressedSize);
 
     asyncFinish();
-    return (c->cachedData.size >= size ||
-        (c->cachedData.size && c->compression != Compression_None));
+    if (c->mappedData)
+        return cacheReadPrefetch(c, size);
+    if (c->cachedData.size >= size && !c->cachedDataCompressed)
+        return true;
+
+    // Cached but compressed => start inflating.
+
+    if (c->cachedDataCompressed && !c->asyncOp)
+        cacheReadPrefetch(c, size);
+    return false;
 }
 
 //------------------------------------------------------------------------
@@ -963,98 +2270,31 @@ void ClusteredFile::cacheWrite(Chunk* c, const void* data, int size, int compres
     cacheEvict(c);
     FW_ASSERT(!c->cachedData.size);
 
-    if (compressedSize == -1)
-    {
-        c->uncompressedSize     = size;
-        c->compressedSize       = size; // fixed below
-        c->cachedDataCompressed = false;
-        allocBuffer(c->cachedData, size);
-        memcpy(c->cachedData.ptr, data, size);
-    }
-    else
-    {
-        c->uncompressedSize     = size;
-        c->compressedSize       = compressedSize;
-        c->cachedDataCompressed = true;
-        allocBuffer(c->cachedData, compressedSize);
-        memcpy(c->cachedData.ptr, data, compressedSize);
-    }
-
-    m_cacheUsed += c->cachedData.size;
-    addChunkToList(c, m_firstCached, m_lastCached);
-
-    // Create AsyncOp.
-
-    AsyncOp* op = new AsyncOp;
-    op->readTarget = NULL;
-
-    if (c->compression == Compression_None || c->cachedDataCompressed)
-    {
-        op->data = c->cachedData;
-        op->dataOwner = c;
-        c->asyncOp = op;
-    }
-    else
-    {
-        Array<U8> tmp;
-        compress(tmp, c->cachedData.ptr, c->uncompressedSize, c->compression);
-        c->compressedSize = tmp.getSize();
-
-        allocBuffer(op->data, tmp.getSize());
-        memcpy(op->data.ptr, tmp.getPtr(), tmp.getSize());
-        op->dataOwner = NULL;
-    }
-
-    // Start async writes.
-
-    bool    grow            = (op->data.size > m_freeClusters.numItems() * m_clusterSize);
-    int     startCluster    = -1;
-    int     startOfs        = 0;
-    int     currCluster     = -1;
-    int     currOfs         = 0;
-
-    while (currCluster != FW_S32_MAX)
-    {
-        // Advance offset.
-
-        int prevCluster = currCluster;
-        if (prevCluster != -1)
-            currOfs += m_clusterSize;
-
-        // Allocate cluster.
-
-        if (currOfs == op->data.size && prevCluster != -1)
-            currCluster = FW_S32_MAX;
-        else if (!grow)
-            currCluster = m_freeClusters.removeMin();
-        else
-        {
-            currCluster = m_clusters.getSize();
-            m_clusters.add();
-        }
+    bool compressed = (compressedSize != -1);
+    c->uncompressedSize = size;
+    c->compressedSize   = (compressed) ? compressedSize : size; // fixed below
 
-        // First cluster => handle as a special case.
+    Buffer buffer;
+    allocBuffer(buffer, c->compressedSize);
+    memcpy(buffer.ptr, data, c->compressedSize);
+    cacheInsert(c, buffer, compressed);
 
-        if (prevCluster == -1)
-        {
-            startCluster = currCluster;
-            c->firstCluster = currCluster;
-            continue;
-        }
+    // Create AsyncOp that writes directly from the cached data.
 
-        // Link to the previous cluster.
-        // Seek => write preceding clusters.
+    AsyncOp* op = new AsyncOp;
+    op->data = c->cachedData;
+    op->dataOwner = c;
+    c->asyncOp = op;
 
-        m_clusters[prevCluster].next = currCluster;
-        if (currCluster != prevCluster + 1 ||
-            currOfs - startOfs + m_clusterSize > File::MaxBytesPerSysCall)
-        {
-            asyncStartRange(op, startOfs, startCluster, prevCluster - startCluster + 1, true);
-            startCluster = currCluster;
-            startOfs = currOfs;
-        }
-    }
+    // Allocate clusters. Compression can only shrink the data, so
+    // reserve enough for the uncompressed size and release the tail
+    // in asyncEndCompress().
 
+    c->firstCluster = allocClusters(op->data.size);
+    if (c->compression != Compression_None && !c->cachedDataCompressed)
+        codecStart(op, true);
+    else
+        asyncStartChain(op, c->firstCluster, true);
     m_asyncOps.add(op);
 }
 
@@ -1078,20 +2318,20 @@ void ClusteredFile::cacheEvict(Chunk* c)
 {
     FW_ASSERT(c);
 
+    // Being compressed => wait until the cluster list is final.
+
+    asyncFinishCompress(c);
+
     // Remove from cache.
 
-    if (c->cachedData.size)
-    {
-        m_cacheUsed -= c->cachedData.size;
-        removeChunkFromList(c, m_firstCached, m_lastCached);
-    }
+    Buffer data = cacheRemove(c);
 
     // Detach pending AsyncOp.
 
     if (c->asyncOp)
     {
         if (c->asyncOp->dataOwner)
-            initBuffer(c->cachedData);
+            initBuffer(data);
 
         c->asyncOp->readTarget  = NULL;
         c->asyncOp->dataOwner   = NULL;
@@ -1100,7 +2340,7 @@ void ClusteredFile::cacheEvict(Chunk* c)
 
     // Delete data.
 
-    freeBuffer(c->cachedData);
+    freeBuffer(data);
 }
 
 //------------------------------------------------------------------------
@@ -1108,8 +2348,80 @@ void ClusteredFile::cacheEvict(Chunk* c)
 void ClusteredFile::cacheEvict(void)
 {
     asyncFinish();
-    while (m_cacheUsed > m_cacheSize)
-        cacheEvict(m_firstCached);
+    while (getCacheUsed() > m_cacheSize)
+    {
+        // Evict the least recently used chunk of each shard in turn.
+
+        CacheShard& s = m_cacheShards[m_evictShard];
+        m_evictShard = (m_evictShard + 1) & (NumCacheShards - 1);
+
+        s.lock.enter();
+        Chunk* c = s.first;
+        s.lock.leave();
+
+        if (c)
+            cacheEvict(c);
+    }
+}
+
+//------------------------------------------------------------------------
+
+int ClusteredFile::allocClusters(int size)
+{
+    FW_ASSERT(size >= 0 && size % m_clusterSize == 0);
+    int numClusters = max(size / m_clusterSize, 1);
+    loadFreeClusters(numClusters);
+    bool grow = (numClusters > m_freeClusters.numItems());
+
+    int first = -1;
+    int prev = -1;
+    for (int i = 0; i < numClusters; i++)
+    {
+        int curr;
+        if (!grow)
+            curr = m_freeClusters.removeMin();
+        else
+        {
+            curr = addCluster();
+        }
+
+        if (prev == -1)
+            first = curr;
+        else
+            getCluster(prev).next = curr;
+        prev = curr;
+    }
+
+    getCluster(prev).next = FW_S32_MAX;
+    return first;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::asyncStartChain(AsyncOp* op, int firstCluster, bool isWrite)
+{
+    FW_ASSERT(op);
+    int startCluster    = firstCluster;
+    int startOfs        = 0;
+    int currCluster     = startCluster;
+    int currOfs         = 0;
+
+    while (currOfs < op->data.size)
+    {
+        FW_ASSERT(currCluster != FW_S32_MAX);
+        int prevCluster = currCluster;
+        currCluster = getCluster(prevCluster).next;
+        currOfs += m_clusterSize;
+
+        if (currOfs == op->data.size ||
+            currCluster != prevCluster + 1 ||
+            currOfs - startOfs + m_clusterSize > File::MaxBytesPerSysCall)
+        {
+            asyncStartRange(op, startOfs, startCluster, prevCluster - startCluster + 1, isWrite);
+            startCluster = currCluster;
+            startOfs = currOfs;
+        }
+    }
 }
 
 //------------------------------------------------------------------------
@@ -1125,7 +2437,7 @@ void ClusteredFile::asyncStartRange(AsyncOp* op, int dataOfs, int firstCluster,
 
     for (int i = 0; i < numClusters; i++)
     {
-        Cluster& c = m_clusters[firstCluster + i];
+        Cluster& c = getCluster(firstCluster + i);
         if (isWrite)
         {
             while (c.pendingReads || c.pendingWrites)
@@ -1140,7 +2452,13 @@ void ClusteredFile::asyncStartRange(AsyncOp* op, int dataOfs, int firstCluster,
         }
     }
 
-    m_file.seek((S64)firstCluster * m_clusterSize);
+    // Preceding clusters may still be waiting for compression => grow the file over them.
+
+    S64 fileOfs = (S64)firstCluster * m_clusterSize;
+    if (isWrite && fileOfs > m_file.getSize())
+        m_file.setSize(fileOfs);
+
+    m_file.seek(fileOfs);
     if (isWrite)
         range.fileOp = m_file.writeAsync(op->data.ptr + dataOfs, numClusters * m_clusterSize);
     else
@@ -1154,7 +2472,7 @@ void ClusteredFile::asyncEndRange(AsyncRange& range)
 {
     for (int i = 0; i < range.numClusters; i++)
     {
-        Cluster& c = m_clusters[range.firstCluster + i];
+        Cluster& c = getCluster(range.firstCluster + i);
         if (range.isWrite)
             c.pendingWrites--;
         else
@@ -1171,12 +2489,17 @@ void ClusteredFile::asyncWait(AsyncOp* op)
     FW_ASSERT(op);
     for (int i = 0; i < op->ranges.getSize(); i++)
         op->ranges[i].fileOp->wait();
+    if (op->codec)
+        codecWait(op->codec);
 }
 
 //------------------------------------------------------------------------
 
 void ClusteredFile::asyncFinish(void)
 {
+    Array<AsyncOp*> writeOps;
+    Array<S32>      writeClusters;
+
     for (int i = 0; i < m_asyncOps.getSize(); i++)
     {
         // Poll file ops and delete finished ones.
@@ -1190,20 +2513,59 @@ void ClusteredFile::asyncFinish(void)
         if (op->ranges.getSize())
             continue;
 
-        // Reading to cache => copy data to the target.
+        // Codec running => skip.
+
+        if (op->codec && !op->codec->done)
+            continue;
+
+        // Compressed => start writing after the loop, so that stalls
+        // within asyncStartRange() do not see a half-started op.
+
+        if (op->codec && op->codec->isCompress)
+        {
+            writeClusters.add(asyncEndCompress(op));
+            writeOps.add(op);
+            m_asyncOps.removeSwap(i);
+            i--;
+            continue;
+        }
+
+        // Decompressed => replace the data.
+
+        if (op->codec)
+        {
+            delete op->codec;
+            op->codec = NULL;
+            freeBuffer(op->data);
+            op->data = op->inflated;
+            op->dataCompressed = false;
+            initBuffer(op->inflated);
+        }
+
+        // Read compressed data for a reader that needs it uncompressed => decompress.
+
+        else if (op->readTarget && op->inflate && op->dataCompressed)
+        {
+            codecStart(op, false);
+            continue;
+        }
+
+        // Reading to cache => copy data to the target. Reading a mapped
+        // chunk => the pages are now resident, drop the copy.
 
         Chunk* c = op->readTarget;
-        if (c)
+        if (c && c->mappedData)
+        {
+            c->asyncOp = NULL;
+            c->mappedResident = true;
+        }
+        else if (c)
         {
             c->asyncOp = NULL;
             cacheEvict(c);
 
-            c->cachedData = op->data;
-            c->cachedDataCompressed = (c->compression != Compression_None);
-            m_cacheUsed += c->cachedData.size;
+            cacheInsert(c, op->data, op->dataCompressed);
             initBuffer(op->data);
-
-            addChunkToList(c, m_firstCached, m_lastCached);
         }
 
         // Release the data array.
@@ -1215,10 +2577,224 @@ void ClusteredFile::asyncFinish(void)
 
         // Delete the op.
 
+        freeBuffer(op->inflated);
         m_asyncOps.removeSwap(i);
         delete op;
         i--;
     }
+
+    // Start writing compressed chunks.
+
+    for (int i = 0; i < writeOps.getSize(); i++)
+    {
+        asyncStartChain(writeOps[i], writeClusters[i], true);
+        m_asyncOps.add(writeOps[i]);
+    }
+}
+
+//------------------------------------------------------------------------
+
+int ClusteredFile::asyncEndCompress(AsyncOp* op)
+{
+    FW_ASSERT(op && op->codec && op->codec->isCompress && op->codec->done);
+    Chunk* c = op->dataOwner;
+    FW_ASSERT(c && c->asyncOp == op);
+
+    // Smaller => write from a separate buffer.
+    // Incompressible => store as is, which also keeps
+    // the chunk readable in place when the file is mapped.
+
+    CodecTask* task = op->codec;
+    op->codec = NULL;
+
+    if (task->compressed.getSize() < c->uncompressedSize)
+    {
+        c->compressedSize = task->compressed.getSize();
+        allocBuffer(op->data, c->compressedSize);
+        memcpy(op->data.ptr, task->compressed.getPtr(), c->compressedSize);
+        op->dataOwner = NULL;
+        c->asyncOp = NULL;
+    }
+    else
+    {
+        c->compression = Compression_None;
+        c->compressedSize = c->uncompressedSize;
+    }
+    delete task;
+
+    // Release the clusters that were reserved but not needed.
+
+    S32 cluster = c->firstCluster;
+    for (int ofs = m_clusterSize; ofs < op->data.size; ofs += m_clusterSize)
+        cluster = getCluster(cluster).next;
+
+    S32 next = getCluster(cluster).next;
+    getCluster(cluster).next = FW_S32_MAX;
+    while (next != FW_S32_MAX)
+    {
+        S32 prev = next;
+        next = getCluster(prev).next;
+        getCluster(prev).next = -1;
+        m_freeClusters.add(prev, prev);
+    }
+    return c->firstCluster;
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::asyncFinishCompress(Chunk* c)
+{
+    FW_ASSERT(c);
+    while (c->asyncOp && c->asyncOp->codec && c->asyncOp->codec->isCompress)
+    {
+        codecWait(c->asyncOp->codec);
+        asyncFinish();
+    }
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::asyncFinishCompress(void)
+{
+    for (;;)
+    {
+        asyncFinish();
+
+        CodecTask* task = NULL;
+        for (int i = 0; i < m_asyncOps.getSize() && !task; i++)
+            if (m_asyncOps[i]->codec && m_asyncOps[i]->codec->isCompress)
+                task = m_asyncOps[i]->codec;
+
+        if (!task)
+            break;
+        codecWait(task);
+    }
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::codecStart(AsyncOp* op, bool isCompress)
+{
+    FW_ASSERT(op && !op->codec);
+    CodecTask* task = new CodecTask;
+    task->isCompress = isCompress;
+    task->src = op->data.ptr;
+    task->done = false;
+
+    if (isCompress)
+    {
+        Chunk* c = op->dataOwner;
+        FW_ASSERT(c);
+        task->compression = c->compression;
+        task->srcSize = c->uncompressedSize;
+        task->dst = NULL;
+        task->dstSize = 0;
+    }
+    else
+    {
+        Chunk* c = op->readTarget;
+        FW_ASSERT(c);
+        allocBuffer(op->inflated, c->uncompressedSize);
+        task->compression = c->compression;
+        task->srcSize = c->compressedSize;
+        task->dst = op->inflated.ptr;
+        task->dstSize = c->uncompressedSize;
+    }
+
+    op->codec = task;
+
+    // First task => start threads.
+
+    if (!m_codecThreads.getSize())
+    {
+        for (int i = 0; i < MulticoreLauncher::getNumCores(); i++)
+        {
+            Thread* thread = new Thread;
+            thread->start(codecThreadFunc, this);
+            m_codecThreads.add(thread);
+        }
+    }
+
+    m_codecMonitor.enter();
+    m_codecQueue.add(task);
+    m_codecMonitor.notifyAll(); // notify() could wake a thread in codecWait()
+    m_codecMonitor.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::codecWait(CodecTask* task)
+{
+    FW_ASSERT(task);
+    m_codecMonitor.enter();
+
+    // Not started yet => run it here instead of waiting for a thread.
+
+    int idx = m_codecQueue.indexOf(task);
+    if (idx != -1)
+    {
+        m_codecQueue.remove(idx);
+        m_codecMonitor.leave();
+        codecRun(task);
+        m_codecMonitor.enter();
+        task->done = true;
+    }
+
+    while (!task->done)
+        m_codecMonitor.wait();
+    m_codecMonitor.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::codecStop(void)
+{
+    // Each thread finishes its current task first.
+
+    m_codecMonitor.enter();
+    m_codecAbort = true;
+    m_codecMonitor.notifyAll();
+    m_codecMonitor.leave();
+
+    for (int i = 0; i < m_codecThreads.getSize(); i++)
+        delete m_codecThreads[i]; // joins
+    m_codecThreads.reset();
+    m_codecAbort = false;
+    FW_ASSERT(!m_codecQueue.getSize());
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::codecThreadFunc(void* param)
+{
+    ClusteredFile* f = (ClusteredFile*)param;
+    f->m_codecMonitor.enter();
+    for (;;)
+    {
+        while (!f->m_codecAbort && !f->m_codecQueue.getSize())
+            f->m_codecMonitor.wait();
+        if (f->m_codecAbort)
+            break;
+
+        CodecTask* task = f->m_codecQueue.remove(0);
+        f->m_codecMonitor.leave();
+        codecRun(task);
+        f->m_codecMonitor.enter();
+
+        task->done = true;
+        f->m_codecMonitor.notifyAll();
+    }
+    f->m_codecMonitor.leave();
+}
+
+//------------------------------------------------------------------------
+
+void ClusteredFile::codecRun(CodecTask* task)
+{
+    if (task->isCompress)
+        compress(task->compressed, task->src, task->srcSize, task->compression);
+    else
+        decompress(task->dst, task->dstSize, task->src, task->srcSize, task->compression);
 }
 
 //------------------------------------------------------------------------
@@ -1235,6 +2811,17 @@ void ClusteredFile::asyncStall(void)
 
 //------------------------------------------------------------------------
 
+void ClusteredFile::asyncWaitAll(void)
+{
+    while (m_asyncOps.getSize())
+    {
+        asyncWait(m_asyncOps.getLast());
+        asyncFinish();
+    }
+}
+
+//------------------------------------------------------------------------
+
 void ClusteredFile::compress(Array<U8>& compressed, const void* data, int uncompressedSize, Compression compression)
 {
     int level;
@@ -1257,6 +2844,10 @@ void ClusteredFile::compress(Array<U8>& compressed, const void* data, int uncomp
         level = 9;
         break;
 
+    case Compression_LZ4:
+        compressLZ4(compressed, (const U8*)data, uncompressedSize);
+        return;
+
     default:
         FW_ASSERT(false);
         return;
@@ -1288,6 +2879,11 @@ void ClusteredFile::decompress(void* data, int uncompressedSize, const void* com
     case Compression_ZLibHigh:
         break;
 
+    case Compression_LZ4:
+        if (!decompressLZ4((U8*)data, uncompressedSize, (const U8*)compressed, compressedSize))
+            fail("ClusteredFile: Corrupt LZ4 data!");
+        return;
+
     default:
         FW_ASSERT(false);
         return;
@@ -1306,3 +2902,200 @@ void ClusteredFile::decompress(void* data, int uncompressedSize, const void* com
 }
 
 //------------------------------------------------------------------------
+
+void ClusteredFile::compressLZ4(Array<U8>& compressed, const U8* data, int uncompressedSize)
+{
+    enum
+    {
+        HashBits        = 16,
+        MinMatch        = 4,
+        MaxOffset       = 65535,
+        LastLiterals    = 5,    // the last bytes are always literals
+        MatchFindLimit  = 12,   // no match may start within the last bytes
+        SkipTrigger     = 6,    // step size grows by 1 every 2^SkipTrigger failed probes
+    };
+
+    FW_ASSERT(data || !uncompressedSize);
+    compressed.reset(uncompressedSize + uncompressedSize / 255 + 16);
+    U8* out = compressed.getPtr();
+
+    Array<S32> table;
+    table.reset(1 << HashBits);
+    memset(table.getPtr(), -1, table.getNumBytes());
+
+    int anchor = 0;
+    int pos = 0;
+    int matchLimit = uncompressedSize - LastLiterals;
+    int posLimit = uncompressedSize - MatchFindLimit;
+
+    while (pos <= posLimit)
+    {
+        // Probe the hash table.
+
+        U32 seq;
+        memcpy(&seq, data + pos, sizeof(U32));
+        U32 hash = (seq * 2654435761u) >> (32 - HashBits);
+        int ref = table[hash];
+        table[hash] = pos;
+
+        U32 refSeq = 0;
+        if (ref >= 0 && pos - ref <= MaxOffset)
+            memcpy(&refSeq, data + ref, sizeof(U32));
+
+        if (ref < 0 || pos - ref > MaxOffset || refSeq != seq)
+        {
+            pos += 1 + ((pos - anchor) >> SkipTrigger);
+            continue;
+        }
+
+        // Extend the match in both directions.
+
+        while (pos > anchor && ref > 0 && data[pos - 1] == data[ref - 1])
+        {
+            pos--;
+            ref--;
+        }
+
+        int len = MinMatch;
+        while (pos + len < matchLimit && data[pos + len] == data[ref + len])
+            len++;
+
+        // Emit token, literals, offset, and match length.
+
+        int numLiterals = pos - anchor;
+        int matchCode = len - MinMatch;
+        U8* token = out++;
+        *token = (U8)((min(numLiterals, 15) << 4) | min(matchCode, 15));
+
+        if (numLiterals >= 15)
+        {
+            int rest = numLiterals - 15;
+            for (; rest >= 255; rest -= 255)
+                *out++ = 255;
+            *out++ = (U8)rest;
+        }
+        memcpy(out, data + anchor, numLiterals);
+        out += numLiterals;
+
+        *out++ = (U8)(pos - ref);
+        *out++ = (U8)((pos - ref) >> 8);
+
+        if (matchCode >= 15)
+        {
+            int rest = matchCode - 15;
+            for (; rest >= 255; rest -= 255)
+                *out++ = 255;
+            *out++ = (U8)rest;
+        }
+
+        pos += len;
+        anchor = pos;
+    }
+
+    // Emit the remaining literals.
+
+    int numLiterals = uncompressedSize - anchor;
+    *out++ = (U8)(min(numLiterals, 15) << 4);
+    if (numLiterals >= 15)
+    {
+        int rest = numLiterals - 15;
+        for (; rest >= 255; rest -= 255)
+            *out++ = 255;
+        *out++ = (U8)rest;
+    }
+    memcpy(out, data + anchor, numLiterals);
+    out += numLiterals;
+
+    compressed.resize((int)(out - compressed.getPtr()));
+}
+
+//------------------------------------------------------------------------
+
+bool ClusteredFile::decompressLZ4(U8* data, int uncompressedSize, const U8* compressed, int compressedSize)
+{
+    FW_ASSERT(data || !uncompressedSize);
+    FW_ASSERT(compressed || !compressedSize);
+
+    const U8*   in      = compressed;
+    const U8*   inEnd   = compressed + compressedSize;
+    U8*         out     = data;
+    U8*         outEnd  = data + uncompressedSize;
+
+    for (;;)
+    {
+        // Literals.
+
+        if (in >= inEnd)
+            return false;
+
+        int token = *in++;
+        int numLiterals = token >> 4;
+        if (numLiterals == 15)
+        {
+            int v;
+            do
+            {
+                if (in >= inEnd)
+                    return false;
+                v = *in++;
+                numLiterals += v;
+            }
+            while (v == 255);
+        }
+
+        if (numLiterals > inEnd - in || numLiterals > outEnd - out)
+            return false;
+
+        memcpy(out, in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+
+        // End of input => must also be the end of output.
+
+        if (in == inEnd)
+            return (out == outEnd);
+
+        // Match.
+
+        if (inEnd - in < 2)
+            return false;
+
+        int offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (!offset || offset > out - data)
+            return false;
+
+        int len = token & 15;
+        if (len == 15)
+        {
+            int v;
+            do
+            {
+                if (in >= inEnd)
+                    return false;
+                v = *in++;
+                len += v;
+            }
+            while (v == 255);
+        }
+        len += 4;
+
+        if (len > outEnd - out)
+            return false;
+
+        // Copy. An overlapping match repeats the last offset bytes, so
+        // the output from ref onwards is periodic and the non-overlapping
+        // part that can be copied at once doubles with each step.
+
+        const U8* ref = out - offset;
+        for (int i = 0; i < len;)
+        {
+            int n = min(offset + i, len - i);
+            memcpy(out + i, ref, n);
+            i += n;
+        }
+        out += len;
+    }
+}
+
+//------------------------------------------------------------------------
@@ -28,10 +28,59 @@
 #pragma once
 #include "io/File.hpp"
 #include "base/BinaryHeap.hpp"
+#include "base/Math.hpp"
+#include "base/MulticoreLauncher.hpp"
+#include "base/Hash.hpp"
 
 namespace FW
 {
 //------------------------------------------------------------------------
+// In File::Read mode, the file is mapped into the address space.
+// Uncompressed chunks that occupy consecutive clusters are then read
+// straight from the mapping and never enter the chunk cache, leaving
+// the caching to the OS page cache that is shared between processes.
+// Other chunks, and all chunks if the mapping fails, go through the
+// regular cache.
+//
+// Compression and decompression run on threads owned by the file, so
+// that reads do not queue up behind MulticoreLauncher tasks. Waiting
+// for a task that has not started yet runs it on the calling thread. A
+// written chunk reserves clusters for its uncompressed size, and the
+// unused tail is released once the worker reports the compressed size.
+// Prefetched compressed chunks are inflated as soon as their reads
+// complete, and readIsReady() waits for that.
+//
+// Chunks written by concurrent builders end up with interleaved and
+// fragmented cluster lists. relayout() rewrites all chunks back to back
+// in the given order, and defragment() incrementally moves the most
+// fragmented chunks into contiguous runs of free clusters.
+//
+// read(), readPrefetch(), readIsReady(), readView(), getSize(),
+// getSizeOnDisk() and exists() may be called from several threads at once. Other methods
+// modify the file and must not overlap with any other call. The chunk
+// cache is split into shards, each with its own lock and LRU list, and
+// cache hits only lock their shard. Misses and evictions serialize on a
+// single I/O lock. Eviction visits the shards round-robin until the total
+// across shards fits in the cache size.
+//
+// ChunkInfo and ClusterInfo are stored in index pages of one cluster
+// each, and opening a file only reads the MasterChunk, which lists the
+// pages. A page is loaded the first time one of its entries is needed,
+// and free clusters enter the allocator as their pages are loaded.
+// Operations that visit the whole file, such as relayout(), load every
+// page. flush() writes only the pages whose contents have changed. They
+// are first appended to the end of the file together with the new
+// MasterChunk, and copied in place only after that journal has reached
+// the disk. A journal left behind by an interrupted flush() is replayed
+// when the file is opened.
+//
+// readView() hands out a refcounted reference to the chunk data instead
+// of a copy. Mapped chunks are referenced in place, and the views must be
+// released before the ClusteredFile is destroyed. Otherwise, the view
+// holds on to the cache buffer, which stays alive after eviction or a
+// later write() until the last view is released. Such buffers no longer
+// count towards the cache size.
+//------------------------------------------------------------------------
 
 class ClusteredFile
 {
@@ -42,6 +91,7 @@ public:
         Compression_ZLibLow,
         Compression_ZLibMedium,
         Compression_ZLibHigh,
+        Compression_LZ4,                    // LZ4 block format; always available
 
         Compression_Max,
     };
@@ -61,12 +111,45 @@ public:
 
     enum PrivateChunkID
     {
-        PrivateChunkID_Master = 0
+        PrivateChunkID_Master = 0,
+        PrivateChunkID_Index,               // clusters of the index pages
+    };
+
+    class View // read-only reference to the contents of a chunk, see readView()
+    {
+    public:
+                        View                (void)                  { init(); }
+                        View                (const View& other)     { init(); set(other); }
+                        ~View               (void)                  { reset(); }
+
+        const void*     getPtr              (void) const            { return m_ptr; }   // NULL if empty
+        int             getSize             (void) const            { return m_size; }  // bytes
+        void            reset               (void);
+        void            set                 (const View& other);
+        View&           operator=           (const View& other)     { set(other); return *this; }
+
+    private:
+        friend class ClusteredFile;
+        void            init                (void)                  { m_file = NULL; m_buffer = NULL; m_ptr = NULL; m_size = 0; }
+
+    private:
+        const ClusteredFile* m_file;        // non-NULL if the view points to the mapping
+        U8*             m_buffer;           // base of the referenced cache buffer, NULL if none
+        const void*     m_ptr;
+        S32             m_size;
     };
 
 private:
+    enum
+    {
+        NumCacheShards      = 16,           // must be a power of two
+        MinClusterSize      = 16,           // one ChunkInfo per index page
+        JournalTrailerSize  = 5 * sizeof(S32),
+    };
+
     struct Chunk;
     struct AsyncOp;
+    struct CodecTask;
 
     struct Cluster
     {
@@ -77,11 +160,39 @@ private:
         Cluster(void) : next(-1), pendingReads(0), pendingWrites(0) {}
     };
 
+    struct BufferHeader                     // at Buffer.base
+    {
+        S32             refCount;           // cache or AsyncOp, plus one per View
+    };
+
     struct Buffer
     {
         S32             size;
         U8*             base;
         U8*             ptr;
+
+        Buffer(void) : size(0), base(NULL), ptr(NULL) {}
+    };
+
+    struct IndexPage
+    {
+        S32             cluster;            // -1 if not allocated yet
+        S32             numFree;            // ClusterInfo pages only, valid until loaded
+        volatile bool   loaded;
+        Array<U8>       image;              // contents on disk, empty if the page must be written
+        Array<Cluster>  clusters;           // ClusterInfo pages only
+
+        IndexPage(void) : cluster(-1), numFree(0), loaded(false) {}
+    };
+
+    struct CacheShard
+    {
+        Spinlock        lock;
+        Chunk*          first;              // least recently used, NULL if none
+        Chunk*          last;               // most recently used, NULL if none
+        S64             used;               // bytes
+
+        CacheShard(void) : first(NULL), last(NULL), used(0) {}
     };
 
     struct Group
@@ -89,7 +200,8 @@ private:
         S32             id;
         Chunk*          firstFree;          // NULL if none
         Chunk*          lastFree;           // NULL if none
-        Array<Chunk*>   chunks;
+        Array<Chunk*>   chunks;             // NULL until the ChunkInfo page is loaded
+        Array<IndexPage*> pages;            // ChunkInfo pages, none for GroupID_Private
     };
 
     struct Chunk
@@ -107,6 +219,8 @@ private:
         Buffer          cachedData;
         bool            cachedDataCompressed;
         AsyncOp*        asyncOp;
+        const U8*       mappedData;         // NULL unless the chunk can be read in place
+        bool            mappedResident;     // mappedData has been read through the file once, see cacheReadPrefetch()
     };
 
     struct AsyncRange
@@ -123,6 +237,25 @@ private:
         Chunk*          dataOwner;          // (!dataOwner || data == dataOwner->cachedData)
         Chunk*          readTarget;
         Array<AsyncRange> ranges;
+
+        bool            dataCompressed;
+        bool            inflate;            // decompress data before handing it to readTarget
+        Buffer          inflated;           // decompression target
+        CodecTask*      codec;              // NULL if none
+
+        AsyncOp(void) : dataOwner(NULL), readTarget(NULL), dataCompressed(false), inflate(false), codec(NULL) {}
+    };
+
+    struct CodecTask
+    {
+        bool            isCompress;
+        Compression     compression;
+        const U8*       src;
+        S32             srcSize;
+        U8*             dst;                // decompression only
+        S32             dstSize;
+        Array<U8>       compressed;         // compression only
+        volatile bool   done;               // protected by m_codecMonitor
     };
 
     struct Backlink
@@ -140,10 +273,13 @@ public:
     S64                 getFileSize         (void)                                  { return m_file.getSize(); }
     F32                 getFragmentsPerChunk(void) const;
     bool                checkWritable       (void) const                            { return m_file.checkWritable(); }
+    bool                isMapped            (void) const                            { return (m_file.getMappedPtr() != NULL); }
 
     int                 getClusterSize      (void) const                            { return m_clusterSize; }
     void                setCompression      (Compression compression);
     Compression         getCompression      (void) const                            { return m_defaultCompression; }
+    static const char*  getCompressionName  (Compression compression);                 // e.g. "lz4", "zlib-high"
+    static bool         isCompressionSupported(Compression compression);
     S64                 getCacheSize        (void) const                            { return m_cacheSize; }
     void                setCacheSize        (S64 size)                              { FW_ASSERT(size >= 0); m_cacheSize = size; cacheEvict(); }
     S64                 getAsyncBytesPending(void) const                            { return m_asyncBytesPending; }
@@ -152,6 +288,8 @@ public:
     void                append              (ClusteredFile& other);
     void                set                 (ClusteredFile& other)                  { if (&other != this) { clear(); append(other); } }
     void                flush               (bool clearCache = true);
+    void                relayout            (const Array<Vec2i>& order);                // (groupID, chunkID); unlisted chunks follow in ID order
+    int                 defragment          (F32 maxFragmentsPerChunk, S64 maxBytes);   // returns the number of chunks moved
 
     int                 getNumGroups        (void) const                            { return m_groups.getSize(); }
     int                 getNumIDs           (int groupID) const;
@@ -164,6 +302,8 @@ public:
     template <class T> void read            (int groupID, int chunkID, Array<T>& data)     { data.reset((getSize(groupID, chunkID) + sizeof(T) - 1) / sizeof(T)); read(groupID, chunkID, data.getPtr(), data.getNumBytes()); }
     void                readPrefetch        (int groupID, int chunkID, int size);
     bool                readIsReady         (int groupID, int chunkID, int size);
+    const void*         readMapped          (int groupID, int chunkID) const;      // NULL unless the chunk can be read in place. Valid until the ClusteredFile is destroyed.
+    void                readView            (int groupID, int chunkID, View& view);    // references the data instead of copying it
 
     void                write               (int groupID, int chunkID, const void* data, int size);
     template <class T> void write           (int groupID, int chunkID, const Array<T>& data) { write(groupID, chunkID, data.getPtr(), data.getNumBytes()); }
@@ -177,63 +317,126 @@ public:
     ClusteredFile&      operator+=          (ClusteredFile& other)                  { append(other); return *this; }
 
 private:
-    Chunk*              get                 (int groupID, int chunkID) const        { return m_groups[groupID]->chunks[chunkID]; }
+    Chunk*              get                 (int groupID, int chunkID) const        { Chunk* c = m_groups[groupID]->chunks[chunkID]; return (c) ? c : loadChunk(groupID, chunkID); }
+    Cluster&            getCluster          (int idx) const                         { FW_ASSERT(idx >= 0 && idx < m_numClusters); IndexPage* p = m_clusterPages[idx / m_clustersPerPage]; if (!p->loaded) loadClusterPage(idx / m_clustersPerPage); return p->clusters[idx % m_clustersPerPage]; }
 
     void                initBuffer          (Buffer& buffer);
     void                allocBuffer         (Buffer& buffer, int size);
     void                freeBuffer          (Buffer& buffer);
 
     void                clearInternal       (void);
+    void                setClusterSize      (int clusterSize);
     bool                readMasterChunk     (void);
+    bool                readMasterChunkV2   (void);
     void                writeMasterChunk    (void);
+    int                 getMasterSize       (void) const;
     void                gatherBacklinks     (Array<Backlink>& backlinks);
-
+    void                mapChunks           (void);                                 // chunks loaded so far
+    void                mapChunk            (Chunk* c) const;
+
+    void                readJournal         (void);
+    void                writeJournal        (const Array<S32>& clusters, const Array<U8>& data);
+    void                readIndexCluster    (int cluster, void* ptr) const;
+    Chunk*              loadChunk           (int groupID, int chunkID) const;
+    void                loadChunkPage       (Group* g, int page) const;
+    void                loadClusterPage     (int page) const;
+    void                loadAllPages        (void) const;
+    void                loadFreeClusters    (int num);
+    void                updateIndexChunk    (void);
+    void                getIndexPages       (Array<IndexPage*>& pages) const;       // in the order of the IndexChunk
+    void                assignIndexClusters (void);
+    void                serializeChunkPage  (U8* out, const Group* g, int page) const;
+    void                serializeClusterPage(U8* out, int page) const;
+    void                stageIndexPage      (IndexPage* p, const Array<U8>& contents, Array<S32>& clusters, Array<U8>& data);
+    int                 addCluster          (void);
+    void                removeLastCluster   (void);
+
+    static Chunk*       allocChunk          (Group* g, int chunkID);
     Chunk*              createChunk         (int groupID, int chunkID);
     void                removeChunk         (Chunk* c, bool freeClusters);
-    void                addChunkToList      (Chunk* c, Chunk*& first, Chunk*& last);
-    void                removeChunkFromList (Chunk* c, Chunk*& first, Chunk*& last);
+    static void         addChunkToList      (Chunk* c, Chunk*& first, Chunk*& last);
+    static void         removeChunkFromList (Chunk* c, Chunk*& first, Chunk*& last);
+    int                 getNumClusters      (const Chunk* c) const                  { return max((c->compressedSize + m_clusterSize - 1) / m_clusterSize, 1); }
+    void                relocateChunk       (Chunk* c, int firstCluster);
+    void                setClusterOwner     (Array<Chunk*>& owners, const Chunk* c, Chunk* owner) const;
+
+    CacheShard&         getShard            (const Chunk* c)                        { return m_cacheShards[(c->id + c->group->id * 7) & (NumCacheShards - 1)]; }
+    S64                 getCacheUsed        (void) const;
+    bool                cacheReadFast       (Chunk* c, void* data, int size, View* view = NULL); // cache hit => copy to data and reference from view, if non-NULL, and return true
+    void                setView             (View& view, const Chunk* c) const;     // mapped or cached uncompressed
+    void                cacheInsert         (Chunk* c, const Buffer& data, bool compressed);
+    Buffer              cacheRemove         (Chunk* c);                             // returns the detached data
+    void                cacheTouch          (Chunk* c);
 
     const U8*           cacheRead           (Chunk* c, int size, bool needUncompressed = true);
-    bool                cacheReadPrefetch   (Chunk* c, int size);
+    bool                cacheReadPrefetch   (Chunk* c, int size, bool needUncompressed = true);
     bool                cacheReadIsReady    (Chunk* c, int size);
     void                cacheWrite          (Chunk* c, const void* data, int size, int compressedSize = -1);
     void                cacheCopy           (Chunk* dst, ClusteredFile& srcFile, Chunk* src);
     void                cacheEvict          (Chunk* c);
     void                cacheEvict          (void);
 
+    int                 allocClusters       (int size);
+    void                asyncStartChain     (AsyncOp* op, int firstCluster, bool isWrite);
     void                asyncStartRange     (AsyncOp* op, int dataOfs, int firstCluster, int numClusters, bool isWrite);
     void                asyncEndRange       (AsyncRange& range);
     void                asyncWait           (AsyncOp* op);
     void                asyncFinish         (void);
     void                asyncStall          (void);
+    void                asyncWaitAll        (void);
+    int                 asyncEndCompress    (AsyncOp* op); // returns the first cluster
+    void                asyncFinishCompress (Chunk* c);
+    void                asyncFinishCompress (void);
+
+    void                codecStart          (AsyncOp* op, bool isCompress);
+    void                codecWait           (CodecTask* task);
+    void                codecStop           (void);
+    static void         codecThreadFunc     (void* param);
+    static void         codecRun            (CodecTask* task);
 
     static void         compress            (Array<U8>& compressed, const void* data, int uncompressedSize, Compression compression);
     static void         decompress          (void* data, int uncompressedSize, const void* compressed, int compressedSize, Compression compression);
+    static void         compressLZ4         (Array<U8>& compressed, const U8* data, int uncompressedSize);
+    static bool         decompressLZ4       (U8* data, int uncompressedSize, const U8* compressed, int compressedSize);
 
 private:
                         ClusteredFile       (const ClusteredFile&); // forbidden
 
 private:
-    File                m_file;
+    mutable File        m_file;             // index pages are loaded from const methods
     S32                 m_clusterSize;
     Compression         m_defaultCompression;
-    BinaryHeap<S32>     m_freeClusters;
-    Array<Cluster>      m_clusters;
+    mutable BinaryHeap<S32> m_freeClusters;
+    S32                 m_numClusters;
+    S32                 m_clustersPerPage;  // ClusterInfo entries per index page
+    S32                 m_chunksPerPage;    // ChunkInfo entries per index page
+    Array<IndexPage*>   m_clusterPages;
+    mutable S32         m_unloadedFree;     // free clusters in ClusterInfo pages that are not loaded
+    S32                 m_freePageCursor;   // ClusterInfo pages before this have no unloaded free clusters
     Array<Group*>       m_groups;
+    Hash<S32, S32>      m_journalIndex;     // cluster => offset in m_journalData, read-only files
+    Array<U8>           m_journalData;
     bool                m_dirty;
 
-    Chunk*              m_firstCached;      // least recently used, NULL if none
-    Chunk*              m_lastCached;       // most recently used, NULL if none
-    S64                 m_cacheUsed;
+    CacheShard          m_cacheShards[NumCacheShards];
+    S32                 m_evictShard;       // next shard to evict from
     S64                 m_cacheSize;
+    mutable Spinlock    m_ioLock;           // everything except cache hits
     Array<AsyncOp*>     m_asyncOps;
     S64                 m_asyncBytesPending;
+    Array<Thread*>      m_codecThreads;     // started on first use
+    volatile bool       m_codecAbort;
+    Monitor             m_codecMonitor;     // m_codecQueue and CodecTask::done
+    Array<CodecTask*>   m_codecQueue;       // not started yet, oldest first
+    mutable S32         m_numMappedViews;   // protected by s_refLock
+
+    static Spinlock     s_refLock;          // buffer and view refcounts
 };
 
 //------------------------------------------------------------------------
 /*
 
-Clustered file format v2
+Clustered file format v3
 ------------------------
 
 - the basic unit of data is 32-bit little-endian int
@@ -242,35 +445,74 @@ Clustered file format v2
 - chunks are identified by groupID and chunkID, both ranging from 0 to num-1
 - groupID 0 is private, and cannot contain user chunks
 - MasterChunk (groupID 0, chunkID 0) starts at the first cluster and is linear
+- IndexChunk (groupID 0, chunkID 1) links the clusters of all index pages, in the order of MasterChunk
+- each index page is one cluster, holding either ClusterInfo or ChunkInfo
+- ChunkInfo of groupID 0 is implied by MasterChunk
+- Compression_LZ4 chunks are a single raw LZ4 block, without a frame header
+- a Journal may follow the last cluster
+- v2 files, which store all ChunkInfo and ClusterInfo in MasterChunk, are still read
 
 MasterChunk
     0       7       struct  MasterHeader
-    ?       n*6     struct  array of ChunkInfo (MasterHeader.numChunks)
-    7       n*1     struct  array of ClusterInfo (MasterHeader.numClusters)
+    7       n*1     struct  array of GroupInfo (MasterHeader.numGroups)
+    ?       n*2     struct  array of ClusterPageInfo (one per clusterSize/4 clusters)
+    ?       n*1     struct  array of ChunkPageInfo (one per clusterSize/16 chunks, for each group except 0)
     ?
 
 MasterHeader
     0       2       bytes   formatID (must be "Clusters")
-    2       1       int     formatVersion (must be 2)
+    2       1       int     formatVersion (must be 3)
     3       1       int     numClusters
-    4       1       int     clusterSize (bytes)
-    5       1       int     numChunks
+    4       1       int     clusterSize (bytes, at least 16)
+    5       1       int     numGroups
     6       1       int     defaultCompression (see ClusteredFile::Compression)
     7
 
-ChunkInfo
-    0       1       int     groupID
-    1       1       int     chunkID
-    2       1       int     firstCluster
-    3       1       int     compression (see ClusteredFile::Compression)
-    4       1       int     compressedSize
-    5       1       int     uncompressedSize
-    6
+GroupInfo
+    0       1       int     numIDs (must be 2 for groupID 0)
+    1
+
+ClusterPageInfo
+    0       1       int     cluster: index page
+    1       1       int     numFree: number of free clusters in the page
+    2
+
+ChunkPageInfo
+    0       1       int     cluster: index page
+    1
+
+ClusterInfo page
+    0       n*1     struct  array of ClusterInfo (-1 past numClusters)
+    ?
 
 ClusterInfo
     0       1       bits    next: next cluster in the chunk (FW_S32_MAX if none, -1 if free)
     1
 
+ChunkInfo page
+    0       n*4     struct  array of ChunkInfo (firstCluster = -1 past numIDs)
+    ?
+
+ChunkInfo
+    0       1       int     firstCluster (-1 if the chunk does not exist)
+    1       1       int     compression (see ClusteredFile::Compression)
+    2       1       int     compressedSize
+    3       1       int     uncompressedSize
+    4
+
+Journal
+    0       n*c     bytes   array of cluster contents (JournalTrailer.numEntries, JournalTrailer.clusterSize each)
+    ?       n*1     int     array of cluster indices to write them to
+    ?       5       struct  JournalTrailer
+    ?
+
+JournalTrailer
+    0       2       bytes   journalID (must be "Journal!")
+    2       1       int     clusterSize (bytes)
+    3       1       int     numEntries
+    4       1       int     checksum: hashArray() of the indices, combined with hashBuffer() of each cluster using hashBits()
+    5
+
 */
 //------------------------------------------------------------------------
 }
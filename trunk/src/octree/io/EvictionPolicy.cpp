@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "EvictionPolicy.hpp"
+#include "base/Math.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+F32 EvictionPolicy::getKeepScore(const SliceInfo& info) const
+{
+    const Params& p = m_params;
+
+    // Freshly loaded => keep regardless.
+
+    if (info.framesSinceLoad < p.minResidentFrames)
+        return FW_F32_MAX;
+
+    // Out of view => decay since last seen.
+
+    F32 keep = info.score;
+    if (!info.inView)
+        keep *= exp2(-(F32)info.framesSinceVisible / max(p.outOfViewHalfLife, 1.0f));
+
+    // Favor slices that are expensive to reload for the memory they free.
+
+    F32 reloadTime = (F32)info.diskBytes / max(p.diskBytesPerSecond, 1.0f) + info.importTime;
+    F32 megs = max((F32)info.memBytes * exp2(-20), 1.0f / 16.0f);
+    keep *= 1.0f + p.costWeight * reloadTime / megs;
+
+    // Hysteresis.
+
+    return keep * (1.0f + p.hysteresis);
+}
+
+//------------------------------------------------------------------------
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "base/Defs.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// Decides which loaded slices OctreeRuntime gives up first when memory
+// runs low. findSlices() with FindMode_Unload or FindMode_UnloadInView
+// asks the policy for a keep score per candidate, and OctreeManager only
+// unloads a slice if a load candidate scores higher. Subclass and pass
+// to OctreeRuntime::setEvictionPolicy() to customize.
+//
+// The default policy starts from the same projected-size score that
+// load candidates use, and adjusts it as follows:
+//  - Slices that have left the view decay towards zero over a few
+//    seconds' worth of frames instead of dropping immediately.
+//  - Slices that would be expensive to reload per megabyte freed are
+//    kept longer.
+//  - All loaded slices get a hysteresis bonus, and freshly loaded ones
+//    cannot be evicted at all, so that slices near the LOD boundary do
+//    not flip back and forth between frames.
+//------------------------------------------------------------------------
+
+class EvictionPolicy
+{
+public:
+    struct Params
+    {
+        F32             hysteresis;             // loaded slices are worth (1 + hysteresis) times a load candidate
+        S32             minResidentFrames;      // cannot be evicted for this many frames after loading
+        F32             outOfViewHalfLife;      // in frames
+        F32             diskBytesPerSecond;     // assumed read bandwidth for reload cost
+        F32             costWeight;             // keep score bonus per second of reload time per megabyte
+
+        Params(void)
+        {
+            hysteresis          = 0.25f;
+            minResidentFrames   = 30;
+            outOfViewHalfLife   = 60.0f;
+            diskBytesPerSecond  = 100.0f * 1024.0f * 1024.0f;
+            costWeight          = 10.0f;
+        }
+    };
+
+    struct SliceInfo
+    {
+        S32             sliceID;
+        F32             score;                  // projected size, as with load candidates
+        bool            inView;                 // false if outside the frustum or the view is unknown
+        S32             framesSinceVisible;
+        S32             framesSinceLoad;
+        S64             memBytes;               // runtime memory used by the slice's blocks
+        S32             diskBytes;              // 0 if unknown
+        F32             importTime;             // in seconds, spent in beginImport() .. commitImport()
+    };
+
+public:
+                        EvictionPolicy      (void)              {}
+    virtual             ~EvictionPolicy     (void)              {}
+
+    void                setParams           (const Params& p)   { m_params = p; }
+    const Params&       getParams           (void) const        { return m_params; }
+
+    virtual F32         getKeepScore        (const SliceInfo& info) const; // lower is evicted first
+
+private:
+                        EvictionPolicy      (const EvictionPolicy&); // forbidden
+    EvictionPolicy&     operator=           (const EvictionPolicy&); // forbidden
+
+private:
+    Params              m_params;
+};
+
+//------------------------------------------------------------------------
+}
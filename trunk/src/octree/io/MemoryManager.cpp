@@ -73,8 +73,9 @@ MemoryManager::Relocation& MemoryManager::Relocation::operator=(const Relocation
 
 //------------------------------------------------------------------------
 
-MemoryManager::MemoryManager(Mode mode, int align)
+MemoryManager::MemoryManager(Mode mode, int align, AllocMode allocMode)
 :   m_mode          (mode),
+    m_allocMode     (allocMode),
     m_buffer        (NULL, 0, Buffer::Hint_None, align)
 {
     // Determine page size.
@@ -115,6 +116,14 @@ MemoryManager::MemoryManager(Mode mode, int align)
     m_freeRanges.startPage  = FW_S64_MAX;
     m_freeRanges.endPage    = FW_S64_MAX;
 
+    if (m_allocMode == AllocMode_Buddy)
+    {
+        FW_ASSERT(m_numPages <= FW_S32_MAX);
+        m_buddyOrder.reset((S32)m_numPages);
+        m_buddyPrev.reset((S32)m_numPages);
+        m_buddyNext.reset((S32)m_numPages);
+    }
+
     clear();
 }
 
@@ -136,6 +145,15 @@ void MemoryManager::clear(void)
         removeFreeRange(m_freeRanges.next);
     addFreeRange(&m_freeRanges, 0, m_numPages);
     m_numFreePages = m_numPages;
+
+    if (m_allocMode == AllocMode_Buddy)
+    {
+        for (int i = 0; i < MaxBuddyOrders; i++)
+            m_buddyHeads[i] = -1;
+        for (int i = 0; i < m_buddyOrder.getSize(); i++)
+            m_buddyOrder[i] = -1;
+        freeBuddyRange(0, m_numPages);
+    }
 }
 
 //------------------------------------------------------------------------
@@ -152,6 +170,17 @@ S64 MemoryManager::alloc(S64 numBytes, Relocation* reloc)
     if (numPages > m_numFreePages)
         return -1;
 
+    // Buddy system => never relocates.
+
+    if (m_allocMode == AllocMode_Buddy)
+    {
+        S64 page = allocBuddy(numPages);
+        if (page == -1)
+            return -1;
+        m_numFreePages -= numPages;
+        return page << m_pageBytesLog;
+    }
+
     // Of all memory ranges containing enough free pages,
     // find the one with the least amount of allocated pages.
 
@@ -227,6 +256,15 @@ void MemoryManager::free(S64 ofs, S64 numBytes)
     S64 endPage = startPage + (max(numBytes - 1, (S64)0) >> m_pageBytesLog) + 1;
     FW_ASSERT(startPage >= 0 && endPage <= m_numPages);
 
+    // Buddy system => return pages to the free lists.
+
+    if (m_allocMode == AllocMode_Buddy)
+    {
+        freeBuddyRange(startPage, endPage);
+        m_numFreePages += endPage - startPage;
+        return;
+    }
+
     // Find previous range.
 
     FreeRange* range = &m_freeRanges;
@@ -252,6 +290,34 @@ void MemoryManager::free(S64 ofs, S64 numBytes)
 
 //------------------------------------------------------------------------
 
+S64 MemoryManager::getLargestFreeBytes(void) const
+{
+    S64 largest = 0;
+    if (m_allocMode == AllocMode_Buddy)
+    {
+        for (int i = MaxBuddyOrders - 1; i >= 0 && !largest; i--)
+            if (m_buddyHeads[i] != -1)
+                largest = (S64)1 << i;
+    }
+    else
+    {
+        for (const FreeRange* range = m_freeRanges.next; range != &m_freeRanges; range = range->next)
+            largest = max(largest, range->endPage - range->startPage);
+    }
+    return largest << m_pageBytesLog;
+}
+
+//------------------------------------------------------------------------
+
+F32 MemoryManager::getFragmentation(void) const
+{
+    if (!m_numFreePages)
+        return 0.0f;
+    return 1.0f - (F32)((F64)getLargestFreeBytes() / (F64)getFreeBytes());
+}
+
+//------------------------------------------------------------------------
+
 MemoryManager::FreeRange* MemoryManager::addFreeRange(FreeRange* prev, S64 startPage, S64 endPage)
 {
     FW_ASSERT(prev);
@@ -347,6 +413,95 @@ void MemoryManager::compact(FreeRange* startRange, FreeRange* endRange, Relocati
 
 //------------------------------------------------------------------------
 
+S64 MemoryManager::allocBuddy(S64 numPages)
+{
+    // Find the smallest free block that is large enough.
+
+    int order = 0;
+    while (((S64)1 << order) < numPages)
+        order++;
+    while (order < MaxBuddyOrders && m_buddyHeads[order] == -1)
+        order++;
+    if (order >= MaxBuddyOrders)
+        return -1;
+
+    // Take it, and return the unused tail to the free lists.
+
+    S32 page = m_buddyHeads[order];
+    unlinkBuddy(page);
+    freeBuddyRange(page + numPages, page + ((S64)1 << order));
+    return page;
+}
+
+//------------------------------------------------------------------------
+
+void MemoryManager::freeBuddyRange(S64 startPage, S64 endPage)
+{
+    while (startPage < endPage)
+    {
+        // Find the largest aligned block at the start of the range.
+
+        int order = 0;
+        while (order + 1 < MaxBuddyOrders &&
+               (startPage & (((S64)2 << order) - 1)) == 0 &&
+               startPage + ((S64)2 << order) <= endPage)
+        {
+            order++;
+        }
+
+        S64 page = startPage;
+        startPage += (S64)1 << order;
+
+        // Merge with free buddies.
+
+        while (order + 1 < MaxBuddyOrders)
+        {
+            S64 buddy = page ^ ((S64)1 << order);
+            if (buddy + ((S64)1 << order) > m_numPages || m_buddyOrder[(S32)buddy] != order)
+                break;
+
+            unlinkBuddy((S32)buddy);
+            page = min(page, buddy);
+            order++;
+        }
+
+        linkBuddy((S32)page, order);
+    }
+}
+
+//------------------------------------------------------------------------
+
+void MemoryManager::linkBuddy(S32 page, int order)
+{
+    S32 next = m_buddyHeads[order];
+    m_buddyOrder[page]  = (S8)order;
+    m_buddyPrev[page]   = -1;
+    m_buddyNext[page]   = next;
+    if (next != -1)
+        m_buddyPrev[next] = page;
+    m_buddyHeads[order] = page;
+}
+
+//------------------------------------------------------------------------
+
+void MemoryManager::unlinkBuddy(S32 page)
+{
+    int order = m_buddyOrder[page];
+    S32 prev = m_buddyPrev[page];
+    S32 next = m_buddyNext[page];
+    FW_ASSERT(order != -1);
+
+    if (prev != -1)
+        m_buddyNext[prev] = next;
+    else
+        m_buddyHeads[order] = next;
+    if (next != -1)
+        m_buddyPrev[next] = prev;
+    m_buddyOrder[page] = -1;
+}
+
+//------------------------------------------------------------------------
+
 void MemoryManager::allocMaximalCudaBuffer(void)
 {
     struct Block
@@ -54,6 +54,12 @@ public:
         Mode_Cuda,
     };
 
+    enum AllocMode
+    {
+        AllocMode_Compact,  // first fit, compacts and relocates live blocks if fragmented
+        AllocMode_Buddy,    // buddy system over pages, never relocates
+    };
+
     //------------------------------------------------------------------------
 
     class Relocation
@@ -89,14 +95,21 @@ private:
         S64                 endPage;                // exclusive
     };
 
+    enum
+    {
+        MaxBuddyOrders      = 32,
+    };
+
 public:
-                            MemoryManager           (Mode mode, int align);
+                            MemoryManager           (Mode mode, int align, AllocMode allocMode = AllocMode_Compact);
                             ~MemoryManager          (void);
 
     Buffer&                 getBuffer               (void)                      { return m_buffer; }
     Mode                    getMode                 (void) const                { return m_mode; }
     S64                     getTotalBytes           (void) const                { return m_numPages << m_pageBytesLog; }
     S64                     getFreeBytes            (void) const                { return m_numFreePages << m_pageBytesLog; }
+    S64                     getLargestFreeBytes     (void) const;
+    F32                     getFragmentation        (void) const;               // 0 = all free memory is contiguous, 1 = none of it
 
     void                    clear                   (void);
     S64                     alloc                   (S64 numBytes, Relocation* reloc = NULL); // -1 if out of memory
@@ -107,6 +120,11 @@ private:
     void                    removeFreeRange         (FreeRange* range);
     void                    compact                 (FreeRange* startRange, FreeRange* endRange, Relocation* reloc);
 
+    S64                     allocBuddy              (S64 numPages); // -1 if no block is large enough
+    void                    freeBuddyRange          (S64 startPage, S64 endPage);
+    void                    linkBuddy               (S32 page, int order);
+    void                    unlinkBuddy             (S32 page);
+
     void                    allocMaximalCudaBuffer  (void);
 
 private:
@@ -115,6 +133,7 @@ private:
 
 private:
     Mode                    m_mode;
+    AllocMode               m_allocMode;
     S32                     m_pageBytes;
     S32                     m_pageBytesLog;
 
@@ -122,7 +141,12 @@ private:
     Array<CUdeviceptr>      m_cudaBlocks;
     S64                     m_numPages;
     S64                     m_numFreePages;
-    FreeRange               m_freeRanges;
+    FreeRange               m_freeRanges;               // AllocMode_Compact
+
+    S32                     m_buddyHeads[MaxBuddyOrders]; // AllocMode_Buddy, first free block of each order, -1 if none
+    Array<S8>               m_buddyOrder;               // per page, order of the free block starting there, -1 if none
+    Array<S32>              m_buddyPrev;                // per page, free list links
+    Array<S32>              m_buddyNext;
 
     Buffer                  m_compactTemp;
 };
@@ -29,14 +29,30 @@
 #include "3d/Mesh.hpp"
 #include "io/MeshBinaryIO.hpp"
 #include "../Util.hpp"
+#include "base/Sort.hpp"
 
 using namespace FW;
 
 //------------------------------------------------------------------------
 
+static U64 spreadMortonBits(U32 v) // 19 bits => every third bit
+{
+    U64 x = v & 0x7FFFF;
+    x = (x | (x << 32)) & 0x001F00000000FFFFull;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+    x = (x | (x << 8))  & 0x100F00F00F00F00Full;
+    x = (x | (x << 4))  & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2))  & 0x1249249249249249ull;
+    return x;
+}
+
+//------------------------------------------------------------------------
+
 OctreeFile::OctreeFile(const String& fileName, File::Mode mode, int clusterSize)
 :   m_file              (fileName, mode, clusterSize, true),
-    m_octreeChunkDirty  (false)
+    m_octreeChunkDirty  (false),
+    m_sliceIDStride     (0),
+    m_nextSliceID       (0)
 {
     switch (mode)
     {
@@ -94,6 +110,9 @@ void OctreeFile::clearSlices(void)
         setSliceState(i, SliceState_Unused);
     }
 
+    for (int i = 0; i < m_file.getNumIDs(GroupID_RuntimeBlocks); i++)
+        m_file.remove(GroupID_RuntimeBlocks, i);
+
     for (int i = 0; i < m_objects.getSize(); i++)
     {
         if (m_objects[i].object.rootSlice == -1)
@@ -121,6 +140,7 @@ void OctreeFile::clearSlices(int objID)
         readSlice(sliceID, slice);
 
         m_file.remove(GroupID_Slices, sliceID);
+        m_file.remove(GroupID_RuntimeBlocks, sliceID);
         setSliceState(sliceID, SliceState_Unused);
 
         for (int i = 0; i < slice.getNumChildEntries(); i++)
@@ -255,6 +275,63 @@ void OctreeFile::flush(bool clearCache)
 
 //------------------------------------------------------------------------
 
+void OctreeFile::relayout(void)
+{
+    struct Entry
+    {
+        U64     key;        // level, then Morton code
+        S32     sliceID;
+    };
+
+    if (!checkWritable())
+        return;
+
+    // Write the OctreeChunk first so that it is placed at the start.
+
+    if (m_octreeChunkDirty)
+    {
+        writeOctreeChunk();
+        m_octreeChunkDirty = false;
+    }
+
+    // Sort slices by level and position.
+
+    Array<Entry> entries;
+    for (int i = 0; i < getNumSliceIDs() && !hasError(); i++)
+    {
+        if (!hasSlice(i))
+            continue;
+
+        S32 info[OctreeSlice::SliceInfo_End];
+        m_file.read(GroupID_Slices, i, info, sizeof(info));
+
+        int scale = clamp(info[OctreeSlice::SliceInfo_CubeScale], 0, (int)UnitScale);
+        int level = UnitScale - scale;
+        int shift = scale + max(level - 19, 0);
+
+        Entry& e = entries.add();
+        e.sliceID = i;
+        e.key = ((U64)level << 57) |
+            (spreadMortonBits((U32)info[OctreeSlice::SliceInfo_CubePos + 0] >> shift) << 0) |
+            (spreadMortonBits((U32)info[OctreeSlice::SliceInfo_CubePos + 1] >> shift) << 1) |
+            (spreadMortonBits((U32)info[OctreeSlice::SliceInfo_CubePos + 2] >> shift) << 2);
+    }
+    FW_SORT_ARRAY(entries, Entry, a.key < b.key);
+
+    // Runtime blocks are loaded together with their slice => keep them adjacent.
+
+    Array<Vec2i> order;
+    order.add(Vec2i(GroupID_Static, StaticChunkID_Octree));
+    for (int i = 0; i < entries.getSize(); i++)
+    {
+        order.add(Vec2i(GroupID_Slices, entries[i].sliceID));
+        order.add(Vec2i(GroupID_RuntimeBlocks, entries[i].sliceID));
+    }
+    m_file.relayout(order);
+}
+
+//------------------------------------------------------------------------
+
 int OctreeFile::addObject(void)
 {
     ObjectInfo& obj         = m_objects.add();
@@ -341,6 +418,27 @@ void OctreeFile::setMesh(int objID, MeshBase* mesh)
 
 //------------------------------------------------------------------------
 
+int OctreeFile::getFreeSliceID(void) const
+{
+    if (!m_sliceIDStride)
+        return m_file.getFreeID(GroupID_Slices);
+
+    while (hasSlice(m_nextSliceID))
+        m_nextSliceID += m_sliceIDStride;
+    return m_nextSliceID;
+}
+
+//------------------------------------------------------------------------
+
+void OctreeFile::setSliceIDStride(int firstID, int stride)
+{
+    FW_ASSERT(firstID >= 0 && stride >= 0);
+    m_sliceIDStride = stride;
+    m_nextSliceID = firstID;
+}
+
+//------------------------------------------------------------------------
+
 OctreeFile::SliceState OctreeFile::getSliceState(int sliceID) const
 {
     int idx = sliceID >> 4;
@@ -354,7 +452,9 @@ OctreeFile::SliceState OctreeFile::getSliceState(int sliceID) const
 
 void OctreeFile::readSlice(int sliceID, OctreeSlice& slice)
 {
-    m_file.read(GroupID_Slices, sliceID, slice.getData());
+    ClusteredFile::View view;
+    m_file.readView(GroupID_Slices, sliceID, view);
+    slice.setView(view);
     FW_ASSERT(!slice.getSize() || slice.getID() == sliceID);
     FW_ASSERT(!slice.getSize() || slice.getState() == getSliceState(sliceID));
 }
@@ -382,7 +482,9 @@ void OctreeFile::writeSlice(const OctreeSlice& slice)
 
     FW_ASSERT(slice.getID() >= 0);
     FW_ASSERT(slice.getState() != SliceState_Unused);
-    m_file.write(GroupID_Slices, slice.getID(), slice.getData().getPtr(), slice.getData().getNumBytes());
+    m_file.write(GroupID_Slices, slice.getID(), slice.getPtr(), slice.getSize() * (int)sizeof(S32));
+    m_file.remove(GroupID_RuntimeBlocks, slice.getID());
+    removeChildRuntimeBlocks(slice);
     setSliceState(slice.getID(), slice.getState());
 }
 
@@ -394,6 +496,7 @@ void OctreeFile::removeSlice(int sliceID)
         return;
 
     m_file.remove(GroupID_Slices, sliceID);
+    m_file.remove(GroupID_RuntimeBlocks, sliceID);
     setSliceState(sliceID, SliceState_Unused);
 
     for (int i = 0; i < m_objects.getSize(); i++)
@@ -408,6 +511,41 @@ void OctreeFile::removeSlice(int sliceID)
 
 //------------------------------------------------------------------------
 
+void OctreeFile::mergeSlices(OctreeFile& other)
+{
+    if (!checkWritable() || &other == this)
+        return;
+
+    // Copy the chunks as they are. Compressed data is reused if both
+    // files use the same compression.
+
+    for (int i = 0; i < other.getNumSliceIDs() && !hasError(); i++)
+    {
+        if (!other.hasSlice(i))
+            continue;
+
+        m_file.copy(GroupID_Slices, i, other.m_file, GroupID_Slices, i);
+        if (other.hasRuntimeBlocks(i))
+            m_file.copy(GroupID_RuntimeBlocks, i, other.m_file, GroupID_RuntimeBlocks, i);
+        else
+            m_file.remove(GroupID_RuntimeBlocks, i);
+        setSliceState(i, other.getSliceState(i));
+    }
+}
+
+//------------------------------------------------------------------------
+
+void OctreeFile::writeRuntimeBlocks(int sliceID, const Array<S32>& data)
+{
+    if (!checkWritable())
+        return;
+
+    FW_ASSERT(hasSlice(sliceID));
+    m_file.write(GroupID_RuntimeBlocks, sliceID, data);
+}
+
+//------------------------------------------------------------------------
+
 void OctreeFile::printStats(void)
 {
     struct Level
@@ -604,6 +742,7 @@ void OctreeFile::printStats(void)
     printf("%-17s%.0f megs\n", "Size on disk", (F32)m_file.getFileSize() * exp2(-20));
     printf("%-17s%.1f%%\n", "Overhead", 100.0f * (1.0f - (F32)totalBytes / (F32)m_file.getFileSize()));
     printf("%-17s%.2f\n", "Fragments/chunk", m_file.getFragmentsPerChunk());
+    printf("%-17s%s\n", "Compression", ClusteredFile::getCompressionName(m_file.getCompression()));
     printf("\n");
 }
 
@@ -643,6 +782,36 @@ void OctreeFile::setSliceState(int sliceID, SliceState state)
 
 //------------------------------------------------------------------------
 
+void OctreeFile::removeChildRuntimeBlocks(const OctreeSlice& slice)
+{
+    // Runtime blocks embed nodes inherited from the parent's block, so
+    // rewriting a slice makes the ones of all descendants stale.
+    // bakeRuntimeBlocks() writes them top-down and we remove them the
+    // same way => a slice without runtime blocks has no descendants
+    // with them, and the traversal can stop there.
+
+    Array<S32> stack;
+    for (int i = 0; i < slice.getNumChildEntries(); i++)
+        if (slice.getChildEntry(i) >= 0 && hasRuntimeBlocks(slice.getChildEntry(i)))
+            stack.add(slice.getChildEntry(i));
+
+    while (stack.getSize())
+    {
+        int sliceID = stack.removeLast();
+        m_file.remove(GroupID_RuntimeBlocks, sliceID);
+        if (!hasSlice(sliceID))
+            continue;
+
+        OctreeSlice child;
+        readSlice(sliceID, child);
+        for (int i = 0; i < child.getNumChildEntries(); i++)
+            if (child.getChildEntry(i) >= 0 && hasRuntimeBlocks(child.getChildEntry(i)))
+                stack.add(child.getChildEntry(i));
+    }
+}
+
+//------------------------------------------------------------------------
+
 bool OctreeFile::readOctreeChunk(void)
 {
     if (!m_file.exists(GroupID_Static, StaticChunkID_Octree))
@@ -732,6 +901,27 @@ void OctreeFile::writeOctreeChunk(void)
 
 //------------------------------------------------------------------------
 
+void OctreeSlice::set(const OctreeSlice& other)
+{
+    if (&other == this)
+        return;
+
+    m_view = other.m_view;
+    m_data.set(other.m_data);
+}
+
+//------------------------------------------------------------------------
+
+void OctreeSlice::swap(OctreeSlice& other)
+{
+    ClusteredFile::View tmp = m_view;
+    m_view = other.m_view;
+    other.m_view = tmp;
+    m_data.swap(other.m_data);
+}
+
+//------------------------------------------------------------------------
+
 void OctreeSlice::init(int numChildEntries, int maxAttach, int numNodes, int numSplitNodes)
 {
     FW_ASSERT(numChildEntries >= 1);
@@ -749,6 +939,7 @@ void OctreeSlice::init(int numChildEntries, int maxAttach, int numNodes, int num
 
     // Set layout.
 
+    m_view.reset();
     m_data.resize(attachDataOfs);
     set(SliceInfo_NumChildEntries, numChildEntries);
     set(SliceInfo_ChildEntryPtr, childEntryOfs);
@@ -784,7 +975,7 @@ void OctreeSlice::startAttach(AttachIO::AttachType type)
 
     set(SliceInfo_NumAttach, numAttach + 1);
     set(attachInfoOfs + AttachInfo_Type, type);
-    set(attachInfoOfs + AttachInfo_Ptr, m_data.getSize());
+    set(attachInfoOfs + AttachInfo_Ptr, getSize());
 }
 
 //------------------------------------------------------------------------
@@ -792,7 +983,16 @@ void OctreeSlice::startAttach(AttachIO::AttachType type)
 void OctreeSlice::endAttach(void)
 {
     int attachInfoOfs = getAttachInfoOfs(getNumAttach() - 1);
-    set(attachInfoOfs + AttachInfo_Size, m_data.getSize() - get(attachInfoOfs + AttachInfo_Ptr));
+    set(attachInfoOfs + AttachInfo_Size, getSize() - get(attachInfoOfs + AttachInfo_Ptr));
+}
+
+//------------------------------------------------------------------------
+
+void OctreeSlice::detach(void)
+{
+    FW_ASSERT(isView());
+    m_data.set((const S32*)m_view.getPtr(), getSize());
+    m_view.reset();
 }
 
 //------------------------------------------------------------------------
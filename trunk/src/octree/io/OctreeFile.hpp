@@ -36,6 +36,9 @@ namespace FW
 class MeshBase;
 class OctreeSlice;
 
+//------------------------------------------------------------------------
+// Slices and runtime blocks may be read from several threads at once,
+// see ClusteredFile. Everything else must be called from one thread.
 //------------------------------------------------------------------------
 
 class OctreeFile
@@ -46,6 +49,7 @@ public:
         UnitScale               = 23,
         MaxPrefetchSlices       = 256,
         MaxPrefetchBytesTotal   = 64 << 20,
+        DefragBytesPerStep      = 64 << 20,
     };
 
     enum SliceState
@@ -70,7 +74,8 @@ private:
     {
         GroupID_Static = ClusteredFile::GroupID_Default,
         GroupID_Slices,
-        GroupID_Meshes
+        GroupID_Meshes,
+        GroupID_RuntimeBlocks
     };
 
     enum StaticChunkID
@@ -105,6 +110,8 @@ public:
     void                clearSlices         (int objID);
     void                set                 (OctreeFile& other, int maxLevels = UnitScale, bool includeMeshes = true, bool enablePrints = false);
     void                flush               (bool clearCache = true);
+    void                relayout            (void);                 // slices breadth-first, Morton order within each level
+    int                 defragment          (S64 maxBytes = DefragBytesPerStep) { return m_file.defragment(1.5f, maxBytes); } // no-op unless over 1.5 fragments per chunk
 
     int                 addObject           (void);
     int                 getNumObjects       (void) const            { return m_objects.getSize(); }
@@ -115,7 +122,8 @@ public:
     void                setMesh             (int objID, MeshBase* mesh);
 
     int                 getNumSliceIDs      (void) const            { return m_file.getNumIDs(GroupID_Slices); }
-    int                 getFreeSliceID      (void) const            { return m_file.getFreeID(GroupID_Slices); }
+    int                 getFreeSliceID      (void) const;
+    void                setSliceIDStride    (int firstID, int stride); // getFreeSliceID() returns firstID + n * stride; 0 to use the lowest free ID
     bool                hasSlice            (int sliceID) const     { return m_file.exists(GroupID_Slices, sliceID); }
     int                 getSliceSize        (int sliceID)           { return m_file.getSize(GroupID_Slices, sliceID); }
     SliceState          getSliceState       (int sliceID) const;
@@ -124,8 +132,16 @@ public:
     void                readSlicePrefetch   (int sliceID);
     bool                readSliceIsReady    (int sliceID);
 
-    void                writeSlice          (const OctreeSlice& slice);
+    void                writeSlice          (const OctreeSlice& slice); // discards runtime blocks for the slice and its descendants
     void                removeSlice         (int sliceID);
+    void                mergeSlices         (OctreeFile& other);    // copies all slices of other under the same IDs, see setSliceIDStride()
+
+    bool                hasRuntimeBlocks    (int sliceID) const     { return m_file.exists(GroupID_RuntimeBlocks, sliceID); }
+    int                 getRuntimeBlocksSize(int sliceID)           { return m_file.getSize(GroupID_RuntimeBlocks, sliceID); }
+    void                readRuntimeBlocks   (int sliceID, Array<S32>& data) { m_file.read(GroupID_RuntimeBlocks, sliceID, data); }
+    void                readRuntimeBlocksPrefetch(int sliceID)      { m_file.readPrefetch(GroupID_RuntimeBlocks, sliceID, m_file.getSize(GroupID_RuntimeBlocks, sliceID)); }
+    bool                readRuntimeBlocksIsReady(int sliceID)       { return m_file.readIsReady(GroupID_RuntimeBlocks, sliceID, m_file.getSize(GroupID_RuntimeBlocks, sliceID)); }
+    void                writeRuntimeBlocks  (int sliceID, const Array<S32>& data); // see OctreeRuntime::exportRuntimeBlocks()
 
     void                printStats          (void);
 
@@ -134,6 +150,7 @@ public:
 private:
     void                clearInternal       (void);
     void                setSliceState       (int sliceID, SliceState state);
+    void                removeChildRuntimeBlocks(const OctreeSlice& slice);
 
     bool                readOctreeChunk     (void);
     void                writeOctreeChunk    (void);
@@ -144,12 +161,20 @@ private:
 private:
     ClusteredFile       m_file;
     bool                m_octreeChunkDirty;
+    S32                 m_sliceIDStride;
+    mutable S32         m_nextSliceID;
     Array<ObjectInfo>   m_objects;
     Array<U32>          m_sliceState; // 16 values per dword
 };
 
 //------------------------------------------------------------------------
 
+// An OctreeSlice either owns its data or refers to the contents of a
+// chunk through a ClusteredFile::View. Copying a view only adds a
+// reference, and the first non-const access copies the data into the
+// slice. Use swap() to hand an owned slice over without copying.
+//------------------------------------------------------------------------
+
 class OctreeSlice // all offsets and sizes are dword-based
 {
 public:
@@ -189,15 +214,21 @@ public:
 
 public:
                         OctreeSlice         (void)                  {}
-                        OctreeSlice         (OctreeSlice& other)    : m_data(other.m_data) {}
+                        OctreeSlice         (const OctreeSlice& other) { set(other); }
                         ~OctreeSlice        (void)                  {}
 
-    const Array<S32>&   getData             (void) const            { return m_data; }
-    Array<S32>&         getData             (void)                  { return m_data; }
-    int                 getSize             (void) const            { return m_data.getSize(); }
-    S32                 get                 (int idx) const         { return m_data[idx]; }
-    S32&                get                 (int idx)               { return m_data[idx]; }
-    void                set                 (int idx, S32 value)    { m_data.set(idx, value); }
+    bool                isView              (void) const            { return (m_view.getPtr() != NULL); }
+    void                setView             (const ClusteredFile::View& view) { m_data.reset(); m_view = view; }
+    void                set                 (const OctreeSlice& other);
+    void                swap                (OctreeSlice& other);
+
+    Array<S32>&         getData             (void)                  { if (isView()) detach(); return m_data; }
+    int                 getSize             (void) const            { return (isView()) ? m_view.getSize() / (int)sizeof(S32) : m_data.getSize(); }
+    const S32*          getPtr              (int idx = 0) const     { FW_ASSERT(idx >= 0 && idx <= getSize()); return ((isView()) ? (const S32*)m_view.getPtr() : m_data.getPtr()) + idx; }
+    S32*                getPtr              (int idx = 0)           { return getData().getPtr(idx); }
+    S32                 get                 (int idx) const         { FW_ASSERT(idx >= 0 && idx < getSize()); return getPtr()[idx]; }
+    S32&                get                 (int idx)               { return getData()[idx]; }
+    void                set                 (int idx, S32 value)    { getData().set(idx, value); }
 
     void                init                (int numChildEntries, int maxAttach, int numNodes, int numSplitNodes);
 
@@ -214,8 +245,8 @@ public:
 
     int                 getNumChildEntries  (void) const            { return get(SliceInfo_NumChildEntries); }
     int                 getChildEntryOfs    (void) const            { return get(SliceInfo_ChildEntryPtr); }
-    const S32*          getChildEntryPtr    (int idx = 0) const     { FW_ASSERT(idx >= 0 && idx <= getNumChildEntries()); return m_data.getPtr(getChildEntryOfs() + idx); }
-    S32*                getChildEntryPtr    (int idx = 0)           { FW_ASSERT(idx >= 0 && idx <= getNumChildEntries()); return m_data.getPtr(getChildEntryOfs() + idx); }
+    const S32*          getChildEntryPtr    (int idx = 0) const     { FW_ASSERT(idx >= 0 && idx <= getNumChildEntries()); return getPtr(getChildEntryOfs() + idx); }
+    S32*                getChildEntryPtr    (int idx = 0)           { FW_ASSERT(idx >= 0 && idx <= getNumChildEntries()); return getPtr(getChildEntryOfs() + idx); }
     int                 getChildEntry       (int idx) const         { FW_ASSERT(idx < getNumChildEntries()); return *getChildEntryPtr(idx); }
     void                setChildEntry       (int idx, int v)        { FW_ASSERT(idx < getNumChildEntries()); *getChildEntryPtr(idx) = v; }
 
@@ -224,30 +255,35 @@ public:
     AttachIO::AttachType getAttachType      (int attachIdx) const   { return (AttachIO::AttachType)get(getAttachInfoOfs(attachIdx) + AttachInfo_Type); }
     int                 getAttachOfs        (int attachIdx) const   { return get(getAttachInfoOfs(attachIdx) + AttachInfo_Ptr); }
     int                 getAttachSize       (int attachIdx) const   { return get(getAttachInfoOfs(attachIdx) + AttachInfo_Size); }
+    const S32*          getAttachPtr        (int attachIdx) const   { return getPtr(getAttachOfs(attachIdx)); }
     void                startAttach         (AttachIO::AttachType type);
     void                endAttach           (void);
 
     int                 getNumNodes         (void) const            { return get(SliceInfo_NumNodes); }
     int                 getNodeSplitOfs     (void) const            { return get(SliceInfo_NodeSplitPtr); }
-    const U32*          getNodeSplitPtr     (void) const            { return (const U32*)m_data.getPtr(getNodeSplitOfs()); }
-    U32*                getNodeSplitPtr     (void)                  { return (U32*)m_data.getPtr(getNodeSplitOfs()); }
+    const U32*          getNodeSplitPtr     (void) const            { return (const U32*)getPtr(getNodeSplitOfs()); }
+    U32*                getNodeSplitPtr     (void)                  { return (U32*)getPtr(getNodeSplitOfs()); }
     bool                isNodeSplit         (int nodeIdx) const;
     void                setNodeSplit        (int nodeIdx, bool isSplit);
 
     int                 getNumSplitNodes    (void) const            { return get(SliceInfo_NumSplitNodes); }
     int                 getNodeValidMaskOfs (void) const            { return get(SliceInfo_NodeValidMaskPtr); }
-    const U8*           getNodeValidMaskPtr (int splitNodeIdx = 0) const { FW_ASSERT(splitNodeIdx >= 0 && splitNodeIdx <= getNumSplitNodes()); return (const U8*)m_data.getPtr(getNodeValidMaskOfs()) + splitNodeIdx; }
-    U8*                 getNodeValidMaskPtr (int splitNodeIdx = 0)  { FW_ASSERT(splitNodeIdx >= 0 && splitNodeIdx <= getNumSplitNodes()); return (U8*)m_data.getPtr(getNodeValidMaskOfs()) + splitNodeIdx; }
+    const U8*           getNodeValidMaskPtr (int splitNodeIdx = 0) const { FW_ASSERT(splitNodeIdx >= 0 && splitNodeIdx <= getNumSplitNodes()); return (const U8*)getPtr(getNodeValidMaskOfs()) + splitNodeIdx; }
+    U8*                 getNodeValidMaskPtr (int splitNodeIdx = 0)  { FW_ASSERT(splitNodeIdx >= 0 && splitNodeIdx <= getNumSplitNodes()); return (U8*)getPtr(getNodeValidMaskOfs()) + splitNodeIdx; }
     U8                  getNodeValidMask    (int splitNodeIdx) const { FW_ASSERT(splitNodeIdx < getNumSplitNodes()); return *getNodeValidMaskPtr(splitNodeIdx); }
     void                setNodeValidMask    (int splitNodeIdx, U32 validMask) { FW_ASSERT(splitNodeIdx < getNumSplitNodes()); *getNodeValidMaskPtr(splitNodeIdx) = (U8)validMask; }
     bool                hasNodeChild        (int splitNodeIdx, int childIdx) const { FW_ASSERT(childIdx >= 0 && childIdx < 8); return ((getNodeValidMask(splitNodeIdx) & (1 << childIdx)) != 0); }
 
-    OctreeSlice&        operator=           (const OctreeSlice& other) { m_data.set(other.m_data); return *this; }
+    OctreeSlice&        operator=           (const OctreeSlice& other) { set(other); return *this; }
     S32                 operator[]          (int idx) const         { return get(idx); }
     S32&                operator[]          (int idx)               { return get(idx); }
 
 private:
-    Array<S32>          m_data;
+    void                detach              (void);                 // copy the view into m_data
+
+private:
+    Array<S32>          m_data;             // empty if isView()
+    ClusteredFile::View m_view;
 };
 
 //------------------------------------------------------------------------
@@ -265,6 +301,7 @@ Group       ID
     1       0       struct  OctreeChunk
     2       sliceID struct  Slice
     3       objID   file    BinaryMesh
+    4       sliceID struct  RuntimeBlocks (optional)
 
 OctreeChunk
     0       5       struct  OctreeHeader
@@ -344,6 +381,19 @@ SliceNodeValidMaskPacked (covers 4 split nodes)
     ...
     1
 
+RuntimeBlocks (written by "octree optimize", ignored if the runtime attachment types differ)
+    0       1       int     pageBytesLog2 (see OctreeRuntime::PageBytesLog2)
+    1       1       int     numAttachTypes
+    2       n*1     int     array of runtime attachment types (numAttachTypes, see AttachIO::AttachType)
+    ?       1       int     numBlocks: same as SliceInfo.numChildEntries
+    ?       n*?     struct  array of RuntimeBlock (numBlocks)
+    ?
+
+RuntimeBlock (one per SliceChildEntry)
+    0       1       int     size: 0 if the entry is split or has no nodes
+    1       n*1     int     block data in OctreeRuntime format (size)
+    ?
+
 Attachments
     See AttachIO.h
 
@@ -28,19 +28,30 @@
 #include "OctreeRuntime.hpp"
 #include "3d/Mesh.hpp"
 #include "base/BinaryHeap.hpp"
+#include "base/Timer.hpp"
 #include "../Util.hpp"
 
 using namespace FW;
 
 //------------------------------------------------------------------------
 
-OctreeRuntime::OctreeRuntime(MemoryManager::Mode mode)
-:   m_mem                   (mode, PageBytes),
+S32 OctreeRuntime::s_reachStamp = 0;
+
+//------------------------------------------------------------------------
+
+OctreeRuntime::OctreeRuntime(MemoryManager::Mode mode, MemoryManager::AllocMode allocMode)
+:   m_mem                   (mode, PageBytes, allocMode),
     m_numSlicesLoaded       (0),
     m_numNodesLoaded        (0),
     m_numNodeChildrenLoaded (0),
-    m_loadSliceID           (-1)
+    m_frameIndex            (0),
+    m_loadImport            (NULL),
+    m_commitImport          (NULL)
 {
+    m_findView.viewSize         = 0.0f;
+    m_findView.focalLength      = 1.0f;
+    m_findView.minVoxelPixels   = 0.0f;
+    m_evictionPolicy            = &m_defaultEvictionPolicy;
 }
 
 //------------------------------------------------------------------------
@@ -70,7 +81,9 @@ void OctreeRuntime::clear(void)
     m_numSlicesLoaded       = 0;
     m_numNodesLoaded        = 0;
     m_numNodeChildrenLoaded = 0;
-    m_loadSliceID           = -1;
+
+    delete m_loadImport;
+    m_loadImport            = NULL;
 }
 
 //------------------------------------------------------------------------
@@ -126,6 +139,7 @@ bool OctreeRuntime::addObject(int objectID, int rootSliceID, const Array<AttachI
     }
 
     slice->isReached    = true;
+    slice->reachStamp   = ++s_reachStamp;
     slice->objectID     = objectID;
     slice->subtrunk     = 0;
     slice->cubePos      = Vec3i(0);
@@ -199,37 +213,56 @@ bool OctreeRuntime::setSliceState(int sliceID, OctreeFile::SliceState state)
 
 S32 OctreeRuntime::setSliceToLoad(const OctreeSlice& sliceData)
 {
-    struct StackEntry
-    {
-        const S32*  oldNode;
-        S32         numLevels;
-    };
+    delete m_loadImport;
+    m_loadImport = beginImportInternal(sliceData);
+    if (!m_loadImport)
+        return 0;
 
-    // No data => ignore.
+    prepareImport(m_loadImport);
+    return m_loadImport->memDelta;
+}
 
-    m_loadSliceID = -1;
-    m_loadBuffer.reset();
+//------------------------------------------------------------------------
+
+OctreeRuntime::SliceImport* OctreeRuntime::beginImportInternal(const OctreeSlice& sliceData)
+{
+    // No data => ignore.
 
+    Timer timer(true);
     if (!sliceData.getSize())
-        return 0;
+        return NULL;
 
     // Set state.
 
     int sliceID = sliceData.getID();
     if (!setSliceState(sliceID, sliceData.getState()))
-        return 0;
+        return NULL;
 
     // Get slice info.
 
     Slice* slice = m_slices[sliceID];
+    const Object* obj = m_objects[slice->objectID];
+    FW_ASSERT(obj);
     FW_ASSERT(slice->cubePos == sliceData.getCubePos());
     FW_ASSERT(slice->cubeScale == sliceData.getCubeScale());
     FW_ASSERT(slice->nodeScale == sliceData.getNodeScale());
-    m_loadBlocks.resize(sliceData.getNumChildEntries());
 
+    SliceImport* imp    = new SliceImport;
+    imp->sliceData      = &sliceData;
+    imp->sliceID        = sliceID;
+    imp->reachStamp     = slice->reachStamp;
+    imp->objectID       = slice->objectID;
+    imp->nodeAlign      = obj->nodeAlign;
+    imp->attachIO       = new AttachIO(obj->attachIO->getRuntimeTypes());
+    imp->oldRootNode    = NULL;
+    imp->numLevels      = slice->cubeScale - slice->nodeScale + 1;
+    imp->memDelta       = 0;
+    imp->attachIO->layoutTrunkBlock(obj->trunksPerPage, obj->pagesPerTrunkBlock, obj->trunkBlockInfoOfs);
+
+    imp->loadBlocks.resize(sliceData.getNumChildEntries());
     for (int i = 0; i < sliceData.getNumChildEntries(); i++)
     {
-        LoadBlock& lb       = m_loadBlocks[i];
+        LoadBlock& lb       = imp->loadBlocks[i];
         lb.childEntry       = sliceData.getChildEntry(i);
         lb.data.clear();
         lb.rootNodeBlock    = NULL;
@@ -249,40 +282,102 @@ S32 OctreeRuntime::setSliceToLoad(const OctreeSlice& sliceData)
 
     // Download old block.
 
-    Array<StackEntry> stack(NULL, 1);
-    stack[0].oldNode = NULL;
-    stack[0].numLevels = slice->cubeScale - slice->nodeScale + 1;
-
     if (slice->parentSliceID != -1)
     {
         const Block& block = m_slices[slice->parentSliceID]->blocks[slice->indexInParent].block;
         FW_ASSERT(block.ofs != -1);
-        m_loadBuffer.reset(NULL, block.size * sizeof(S32), Buffer::Hint_None, PageBytes);
-        m_loadBuffer.setRange(0, m_mem.getBuffer(), block.ofs * sizeof(S32), block.size * sizeof(S32));
-        stack[0].oldNode = (const S32*)m_loadBuffer.getPtr() + m_objects[slice->objectID]->nodeAlign;
+        imp->oldBlock.reset(NULL, block.size * sizeof(S32), Buffer::Hint_None, PageBytes);
+        imp->oldBlock.setRange(0, m_mem.getBuffer(), block.ofs * sizeof(S32), block.size * sizeof(S32));
+        imp->oldRootNode = (const S32*)imp->oldBlock.getPtr() + obj->nodeAlign;
     }
 
-    // Build new blocks.
+    imp->importTime = timer.getElapsed();
+    return imp;
+}
+
+//------------------------------------------------------------------------
+
+bool OctreeRuntime::getRuntimeBlocks(Array<const S32*>& blocks, const SliceImport* imp)
+{
+    const Array<S32>& data = imp->runtimeBlocks;
+    const Array<AttachIO::AttachType>& types = imp->attachIO->getRuntimeTypes();
+    int numBlocks = imp->loadBlocks.getSize();
+    blocks.clear();
+
+    // Check header.
 
+    int ofs = 2 + types.getSize() + 1;
+    if (data.getSize() < ofs || data[0] != PageBytesLog2 || data[1] != types.getSize() || data[ofs - 1] != numBlocks)
+        return false;
+
+    for (int i = 0; i < types.getSize(); i++)
+        if (data[2 + i] != types[i])
+            return false;
+
+    // Locate blocks.
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        if (ofs >= data.getSize() || data[ofs] < 0 || data[ofs] > data.getSize() - ofs - 1)
+            return false;
+        blocks.add(data.getPtr(ofs));
+        ofs += data[ofs] + 1;
+    }
+    return (ofs == data.getSize());
+}
+
+//------------------------------------------------------------------------
+
+OctreeRuntime::SliceImport* OctreeRuntime::beginImport(OctreeSlice* sliceData)
+{
+    FW_ASSERT(sliceData);
+    SliceImport* imp = beginImportInternal(*sliceData);
+    if (imp)
+        imp->ownedSliceData = sliceData;
+    else
+        delete sliceData;
+    return imp;
+}
+
+//------------------------------------------------------------------------
+
+void OctreeRuntime::prepareImport(SliceImport* imp)
+{
+    struct StackEntry
+    {
+        const S32*  oldNode;
+        S32         numLevels;
+    };
+
+    FW_ASSERT(imp);
+    Timer timer(true);
+    const OctreeSlice& sliceData = *imp->sliceData;
+    bool hasParent = (imp->oldRootNode != NULL);
+
+    Array<StackEntry> stack(NULL, 1);
+    stack[0].oldNode = imp->oldRootNode;
+    stack[0].numLevels = imp->numLevels;
+
+    // Build new blocks, or take them from the file if pre-baked.
+
+    Array<const S32*> runtimeBlocks;
+    bool baked = getRuntimeBlocks(runtimeBlocks, imp);
     int nodeIdx = 0;
     int splitNodeIdx = 0;
-    S32 memDelta = 0;
+    S32 memDelta = -(S32)(imp->oldBlock.getSize() / sizeof(S32));
 
-    if (slice->parentSliceID != -1)
-        memDelta -= (S32)m_slices[slice->parentSliceID]->blocks[slice->indexInParent].block.size;
-
-    m_objects[slice->objectID]->attachIO->beginSliceImport(&sliceData);
+    imp->attachIO->beginSliceImport(&sliceData);
 
-    for (int i = 0; i < m_loadBlocks.getSize(); i++)
+    for (int i = 0; i < imp->loadBlocks.getSize(); i++)
     {
-        LoadBlock& lb = m_loadBlocks[i];
+        LoadBlock& lb = imp->loadBlocks[i];
         StackEntry curr = stack.removeLast();
 
         // Split => push children to stack.
 
         if (lb.childEntry == OctreeSlice::ChildEntry_Split)
         {
-            lb.rootNodeBlock = (const S32*)m_loadBuffer.getPtr();
+            lb.rootNodeBlock = (hasParent) ? imp->oldRootNode - imp->nodeAlign : NULL;
             lb.rootNode = curr.oldNode;
 
             for (int j = 7; j >= 0; j--)
@@ -298,31 +393,133 @@ S32 OctreeRuntime::setSliceToLoad(const OctreeSlice& sliceData)
 
         // Does not have any nodes => skip.
 
-        if (!curr.oldNode && slice->parentSliceID != -1)
+        if (!curr.oldNode && hasParent)
             continue;
 
         // Build block.
 
-        gatherImportNodes(&sliceData, &nodeIdx, &splitNodeIdx, curr.oldNode, curr.numLevels);
-        int blockInfoOfs = layoutImportNodes(slice->objectID);
-        buildBlock(lb.data, blockInfoOfs, m_loadSliceID, i, slice->objectID);
+        if (baked)
+        {
+            FW_ASSERT(*runtimeBlocks[i] > 0);
+            lb.data.set(runtimeBlocks[i] + 1, *runtimeBlocks[i]);
+        }
+        else
+        {
+            gatherImportNodes(imp->importNodes, &sliceData, &nodeIdx, &splitNodeIdx, curr.oldNode, curr.numLevels);
+            int blockInfoOfs = layoutImportNodes(imp->importNodes, imp->nodeAlign);
+            buildBlock(lb.data, imp->importNodes, imp->attachIO, blockInfoOfs, imp->sliceID, i);
+        }
+
         lb.rootNodeBlock = lb.data.getPtr();
-        lb.rootNode = lb.rootNodeBlock + m_objects[slice->objectID]->nodeAlign;
+        lb.rootNode = lb.rootNodeBlock + imp->nodeAlign;
         memDelta += (lb.data.getSize() + PageSize - 1) & -PageSize;
     }
 
-    FW_ASSERT(nodeIdx == sliceData.getNumNodes());
-    FW_ASSERT(splitNodeIdx == sliceData.getNumSplitNodes());
+    FW_ASSERT(baked || nodeIdx == sliceData.getNumNodes());
+    FW_ASSERT(baked || splitNodeIdx == sliceData.getNumSplitNodes());
+
+    imp->memDelta = memDelta * sizeof(S32);
+    imp->importNodes.reset();
+    imp->runtimeBlocks.reset();
+    imp->importTime += timer.getElapsed();
+}
+
+//------------------------------------------------------------------------
+
+void OctreeRuntime::exportRuntimeBlocks(Array<S32>& out, const SliceImport* imp)
+{
+    FW_ASSERT(imp);
+    const Array<AttachIO::AttachType>& types = imp->attachIO->getRuntimeTypes();
+
+    out.clear();
+    out.add(PageBytesLog2);
+    out.add(types.getSize());
+    for (int i = 0; i < types.getSize(); i++)
+        out.add(types[i]);
+
+    out.add(imp->loadBlocks.getSize());
+    for (int i = 0; i < imp->loadBlocks.getSize(); i++)
+    {
+        const Array<S32>& data = imp->loadBlocks[i].data;
+        out.add(data.getSize());
+        out.add(data);
+    }
+}
+
+//------------------------------------------------------------------------
+
+void OctreeRuntime::bakeRuntimeBlocks(OctreeFile& file, int objectID, const Array<AttachIO::AttachType>& runtimeAttachTypes)
+{
+    int rootSliceID = file.getObject(objectID).rootSlice;
+    clear();
+    if (rootSliceID == -1 || !addObject(objectID, rootSliceID, runtimeAttachTypes))
+        return;
+
+    // Load slices depth-first, so that each one is prepared against the
+    // same parent block as during rendering. Unload each subtree once it
+    // has been processed to keep memory usage bounded.
+
+    Array<S32> stack(rootSliceID);
+    Array<S32> blocks;
+
+    while (stack.getSize() && !hasError())
+    {
+        int sliceID = stack.removeLast();
+        if (sliceID < 0)
+        {
+            unloadSlice(~sliceID);
+            continue;
+        }
+
+        // Import and write the blocks.
+
+        OctreeSlice* sliceData = new OctreeSlice;
+        file.readSlice(sliceID, *sliceData);
+        SliceImport* imp = beginImport(sliceData);
+        if (!imp)
+            continue;
+
+        prepareImport(imp);
+        exportRuntimeBlocks(blocks, imp);
+        file.writeRuntimeBlocks(sliceID, blocks);
+
+        if (!commitImport(imp) || !isSliceLoaded(sliceID))
+        {
+            setError("OctreeRuntime: Out of memory while baking slice %d!", sliceID);
+            delete imp;
+            break;
+        }
+
+        // Queue children.
 
-    // Let loadSlice() do the rest.
+        stack.add(~sliceID);
+        for (int i = sliceData->getNumChildEntries() - 1; i >= 0; i--)
+        {
+            int child = sliceData->getChildEntry(i);
+            if (child >= 0 && file.getSliceState(child) == OctreeFile::SliceState_Complete)
+                stack.add(child);
+        }
+        delete imp;
+    }
 
-    m_loadSliceID = sliceID;
-    return memDelta * sizeof(S32);
+    clear();
 }
 
 //------------------------------------------------------------------------
 
 bool OctreeRuntime::loadSlice(void)
+{
+    if (!m_loadImport || !commitImport(m_loadImport))
+        return (!m_loadImport);
+
+    delete m_loadImport;
+    m_loadImport = NULL;
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+bool OctreeRuntime::commitImport(SliceImport* imp)
 {
     struct StackEntry
     {
@@ -332,19 +529,30 @@ bool OctreeRuntime::loadSlice(void)
         S32     subtrunk;
     };
 
-    if (m_loadSliceID == -1)
+    FW_ASSERT(imp);
+    Timer timer(true);
+
+    // Slice no longer reachable in the state the import was prepared for => drop.
+
+    int sliceID = imp->sliceID;
+    if (sliceID >= m_slices.getSize() || m_slices[sliceID]->reachStamp != imp->reachStamp ||
+        !m_slices[sliceID]->isReached || m_slices[sliceID]->isLoaded)
+    {
         return true;
+    }
 
-    Slice* slice = m_slices[m_loadSliceID];
+    Slice* slice = m_slices[sliceID];
     Object* obj = m_objects[slice->objectID];
+    Array<LoadBlock>& loadBlocks = imp->loadBlocks;
     bool ok = true;
     FW_ASSERT(obj);
+    m_commitImport = imp; // allocateBlock() may relocate the new blocks
 
     // Allocate trunks and blocks.
 
-    for (int i = 0; i < m_loadBlocks.getSize() && ok; i++)
+    for (int i = 0; i < loadBlocks.getSize() && ok; i++)
     {
-        LoadBlock& lb = m_loadBlocks[i];
+        LoadBlock& lb = loadBlocks[i];
         if (!lb.rootNode)
             continue;
 
@@ -364,14 +572,15 @@ bool OctreeRuntime::loadSlice(void)
 
     if (!ok)
     {
-        for (int i = 0; i < m_loadBlocks.getSize(); i++)
+        for (int i = 0; i < loadBlocks.getSize(); i++)
         {
-            LoadBlock& lb = m_loadBlocks[i];
+            LoadBlock& lb = loadBlocks[i];
             if (lb.splitTrunkID != -1)
                 freeTrunk(slice->objectID, lb.splitTrunkID);
             lb.splitTrunkID = -1;
             freeBlock(lb.block);
         }
+        m_commitImport = NULL;
         return false;
     }
 
@@ -382,7 +591,7 @@ bool OctreeRuntime::loadSlice(void)
 
     // Update children.
 
-    slice->blocks.resize(m_loadBlocks.getSize());
+    slice->blocks.resize(loadBlocks.getSize());
     Array<StackEntry> stack(NULL, 1);
 
     stack[0].cubePos    = slice->cubePos;
@@ -390,10 +599,10 @@ bool OctreeRuntime::loadSlice(void)
     stack[0].trunkID    = slice->trunkID;
     stack[0].subtrunk   = slice->subtrunk;
 
-    for (int i = 0; i < m_loadBlocks.getSize(); i++)
+    for (int i = 0; i < loadBlocks.getSize(); i++)
     {
         StackEntry curr = stack.removeLast();
-        const LoadBlock& lb = m_loadBlocks[i];
+        const LoadBlock& lb = loadBlocks[i];
         SliceBlock& sb = slice->blocks[i];
 
         // Copy LoadBlock to SliceBlock.
@@ -453,8 +662,9 @@ bool OctreeRuntime::loadSlice(void)
         FW_ASSERT(!c->isReached && !c->isLoaded);
 
         c->isReached     = true;
+        c->reachStamp    = ++s_reachStamp;
         c->objectID      = slice->objectID;
-        c->parentSliceID = m_loadSliceID;
+        c->parentSliceID = sliceID;
         c->indexInParent = i;
         c->trunkID       = curr.trunkID;
         c->subtrunk      = curr.subtrunk;
@@ -468,7 +678,11 @@ bool OctreeRuntime::loadSlice(void)
 
     // Update rest of the state.
 
-    slice->isLoaded = true;
+    slice->isLoaded         = true;
+    slice->loadFrame        = m_frameIndex;
+    slice->lastVisibleFrame = m_frameIndex;
+    slice->diskBytes        = imp->diskBytes;
+    slice->importTime       = imp->importTime + timer.getElapsed();
     if (slice->parentSliceID != -1)
         m_slices[slice->parentSliceID]->numChildrenLoaded++;
 
@@ -476,9 +690,9 @@ bool OctreeRuntime::loadSlice(void)
     m_numNodesLoaded += slice->numNodes;
     m_numNodeChildrenLoaded += slice->numNodeChildren;
 
-    m_loadSliceID = -1;
-    m_loadBlocks.clear();
-    m_loadBuffer.reset();
+    m_commitImport = NULL;
+    loadBlocks.clear();
+    imp->oldBlock.reset();
     return true;
 }
 
@@ -542,7 +756,8 @@ void OctreeRuntime::findSlices(
     const Vec3f&        areaLo,
     const Vec3f&        areaHi,
     int                 maxLevels,
-    int                 maxResults)
+    int                 maxResults,
+    const Set<S32>*     visibleSlices)
 {
     FW_ASSERT(maxLevels >= 0);
     FW_ASSERT(maxResults >= 0);
@@ -553,6 +768,26 @@ void OctreeRuntime::findSlices(
     if (!hasObject(objectID) || !maxResults)
         return;
 
+    // Visibility feedback lists the slices that rays needed more detail
+    // for. Rays that ended in a trunk node (-1) cannot be attributed to
+    // a slice; the renderer leaves them out, and since no slice has -1
+    // as its parent, a stray entry would not match anything either.
+
+    bool loadMode = (mode == FindMode_Load || mode == FindMode_Build || mode == FindMode_LoadOrBuild ||
+                     mode == FindMode_LoadInView || mode == FindMode_LoadOrBuildInView);
+
+    // View-dependent => transform frustum planes from viewport space
+    // to the scaled octree space that cubePos uses. FindMode_Unload does
+    // not score by the view, but still tells the eviction policy which
+    // slices are in it when a view has been set.
+
+    bool inView = (mode == FindMode_LoadInView || mode == FindMode_LoadOrBuildInView || mode == FindMode_UnloadInView);
+    bool usePlanes = (inView || mode == FindMode_Unload);
+    Vec4f planes[6];
+    if (usePlanes)
+        usePlanes = getViewPlanes(planes);
+    inView = (inView && usePlanes);
+
     // Calculate temporary values.
 
     S32 scaleLimit = OctreeFile::UnitScale + 1 - maxLevels;
@@ -585,11 +820,22 @@ void OctreeRuntime::findSlices(
         case FindMode_LoadOrBuild:      valid = (!slice->isLoaded); break;
         case FindMode_Unload:           valid = (slice->isLoaded && !slice->numChildrenLoaded); break;
         case FindMode_UnloadDeepest:    valid = (slice->isLoaded && !slice->numChildrenLoaded); break;
+        case FindMode_LoadInView:       valid = (!slice->isLoaded && !slice->isUnbuilt); break;
+        case FindMode_LoadOrBuildInView: valid = (!slice->isLoaded); break;
+        case FindMode_UnloadInView:     valid = (slice->isLoaded && !slice->numChildrenLoaded); break;
         default:                        FW_ASSERT(false); return;
         }
         if (!valid)
             continue;
 
+        // Not requested by visibility feedback => do not load or build.
+
+        if (visibleSlices && loadMode &&
+            slice->parentSliceID != -1 && !visibleSlices->contains(slice->parentSliceID))
+        {
+            continue;
+        }
+
         // Calculate temporary values.
 
         F32 cubeSize = exp2(slice->cubeScale);
@@ -601,6 +847,12 @@ void OctreeRuntime::findSlices(
             sqr(max(areaLoScaled.y - cubeHi.y, cubeLo.y - areaHiScaled.y, 0.0f)) +
             sqr(max(areaLoScaled.z - cubeHi.z, cubeLo.z - areaHiScaled.z, 0.0f)));
 
+        // Cull against the view frustum.
+
+        bool inFrustum = (!usePlanes || isCubeInView(planes, cubeLo, cubeHi));
+        if (loadMode && !inFrustum)
+            continue;
+
         // Evaluate score.
 
         F32 score;
@@ -609,11 +861,24 @@ void OctreeRuntime::findSlices(
         case FindMode_Load:             score = exp2(slice->nodeScale) / dist; break;
         case FindMode_Build:            score = exp2(slice->nodeScale) / dist; break;
         case FindMode_LoadOrBuild:      score = exp2(slice->nodeScale) / dist; break;
-        case FindMode_Unload:           score = -exp2(slice->nodeScale) / dist; break;
+        case FindMode_Unload:           score = -getKeepScore(sliceID, exp2(slice->nodeScale) / dist, inFrustum); break;
         case FindMode_UnloadDeepest:    score = (F32)-slice->nodeScale; break;
+        case FindMode_LoadInView:       score = exp2(slice->nodeScale) / dist * m_findView.focalLength; break;
+        case FindMode_LoadOrBuildInView: score = exp2(slice->nodeScale) / dist * m_findView.focalLength; break;
+        case FindMode_UnloadInView:     score = -getKeepScore(sliceID, exp2(slice->nodeScale) / dist * m_findView.focalLength, inFrustum); break;
         default:                        FW_ASSERT(false); return;
         }
 
+        // Voxels would project smaller than required => not worth loading.
+        // The slice adds voxels of half its node size, and the nearest
+        // one can be as close as the nearest point of the cube.
+
+        if (inView && loadMode &&
+            exp2(slice->nodeScale - 1) * m_findView.focalLength < m_findView.minVoxelPixels * (dist - cubeSize * 0.5f))
+        {
+            continue;
+        }
+
         // Not good enough => skip.
 
         if (results.getSize() == maxResults && score <= results.getLast().score)
@@ -637,7 +902,7 @@ void OctreeRuntime::findSlices(
 
     // Unload => negate scores.
 
-    if (mode == FindMode_Unload || mode == FindMode_UnloadDeepest)
+    if (!loadMode)
         for (int i = 0; i < results.getSize(); i++)
             results[i].score = -results[i].score;
 }
@@ -664,15 +929,44 @@ OctreeRuntime::FindResult OctreeRuntime::findSlice(
 
 //------------------------------------------------------------------------
 
+void OctreeRuntime::updateVisibility(int objectID)
+{
+    Vec4f planes[6];
+    if (!hasObject(objectID) || !getViewPlanes(planes))
+        return;
+
+    Array<S32> stack(m_objects[objectID]->rootSliceID);
+    while (stack.getSize())
+    {
+        int sliceID = stack.removeLast();
+        Slice* slice = m_slices[sliceID];
+        if (!slice->isLoaded)
+            continue;
+
+        Vec3f cubeLo = Vec3f(slice->cubePos);
+        Vec3f cubeHi = cubeLo + exp2(slice->cubeScale);
+        if (!isCubeInView(planes, cubeLo, cubeHi))
+            continue;
+
+        slice->lastVisibleFrame = m_frameIndex;
+        for (int i = 0; i < slice->blocks.getSize(); i++)
+            if (slice->blocks[i].childEntry >= 0)
+                stack.add(slice->blocks[i].childEntry);
+    }
+}
+
+//------------------------------------------------------------------------
+
 String OctreeRuntime::getStats(void) const
 {
     S64 total = m_mem.getTotalBytes();
     S64 used = total - m_mem.getFreeBytes();
 
-    return sprintf("OctreeRuntime: slices %d, megs %.0f, used %.0f%%, bytes/voxel %.2f",
+    return sprintf("OctreeRuntime: slices %d, megs %.0f, used %.0f%%, frag %.0f%%, bytes/voxel %.2f",
         m_numSlicesLoaded,
         (F64)used * exp2(-20),
         (F64)used / (F64)total * 100.0,
+        m_mem.getFragmentation() * 100.0f,
         (F64)used / (F64)max(m_numNodeChildrenLoaded, (S64)1));
 }
 
@@ -730,8 +1024,9 @@ OctreeRuntime::Block OctreeRuntime::allocateBlock(S64 size)
             blocks[j].block.ofs += m_reloc.getDWordDelta(blocks[j].block.ofs);
     }
 
-    for (int i = 0; i < m_loadBlocks.getSize(); i++)
-        m_loadBlocks[i].block.ofs += m_reloc.getDWordDelta(m_loadBlocks[i].block.ofs);
+    if (m_commitImport)
+        for (int i = 0; i < m_commitImport->loadBlocks.getSize(); i++)
+            m_commitImport->loadBlocks[i].block.ofs += m_reloc.getDWordDelta(m_commitImport->loadBlocks[i].block.ofs);
     return block;
 }
 
@@ -959,10 +1254,10 @@ void OctreeRuntime::unloadSliceInternal(int sliceID)
     if (slice->parentSliceID != -1)
     {
         Block& block = m_slices[slice->parentSliceID]->blocks[slice->indexInParent].block;
-        gatherImportNodes(NULL, NULL, NULL, bufferData + slice->subtrunk * 2 + obj->nodeAlign, slice->cubeScale - slice->nodeScale);
-        int blockInfoOfs = layoutImportNodes(slice->objectID);
+        gatherImportNodes(m_unloadNodes, NULL, NULL, NULL, bufferData + slice->subtrunk * 2 + obj->nodeAlign, slice->cubeScale - slice->nodeScale);
+        int blockInfoOfs = layoutImportNodes(m_unloadNodes, obj->nodeAlign);
         obj->attachIO->beginSliceImport(NULL);
-        buildBlock(m_unloadBlock, blockInfoOfs, slice->parentSliceID, slice->indexInParent, slice->objectID);
+        buildBlock(m_unloadBlock, m_unloadNodes, obj->attachIO, blockInfoOfs, slice->parentSliceID, slice->indexInParent);
 
         // Allocate.
 
@@ -973,7 +1268,7 @@ void OctreeRuntime::unloadSliceInternal(int sliceID)
         // Update trunk node.
 
         Trunk& trunk = obj->trunks[slice->trunkID];
-        trunk.nonLeafMask[slice->subtrunk] = m_importNodes[0].nonLeafMask;
+        trunk.nonLeafMask[slice->subtrunk] = m_unloadNodes[0].nonLeafMask;
         trunk.childOfs[slice->subtrunk] = block.ofs + obj->nodeAlign * 2;
         updateTrunkNode(trunk, slice->subtrunk);
 
@@ -1029,6 +1324,12 @@ OctreeRuntime::Slice* OctreeRuntime::getOrCreateSlice(S32 sliceID)
         slice->cubePos       = Vec3i(0);
         slice->cubeScale     = OctreeFile::UnitScale;
         slice->nodeScale     = OctreeFile::UnitScale;
+        slice->reachStamp    = 0;
+
+        slice->loadFrame        = 0;
+        slice->lastVisibleFrame = 0;
+        slice->diskBytes        = 0;
+        slice->importTime       = 0.0f;
     }
     return m_slices[sliceID];
 }
@@ -1050,7 +1351,77 @@ S64 OctreeRuntime::getRootNodeOfs(int objectID)
 
 //------------------------------------------------------------------------
 
+bool OctreeRuntime::getViewPlanes(Vec4f* planes) const
+{
+    // Transform frustum planes from viewport space to the scaled octree
+    // space that Slice::cubePos uses.
+
+    const Vec2f& size = m_findView.viewSize;
+    if (size.x <= 0.0f || size.y <= 0.0f)
+        return false;
+
+    Vec4f viewportPlanes[6] =
+    {
+        Vec4f(1.0f, 0.0f, 0.0f, 0.0f),  Vec4f(-1.0f, 0.0f, 0.0f, size.x),
+        Vec4f(0.0f, 1.0f, 0.0f, 0.0f),  Vec4f(0.0f, -1.0f, 0.0f, size.y),
+        Vec4f(0.0f, 0.0f, 1.0f, 1.0f),  Vec4f(0.0f, 0.0f, -1.0f, 1.0f),
+    };
+
+    F32 unit = exp2(-OctreeFile::UnitScale);
+    for (int i = 0; i < 6; i++)
+    {
+        Vec4f p = m_findView.viewportToOctreeN * viewportPlanes[i];
+        planes[i] = Vec4f(p.getXYZ() * unit, p.w);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+bool OctreeRuntime::isCubeInView(const Vec4f* planes, const Vec3f& cubeLo, const Vec3f& cubeHi)
+{
+    // Test the corner of the cube that lies furthest along each plane normal.
+
+    for (int i = 0; i < 6; i++)
+    {
+        const Vec4f& p = planes[i];
+        Vec3f v(
+            (p.x >= 0.0f) ? cubeHi.x : cubeLo.x,
+            (p.y >= 0.0f) ? cubeHi.y : cubeLo.y,
+            (p.z >= 0.0f) ? cubeHi.z : cubeLo.z);
+        if (dot(p.getXYZ(), v) + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+F32 OctreeRuntime::getKeepScore(int sliceID, F32 score, bool inView) const
+{
+    const Slice* slice = m_slices[sliceID];
+
+    EvictionPolicy::SliceInfo info;
+    info.sliceID            = sliceID;
+    info.score              = score;
+    info.inView             = inView;
+    info.framesSinceVisible = m_frameIndex - slice->lastVisibleFrame;
+    info.framesSinceLoad    = m_frameIndex - slice->loadFrame;
+    info.memBytes           = 0;
+    info.diskBytes          = slice->diskBytes;
+    info.importTime         = slice->importTime;
+
+    for (int i = 0; i < slice->blocks.getSize(); i++)
+        if (slice->blocks[i].block.ofs != -1)
+            info.memBytes += slice->blocks[i].block.size * sizeof(S32);
+
+    return m_evictionPolicy->getKeepScore(info);
+}
+
+//------------------------------------------------------------------------
+
 void OctreeRuntime::gatherImportNodes(
+    Array<AttachIO::ImportNode>& nodes,
     const OctreeSlice*  sliceData,
     int*                sliceNodeIdx,
     int*                sliceSplitNodeIdx,
@@ -1066,7 +1437,7 @@ void OctreeRuntime::gatherImportNodes(
 
     // Initialize traversal.
 
-    m_importNodes.clear();
+    nodes.clear();
 
     Array<StackEntry> stack(NULL, 1);
     stack[0].level          = -1;
@@ -1079,7 +1450,7 @@ void OctreeRuntime::gatherImportNodes(
     {
         StackEntry curr = stack.removeLast();
         U32 oldNodeData = (curr.oldNode) ? *curr.oldNode : 0x0101;
-        int firstChild  = m_importNodes.getSize();
+        int firstChild  = nodes.getSize();
         U32 nonLeafMask = 0;
 
         // Leaf in loadSlice() => get children from the slice.
@@ -1094,12 +1465,12 @@ void OctreeRuntime::gatherImportNodes(
                 if (!sliceData->isNodeSplit((*sliceNodeIdx)++))
                     continue;
 
-                AttachIO::ImportNode& child = m_importNodes.add();
+                AttachIO::ImportNode& child = nodes.add();
                 child.srcInRuntime = NULL;
                 child.srcInSlice   = (*sliceSplitNodeIdx)++;
                 child.validMask    = sliceData->getNodeValidMask(child.srcInSlice);
                 child.nonLeafMask  = 0x00;
-                child.firstChild   = m_importNodes.getSize() - 1;
+                child.firstChild   = nodes.getSize() - 1;
                 nonLeafMask |= 1 << i;
             }
         }
@@ -1125,7 +1496,7 @@ void OctreeRuntime::gatherImportNodes(
                 top.level           = curr.level + 1;
                 top.oldNode         = oldChildren + childIdx * 2;
                 top.importNodeIdx   = firstChild + childIdx;
-                m_importNodes.add();
+                nodes.add();
             }
         }
 
@@ -1133,7 +1504,7 @@ void OctreeRuntime::gatherImportNodes(
 
         if (curr.importNodeIdx != -1)
         {
-            AttachIO::ImportNode& node = m_importNodes[curr.importNodeIdx];
+            AttachIO::ImportNode& node = nodes[curr.importNodeIdx];
             node.srcInRuntime = curr.oldNode;
             node.srcInSlice   = -1;
             node.validMask    = (U8)(oldNodeData >> 8);
@@ -1148,7 +1519,7 @@ void OctreeRuntime::gatherImportNodes(
             int num = popc8(nonLeafMask);
             for (int i = 0; i < num; i++)
             {
-                AttachIO::ImportNode& node = m_importNodes[firstChild + i];
+                AttachIO::ImportNode& node = nodes[firstChild + i];
                 node.numParentChildren = (U8)num;
                 node.idxInParent = (U8)i;
             }
@@ -1158,28 +1529,28 @@ void OctreeRuntime::gatherImportNodes(
 
 //------------------------------------------------------------------------
 
-int OctreeRuntime::layoutImportNodes(int objectID)
+int OctreeRuntime::layoutImportNodes(Array<AttachIO::ImportNode>& nodes, int nodeAlign)
 {
     // Determine node offsets, ignoring PageHeaders and
     // assuming that FarPtrs follow Nodes immediately.
 
-    int numNodes = m_importNodes.getSize();
-    int align = m_objects[objectID]->nodeAlign;
+    int numNodes = nodes.getSize();
+    int align = nodeAlign;
 
-    FW_ASSERT(m_importNodes.getSize());
-    m_importNodes.add();
-    m_importNodes[numNodes].ofsInBlock = 0;
+    FW_ASSERT(nodes.getSize());
+    nodes.add();
+    nodes[numNodes].ofsInBlock = 0;
 
     for (int i = numNodes - 1; i >= 0; i--)
     {
-        AttachIO::ImportNode& node = m_importNodes[i];
-        node.ofsInBlock = m_importNodes[i + 1].ofsInBlock; // to account for nonLeafMask=0x00
+        AttachIO::ImportNode& node = nodes[i];
+        node.ofsInBlock = nodes[i + 1].ofsInBlock; // to account for nonLeafMask=0x00
         if (node.idxInParent == node.numParentChildren - 1)
             node.ofsInBlock -= align - 2; // to account for possible alignment
 
         // Approximate distance between the node and its first child.
 
-        int diff = m_importNodes[node.firstChild].ofsInBlock - node.ofsInBlock;
+        int diff = nodes[node.firstChild].ofsInBlock - node.ofsInBlock;
 
         // Account for the difference between currOfs and the final offset.
 
@@ -1203,20 +1574,20 @@ int OctreeRuntime::layoutImportNodes(int objectID)
     int currNodeOfs = 0;
     for (int i = 0; i < numNodes;)
     {
-        int num = m_importNodes[i].numParentChildren;
-        int needed = m_importNodes[i + num].ofsInBlock - m_importNodes[i].ofsInBlock - (align - 2); // Nodes and FarPtrs
+        int num = nodes[i].numParentChildren;
+        int needed = nodes[i + num].ofsInBlock - nodes[i].ofsInBlock - (align - 2); // Nodes and FarPtrs
 
         currNodeOfs = max(currNodeOfs, ((currNodeOfs + needed - 1) & -PageSize) + align);
         for (int j = 0; j < num; j++)
-            m_importNodes[i + j].ofsInBlock = currNodeOfs + j * 2;
+            nodes[i + j].ofsInBlock = currNodeOfs + j * 2;
 
         currNodeOfs = (currNodeOfs + needed + align - 1) & -align;
         i += num;
     }
 
-    m_importNodes.removeLast();
-    FW_ASSERT(m_importNodes[0].ofsInBlock == align);
-    FW_ASSERT(m_importNodes.getSize() < 2 || m_importNodes[1].ofsInBlock == align * 2);
+    nodes.removeLast();
+    FW_ASSERT(nodes[0].ofsInBlock == align);
+    FW_ASSERT(nodes.getSize() < 2 || nodes[1].ofsInBlock == align * 2);
     return currNodeOfs;
 }
 
@@ -1224,10 +1595,11 @@ int OctreeRuntime::layoutImportNodes(int objectID)
 
 void OctreeRuntime::buildBlock(
     Array<S32>&         blockData,
+    Array<AttachIO::ImportNode>& nodes,
+    AttachIO*           attachIO,
     int                 blockInfoOfs,
     int                 sliceID,
-    int                 indexInSlice,
-    int                 objectID)
+    int                 indexInSlice)
 {
     // Fill in PageHeaders.
 
@@ -1238,17 +1610,17 @@ void OctreeRuntime::buildBlock(
 
     // Fill in Nodes and FarPtrs.
 
-    int numNodes = m_importNodes.getSize();
+    int numNodes = nodes.getSize();
     for (int i = 0; i < numNodes;)
     {
-        int num = m_importNodes[i].numParentChildren;
+        int num = nodes[i].numParentChildren;
         int nextI = i + num;
-        int farPtrOfs = m_importNodes[i].ofsInBlock + num * 2;
+        int farPtrOfs = nodes[i].ofsInBlock + num * 2;
 
         for (int j = i; j < nextI; j++)
         {
-            const AttachIO::ImportNode& node = m_importNodes[j];
-            int childPtr = m_importNodes[node.firstChild].ofsInBlock - node.ofsInBlock;
+            const AttachIO::ImportNode& node = nodes[j];
+            int childPtr = nodes[node.firstChild].ofsInBlock - node.ofsInBlock;
             FW_ASSERT(childPtr >= 0 && (childPtr & 1) == 0);
 
             if ((childPtr & ~0xFFFE) != 0)
@@ -1271,7 +1643,7 @@ void OctreeRuntime::buildBlock(
 
     // Import in attachments.
 
-    m_objects[objectID]->attachIO->importNodes(blockData, m_importNodes);
+    attachIO->importNodes(blockData, nodes);
 }
 
 //------------------------------------------------------------------------
@@ -30,7 +30,9 @@
 #if !FW_CUDA
 #   include "OctreeFile.hpp"
 #   include "MemoryManager.hpp"
+#   include "EvictionPolicy.hpp"
 #   include "gpu/Buffer.hpp"
+#   include "base/Hash.hpp"
 #endif
 
 namespace FW
@@ -56,6 +58,9 @@ public:
         FindMode_LoadOrBuild,
         FindMode_Unload,
         FindMode_UnloadDeepest,
+        FindMode_LoadInView,            // setFindView() required for the *InView modes
+        FindMode_LoadOrBuildInView,
+        FindMode_UnloadInView,
 
         FindMode_Max
     };
@@ -85,6 +90,14 @@ public:
         F32                 score;
     };
 
+    struct FindView
+    {
+        Mat4f               viewportToOctreeN;      // transposed octree-to-viewport; transforms viewport planes to octree space
+        Vec2f               viewSize;               // in pixels
+        F32                 focalLength;            // in pixels
+        F32                 minVoxelPixels;         // slices with smaller projected voxels are not worth loading
+    };
+
 private:
     struct Block
     {
@@ -148,6 +161,12 @@ private:
 
         S32                 numNodes;
         S32                 numNodeChildren;
+        S32                 reachStamp;             // unique per transition to isReached
+
+        S32                 loadFrame;              // see beginFrame()
+        S32                 lastVisibleFrame;
+        S32                 diskBytes;              // 0 if unknown
+        F32                 importTime;             // in seconds
 
         Array<SliceBlock>   blocks;
     };
@@ -163,6 +182,36 @@ private:
         Block               block;
     };
 
+public:
+    struct SliceImport // see beginImport()
+    {
+        const OctreeSlice*  sliceData;
+        OctreeSlice*        ownedSliceData;         // NULL if not owned
+        S32                 sliceID;
+        S32                 reachStamp;             // Slice::reachStamp at beginImport()
+        S32                 objectID;
+        S32                 nodeAlign;
+        AttachIO*           attachIO;               // private instance => usable on any thread
+        Buffer              oldBlock;               // copy of the parent's block for the slice
+        const S32*          oldRootNode;            // NULL if none
+        S32                 numLevels;
+        S32                 memDelta;               // additional memory consumption in bytes
+        S32                 diskBytes;              // set by the caller for EvictionPolicy, 0 if unknown
+        S32                 lastWantedFrame;        // set by the caller to expire unused imports, see getFrameIndex()
+        F32                 importTime;             // in seconds, accumulated over the three phases
+        Array<LoadBlock>    loadBlocks;
+        Array<AttachIO::ImportNode> importNodes;
+        Array<S32>          runtimeBlocks;          // optional, from OctreeFile::readRuntimeBlocks(); used by prepareImport() if compatible
+
+                            SliceImport             (void) : ownedSliceData(NULL), attachIO(NULL), diskBytes(0), lastWantedFrame(0), importTime(0.0f) {}
+                            ~SliceImport            (void) { delete ownedSliceData; delete attachIO; }
+
+    private:
+                            SliceImport             (const SliceImport&); // forbidden
+        SliceImport&        operator=               (const SliceImport&); // forbidden
+    };
+
+private:
     struct Relocation
     {
         S64                 oldOfs;
@@ -170,7 +219,7 @@ private:
     };
 
 public:
-                            OctreeRuntime           (MemoryManager::Mode mode);
+                            OctreeRuntime           (MemoryManager::Mode mode, MemoryManager::AllocMode allocMode = MemoryManager::AllocMode_Buddy);
                             ~OctreeRuntime          (void);
 
     void                    clear                   (void);
@@ -184,6 +233,18 @@ public:
     S32                     setSliceToLoad          (const OctreeSlice& sliceData); // returns additional memory consumption after load
     bool                    loadSlice               (void); // false if out of memory
     bool                    loadSlice               (const OctreeSlice& sliceData)  { setSliceToLoad(sliceData); return loadSlice(); }
+
+    // Same as setSliceToLoad() and loadSlice(), but split so that the
+    // expensive part can run on worker threads. beginImport() and
+    // commitImport() must be called on the main thread. prepareImport()
+    // only touches the SliceImport, so any number of them can run in
+    // parallel with each other and with the runtime being modified.
+
+    SliceImport*            beginImport             (OctreeSlice* sliceData); // takes ownership; NULL if not loadable
+    static void             prepareImport           (SliceImport* imp);
+    bool                    commitImport            (SliceImport* imp); // false if out of memory; true if loaded or no longer loadable
+    static void             exportRuntimeBlocks     (Array<S32>& out, const SliceImport* imp); // after prepareImport(), for OctreeFile::writeRuntimeBlocks()
+    void                    bakeRuntimeBlocks       (OctreeFile& file, int objectID, const Array<AttachIO::AttachType>& runtimeAttachTypes); // clears the runtime
     void                    unloadSlice             (int sliceID);
     bool                    isSliceLoaded           (int sliceID) const             { return (sliceID < m_slices.getSize() && m_slices[sliceID]->isLoaded); }
 
@@ -192,8 +253,15 @@ public:
     CUdeviceptr             getRootNodeCuda         (int objectID); // NULL if none
     Buffer&                 getBuffer               (void)                          { return m_mem.getBuffer(); }
 
-    void                    findSlices              (Array<FindResult>& results, FindMode mode, int objectID, const Vec3f& areaLo, const Vec3f& areaHi, int maxLevels, int maxResults);
+    void                    findSlices              (Array<FindResult>& results, FindMode mode, int objectID, const Vec3f& areaLo, const Vec3f& areaHi, int maxLevels, int maxResults, const Set<S32>* visibleSlices = NULL);
     FindResult              findSlice               (FindMode mode, int objectID, const Vec3f& areaLo, const Vec3f& areaHi, int maxLevels);
+    void                    setFindView             (const FindView& view)          { m_findView = view; }
+
+    void                    beginFrame              (void)                          { m_frameIndex++; }
+    S32                     getFrameIndex           (void) const                    { return m_frameIndex; }
+    void                    updateVisibility        (int objectID); // marks loaded slices in the view set by setFindView() as visible this frame
+    void                    setEvictionPolicy       (EvictionPolicy* policy)        { m_evictionPolicy = (policy) ? policy : &m_defaultEvictionPolicy; } // not owned; NULL = default
+    EvictionPolicy&         getEvictionPolicy       (void)                          { return *m_evictionPolicy; }
 
     String                  getStats                (void) const;
     S64                     getFreeBytes            (void) const                    { return m_mem.getFreeBytes(); }
@@ -232,19 +300,28 @@ private:
     Slice*                  getOrCreateSlice        (int sliceID);
     S64                     getRootNodeOfs          (int objectID); // -1 if none
 
-    void                    gatherImportNodes       (const OctreeSlice* sliceData,
+    bool                    getViewPlanes           (Vec4f* planes) const; // false if no view has been set
+    static bool             isCubeInView            (const Vec4f* planes, const Vec3f& cubeLo, const Vec3f& cubeHi);
+    F32                     getKeepScore            (int sliceID, F32 score, bool inView) const;
+
+    SliceImport*            beginImportInternal     (const OctreeSlice& sliceData);
+    static bool             getRuntimeBlocks        (Array<const S32*>& blocks, const SliceImport* imp); // false if missing or incompatible
+
+    static void             gatherImportNodes       (Array<AttachIO::ImportNode>& nodes,
+                                                     const OctreeSlice* sliceData,
                                                      int*               sliceNodeIdx,
                                                      int*               sliceSplitNodeIdx,
                                                      const S32*         oldRootNode,
                                                      int                numLevels);
 
-    int                     layoutImportNodes       (int objectID);
+    static int              layoutImportNodes       (Array<AttachIO::ImportNode>& nodes, int nodeAlign);
 
-    void                    buildBlock              (Array<S32>&        blockData,
+    static void             buildBlock              (Array<S32>&        blockData,
+                                                     Array<AttachIO::ImportNode>& nodes,
+                                                     AttachIO*          attachIO,
                                                      int                blockInfoOfs,
                                                      int                sliceID,
-                                                     int                indexInSlice,
-                                                     int                objectID);
+                                                     int                indexInSlice);
 
 private:
                             OctreeRuntime           (OctreeRuntime&); // forbidden
@@ -260,17 +337,19 @@ private:
     S32                     m_numSlicesLoaded;
     S64                     m_numNodesLoaded;
     S64                     m_numNodeChildrenLoaded;
+    FindView                m_findView;
+
+    S32                     m_frameIndex;
+    EvictionPolicy          m_defaultEvictionPolicy;
+    EvictionPolicy*         m_evictionPolicy;
 
     // setSliceToLoad(), loadSlice(), unloadSliceInternal()
 
-    S32                     m_loadSliceID;
-    Buffer                  m_loadBuffer;
-    Array<LoadBlock>        m_loadBlocks;
+    static S32              s_reachStamp;
+    SliceImport*            m_loadImport;
+    SliceImport*            m_commitImport;
     Array<S32>              m_unloadBlock;
-
-    // gatherImportNodes(), layoutImportNodes(), fillInBlockData()
-
-    Array<AttachIO::ImportNode> m_importNodes;
+    Array<AttachIO::ImportNode> m_unloadNodes;
 #endif // !FW_CUDA
 };
 
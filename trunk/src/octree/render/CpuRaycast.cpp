@@ -0,0 +1,1211 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CpuRaycast.hpp"
+#include "../Util.hpp"
+#include "../SimdOps.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+static const F32 c_dxtColorCoefs[4] =
+{
+    1.0f / (F32)(1 << 24),
+    0.0f,
+    2.0f / (F32)(3 << 24),
+    1.0f / (F32)(3 << 24),
+};
+
+static const F32 c_dxtNormalCoefs[4] =
+{
+    -1.0f,
+    -1.0f / 3.0f,
+    +1.0f / 3.0f,
+    +1.0f,
+};
+
+static const F32 c_dxtAOCoefs[8] =
+{
+    0.f,
+    1.f / ((F32)(1 << 24) * 255.f * 7.f),
+    2.f / ((F32)(1 << 24) * 255.f * 7.f),
+    3.f / ((F32)(1 << 24) * 255.f * 7.f),
+    4.f / ((F32)(1 << 24) * 255.f * 7.f),
+    5.f / ((F32)(1 << 24) * 255.f * 7.f),
+    6.f / ((F32)(1 << 24) * 255.f * 7.f),
+    1.f / ((F32)(1 << 24) * 255.f)
+};
+
+//------------------------------------------------------------------------
+// Per-texel decoders. Unlike decodeDXTColors() et al. in Util.hpp, these
+// only decode the texel that was hit, and return colors in [0, 255].
+//------------------------------------------------------------------------
+
+static inline Vec4f fromABGR255(U32 abgr)
+{
+    return Vec4f(
+        (F32)(abgr & 0xFF),
+        (F32)((abgr >> 8) & 0xFF),
+        (F32)((abgr >> 16) & 0xFF),
+        (F32)(abgr >> 24));
+}
+
+//------------------------------------------------------------------------
+
+static inline Vec3f decodeDXTColorTexel(U64 block, int texelIdx)
+{
+    U32 head = (U32)block;
+    U32 bits = (U32)(block >> 32);
+
+    F32 c0 = c_dxtColorCoefs[(bits >> (texelIdx * 2)) & 3];
+    F32 c1 = 1.0f / (F32)(1 << 24) - c0;
+
+    return Vec3f(
+        c0 * (F32)(head << 16) + c1 * (F32)head,
+        c0 * (F32)(head << 21) + c1 * (F32)(head << 5),
+        c0 * (F32)(head << 27) + c1 * (F32)(head << 11));
+}
+
+//------------------------------------------------------------------------
+
+static inline Vec3f decodeDXTNormalTexel(U64 blockA, U64 blockB, int texelIdx)
+{
+    U32 headBase = (U32)blockA;
+    U32 headUV   = (U32)blockB;
+    U32 bitsU    = (U32)(blockA >> 32);
+    U32 bitsV    = (U32)(blockB >> 32);
+
+    int shift = texelIdx * 2;
+    F32 cu = c_dxtNormalCoefs[(bitsU >> shift) & 3];
+    F32 cv = c_dxtNormalCoefs[(bitsV >> shift) & 3];
+
+    cu *= bitsToFloat(((headUV & 15) + (127 + 3 - 13)) << 23);
+    cv *= bitsToFloat((((headUV >> 16) & 15) + (127 + 3 - 13)) << 23);
+
+    Vec3f base = Vec3f(decodeRawNormal(headBase));
+    return Vec3f(
+        base.x + cu * (F32)(S32)(headUV << 16) + cv * (F32)(S32)headUV,
+        base.y + cu * (F32)(S32)(headUV << 20) + cv * (F32)(S32)(headUV << 4),
+        base.z + cu * (F32)(S32)(headUV << 24) + cv * (F32)(S32)(headUV << 8));
+}
+
+//------------------------------------------------------------------------
+
+static inline F32 decodeAOTexel(U64 block, int texelIdx)
+{
+    F32 c0 = c_dxtAOCoefs[((U32)(block >> (texelIdx * 3 + 16))) & 7];
+    F32 c1 = c_dxtAOCoefs[7] - c0;
+    return c0 * (F32)((U32)block << 16) + c1 * (F32)((U32)block << 24);
+}
+
+//------------------------------------------------------------------------
+
+static inline const S32* getAttachDataCPU(const S32* blockInfo, int slot)
+{
+    const S32* attachInfo = blockInfo + OctreeRuntime::BlockInfo_End + OctreeRuntime::AttachInfo_End * slot;
+    return blockInfo + attachInfo[OctreeRuntime::AttachInfo_Ptr];
+}
+
+//------------------------------------------------------------------------
+// Reads the ancestor at the given level from the stack, or finds it by
+// descending from the root if a short stack no longer holds it.
+//------------------------------------------------------------------------
+
+static const S32* readAncestorCPU(const CpuCastStack& stack, const S32* rootNode, U32 px, U32 py, U32 pz, int level)
+{
+    F32 tmax;
+    const S32* node = stack.read(level, tmax);
+    if (node)
+        return node;
+
+    node = rootNode;
+    for (int scale = CpuCastStackDepth - 1; scale > level; scale--)
+    {
+        int cidx = ((px >> scale) & 1) | (((py >> scale) & 1) << 1) | (((pz >> scale) & 1) << 2);
+        S32 desc_x = node[0];
+        int ofs = (U32)desc_x >> 17;
+        if ((desc_x & 0x10000) != 0)
+            ofs = node[ofs * 2];
+        node += (ofs + popc8(desc_x & ((1 << cidx) - 1))) * 2;
+    }
+    return node;
+}
+
+//------------------------------------------------------------------------
+// Perf counters. Unlike on the GPU, there is no notion of memory
+// transactions or instructions; those counters are left at zero.
+//------------------------------------------------------------------------
+
+static inline void updateCounter(S64* counters, PerfCounter counter, S64 amount = 1)
+{
+    if (counters)
+        counters[counter] += amount;
+}
+
+//------------------------------------------------------------------------
+
+static inline void updateCountersForGlobalAccess(S64* counters, int sizeLog2, int count = 1)
+{
+    updateCounter(counters, PerfCounter_GlobalAccesses, count);
+    updateCounter(counters, PerfCounter_GlobalBytes, count << sizeLog2);
+}
+
+//------------------------------------------------------------------------
+
+static inline void updateCountersForLocalAccess(S64* counters, int sizeLog2, int count = 1)
+{
+    updateCounter(counters, PerfCounter_LocalAccesses, count);
+    updateCounter(counters, PerfCounter_LocalBytes, count << sizeLog2);
+}
+
+//------------------------------------------------------------------------
+// Traversal state of a single ray. castRayCPU() and castRayPacketCPU()
+// both advance it one iteration at a time with stepCast().
+//------------------------------------------------------------------------
+
+struct CastState
+{
+    Vec3f       dir;
+    F32         tx_coef, ty_coef, tz_coef;
+    F32         tx_bias, ty_bias, tz_bias;
+    int         octant_mask;
+
+    F32         t_min;
+    F32         t_max;
+    F32         h;
+    const S32*  parent;
+    S32         desc_x;     // invalid until fetched
+    S32         desc_y;
+    int         idx;
+    Vec3f       pos;
+    int         scale;
+    F32         scale_exp2; // exp2f(scale - s_max)
+    int         iter;
+
+    const S32*  root;
+    F32         root_t_max;
+};
+
+//------------------------------------------------------------------------
+
+static inline void initCast(CastState& s, const CpuRay& ray, const S32* rootNode)
+{
+    const F32 epsilon = exp2(-CpuCastStackDepth);
+    s.dir = ray.dir;
+    s.iter = 0;
+
+    // Get rid of small ray direction components to avoid division by zero.
+
+    if (FW::abs(s.dir.x) < epsilon) s.dir.x = ((floatToBits(s.dir.x) & 0x80000000u) != 0) ? -epsilon : epsilon;
+    if (FW::abs(s.dir.y) < epsilon) s.dir.y = ((floatToBits(s.dir.y) & 0x80000000u) != 0) ? -epsilon : epsilon;
+    if (FW::abs(s.dir.z) < epsilon) s.dir.z = ((floatToBits(s.dir.z) & 0x80000000u) != 0) ? -epsilon : epsilon;
+
+    // Precompute the coefficients of tx(x), ty(y), and tz(z).
+    // The octree is assumed to reside at coordinates [1, 2].
+
+    s.tx_coef = 1.0f / -FW::abs(s.dir.x);
+    s.ty_coef = 1.0f / -FW::abs(s.dir.y);
+    s.tz_coef = 1.0f / -FW::abs(s.dir.z);
+
+    s.tx_bias = s.tx_coef * ray.orig.x;
+    s.ty_bias = s.ty_coef * ray.orig.y;
+    s.tz_bias = s.tz_coef * ray.orig.z;
+
+    // Select octant mask to mirror the coordinate system so
+    // that ray direction is negative along each axis.
+
+    s.octant_mask = 7;
+    if (s.dir.x > 0.0f) s.octant_mask ^= 1, s.tx_bias = 3.0f * s.tx_coef - s.tx_bias;
+    if (s.dir.y > 0.0f) s.octant_mask ^= 2, s.ty_bias = 3.0f * s.ty_coef - s.ty_bias;
+    if (s.dir.z > 0.0f) s.octant_mask ^= 4, s.tz_bias = 3.0f * s.tz_coef - s.tz_bias;
+
+    // Initialize the active span of t-values.
+
+    s.t_min = max(2.0f * s.tx_coef - s.tx_bias, 2.0f * s.ty_coef - s.ty_bias, 2.0f * s.tz_coef - s.tz_bias);
+    s.t_max = min(s.tx_coef - s.tx_bias, s.ty_coef - s.ty_bias, s.tz_coef - s.tz_bias);
+    s.h = s.t_max;
+    s.t_min = max(s.t_min, 0.0f);
+    s.t_max = min(s.t_max, 1.0f);
+    s.root = rootNode;
+    s.root_t_max = s.t_max;
+
+    // Initialize the current voxel to the first child of the root.
+
+    s.parent        = rootNode;
+    s.desc_x        = 0;
+    s.desc_y        = 0;
+    s.idx           = 0;
+    s.pos           = Vec3f(1.0f, 1.0f, 1.0f);
+    s.scale         = CpuCastStackDepth - 1;
+    s.scale_exp2    = 0.5f;
+
+    if (1.5f * s.tx_coef - s.tx_bias > s.t_min) s.idx ^= 1, s.pos.x = 1.5f;
+    if (1.5f * s.ty_coef - s.ty_bias > s.t_min) s.idx ^= 2, s.pos.y = 1.5f;
+    if (1.5f * s.tz_coef - s.tz_bias > s.t_min) s.idx ^= 4, s.pos.z = 1.5f;
+}
+
+//------------------------------------------------------------------------
+// Short stack only: restores the parent of the current voxel and its
+// t_max after the stack entry has been evicted. Redoes the pushes from
+// the root down to the current scale, which yields exactly the values
+// that the evicted entry held, and refills the stack along the way.
+//------------------------------------------------------------------------
+
+static void refetchParent(CastState& s, CpuCastStack& stack, U32 castFlags, S64* counters)
+{
+    const S32* node = s.root;
+    F32 t_max = s.root_t_max;
+
+    for (int scale = CpuCastStackDepth - 1; scale > s.scale; scale--)
+    {
+        stack.write(scale, node, t_max);
+
+        // Ancestor voxel of the current position at this scale.
+
+        int shx = floatToBits(s.pos.x) >> scale;
+        int shy = floatToBits(s.pos.y) >> scale;
+        int shz = floatToBits(s.pos.z) >> scale;
+        int idx = (shx & 1) | ((shy & 1) << 1) | ((shz & 1) << 2);
+        F32 scale_exp2 = bitsToFloat((scale - CpuCastStackDepth + 127) << 23);
+
+        S32 desc_x = node[0];
+        S32 desc_y = node[1];
+        updateCountersForGlobalAccess(counters, 3);
+
+        // Intersect active t-span with the voxel, as in PUSH.
+
+        F32 tx_corner = bitsToFloat(shx << scale) * s.tx_coef - s.tx_bias;
+        F32 ty_corner = bitsToFloat(shy << scale) * s.ty_coef - s.ty_bias;
+        F32 tz_corner = bitsToFloat(shz << scale) * s.tz_coef - s.tz_bias;
+        F32 tv_max = min(t_max, tx_corner, ty_corner, tz_corner);
+
+        int child_shift = idx ^ s.octant_mask;
+        int child_masks = desc_x << child_shift;
+        int contour_mask = desc_y << child_shift;
+        if ((castFlags & CastFlags_EnableContours) != 0 && (contour_mask & 0x80) != 0)
+        {
+            F32 half   = scale_exp2 * 0.5f;
+            int ofs    = (U32)desc_y >> 8;
+            int value  = node[ofs + popc8(contour_mask & 0x7F)];
+            updateCountersForGlobalAccess(counters, 2);
+            F32 cthick = (F32)(U32)value * scale_exp2 * 0.75f;
+            F32 cpos   = (F32)(value << 7) * scale_exp2 * 1.5f;
+            F32 cdirx  = (F32)(value << 14) * s.dir.x;
+            F32 cdiry  = (F32)(value << 20) * s.dir.y;
+            F32 cdirz  = (F32)(value << 26) * s.dir.z;
+            F32 tcoef  = 1.0f / (cdirx + cdiry + cdirz);
+            F32 tavg   = (half * s.tx_coef + tx_corner) * cdirx + (half * s.ty_coef + ty_corner) * cdiry + (half * s.tz_coef + tz_corner) * cdirz + cpos;
+            tv_max = min(tv_max, tcoef * tavg + FW::abs(cthick * tcoef));
+        }
+
+        // Descend.
+
+        int ofs = (U32)desc_x >> 17;
+        if ((desc_x & 0x10000) != 0)
+        {
+            ofs = node[ofs * 2];
+            updateCountersForGlobalAccess(counters, 2);
+        }
+        ofs += popc8(child_masks & 0x7F);
+        node += ofs * 2;
+        t_max = tv_max;
+    }
+
+    s.parent = node;
+    s.t_max = t_max;
+    stack.write(s.scale, node, t_max);
+}
+
+//------------------------------------------------------------------------
+// Performs one iteration of the traversal loop. Returns false once the
+// ray has terminated, either by hitting a voxel or by exiting the octree.
+//------------------------------------------------------------------------
+
+static inline bool stepCast(CastState& s, CpuCastStack& stack, const CpuRay& ray, U32 castFlags, S64* counters)
+{
+    // Traverse voxels along the ray as long as the current voxel
+    // stays within the octree.
+
+    if (s.scale >= CpuCastStackDepth)
+        return false;
+
+    updateCounter(counters, PerfCounter_Iterations);
+    s.iter++;
+    if (s.iter > CpuMaxRaycastIterations)
+        return false;
+
+    // Fetch child descriptor unless it is already valid.
+
+    if (s.desc_x == 0)
+    {
+        s.desc_x = s.parent[0];
+        s.desc_y = s.parent[1];
+        updateCountersForGlobalAccess(counters, 3);
+    }
+
+    // Determine maximum t-value of the cube by evaluating
+    // tx(), ty(), and tz() at its corner.
+
+    F32 tx_corner = s.pos.x * s.tx_coef - s.tx_bias;
+    F32 ty_corner = s.pos.y * s.ty_coef - s.ty_bias;
+    F32 tz_corner = s.pos.z * s.tz_coef - s.tz_bias;
+    F32 tc_max = min(tx_corner, ty_corner, tz_corner);
+
+    // Process voxel if the corresponding bit in valid mask is set
+    // and the active t-span is non-empty.
+
+    int child_shift = s.idx ^ s.octant_mask; // permute child slots based on the mirroring
+    int child_masks = s.desc_x << child_shift;
+    if ((child_masks & 0x8000) != 0 && s.t_min <= s.t_max)
+    {
+        // Terminate if the voxel is small enough.
+
+        if (tc_max * ray.dir_sz + ray.orig_sz >= s.scale_exp2)
+            return false; // at t_min
+
+        // INTERSECT
+        // Intersect active t-span with the cube and evaluate
+        // tx(), ty(), and tz() at the center of the voxel.
+
+        updateCounter(counters, PerfCounter_Intersect);
+        F32 tv_max = min(s.t_max, tc_max);
+        F32 half = s.scale_exp2 * 0.5f;
+        F32 tx_center = half * s.tx_coef + tx_corner;
+        F32 ty_center = half * s.ty_coef + ty_corner;
+        F32 tz_center = half * s.tz_coef + tz_corner;
+
+        // Intersect with contour if the corresponding bit in contour mask is set.
+
+        int contour_mask = s.desc_y << child_shift;
+        if ((castFlags & CastFlags_EnableContours) == 0)
+            contour_mask = 0;
+
+        if ((contour_mask & 0x80) != 0)
+        {
+            int ofs    = (U32)s.desc_y >> 8;                            // contour pointer
+            int value  = s.parent[ofs + popc8(contour_mask & 0x7F)];    // contour value
+            updateCountersForGlobalAccess(counters, 2);
+            F32 cthick = (F32)(U32)value * s.scale_exp2 * 0.75f;        // thickness
+            F32 cpos   = (F32)(value << 7) * s.scale_exp2 * 1.5f;       // position
+            F32 cdirx  = (F32)(value << 14) * s.dir.x;                  // nx
+            F32 cdiry  = (F32)(value << 20) * s.dir.y;                  // ny
+            F32 cdirz  = (F32)(value << 26) * s.dir.z;                  // nz
+            F32 tcoef  = 1.0f / (cdirx + cdiry + cdirz);
+            F32 tavg   = tx_center * cdirx + ty_center * cdiry + tz_center * cdirz + cpos;
+            F32 tdiff  = cthick * tcoef;
+
+            s.t_min = max(s.t_min, tcoef * tavg - FW::abs(tdiff)); // Override t_min with tv_min.
+            tv_max  = min(tv_max,  tcoef * tavg + FW::abs(tdiff));
+        }
+
+        // Descend to the first child if the resulting t-span is non-empty.
+
+        if (s.t_min <= tv_max)
+        {
+            // Terminate if the corresponding bit in the non-leaf mask is not set.
+
+            if ((child_masks & 0x0080) == 0)
+                return false; // at t_min (overridden with tv_min).
+
+            // PUSH
+            // Write current parent to the stack.
+
+            updateCounter(counters, PerfCounter_Push);
+            if (tc_max < s.h || (castFlags & CastFlags_DisablePushOptimization) != 0)
+            {
+                updateCounter(counters, PerfCounter_PushStore);
+                stack.write(s.scale, s.parent, s.t_max);
+                updateCountersForLocalAccess(counters, 3);
+            }
+            s.h = tc_max;
+
+            // Find child descriptor corresponding to the current voxel.
+
+            int ofs = (U32)s.desc_x >> 17; // child pointer
+            if ((s.desc_x & 0x10000) != 0) // far
+            {
+                ofs = s.parent[ofs * 2]; // far pointer
+                updateCountersForGlobalAccess(counters, 2);
+            }
+            ofs += popc8(child_masks & 0x7F);
+            s.parent += ofs * 2;
+
+            // Select child voxel that the ray enters first.
+
+            s.idx = 0;
+            s.scale--;
+            s.scale_exp2 = half;
+
+            if (tx_center > s.t_min) s.idx ^= 1, s.pos.x += s.scale_exp2;
+            if (ty_center > s.t_min) s.idx ^= 2, s.pos.y += s.scale_exp2;
+            if (tz_center > s.t_min) s.idx ^= 4, s.pos.z += s.scale_exp2;
+
+            // Update active t-span and invalidate cached child descriptor.
+
+            s.t_max = tv_max;
+            s.desc_x = 0;
+            return true;
+        }
+    }
+
+    // ADVANCE
+    // Step along the ray.
+
+    updateCounter(counters, PerfCounter_Advance);
+    int step_mask = 0;
+    if (tx_corner <= tc_max) step_mask ^= 1, s.pos.x -= s.scale_exp2;
+    if (ty_corner <= tc_max) step_mask ^= 2, s.pos.y -= s.scale_exp2;
+    if (tz_corner <= tc_max) step_mask ^= 4, s.pos.z -= s.scale_exp2;
+
+    // Update active t-span and flip bits of the child slot index.
+
+    s.t_min = tc_max;
+    s.idx ^= step_mask;
+
+    // Proceed with pop if the bit flips disagree with the ray direction.
+
+    if ((s.idx & step_mask) != 0)
+    {
+        // POP
+        // Find the highest differing bit between the two positions.
+
+        updateCounter(counters, PerfCounter_Pop);
+        U32 differing_bits = 0;
+        if ((step_mask & 1) != 0) differing_bits |= floatToBits(s.pos.x) ^ floatToBits(s.pos.x + s.scale_exp2);
+        if ((step_mask & 2) != 0) differing_bits |= floatToBits(s.pos.y) ^ floatToBits(s.pos.y + s.scale_exp2);
+        if ((step_mask & 4) != 0) differing_bits |= floatToBits(s.pos.z) ^ floatToBits(s.pos.z + s.scale_exp2);
+        s.scale = (floatToBits((F32)differing_bits) >> 23) - 127; // position of the highest bit
+        s.scale_exp2 = bitsToFloat((s.scale - CpuCastStackDepth + 127) << 23); // exp2f(scale - s_max)
+
+        // Restore parent voxel from the stack.
+
+        s.parent = stack.read(s.scale, s.t_max);
+        updateCountersForLocalAccess(counters, 3);
+
+        // Round cube position and extract child slot index.
+
+        int shx = floatToBits(s.pos.x) >> s.scale;
+        int shy = floatToBits(s.pos.y) >> s.scale;
+        int shz = floatToBits(s.pos.z) >> s.scale;
+        s.pos.x = bitsToFloat(shx << s.scale);
+        s.pos.y = bitsToFloat(shy << s.scale);
+        s.pos.z = bitsToFloat(shz << s.scale);
+        s.idx  = (shx & 1) | ((shy & 1) << 1) | ((shz & 1) << 2);
+
+#if (CPU_SHORT_STACK_SIZE > 0)
+        // Entry evicted from the short stack => restart from the root.
+
+        if (!s.parent && s.scale < CpuCastStackDepth)
+            refetchParent(s, stack, castFlags, counters);
+#endif
+
+        // Prevent same parent from being stored again and invalidate cached child descriptor.
+
+        s.h = 0.0f;
+        s.desc_x = 0;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+static inline void finishCast(CpuCastResult& res, CastState& s, const CpuRay& ray)
+{
+    const F32 epsilon = exp2(-CpuCastStackDepth);
+
+    // Indicate miss if we are outside the octree.
+
+    if (s.scale >= CpuCastStackDepth || s.iter > CpuMaxRaycastIterations)
+        s.t_min = 2.0f;
+
+    // Undo mirroring of the coordinate system.
+
+    if ((s.octant_mask & 1) == 0) s.pos.x = 3.0f - s.scale_exp2 - s.pos.x;
+    if ((s.octant_mask & 2) == 0) s.pos.y = 3.0f - s.scale_exp2 - s.pos.y;
+    if ((s.octant_mask & 4) == 0) s.pos.z = 3.0f - s.scale_exp2 - s.pos.z;
+
+    // Output results.
+
+    res.t = s.t_min;
+    res.iter = s.iter;
+    res.pos.x = min(max(ray.orig.x + s.t_min * s.dir.x, s.pos.x + epsilon), s.pos.x + s.scale_exp2 - epsilon);
+    res.pos.y = min(max(ray.orig.y + s.t_min * s.dir.y, s.pos.y + epsilon), s.pos.y + s.scale_exp2 - epsilon);
+    res.pos.z = min(max(ray.orig.z + s.t_min * s.dir.z, s.pos.z + epsilon), s.pos.z + s.scale_exp2 - epsilon);
+    res.node = s.parent;
+    res.childIdx = s.idx ^ s.octant_mask ^ 7;
+    res.stackPtr = s.scale;
+    res.root = s.root;
+}
+
+//------------------------------------------------------------------------
+
+void FW::castRayCPU(CpuCastResult& res, CpuCastStack& stack, const CpuRay& ray, const S32* rootNode, U32 castFlags, S64* perfCounters)
+{
+    CastState s;
+    initCast(s, ray, rootNode);
+    stack.clear();
+    while (stepCast(s, stack, ray, castFlags, perfCounters));
+    finishCast(res, s, ray);
+}
+
+//------------------------------------------------------------------------
+
+//------------------------------------------------------------------------
+// Packet traversal. While the rays of a packet are in the same child
+// slot of the same parent and share the octant mask, all of the
+// traversal state except the t-spans is the same for every ray. Each
+// step evaluates the t-values of the whole packet in SIMD lanes and is
+// committed only if the remaining rays agree on the outcome: descend to
+// the same child, or advance along the same axes. Otherwise the state
+// is handed back to stepCast() before the step, so the results are
+// identical to castRayCPU().
+//------------------------------------------------------------------------
+
+struct PacketState
+{
+    // Shared by all rays.
+
+    const S32*  parent;
+    S32         desc_x;     // invalid until fetched
+    S32         desc_y;
+    int         idx;
+    Vec3f       pos;
+    int         scale;
+    F32         scale_exp2;
+    int         iter;
+    int         octant_mask;
+
+    // One lane per ray.
+
+    F32         tx_coef[CpuRayPacketSize];
+    F32         ty_coef[CpuRayPacketSize];
+    F32         tz_coef[CpuRayPacketSize];
+    F32         tx_bias[CpuRayPacketSize];
+    F32         ty_bias[CpuRayPacketSize];
+    F32         tz_bias[CpuRayPacketSize];
+    F32         dir_x[CpuRayPacketSize];
+    F32         dir_y[CpuRayPacketSize];
+    F32         dir_z[CpuRayPacketSize];
+    F32         orig_sz[CpuRayPacketSize];
+    F32         dir_sz[CpuRayPacketSize];
+    F32         t_min[CpuRayPacketSize];
+    F32         t_max[CpuRayPacketSize];
+    F32         h[CpuRayPacketSize];
+};
+
+//------------------------------------------------------------------------
+
+static const bool s_useAVX = hasAVX(); // before any threads are started
+
+//------------------------------------------------------------------------
+// Returns false if the active rays do not start out coherent.
+
+static bool beginPacket(PacketState& p, const CastState* s, const CpuRay* rays, int numRays, U32 active)
+{
+    int first = 0;
+    while ((active & (1u << first)) == 0)
+        first++;
+
+    for (int i = first + 1; i < numRays; i++)
+        if ((active & (1u << i)) != 0 &&
+            (s[i].octant_mask != s[first].octant_mask || s[i].parent != s[first].parent ||
+             s[i].scale != s[first].scale || s[i].idx != s[first].idx))
+        {
+            return false;
+        }
+
+    const CastState& f = s[first];
+    p.parent        = f.parent;
+    p.desc_x        = f.desc_x;
+    p.desc_y        = f.desc_y;
+    p.idx           = f.idx;
+    p.pos           = f.pos;
+    p.scale         = f.scale;
+    p.scale_exp2    = f.scale_exp2;
+    p.iter          = f.iter;
+    p.octant_mask   = f.octant_mask;
+
+    // Unused lanes repeat the first ray so that they stay finite.
+
+    for (int i = 0; i < CpuRayPacketSize; i++)
+    {
+        int j = (i < numRays && (active & (1u << i)) != 0) ? i : first;
+        p.tx_coef[i]    = s[j].tx_coef;
+        p.ty_coef[i]    = s[j].ty_coef;
+        p.tz_coef[i]    = s[j].tz_coef;
+        p.tx_bias[i]    = s[j].tx_bias;
+        p.ty_bias[i]    = s[j].ty_bias;
+        p.tz_bias[i]    = s[j].tz_bias;
+        p.dir_x[i]      = s[j].dir.x;
+        p.dir_y[i]      = s[j].dir.y;
+        p.dir_z[i]      = s[j].dir.z;
+        p.orig_sz[i]    = rays[j].orig_sz;
+        p.dir_sz[i]     = rays[j].dir_sz;
+        p.t_min[i]      = s[j].t_min;
+        p.t_max[i]      = s[j].t_max;
+        p.h[i]          = s[j].h;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+static inline void endPacketRay(CastState& s, const PacketState& p, int lane)
+{
+    s.parent        = p.parent;
+    s.desc_x        = p.desc_x;
+    s.desc_y        = p.desc_y;
+    s.idx           = p.idx;
+    s.pos           = p.pos;
+    s.scale         = p.scale;
+    s.scale_exp2    = p.scale_exp2;
+    s.iter          = p.iter;
+    s.t_min         = p.t_min[lane];
+    s.t_max         = p.t_max[lane];
+    s.h             = p.h[lane];
+}
+
+//------------------------------------------------------------------------
+// Runs the packet until every ray has terminated or the packet diverges.
+// Returns the rays that stepCast() needs to finish.
+
+template <class O> static U32 castPacket(PacketState& p, CastState* s, CpuCastStack* stacks, U32 active, U32 castFlags, S64* counters)
+{
+    typedef typename O::V V;
+    F32 tc_max[CpuRayPacketSize];
+    F32 tv_min[CpuRayPacketSize]; // t_min, overridden by the contour
+    F32 tv_max[CpuRayPacketSize];
+
+    for (;;)
+    {
+        // Exited the octree or out of iterations => every ray is done.
+
+        if (p.scale < CpuCastStackDepth)
+            p.iter++;
+
+        if (p.scale >= CpuCastStackDepth || p.iter > CpuMaxRaycastIterations)
+        {
+            if (p.scale < CpuCastStackDepth)
+                updateCounter(counters, PerfCounter_Iterations, popc8(active));
+            for (int i = 0; i < CpuRayPacketSize; i++)
+                if ((active & (1u << i)) != 0)
+                    endPacketRay(s[i], p, i);
+            active = 0;
+            break;
+        }
+
+        // Fetch child descriptor unless it is already valid.
+
+        if (p.desc_x == 0)
+        {
+            p.desc_x = p.parent[0];
+            p.desc_y = p.parent[1];
+            updateCountersForGlobalAccess(counters, 3);
+        }
+
+        int  child_shift    = p.idx ^ p.octant_mask;
+        int  child_masks    = p.desc_x << child_shift;
+        int  contour_mask   = ((castFlags & CastFlags_EnableContours) != 0) ? p.desc_y << child_shift : 0;
+        bool valid          = ((child_masks & 0x8000) != 0);
+        bool contour        = (valid && (contour_mask & 0x80) != 0);
+        F32  half           = p.scale_exp2 * 0.5f;
+
+        // The contour is shared, only its distance along each ray differs.
+
+        S32 value = 0;
+        if (contour)
+            value = p.parent[((U32)p.desc_y >> 8) + popc8(contour_mask & 0x7F)];
+
+        F32 cthick = (F32)(U32)value * p.scale_exp2 * 0.75f;
+        F32 cpos   = (F32)(value << 7) * p.scale_exp2 * 1.5f;
+
+        // Evaluate the outcome of the step for every lane.
+
+        U32 spanMask = 0, lodMask = 0, descMask = 0, pushMask = 0;
+        U32 childX = 0, childY = 0, childZ = 0;
+        U32 stepX = 0, stepY = 0, stepZ = 0;
+
+        for (int b = 0; b < CpuRayPacketSize; b += O::Width)
+        {
+            V tx_coef   = O::load(p.tx_coef + b);
+            V ty_coef   = O::load(p.ty_coef + b);
+            V tz_coef   = O::load(p.tz_coef + b);
+            V tx_corner = O::sub(O::mul(O::set1(p.pos.x), tx_coef), O::load(p.tx_bias + b));
+            V ty_corner = O::sub(O::mul(O::set1(p.pos.y), ty_coef), O::load(p.ty_bias + b));
+            V tz_corner = O::sub(O::mul(O::set1(p.pos.z), tz_coef), O::load(p.tz_bias + b));
+            V tcm       = O::min(O::min(tx_corner, ty_corner), tz_corner);
+            V tmin      = O::load(p.t_min + b);
+            V tmax      = O::load(p.t_max + b);
+            O::store(tc_max + b, tcm);
+
+            stepX       |= O::mask(O::le(tx_corner, tcm)) << b;
+            stepY       |= O::mask(O::le(ty_corner, tcm)) << b;
+            stepZ       |= O::mask(O::le(tz_corner, tcm)) << b;
+            pushMask    |= O::mask(O::lt(tcm, O::load(p.h + b))) << b;
+
+            if (!valid)
+                continue;
+
+            V lod       = O::add(O::mul(tcm, O::load(p.dir_sz + b)), O::load(p.orig_sz + b));
+            spanMask    |= O::mask(O::le(tmin, tmax)) << b;
+            lodMask     |= O::mask(O::ge(lod, O::set1(p.scale_exp2))) << b;
+
+            V vmin      = tmin;
+            V vmax      = O::min(tmax, tcm);
+            V tx_center = O::add(O::mul(O::set1(half), tx_coef), tx_corner);
+            V ty_center = O::add(O::mul(O::set1(half), ty_coef), ty_corner);
+            V tz_center = O::add(O::mul(O::set1(half), tz_coef), tz_corner);
+
+            if (contour)
+            {
+                V cdirx = O::mul(O::set1((F32)(value << 14)), O::load(p.dir_x + b));
+                V cdiry = O::mul(O::set1((F32)(value << 20)), O::load(p.dir_y + b));
+                V cdirz = O::mul(O::set1((F32)(value << 26)), O::load(p.dir_z + b));
+                V tcoef = O::div(O::set1(1.0f), O::add(O::add(cdirx, cdiry), cdirz));
+                V tavg  = O::add(O::add(O::add(O::mul(tx_center, cdirx), O::mul(ty_center, cdiry)), O::mul(tz_center, cdirz)), O::set1(cpos));
+                V tdiff = O::abs(O::mul(O::set1(cthick), tcoef));
+                vmin    = O::max(vmin, O::sub(O::mul(tcoef, tavg), tdiff));
+                vmax    = O::min(vmax, O::add(O::mul(tcoef, tavg), tdiff));
+            }
+
+            O::store(tv_min + b, vmin);
+            O::store(tv_max + b, vmax);
+            descMask    |= O::mask(O::le(vmin, vmax)) << b;
+            childX      |= O::mask(O::gt(tx_center, vmin)) << b;
+            childY      |= O::mask(O::gt(ty_center, vmin)) << b;
+            childZ      |= O::mask(O::gt(tz_center, vmin)) << b;
+        }
+
+        // Classify the rays: terminate, descend, or advance.
+
+        U32 isect = (valid) ? active & spanMask & ~lodMask : 0;
+        U32 term  = (valid) ? active & spanMask & lodMask : 0;
+        U32 desc  = isect & descMask;
+        U32 leaf  = ((child_masks & 0x0080) == 0) ? desc : 0;
+        U32 rest  = active & ~term & ~leaf;
+
+        desc &= ~leaf;
+        term |= leaf;
+
+        bool diverged = false;
+        if (desc != 0)
+            diverged = (desc != rest ||
+                ((childX & rest) != 0 && (childX & rest) != rest) ||
+                ((childY & rest) != 0 && (childY & rest) != rest) ||
+                ((childZ & rest) != 0 && (childZ & rest) != rest));
+        else
+            diverged = (((stepX & rest) != 0 && (stepX & rest) != rest) ||
+                        ((stepY & rest) != 0 && (stepY & rest) != rest) ||
+                        ((stepZ & rest) != 0 && (stepZ & rest) != rest));
+
+        // Terminated rays leave the packet.
+
+        U32 done = (diverged) ? term : active;
+        updateCounter(counters, PerfCounter_Iterations, popc8(done));
+        updateCounter(counters, PerfCounter_Intersect, popc8(isect & done));
+        if (contour)
+            updateCountersForGlobalAccess(counters, 2, popc8(isect & done));
+
+        for (int i = 0; i < CpuRayPacketSize; i++)
+        {
+            if ((term & (1u << i)) == 0)
+                continue;
+
+            endPacketRay(s[i], p, i);
+            if ((leaf & (1u << i)) != 0)
+                s[i].t_min = tv_min[i]; // at t_min (overridden with tv_min).
+        }
+
+        active = rest;
+        if (!active)
+            break;
+
+        // Diverged => let stepCast() redo the step for each ray.
+
+        if (diverged)
+        {
+            p.iter--;
+            for (int i = 0; i < CpuRayPacketSize; i++)
+                if ((active & (1u << i)) != 0)
+                    endPacketRay(s[i], p, i);
+            break;
+        }
+
+        if (desc != 0)
+        {
+            // PUSH
+            // Write current parent to the stacks.
+
+            updateCounter(counters, PerfCounter_Push, popc8(active));
+            for (int i = 0; i < CpuRayPacketSize; i++)
+            {
+                if ((active & (1u << i)) == 0)
+                    continue;
+
+                if ((pushMask & (1u << i)) != 0 || (castFlags & CastFlags_DisablePushOptimization) != 0)
+                {
+                    updateCounter(counters, PerfCounter_PushStore);
+                    stacks[i].write(p.scale, p.parent, p.t_max[i]);
+                    updateCountersForLocalAccess(counters, 3);
+                }
+                p.h[i] = tc_max[i];
+                p.t_min[i] = tv_min[i];
+                p.t_max[i] = tv_max[i];
+            }
+
+            // Find child descriptor corresponding to the current voxel.
+
+            int ofs = (U32)p.desc_x >> 17; // child pointer
+            if ((p.desc_x & 0x10000) != 0) // far
+            {
+                ofs = p.parent[ofs * 2]; // far pointer
+                updateCountersForGlobalAccess(counters, 2, popc8(active));
+            }
+            ofs += popc8(child_masks & 0x7F);
+            p.parent += ofs * 2;
+
+            // Select child voxel that the rays enter first.
+
+            p.idx = 0;
+            p.scale--;
+            p.scale_exp2 = half;
+
+            if ((childX & active) != 0) p.idx ^= 1, p.pos.x += p.scale_exp2;
+            if ((childY & active) != 0) p.idx ^= 2, p.pos.y += p.scale_exp2;
+            if ((childZ & active) != 0) p.idx ^= 4, p.pos.z += p.scale_exp2;
+
+            p.desc_x = 0;
+            continue;
+        }
+
+        // ADVANCE
+        // Step along the rays.
+
+        updateCounter(counters, PerfCounter_Advance, popc8(active));
+        int step_mask = 0;
+        if ((stepX & active) != 0) step_mask ^= 1, p.pos.x -= p.scale_exp2;
+        if ((stepY & active) != 0) step_mask ^= 2, p.pos.y -= p.scale_exp2;
+        if ((stepZ & active) != 0) step_mask ^= 4, p.pos.z -= p.scale_exp2;
+
+        for (int i = 0; i < CpuRayPacketSize; i++)
+            p.t_min[i] = tc_max[i];
+        p.idx ^= step_mask;
+
+        if ((p.idx & step_mask) == 0)
+            continue;
+
+        // POP
+        // Find the highest differing bit between the two positions.
+
+        updateCounter(counters, PerfCounter_Pop, popc8(active));
+        U32 differing_bits = 0;
+        if ((step_mask & 1) != 0) differing_bits |= floatToBits(p.pos.x) ^ floatToBits(p.pos.x + p.scale_exp2);
+        if ((step_mask & 2) != 0) differing_bits |= floatToBits(p.pos.y) ^ floatToBits(p.pos.y + p.scale_exp2);
+        if ((step_mask & 4) != 0) differing_bits |= floatToBits(p.pos.z) ^ floatToBits(p.pos.z + p.scale_exp2);
+        p.scale = (floatToBits((F32)differing_bits) >> 23) - 127; // position of the highest bit
+        p.scale_exp2 = bitsToFloat((p.scale - CpuCastStackDepth + 127) << 23); // exp2f(scale - s_max)
+
+        // Restore parent voxel from the stacks.
+
+        const S32* parents[CpuRayPacketSize];
+        int first = -1;
+        bool sameParent = true;
+        for (int i = 0; i < CpuRayPacketSize; i++)
+        {
+            if ((active & (1u << i)) == 0)
+                continue;
+
+            if (first == -1)
+                first = i;
+            parents[i] = stacks[i].read(p.scale, p.t_max[i]);
+            p.h[i] = 0.0f;
+            sameParent = (sameParent && parents[i] && parents[i] == parents[first]);
+        }
+        updateCountersForLocalAccess(counters, 3, popc8(active));
+
+        // Round cube position and extract child slot index.
+
+        int shx = floatToBits(p.pos.x) >> p.scale;
+        int shy = floatToBits(p.pos.y) >> p.scale;
+        int shz = floatToBits(p.pos.z) >> p.scale;
+        p.pos.x = bitsToFloat(shx << p.scale);
+        p.pos.y = bitsToFloat(shy << p.scale);
+        p.pos.z = bitsToFloat(shz << p.scale);
+        p.idx  = (shx & 1) | ((shy & 1) << 1) | ((shz & 1) << 2);
+        p.desc_x = 0;
+
+        if (sameParent || p.scale >= CpuCastStackDepth)
+        {
+            p.parent = parents[first];
+            continue;
+        }
+
+        // Parents differ or were evicted from a short stack => continue
+        // one ray at a time.
+
+        for (int i = 0; i < CpuRayPacketSize; i++)
+        {
+            if ((active & (1u << i)) == 0)
+                continue;
+
+            endPacketRay(s[i], p, i);
+            s[i].parent = parents[i];
+#if (CPU_SHORT_STACK_SIZE > 0)
+            if (!s[i].parent)
+                refetchParent(s[i], stacks[i], castFlags, counters);
+#endif
+        }
+        break;
+    }
+
+    O::finish();
+    return active;
+}
+
+//------------------------------------------------------------------------
+
+void FW::castRayPacketCPU(CpuCastResult* res, CpuCastStack* stacks, const CpuRay* rays, int numRays, const S32* rootNode, U32 castFlags, S64* perfCounters)
+{
+    FW_ASSERT(res && stacks && rays);
+    FW_ASSERT(numRays >= 0 && numRays <= CpuRayPacketSize);
+
+    CastState s[CpuRayPacketSize];
+    for (int i = 0; i < numRays; i++)
+    {
+        initCast(s[i], rays[i], rootNode);
+        stacks[i].clear();
+    }
+
+    // Traverse as a packet while the rays stay coherent.
+
+    U32 active = (1u << numRays) - 1;
+    PacketState p;
+
+    if (numRays > 1 && beginPacket(p, s, rays, numRays, active))
+    {
+#if ENABLE_AVX
+        if (s_useAVX)
+            active = castPacket<AvxOps>(p, s, stacks, active, castFlags, perfCounters);
+        else
+#endif
+            active = castPacket<SseOps>(p, s, stacks, active, castFlags, perfCounters);
+    }
+
+    // The packet has diverged => finish the remaining rays one by one.
+
+    for (int i = 0; i < numRays; i++)
+        if ((active & (1u << i)) != 0)
+            while (stepCast(s[i], stacks[i], rays[i], castFlags, perfCounters));
+
+    for (int i = 0; i < numRays; i++)
+        finishCast(res[i], s[i], rays[i]);
+}
+
+//------------------------------------------------------------------------
+
+U32 FW::getCastFlagsCPU(const Array<AttachIO::AttachType>& attach, bool enableContours)
+{
+    FW_ASSERT(attach.getSize() == AttachSlot_Max);
+    U32 flags = 0;
+
+    if (attach[AttachSlot_Contour] == AttachIO::ContourAttach && enableContours)
+        flags |= CastFlags_EnableContours;
+
+    if (attach[AttachSlot_Attribute] == AttachIO::ColorNormalPaletteAttach ||
+        attach[AttachSlot_Attribute] == AttachIO::ColorNormalCornerAttach)
+    {
+        flags |= CastFlags_DisablePushOptimization;
+    }
+    return flags;
+}
+
+//------------------------------------------------------------------------
+
+void FW::lookupVoxelColorNormalCPU(Vec4f& colorRes, Vec3f& normalRes, const CpuCastResult& castRes, const CpuCastStack& stack, AttachIO::AttachType attribType)
+{
+    U32 px = floatToBits(castRes.pos.x);
+    U32 py = floatToBits(castRes.pos.y);
+    U32 pz = floatToBits(castRes.pos.z);
+
+    const S32* node       = castRes.node;
+    int        cidx       = castRes.childIdx;
+    int        level      = castRes.stackPtr;
+    const S32* pageHeader = (const S32*)((UPTR)node & -(UPTR)OctreeRuntime::PageBytes);
+    const S32* blockInfo  = OctreeRuntime::getBlockInfo(node);
+    const S32* blockStart = OctreeRuntime::getBlockStart(blockInfo);
+    const S32* attachData = getAttachDataCPU(blockInfo, AttachSlot_Attribute);
+
+    switch (attribType)
+    {
+    // Uncompressed attributes: walk up the stack until a voxel with a color is found.
+
+    case AttachIO::ColorNormalPaletteAttach:
+        {
+            U32 paletteNode = attachData[(node - blockStart) >> 1];
+            while (((paletteNode >> cidx) & 1) == 0)
+            {
+                level++;
+                if (level >= CpuCastStackDepth)
+                {
+                    colorRes = Vec4f(0.0f, 0.0f, 0.0f, 0.0f);
+                    normalRes = Vec3f(1.0f, 0.0f, 0.0f);
+                    return;
+                }
+
+                node = readAncestorCPU(stack, castRes.root, px, py, pz, level);
+                cidx = 0;
+                if ((px & (1 << level)) != 0) cidx |= 1;
+                if ((py & (1 << level)) != 0) cidx |= 2;
+                if ((pz & (1 << level)) != 0) cidx |= 4;
+
+                blockInfo   = OctreeRuntime::getBlockInfo(node);
+                blockStart  = OctreeRuntime::getBlockStart(blockInfo);
+                attachData  = getAttachDataCPU(blockInfo, AttachSlot_Attribute);
+                paletteNode = attachData[(node - blockStart) >> 1];
+            }
+
+            const S32* pAttach = attachData + (paletteNode >> 8) + popc8(paletteNode & ((1 << cidx) - 1)) * 2;
+            colorRes = fromABGR255(pAttach[0]);
+            normalRes = Vec3f(decodeRawNormal(pAttach[1]));
+        }
+        break;
+
+    // Interpolated attributes: walk up the stack until a voxel with corner colors is found.
+
+    case AttachIO::ColorNormalCornerAttach:
+        for (;;)
+        {
+            U32 bits = attachData[node - blockStart];
+
+            int subIdx = 0;
+            U32 lmask = 1 << level;
+            if ((px & lmask) != 0) subIdx += 1;
+            if ((py & lmask) != 0) subIdx += 3;
+            if ((pz & lmask) != 0) subIdx += 9;
+
+            U32 bitsOrig = bits;
+            bits >>= subIdx;
+
+            // Hit if at least some bits for this subcube are nonzero.
+
+            if ((bits & 0x361b) != 0)
+            {
+                const S32* pAttach = attachData + attachData[(node - blockStart) + 1];
+                pAttach += 2 * popc16(bitsOrig & ((1 << subIdx) - 1));
+
+                // Position within the voxel, in [0, 1].
+
+                U32 fracMask = lmask - 1;
+                F32 fx1 = (F32)(px & fracMask) / (F32)(fracMask + 1);
+                F32 fy1 = (F32)(py & fracMask) / (F32)(fracMask + 1);
+                F32 fz1 = (F32)(pz & fracMask) / (F32)(fracMask + 1);
+                F32 fx0 = 1.0f - fx1;
+                F32 fy0 = 1.0f - fy1;
+                F32 fz0 = 1.0f - fz1;
+
+                // Process the eight corners.
+
+                Vec4f color = 0.0f;
+                Vec3f normal = 0.0f;
+                F32 w[8] =
+                {
+                    fx0 * fy0 * fz0, fx1 * fy0 * fz0, fx0 * fy1 * fz0, fx1 * fy1 * fz0,
+                    fx0 * fy0 * fz1, fx1 * fy0 * fz1, fx0 * fy1 * fz1, fx1 * fy1 * fz1,
+                };
+
+                for (int i = 0; i < 8; i++)
+                {
+                    color += fromABGR255(pAttach[0]) * w[i];
+                    normal += Vec3f(decodeRawNormal(pAttach[1])).normalized() * w[i];
+                    pAttach += 2;
+
+                    if (i == 1 && (bits & 0x0004) != 0)
+                        pAttach += 2;
+                    else if (i == 3)
+                        pAttach += 2 * popc8((bits & 0x01e0) >> 5);
+                    else if (i == 5 && (bits & 0x0800) != 0)
+                        pAttach += 2;
+                }
+
+                colorRes = color;
+                normalRes = normal;
+                return;
+            }
+
+            // Move upwards.
+
+            level++;
+            if (level >= CpuCastStackDepth)
+            {
+                colorRes = Vec4f(0.0f, 0.0f, 0.0f, 0.0f);
+                normalRes = Vec3f(1.0f, 0.0f, 0.0f);
+                return;
+            }
+
+            node        = readAncestorCPU(stack, castRes.root, px, py, pz, level);
+            blockInfo   = OctreeRuntime::getBlockInfo(node);
+            blockStart  = OctreeRuntime::getBlockStart(blockInfo);
+            attachData  = getAttachDataCPU(blockInfo, AttachSlot_Attribute);
+        }
+        break;
+
+    // DXT-compressed attributes.
+
+    case AttachIO::ColorNormalDXTAttach:
+        {
+            const U64* dxtBlock = (const U64*)(attachData + ((node - blockStart) >> 2) * 6);
+            int texelIdx = castRes.childIdx | (((node - pageHeader) & 2) << 2);
+            Vec3f tmp = decodeDXTColorTexel(dxtBlock[0], texelIdx);
+            colorRes = Vec4f(tmp, 255.0f);
+            normalRes = decodeDXTNormalTexel(dxtBlock[1], dxtBlock[2], texelIdx);
+        }
+        break;
+
+    default:
+        colorRes = Vec4f(0.0f, 0.0f, 0.0f, 0.0f);
+        normalRes = Vec3f(1.0f, 0.0f, 0.0f);
+        break;
+    }
+}
+
+//------------------------------------------------------------------------
+
+void FW::lookupVoxelAOCPU(F32& res, const CpuCastResult& castRes, const CpuCastStack& stack)
+{
+    FW_UNREF(stack);
+    const S32* pageHeader = (const S32*)((UPTR)castRes.node & -(UPTR)OctreeRuntime::PageBytes);
+    const S32* blockInfo  = OctreeRuntime::getBlockInfo(castRes.node);
+    const S32* blockStart = OctreeRuntime::getBlockStart(blockInfo);
+    const S32* attachData = getAttachDataCPU(blockInfo, AttachSlot_AO);
+    const U64* dxtBlock   = (const U64*)(attachData + ((castRes.node - blockStart) >> 2) * 2);
+
+    int texelIdx = castRes.childIdx | (((castRes.node - pageHeader) & 2) << 2);
+    res = decodeAOTexel(dxtBlock[0], texelIdx);
+}
+
+//------------------------------------------------------------------------
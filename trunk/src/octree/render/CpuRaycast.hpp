@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "../io/OctreeRuntime.hpp"
+#include "../cuda/Render.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// CPU port of the raycaster in cuda/Raycast.inl and the attribute
+// lookups in cuda/AttribLookup.inl. Operates directly on the node
+// format of an OctreeRuntime created with MemoryManager::Mode_CPU.
+//------------------------------------------------------------------------
+// Number of entries in CpuCastStack. 0 keeps one entry per octree level.
+// Otherwise only the most recent levels are kept, and the traversal
+// restarts from the root to restore an ancestor that has been evicted.
+// This keeps per-ray state small enough for large ray batches to stay
+// in cache, at the cost of extra node fetches on deep octrees.
+//------------------------------------------------------------------------
+
+#ifndef CPU_SHORT_STACK_SIZE
+#   define CPU_SHORT_STACK_SIZE 0
+#endif
+
+//------------------------------------------------------------------------
+
+enum
+{
+    CpuCastStackDepth       = 23,       // CAST_STACK_DEPTH
+    CpuMaxRaycastIterations = 10000,    // MAX_RAYCAST_ITERATIONS
+    CpuRayPacketSize        = 8,        // max rays per castRayPacketCPU()
+};
+
+enum CastFlags
+{
+    CastFlags_EnableContours            = 1 << 0,   // ENABLE_CONTOURS
+    CastFlags_DisablePushOptimization   = 1 << 1,   // DISABLE_PUSH_OPTIMIZATION
+};
+
+//------------------------------------------------------------------------
+
+struct CpuRay
+{
+    Vec3f           orig;
+    F32             orig_sz;
+    Vec3f           dir;
+    F32             dir_sz;
+};
+
+//------------------------------------------------------------------------
+
+struct CpuCastResult
+{
+    F32             t;          // > 1.0f if the ray missed
+    Vec3f           pos;
+    S32             iter;
+
+    const S32*      node;
+    S32             childIdx;
+    S32             stackPtr;   // scale of the voxel that was hit
+    const S32*      root;
+};
+
+//------------------------------------------------------------------------
+
+class CpuCastStack
+{
+public:
+                    CpuCastStack    (void)                                  { clear(); }
+
+#if (CPU_SHORT_STACK_SIZE == 0)
+    void            clear           (void)                                  {}
+    const S32*      read            (int idx, F32& tmax) const              { tmax = m_tmax[idx]; return m_nodes[idx]; }
+    void            write           (int idx, const S32* node, F32 tmax)    { m_nodes[idx] = node; m_tmax[idx] = tmax; }
+#else
+    void            clear           (void)                                  { for (int i = 0; i < CPU_SHORT_STACK_SIZE; i++) m_levels[i] = -1; }
+    const S32*      read            (int idx, F32& tmax) const              { int i = idx % CPU_SHORT_STACK_SIZE; tmax = m_tmax[i]; return (m_levels[i] == idx) ? m_nodes[i] : NULL; } // NULL if evicted
+    void            write           (int idx, const S32* node, F32 tmax)    { int i = idx % CPU_SHORT_STACK_SIZE; m_nodes[i] = node; m_tmax[i] = tmax; m_levels[i] = (S8)idx; }
+#endif
+
+private:
+                    CpuCastStack    (const CpuCastStack&); // forbidden
+    CpuCastStack&   operator=       (const CpuCastStack&); // forbidden
+
+private:
+#if (CPU_SHORT_STACK_SIZE == 0)
+    const S32*      m_nodes[CpuCastStackDepth + 1];
+    F32             m_tmax[CpuCastStackDepth + 1];
+#else
+    const S32*      m_nodes[CPU_SHORT_STACK_SIZE];
+    F32             m_tmax[CPU_SHORT_STACK_SIZE];
+    S8              m_levels[CPU_SHORT_STACK_SIZE];
+#endif
+};
+
+//------------------------------------------------------------------------
+
+// perfCounters, if non-NULL, points to PerfCounter_Max entries that are
+// incremented during traversal.
+
+void                castRayCPU              (CpuCastResult& res, CpuCastStack& stack, const CpuRay& ray, const S32* rootNode, U32 castFlags, S64* perfCounters = NULL);
+
+// Casts up to CpuRayPacketSize coherent rays together. While the rays
+// visit the same voxels, child descriptors are fetched once per packet
+// and the t-spans of all rays are updated in SSE or AVX lanes; once they
+// diverge, each ray is finished separately. Results are identical to
+// calling castRayCPU() for each ray.
+
+void                castRayPacketCPU        (CpuCastResult* res, CpuCastStack* stacks, const CpuRay* rays, int numRays, const S32* rootNode, U32 castFlags, S64* perfCounters = NULL);
+
+U32                 getCastFlagsCPU         (const Array<AttachIO::AttachType>& attach, bool enableContours);
+
+void                lookupVoxelColorNormalCPU(Vec4f& colorRes, Vec3f& normalRes, const CpuCastResult& castRes, const CpuCastStack& stack, AttachIO::AttachType attribType);
+void                lookupVoxelAOCPU        (F32& res, const CpuCastResult& castRes, const CpuCastStack& stack);
+
+//------------------------------------------------------------------------
+}
@@ -0,0 +1,624 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CpuRenderer.hpp"
+#include "base/Timer.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+static const Vec2f c_aa4table[4] =
+{
+    Vec2f(0.125f, 0.375f),
+    Vec2f(0.375f, 0.875f),
+    Vec2f(0.875f, 0.625f),
+    Vec2f(0.625f, 0.125f)
+};
+
+//------------------------------------------------------------------------
+
+static inline U32 toABGR255(const Vec4f& v)
+{
+    U32 ir = (U32)clamp(v.x, 0.0f, 255.0f);
+    U32 ig = (U32)clamp(v.y, 0.0f, 255.0f);
+    U32 ib = (U32)clamp(v.z, 0.0f, 255.0f);
+    U32 ia = (U32)clamp(v.w, 0.0f, 255.0f);
+    return ir | (ig << 8) | (ib << 16) | (ia << 24);
+}
+
+// Records the slice of the hit voxel if the ray stopped at a leaf while
+// its footprint asked for at least one more level. Trunk nodes (-1) do
+// not belong to any slice and are skipped.
+
+static inline void recordFeedback(Array<S32>& sliceIDs, const CpuRay& ray, const CpuCastResult& castRes)
+{
+    if (castRes.t > 1.0f)
+        return;
+
+    F32 voxelSize = (F32)(1 << castRes.stackPtr) / (F32)(1 << CpuCastStackDepth);
+    if (ray.orig_sz + castRes.t * ray.dir_sz >= voxelSize * 0.5f)
+        return;
+
+    S32 sliceID = OctreeRuntime::getBlockInfo(castRes.node)[OctreeRuntime::BlockInfo_SliceID];
+    if (sliceID != -1 && !sliceIDs.contains(sliceID))
+        sliceIDs.add(sliceID);
+}
+
+//------------------------------------------------------------------------
+
+CpuRenderer::CpuRenderer(void)
+:   m_feedbackObjectID  (-1)
+{
+    clearResults();
+}
+
+//------------------------------------------------------------------------
+
+CpuRenderer::~CpuRenderer(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::selectAttachments(Array<AttachIO::AttachType>& out, const Array<AttachIO::AttachType>& in) const
+{
+    // Clear slots.
+
+    out.clear();
+    for (int i = 0; i < AttachSlot_Max; i++)
+        out.add(AttachIO::VoidAttach);
+
+    // Assign imported attachments.
+
+    for (int i = 0; i < in.getSize(); i++)
+    {
+        AttachIO::AttachType t = in[i];
+        switch (t)
+        {
+        case AttachIO::ColorNormalPaletteAttach:    out[AttachSlot_Attribute] = t; break;
+        case AttachIO::ColorNormalCornerAttach:     out[AttachSlot_Attribute] = t; break;
+        case AttachIO::ColorNormalDXTAttach:        out[AttachSlot_Attribute] = t; break;
+        case AttachIO::ContourAttach:               out[AttachSlot_Contour] = t; break;
+        case AttachIO::AOAttach:                    out[AttachSlot_AO] = t; break;
+        default:                                    break;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+String CpuRenderer::renderObject(
+    Image&          frame,
+    OctreeRuntime*  runtime,
+    int             objectID,
+    const Mat4f&    octreeToWorld,
+    const Mat4f&    worldToCamera,
+    const Mat4f&    projection)
+{
+    FW_ASSERT(runtime);
+    m_feedback.clear();
+    m_feedbackObjectID = -1;
+
+    // Check frame buffer validity.
+
+    if (frame.getSize().min() <= 0)
+        return "";
+
+    if (frame.getFormat() != ImageFormat::ABGR_8888 ||
+        frame.getStride() % sizeof(U32) != 0)
+    {
+        return "CpuRenderer: Incompatible framebuffer!";
+    }
+
+    if (runtime->getMode() != MemoryManager::Mode_CPU)
+        return "CpuRenderer: OctreeRuntime must reside in CPU memory!";
+
+    const S32* rootNode = runtime->getRootNodeCPU(objectID);
+    if (!rootNode)
+        return "";
+
+    // Determine attachments.
+
+    const Array<AttachIO::AttachType>& attach = runtime->getAttachTypes(objectID);
+    FW_ASSERT(attach.getSize() == AttachSlot_Max);
+
+    switch (attach[AttachSlot_Attribute])
+    {
+    case AttachIO::ColorNormalPaletteAttach:
+    case AttachIO::ColorNormalCornerAttach:
+    case AttachIO::ColorNormalDXTAttach:
+        break;
+
+    default:
+        return "Unsupported attribute attachment!";
+    }
+
+    // Determine flags.
+
+    U32 flags = 0;
+    if (m_params.visualization == Visualization_IterationCount)
+        flags |= RenderFlags_VisualizeIterations;
+    else if (m_params.visualization == Visualization_RaycastLevel)
+        flags |= RenderFlags_VisualizeRaycastLevel;
+
+    // Set input.
+
+    m_input.frameSize       = frame.getSize();
+    m_input.flags           = flags;
+    m_input.castFlags       = getCastFlagsCPU(attach, m_params.enableContours);
+    m_input.attribType      = attach[AttachSlot_Attribute];
+    m_input.enableAO        = (attach[AttachSlot_AO] == AttachIO::AOAttach);
+    m_input.enableShadows   = (m_params.visualization == Visualization_PrimaryAndShadow);
+    m_input.aaRays          = (m_params.enableAntialias) ? 4 : 1;
+    m_input.enableRayPackets = m_params.enableRayPackets;
+    m_input.maxVoxelSize    = m_params.maxVoxelSize;
+    m_input.brightness      = m_params.brightness;
+    m_input.frame           = (U32*)frame.getMutablePtr();
+    m_input.frameStride     = (S32)(frame.getStride() / sizeof(U32));
+    m_input.rootNode        = rootNode;
+    m_input.tileSize        = max(m_params.tileSize, 1);
+    m_input.numTiles        = (m_input.frameSize + (m_input.tileSize - 1)) / m_input.tileSize;
+    m_input.numWorkers      = MulticoreLauncher::getNumCores();
+    m_input.coarseSize      = max(m_params.coarseSize, 1);
+    m_input.coarseFrameSize = (m_input.frameSize + (m_input.coarseSize - 1)) / m_input.coarseSize + 1;
+
+    OctreeMatrices& om      = m_input.octreeMatrices;
+    Vec3f scale             = Vec3f(Vec2f(2.0f) / Vec2f(m_input.frameSize), 1.0f);
+    om.viewportToCamera     = projection.inverted() * Mat4f::translate(Vec3f(-1.0f, -1.0f, 0.0f)) * Mat4f::scale(scale);
+    om.cameraToOctree       = Mat4f::translate(Vec3f(1.0f)) * (worldToCamera * octreeToWorld).inverted();
+    Mat4f vto               = om.cameraToOctree * om.viewportToCamera;
+    om.pixelInOctree        = sqrt(Vec4f(vto.col(0)).getXYZ().cross(Vec4f(vto.col(1)).getXYZ()).length());
+
+    om.octreeToWorld        = octreeToWorld * Mat4f::translate(Vec3f(-1.0f));
+    om.worldToOctree        = invert(om.octreeToWorld);
+    om.octreeToWorldN       = octreeToWorld.getXYZ().inverted().transposed();
+    om.cameraPosition       = invert(worldToCamera) * Vec3f(0.f, 0.f, 0.f);
+    om.octreeToViewport     = invert(om.viewportToCamera) * invert(om.cameraToOctree);
+    om.viewportToOctreeN    = (om.octreeToViewport).transposed();
+
+    // Coarse frame buffer.
+
+    int coarseNumPixels = m_input.coarseFrameSize.x * m_input.coarseFrameSize.y;
+    m_input.frameCoarse = NULL;
+    if (m_params.enableBeamOptimization)
+    {
+        m_coarseFrameBuffer.resizeDiscard(coarseNumPixels * sizeof(F32));
+        m_input.frameCoarse = (F32*)m_coarseFrameBuffer.getMutablePtr();
+        m_input.flags |= RenderFlags_UseCoarseData;
+    }
+
+    // Per-task perf counters.
+
+    m_input.taskCounters = NULL;
+    if (m_params.enablePerfCounters)
+    {
+        m_taskCounters.reset(max(m_input.numWorkers, m_input.coarseFrameSize.y) * PerfCounter_Max);
+        memset(m_taskCounters.getPtr(), 0, m_taskCounters.getNumBytes());
+        m_input.taskCounters = m_taskCounters.getPtr();
+    }
+
+    // Visibility feedback.
+
+    m_input.feedback = NULL;
+    m_input.feedbackLock = &m_feedbackLock;
+    if (m_params.enableVisibilityFeedback)
+    {
+        m_input.feedback = &m_feedback;
+        m_feedbackObjectID = objectID;
+    }
+
+    // Render tiles on all cores, preceded by the coarse pass if enabled.
+
+    int numSteals = 0;
+    Timer timer(true);
+    F32 coarseTime = 0.0f;
+    F32 renderTime = 0.0f;
+
+    for (int i = 0; i < m_params.numFrameRepeats; i++)
+    {
+        if (m_params.enableBeamOptimization)
+        {
+            MulticoreLauncher().push(renderCoarseRow, this, 0, m_input.coarseFrameSize.y).popAll();
+            coarseTime += timer.end();
+        }
+
+        m_scheduler.reset(m_input.numTiles, m_input.numWorkers, m_params.batchSize);
+        MulticoreLauncher().push(renderWorker, this, 0, m_input.numWorkers).popAll();
+        numSteals += m_scheduler.getNumSteals();
+        renderTime += timer.end();
+    }
+
+    // Update statistics.
+
+    F32 totalTime = coarseTime + renderTime;
+    int numPixels = m_input.frameSize.x * m_input.frameSize.y;
+    m_results.launchTime += totalTime;
+    m_results.coarseTime += coarseTime;
+    m_results.numRays += (S64)numPixels * m_input.aaRays * m_params.numFrameRepeats;
+    if (m_params.enableBeamOptimization)
+        m_results.numRays += (S64)coarseNumPixels * m_params.numFrameRepeats;
+
+    if (m_input.taskCounters)
+        for (int i = 0; i < m_taskCounters.getSize(); i++)
+            m_results.perfCounters[i % PerfCounter_Max] += m_taskCounters[i];
+
+    m_stats = sprintf("CpuRenderer: render %.2f ms (%.2f FPS), %.2f MPix/s, coarse %.1f%%, %d threads, %.1f steals",
+        totalTime * 1.0e3f,
+        1.0f / totalTime,
+        numPixels * m_params.numFrameRepeats * 1.0e-6f / totalTime,
+        coarseTime / totalTime * 100.0f,
+        m_input.numWorkers,
+        (F32)numSteals / (F32)m_params.numFrameRepeats);
+    return "";
+}
+
+//------------------------------------------------------------------------
+
+String CpuRenderer::renderObject(
+    GLContext*      gl,
+    OctreeRuntime*  runtime,
+    int             objectID,
+    const Mat4f&    octreeToWorld,
+    const Mat4f&    worldToCamera,
+    const Mat4f&    projection)
+{
+    // Setup framebuffer.
+
+    FW_ASSERT(gl);
+    const Vec2i& size = gl->getViewSize();
+    int stride = size.x * sizeof(U32);
+    m_frameBuffer.resizeDiscard(size.y * stride);
+    Image image(size, ImageFormat::ABGR_8888, m_frameBuffer, 0, stride);
+
+    // Render.
+
+    String error = renderObject(image, runtime, objectID, octreeToWorld, worldToCamera, projection);
+    if (error.getLength())
+        return error;
+
+    // Blit to the screen.
+
+    Mat4f old = gl->setVGXform(Mat4f());
+    gl->drawImage(image, Vec2f(0.0f), 0.5f, false);
+    gl->setVGXform(old);
+    return "";
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::clearResults(void)
+{
+    m_results.launchTime    = 0.0f;
+    m_results.coarseTime    = 0.0f;
+    for (int i = 0; i < PerfCounter_Max; i++)
+        m_results.perfCounters[i] = 0;
+    m_results.numRays       = 0;
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::renderWorker(MulticoreLauncher::Task& task)
+{
+    CpuRenderer& r = *(CpuRenderer*)task.data;
+    const Input& in = r.m_input;
+    S64* counters = (in.taskCounters) ? in.taskCounters + task.idx * PerfCounter_Max : NULL;
+
+    int first, num;
+    while (r.m_scheduler.fetchWork(task.idx, first, num))
+        for (int i = first; i < first + num; i++)
+            r.renderTile(r.m_scheduler.getTile(i), counters);
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::renderTile(int tileIdx, S64* counters) const
+{
+    const Input& in = m_input;
+
+    Vec2i lo = Vec2i(tileIdx % in.numTiles.x, tileIdx / in.numTiles.x) * in.tileSize;
+    Vec2i hi = min(lo + in.tileSize, in.frameSize);
+
+    CpuRay          rays[BlockWidth * BlockHeight * MaxAARays];
+    CpuCastResult   castRes[BlockWidth * BlockHeight * MaxAARays];
+    CpuCastStack    stacks[BlockWidth * BlockHeight * MaxAARays];
+    Array<S32>      tileFeedback;
+
+    for (int by = lo.y; by < hi.y; by += BlockHeight)
+    for (int bx = lo.x; bx < hi.x; bx += BlockWidth)
+    {
+        Vec2i bhi = min(Vec2i(bx + BlockWidth, by + BlockHeight), hi);
+
+        // Construct primary rays for the block, aaRays consecutive samples per pixel.
+
+        int numRays = 0;
+        for (int py = by; py < bhi.y; py++)
+        for (int px = bx; px < bhi.x; px++)
+        {
+            F32 tmin = ((in.flags & RenderFlags_UseCoarseData) != 0) ? getCoarseTMin(px, py) : 0.0f;
+            for (int i = 0; i < in.aaRays; i++)
+            {
+                Vec2f ofs = (in.aaRays == 1) ? Vec2f(0.5f) : c_aa4table[i];
+                constructPrimaryRay(rays[numRays++], (F32)px + ofs.x, (F32)py + ofs.y, in.maxVoxelSize, tmin);
+            }
+        }
+
+        // Cast primary rays.
+
+        if (in.enableRayPackets)
+        {
+            for (int i = 0; i < numRays; i += CpuRayPacketSize)
+                castRayPacketCPU(castRes + i, stacks + i, rays + i, min(numRays - i, (int)CpuRayPacketSize), in.rootNode, in.castFlags, counters);
+        }
+        else
+        {
+            for (int i = 0; i < numRays; i++)
+                castRayCPU(castRes[i], stacks[i], rays[i], in.rootNode, in.castFlags, counters);
+        }
+
+        if (in.feedback)
+            for (int i = 0; i < numRays; i++)
+                recordFeedback(tileFeedback, rays[i], castRes[i]);
+
+        // Shade.
+
+        int rayIdx = 0;
+        for (int py = by; py < bhi.y; py++)
+        {
+            U32* framePtr = in.frame + py * in.frameStride;
+            for (int px = bx; px < bhi.x; px++)
+            {
+                // No AA => single ray through the pixel center.
+
+                if (in.aaRays == 1)
+                {
+                    framePtr[px] = shadePrimaryRay(rays[rayIdx], castRes[rayIdx], stacks[rayIdx]) | 0xFF000000u;
+                    rayIdx++;
+                    continue;
+                }
+
+                // 4x AA => average the samples.
+
+                U32 sum = 0;
+                for (int i = 0; i < 4; i++, rayIdx++)
+                {
+                    U32 color = shadePrimaryRay(rays[rayIdx], castRes[rayIdx], stacks[rayIdx]);
+                    sum += (color & 0xff) | ((color & 0xff00) << 2) | ((color & 0xff0000) << 4);
+                }
+                framePtr[px] = ((sum >> 2) & 0xff) | ((sum >> 4) & 0xff00) | ((sum >> 6) & 0xff0000) | 0xFF000000u;
+            }
+        }
+    }
+
+    // Merge visibility feedback.
+
+    if (tileFeedback.getSize())
+    {
+        in.feedbackLock->enter();
+        for (int i = 0; i < tileFeedback.getSize(); i++)
+            if (!in.feedback->contains(tileFeedback[i]))
+                in.feedback->add(tileFeedback[i]);
+        in.feedbackLock->leave();
+    }
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::renderCoarseRow(MulticoreLauncher::Task& task)
+{
+    const CpuRenderer& r = *(const CpuRenderer*)task.data;
+    const Input& in = r.m_input;
+
+    // Make voxels large enough so that rays cannot accidentally get past them.
+
+    F32 voxelSize = (F32)in.coarseSize * 2.83f; // sqrt(8)
+    U32 castFlags = in.castFlags & ~CastFlags_EnableContours;
+    F32* coarsePtr = in.frameCoarse + task.idx * in.coarseFrameSize.x;
+    F32 fy = (F32)(task.idx * in.coarseSize);
+    S64* counters = (in.taskCounters) ? in.taskCounters + task.idx * PerfCounter_Max : NULL;
+
+    CpuRay          rays[CpuRayPacketSize];
+    CpuCastResult   castRes[CpuRayPacketSize];
+    CpuCastStack    stacks[CpuRayPacketSize];
+
+    for (int x = 0; x < in.coarseFrameSize.x; x += CpuRayPacketSize)
+    {
+        int numRays = min(in.coarseFrameSize.x - x, (int)CpuRayPacketSize);
+        for (int i = 0; i < numRays; i++)
+            r.constructPrimaryRay(rays[i], (F32)((x + i) * in.coarseSize), fy, voxelSize, 0.0f);
+
+        if (in.enableRayPackets)
+            castRayPacketCPU(castRes, stacks, rays, numRays, in.rootNode, castFlags, counters);
+        else
+            for (int i = 0; i < numRays; i++)
+                castRayCPU(castRes[i], stacks[i], rays[i], in.rootNode, castFlags, counters);
+
+        // Back off by half a voxel to get a conservative tmin.
+
+        for (int i = 0; i < numRays; i++)
+        {
+            F32 t = castRes[i].t;
+            if (t < 1.0f)
+            {
+                F32 size = (F32)(1 << castRes[i].stackPtr) / (F32)(1 << CpuCastStackDepth);
+                t -= size / rays[i].dir.length() * 0.5f;
+            }
+            coarsePtr[x + i] = max(t, 0.0f);
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+F32 CpuRenderer::getCoarseTMin(int px, int py) const
+{
+    const Input& in = m_input;
+    int w = in.coarseFrameSize.x;
+    const F32* p = in.frameCoarse + (px / in.coarseSize) + (py / in.coarseSize) * w;
+    return min(p[0], p[1], p[w], p[w + 1], 0.9999f);
+}
+
+//------------------------------------------------------------------------
+
+void CpuRenderer::constructPrimaryRay(CpuRay& ray, F32 fx, F32 fy, F32 voxelSize, F32 tmin) const
+{
+    const Mat4f& vtc = m_input.octreeMatrices.viewportToCamera;
+    const Mat4f& cto = m_input.octreeMatrices.cameraToOctree;
+
+    Vec4f pos(
+        vtc.m00 * fx + vtc.m01 * fy + vtc.m03,
+        vtc.m10 * fx + vtc.m11 * fy + vtc.m13,
+        vtc.m20 * fx + vtc.m21 * fy + vtc.m23,
+        vtc.m30 * fx + vtc.m31 * fy + vtc.m33);
+
+    Vec3f near(
+        pos.x - vtc.m02,
+        pos.y - vtc.m12,
+        pos.z - vtc.m22);
+    F32 near_sz = m_input.octreeMatrices.pixelInOctree * voxelSize;
+
+    Vec3f diff(
+        vtc.m32 * pos.x - vtc.m02 * pos.w,
+        vtc.m32 * pos.y - vtc.m12 * pos.w,
+        vtc.m32 * pos.z - vtc.m22 * pos.w);
+    F32 diff_sz = near_sz * vtc.m32;
+
+    F32 a = 1.0f / (pos.w - vtc.m32);
+    F32 b = 2.0f * a / max(pos.w + vtc.m32, 1.0e-8f);
+    F32 c = tmin * b;
+
+    Vec3f orig  = near * a - diff * c;
+    Vec3f dir   = diff * (c - b);
+    ray.orig_sz = near_sz * a - diff_sz * c;
+    ray.dir_sz  = diff_sz * (c - b);
+
+    ray.orig = Vec3f(
+        cto.m00 * orig.x + cto.m01 * orig.y + cto.m02 * orig.z + cto.m03,
+        cto.m10 * orig.x + cto.m11 * orig.y + cto.m12 * orig.z + cto.m13,
+        cto.m20 * orig.x + cto.m21 * orig.y + cto.m22 * orig.z + cto.m23);
+    ray.dir = Vec3f(
+        cto.m00 * dir.x + cto.m01 * dir.y + cto.m02 * dir.z,
+        cto.m10 * dir.x + cto.m11 * dir.y + cto.m12 * dir.z,
+        cto.m20 * dir.x + cto.m21 * dir.y + cto.m22 * dir.z);
+}
+
+//------------------------------------------------------------------------
+
+U32 CpuRenderer::shadePrimaryRay(const CpuRay& ray, const CpuCastResult& castRes, const CpuCastStack& stack) const
+{
+    const Input& in = m_input;
+
+    // Handle visualizations.
+
+    if (in.flags & RenderFlags_VisualizeIterations)
+    {
+        F32 v = 255.0f * (F32)castRes.iter / 64.0f;
+        return toABGR255(Vec4f(v, v, v, 0.0f));
+    }
+    else if (in.flags & RenderFlags_VisualizeRaycastLevel)
+    {
+        F32 v = 0.0f;
+        if (castRes.t <= 1.0f)
+            v = 255.0f - ((F32)CpuCastStackDepth - (F32)castRes.stackPtr) * (255.0f / 18.0f);
+        return toABGR255(Vec4f(v * 0.5f, v, v * 0.5f, 0.0f));
+    }
+
+    // Initialize light and incident vectors.
+
+    Vec3f L = Vec3f(0.3643f, 0.3535f, 0.8616f);
+    Vec3f I = (in.octreeMatrices.octreeToWorld.getXYZ() * ray.dir).normalized();
+
+    // No hit => sky.
+
+    if (castRes.t > 1.0f)
+    {
+        Vec3f c;
+        if (I.y >= 0.0f)
+        {
+            Vec3f horz = Vec3f(179.0f, 205.0f, 253.0f);
+            Vec3f zen  = Vec3f(77.0f,  102.0f, 179.0f);
+            c = horz + (zen - horz) * I.y * I.y;
+            c *= 2.5f;
+        }
+        else
+        {
+            Vec3f horz = Vec3f(192.0f, 154.0f, 102.0f);
+            Vec3f zen  = Vec3f(128.0f, 102.0f, 77.0f);
+            c = horz - (zen - horz) * I.y;
+        }
+
+        c *= max(L.y, 0.0f);
+        F32 IL = dot(I, L);
+        if (IL > 0.0f)
+            c += Vec3f(255.0f, 179.0f, 102.0f) * pow(IL, 1000.0f); // sun
+
+        return toABGR255(Vec4f(c, 0.0f));
+    }
+
+    // Get voxel color, normal, and ambient.
+
+    Vec4f voxelColor;
+    Vec3f voxelNormal;
+    lookupVoxelColorNormalCPU(voxelColor, voxelNormal, castRes, stack, in.attribType);
+
+    F32 voxelAmbient = 1.0f;
+    if (in.enableAO)
+        lookupVoxelAOCPU(voxelAmbient, castRes, stack);
+
+    // Calculate world-space normal and reflection vectors.
+
+    Vec3f N  = (in.octreeMatrices.octreeToWorldN * voxelNormal).normalized();
+    Vec3f R  = I - N * (dot(N, I) * 2.0f);
+    F32   LN = dot(L, N);
+
+    // Cast shadow ray.
+
+    bool shadow = (LN <= 0.0f);
+    if (!shadow && in.enableShadows)
+    {
+        CpuRay rayShad;
+        rayShad.orig_sz = 0.0f;
+        rayShad.dir_sz  = 0.0f;
+        rayShad.orig    = castRes.pos + L * 0.0006f;
+        rayShad.dir     = L * 3.0f;
+
+        CpuCastResult castResShad;
+        CpuCastStack  stackShad;
+        castRayCPU(castResShad, stackShad, rayShad, in.rootNode, in.castFlags);
+        shadow = (castResShad.t <= 1.0f);
+    }
+
+    // Shade.
+
+    Vec4f shadedColor = voxelColor * (voxelAmbient * (0.25f + LN * ((LN < 0.0f) ? 0.15f : (shadow) ? 0.25f : 1.0f)));
+    if (!shadow)
+        shadedColor += Vec4f(32.0f, 32.0f, 32.0f, 0.0f) * pow(max(dot(L, R), 0.0f), 18.0f); // specular
+    shadedColor *= in.brightness;
+    return toABGR255(shadedColor);
+}
+
+//------------------------------------------------------------------------
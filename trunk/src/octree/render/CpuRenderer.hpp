@@ -0,0 +1,193 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "CpuRaycast.hpp"
+#include "TileScheduler.hpp"
+#include "gui/Image.hpp"
+#include "gpu/GLContext.hpp"
+#include "base/MulticoreLauncher.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// Multithreaded CPU counterpart of CudaRenderer. Requires an
+// OctreeRuntime created with MemoryManager::Mode_CPU. The frame is split
+// into tiles that one worker per core fetches from a TileScheduler.
+// There is no post-process filter; alpha is always written as 255.
+//
+// With visibility feedback enabled, each frame records the slices that
+// contain voxels where a ray stopped at a leaf at least one level
+// coarser than its footprint asked for. OctreeManager loads only the
+// children of those slices instead of everything near the camera.
+//------------------------------------------------------------------------
+
+class CpuRenderer
+{
+public:
+    enum Visualization
+    {
+        Visualization_Primary,
+        Visualization_PrimaryAndShadow,
+        Visualization_RaycastLevel,
+        Visualization_IterationCount,
+    };
+
+    struct Params
+    {
+        Visualization   visualization;
+        bool            enableContours;
+        bool            enableAntialias;
+        bool            enableBeamOptimization;
+        S32             coarseSize;
+        F32             maxVoxelSize;
+        F32             brightness;
+        S32             numFrameRepeats;
+        S32             tileSize;       // in pixels
+        S32             batchSize;      // tiles per fetch
+        bool            enableRayPackets;
+        bool            enablePerfCounters;
+        bool            enableVisibilityFeedback;
+
+        Params(void)
+        {
+            visualization             = Visualization_Primary;
+            enableContours            = true;
+            enableAntialias           = false;
+            enableBeamOptimization    = false;
+            coarseSize                = 4;
+            maxVoxelSize              = 1.0f;
+            brightness                = 1.7f;
+            numFrameRepeats           = 1;
+            tileSize                  = 32;
+            batchSize                 = 2;
+            enableRayPackets          = true;
+            enablePerfCounters        = false;
+            enableVisibilityFeedback  = true;
+        }
+    };
+
+    struct Results
+    {
+        F32             launchTime; // total time spent raycasting
+        F32             coarseTime; // time spent on the coarse pass (beam optimization)
+        S64             numRays;
+        S64             perfCounters[PerfCounter_Max];
+    };
+
+private:
+    enum
+    {
+        BlockWidth      = 4,    // pixels covered by one primary ray packet
+        BlockHeight     = 2,
+        MaxAARays       = 4,
+    };
+
+    struct Input
+    {
+        Vec2i           frameSize;
+        U32             flags;
+        U32             castFlags;
+        AttachIO::AttachType attribType;
+        bool            enableAO;
+        bool            enableShadows;
+        S32             aaRays;
+        bool            enableRayPackets;
+        F32             maxVoxelSize;
+        F32             brightness;
+        U32*            frame;
+        S32             frameStride;    // in pixels
+        const S32*      rootNode;
+        S32             tileSize;
+        Vec2i           numTiles;
+        S32             numWorkers;
+        S32             coarseSize;         // block size for coarse data
+        Vec2i           coarseFrameSize;    // coarse data buffer size
+        F32*            frameCoarse;        // contains tmin
+        S64*            taskCounters;       // PerfCounter_Max per task, or NULL
+        Set<S32>*       feedback;           // slice IDs, or NULL
+        Spinlock*       feedbackLock;
+        OctreeMatrices  octreeMatrices;
+    };
+
+public:
+                        CpuRenderer         (void);
+                        ~CpuRenderer        (void);
+
+    void                selectAttachments   (Array<AttachIO::AttachType>& out, const Array<AttachIO::AttachType>& in) const;
+
+    String              renderObject        (Image&         frame,
+                                             OctreeRuntime* runtime,
+                                             int            objectID,
+                                             const Mat4f&   octreeToWorld,
+                                             const Mat4f&   worldToCamera,
+                                             const Mat4f&   projection);
+
+    String              renderObject        (GLContext*     gl,
+                                             OctreeRuntime* runtime,
+                                             int            objectID,
+                                             const Mat4f&   octreeToWorld,
+                                             const Mat4f&   worldToCamera,
+                                             const Mat4f&   projection);
+
+    String              getStats            (void) const        { return m_stats; }
+    void                setParams           (const Params& p)   { m_params = p; }
+    const Results&      getResults          (void) const        { return m_results; }
+    void                clearResults        (void);
+    const Set<S32>*     getVisibilityFeedback(int objectID) const { return (objectID == m_feedbackObjectID) ? &m_feedback : NULL; } // from the last frame, NULL if none
+
+private:
+    static void         renderWorker        (MulticoreLauncher::Task& task);
+    void                renderTile          (int tileIdx, S64* counters) const;
+    static void         renderCoarseRow     (MulticoreLauncher::Task& task);
+    void                constructPrimaryRay (CpuRay& ray, F32 fx, F32 fy, F32 voxelSize, F32 tmin) const;
+    F32                 getCoarseTMin       (int px, int py) const;
+    U32                 shadePrimaryRay     (const CpuRay& ray, const CpuCastResult& castRes, const CpuCastStack& stack) const;
+
+private:
+                        CpuRenderer         (CpuRenderer&); // forbidden
+    CpuRenderer&        operator=           (CpuRenderer&); // forbidden
+
+private:
+    Buffer              m_frameBuffer;
+    Buffer              m_coarseFrameBuffer;
+    Array<S64>          m_taskCounters;
+    TileScheduler       m_scheduler;
+    Set<S32>            m_feedback;
+    Spinlock            m_feedbackLock;
+    S32                 m_feedbackObjectID;
+
+    Input               m_input;
+
+    String              m_stats;
+    Params              m_params;
+
+    Results             m_results;
+};
+
+//------------------------------------------------------------------------
+}
@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RayQuery.hpp"
+#include "base/Timer.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+RayQuery::RayQuery(void)
+{
+    clearResults();
+}
+
+//------------------------------------------------------------------------
+
+RayQuery::~RayQuery(void)
+{
+}
+
+//------------------------------------------------------------------------
+
+String RayQuery::query(OctreeRuntime* runtime, int objectID, const Rays& rays, const Hits& hits)
+{
+    FW_ASSERT(runtime);
+    FW_ASSERT(rays.numRays >= 0);
+    FW_ASSERT(rays.numRays == 0 || (rays.orig && rays.dir));
+
+    if (runtime->getMode() != MemoryManager::Mode_CPU)
+        return "RayQuery: OctreeRuntime must reside in CPU memory!";
+
+    // Empty object => all rays miss.
+
+    const S32* rootNode = runtime->getRootNodeCPU(objectID);
+    if (!rootNode)
+    {
+        if (hits.t)
+            for (int i = 0; i < rays.numRays; i++)
+                hits.t[i] = FW_F32_MAX;
+        m_results.numRays += rays.numRays;
+        return "";
+    }
+
+    // Determine attachments.
+
+    const Array<AttachIO::AttachType>& attach = runtime->getAttachTypes(objectID);
+    FW_ASSERT(attach.getSize() == AttachSlot_Max);
+
+    if (hits.color || hits.normal)
+    {
+        switch (attach[AttachSlot_Attribute])
+        {
+        case AttachIO::ColorNormalPaletteAttach:
+        case AttachIO::ColorNormalCornerAttach:
+        case AttachIO::ColorNormalDXTAttach:
+            break;
+
+        default:
+            return "RayQuery: Unsupported attribute attachment!";
+        }
+    }
+
+    // Set input.
+
+    m_input.rays        = rays;
+    m_input.hits        = hits;
+    m_input.rootNode    = rootNode;
+    m_input.castFlags   = getCastFlagsCPU(attach, m_params.enableContours);
+    m_input.attribType  = attach[AttachSlot_Attribute];
+    m_input.enableAO    = (attach[AttachSlot_AO] == AttachIO::AOAttach);
+    m_input.raysPerTask = max(m_params.raysPerTask, 1);
+
+    int numTasks = (rays.numRays + m_input.raysPerTask - 1) / m_input.raysPerTask;
+    m_taskHits.reset(numTasks);
+    m_input.taskHits = m_taskHits.getPtr();
+
+    // Trace.
+
+    Timer timer(true);
+    if (numTasks)
+        MulticoreLauncher().push(queryTask, this, 0, numTasks).popAll();
+    F32 launchTime = timer.end();
+
+    // Update statistics.
+
+    S64 numHits = 0;
+    for (int i = 0; i < numTasks; i++)
+        numHits += m_taskHits[i];
+
+    m_results.launchTime += launchTime;
+    m_results.numRays += rays.numRays;
+    m_results.numHits += numHits;
+
+    m_stats = sprintf("RayQuery: %d rays in %.2f ms, %.2f MRays/s, %.1f%% hits",
+        rays.numRays,
+        launchTime * 1.0e3f,
+        rays.numRays * 1.0e-6f / max(launchTime, 1.0e-6f),
+        (F32)numHits / (F32)max(rays.numRays, 1) * 100.0f);
+    return "";
+}
+
+//------------------------------------------------------------------------
+
+void RayQuery::clearResults(void)
+{
+    m_results.launchTime    = 0.0f;
+    m_results.numRays       = 0;
+    m_results.numHits       = 0;
+}
+
+//------------------------------------------------------------------------
+
+void RayQuery::queryTask(MulticoreLauncher::Task& task)
+{
+    const RayQuery& q = *(const RayQuery*)task.data;
+    const Input& in = q.m_input;
+    const Hits& hits = in.hits;
+
+    int lo = task.idx * in.raysPerTask;
+    int hi = min(lo + in.raysPerTask, in.rays.numRays);
+    int numHits = 0;
+
+    CpuRay          ray;
+    CpuCastResult   castRes;
+    CpuCastStack    stack;
+
+    for (int i = lo; i < hi; i++)
+    {
+        F32 tmin, tlen;
+        bool hit = q.setupRay(ray, tmin, tlen, i);
+        if (hit)
+        {
+            castRayCPU(castRes, stack, ray, in.rootNode, in.castFlags);
+            hit = (castRes.t <= 1.0f);
+        }
+
+        if (!hit)
+        {
+            if (hits.t)
+                hits.t[i] = FW_F32_MAX;
+            continue;
+        }
+
+        numHits++;
+        if (hits.t)     hits.t[i]       = tmin + castRes.t * tlen;
+        if (hits.pos)   hits.pos[i]     = castRes.pos - 1.0f;
+        if (hits.level) hits.level[i]   = CpuCastStackDepth - castRes.stackPtr;
+
+        if (hits.color || hits.normal)
+        {
+            Vec4f color;
+            Vec3f normal;
+            lookupVoxelColorNormalCPU(color, normal, castRes, stack, in.attribType);
+            if (hits.color)  hits.color[i]  = color * (1.0f / 255.0f);
+            if (hits.normal) hits.normal[i] = normal.normalized();
+        }
+
+        if (hits.ao)
+        {
+            F32 ao = 1.0f;
+            if (in.enableAO)
+                lookupVoxelAOCPU(ao, castRes, stack);
+            hits.ao[i] = ao;
+        }
+    }
+
+    in.taskHits[task.idx] = numHits;
+}
+
+//------------------------------------------------------------------------
+
+bool RayQuery::setupRay(CpuRay& ray, F32& tmin, F32& tlen, int rayIdx) const
+{
+    const Rays& rays = m_input.rays;
+    Vec3f orig = rays.orig[rayIdx];
+    Vec3f dir  = rays.dir[rayIdx];
+    F32 t0 = (rays.tmin) ? rays.tmin[rayIdx] : 0.0f;
+    F32 t1 = (rays.tmax) ? rays.tmax[rayIdx] : FW_F32_MAX;
+
+    // Clip the t-range against a slightly enlarged bounding box of the
+    // octree so that castRayCPU() receives a finite span.
+
+    const F32 margin = 1.0e-3f;
+    for (int i = 0; i < 3; i++)
+    {
+        if (dir[i] == 0.0f)
+        {
+            if (orig[i] < -margin || orig[i] > 1.0f + margin)
+                return false;
+            continue;
+        }
+
+        F32 ta = (-margin - orig[i]) / dir[i];
+        F32 tb = (1.0f + margin - orig[i]) / dir[i];
+        t0 = max(t0, min(ta, tb));
+        t1 = min(t1, max(ta, tb));
+    }
+
+    if (!(t0 < t1))
+        return false;
+
+    // Map [t0, t1] to [0, 1] and the octree to [1, 2].
+
+    ray.orig    = orig + dir * t0 + 1.0f;
+    ray.dir     = dir * (t1 - t0);
+    ray.orig_sz = 0.0f;
+    ray.dir_sz  = 0.0f;
+    tmin        = t0;
+    tlen        = t1 - t0;
+    return true;
+}
+
+//------------------------------------------------------------------------
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "CpuRaycast.hpp"
+#include "base/MulticoreLauncher.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// Batched ray queries against an OctreeRuntime created with
+// MemoryManager::Mode_CPU, for clients that need hit information rather
+// than an image. Rays are given in octree space, where the octree
+// occupies [0, 1]^3; object-space rays must first be transformed by the
+// inverse of OctreeFile::Object::octreeToObject. The batch is split into
+// fixed-size chunks that are traced on all cores using castRayCPU().
+//------------------------------------------------------------------------
+
+class RayQuery
+{
+public:
+    struct Params
+    {
+        bool            enableContours;
+        S32             raysPerTask;
+
+        Params(void)
+        {
+            enableContours  = true;
+            raysPerTask     = 1024;
+        }
+    };
+
+    struct Rays // structure of arrays, numRays entries each
+    {
+        S32             numRays;
+        const Vec3f*    orig;
+        const Vec3f*    dir;        // need not be normalized
+        const F32*      tmin;       // NULL => 0
+        const F32*      tmax;       // NULL => unbounded
+
+        Rays(void) : numRays(0), orig(NULL), dir(NULL), tmin(NULL), tmax(NULL) {}
+    };
+
+    struct Hits // any array may be NULL to skip the output; only t is written for misses
+    {
+        F32*            t;          // orig + dir * t, FW_F32_MAX if the ray missed
+        Vec3f*          pos;        // octree space
+        S32*            level;      // root = 0
+        Vec4f*          color;      // [0, 1]
+        Vec3f*          normal;     // octree space, normalized
+        F32*            ao;         // 1 if the object has no AO attachment
+
+        Hits(void) : t(NULL), pos(NULL), level(NULL), color(NULL), normal(NULL), ao(NULL) {}
+    };
+
+    struct Results
+    {
+        F32             launchTime;
+        S64             numRays;
+        S64             numHits;
+    };
+
+private:
+    struct Input
+    {
+        Rays            rays;
+        Hits            hits;
+        const S32*      rootNode;
+        U32             castFlags;
+        AttachIO::AttachType attribType;
+        bool            enableAO;
+        S32             raysPerTask;
+        S32*            taskHits;
+    };
+
+public:
+                        RayQuery            (void);
+                        ~RayQuery           (void);
+
+    String              query               (OctreeRuntime* runtime, int objectID, const Rays& rays, const Hits& hits);
+
+    String              getStats            (void) const        { return m_stats; }
+    void                setParams           (const Params& p)   { m_params = p; }
+    const Results&      getResults          (void) const        { return m_results; }
+    void                clearResults        (void);
+
+private:
+    static void         queryTask           (MulticoreLauncher::Task& task);
+    bool                setupRay            (CpuRay& ray, F32& tmin, F32& tlen, int rayIdx) const;
+
+private:
+                        RayQuery            (RayQuery&); // forbidden
+    RayQuery&           operator=           (RayQuery&); // forbidden
+
+private:
+    Array<S32>          m_taskHits;
+    Input               m_input;
+
+    String              m_stats;
+    Params              m_params;
+
+    Results             m_results;
+};
+
+//------------------------------------------------------------------------
+}
@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TileScheduler.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+TileScheduler::TileScheduler(void)
+:   m_numTiles  (0),
+    m_batchSize (1),
+    m_queues    (NULL),
+    m_numQueues (0)
+{
+}
+
+//------------------------------------------------------------------------
+
+TileScheduler::~TileScheduler(void)
+{
+    delete[] m_queues;
+}
+
+//------------------------------------------------------------------------
+
+void TileScheduler::reset(const Vec2i& numTiles, int numQueues, int batchSize)
+{
+    FW_ASSERT(numTiles.min() >= 0 && numQueues > 0);
+
+    // Recalculate tile order if the tile grid has changed.
+
+    if (numTiles != m_numTiles)
+    {
+        m_numTiles = numTiles;
+        recalculate();
+    }
+
+    // Reallocate queues if needed.
+
+    if (numQueues != m_numQueues)
+    {
+        delete[] m_queues;
+        m_queues = new Queue[numQueues];
+        m_numQueues = numQueues;
+    }
+
+    // Distribute the curve evenly among the queues.
+
+    m_batchSize = max(batchSize, 1);
+    int total = m_order.getSize();
+    for (int i = 0; i < m_numQueues; i++)
+    {
+        Queue& q    = m_queues[i];
+        q.head      = (S32)((S64)total * i / m_numQueues);
+        q.tail      = (S32)((S64)total * (i + 1) / m_numQueues);
+        q.numStolen = 0;
+    }
+}
+
+//------------------------------------------------------------------------
+
+bool TileScheduler::fetchWork(int queueIdx, int& first, int& num)
+{
+    FW_ASSERT(queueIdx >= 0 && queueIdx < m_numQueues);
+    Queue& q = m_queues[queueIdx];
+
+    for (;;)
+    {
+        // Take a batch from the head of our own queue.
+
+        q.lock.enter();
+        if (q.head < q.tail)
+        {
+            first = q.head;
+            num = min(m_batchSize, q.tail - q.head);
+            q.head += num;
+            q.lock.leave();
+            return true;
+        }
+        q.lock.leave();
+
+        // Empty => refill by stealing.
+
+        if (!steal(queueIdx))
+            return false;
+    }
+}
+
+//------------------------------------------------------------------------
+
+int TileScheduler::getNumSteals(void) const
+{
+    int total = 0;
+    for (int i = 0; i < m_numQueues; i++)
+        total += m_queues[i].numStolen;
+    return total;
+}
+
+//------------------------------------------------------------------------
+
+bool TileScheduler::steal(int queueIdx)
+{
+    // Visit the other queues starting from our neighbor, and take
+    // half of the first non-empty one from its tail.
+
+    for (int i = 1; i < m_numQueues; i++)
+    {
+        Queue& victim = m_queues[(queueIdx + i) % m_numQueues];
+        victim.lock.enter();
+
+        int remaining = victim.tail - victim.head;
+        if (remaining <= 0)
+        {
+            victim.lock.leave();
+            continue;
+        }
+
+        int take = (remaining + 1) >> 1;
+        victim.tail -= take;
+        victim.numStolen++;
+        int first = victim.tail;
+        victim.lock.leave();
+
+        // Stolen range is contiguous on the curve => becomes our queue.
+
+        Queue& q = m_queues[queueIdx];
+        q.lock.enter();
+        q.head = first;
+        q.tail = first + take;
+        q.lock.leave();
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------
+
+void TileScheduler::recalculate(void)
+{
+    m_order.clear();
+    m_order.reserve(m_numTiles.x * m_numTiles.y);
+
+    // Round the larger dimension up to a power of two.
+
+    int maxdim = max(m_numTiles.x, m_numTiles.y, 1) - 1;
+    maxdim |= maxdim >> 1;
+    maxdim |= maxdim >> 2;
+    maxdim |= maxdim >> 4;
+    maxdim |= maxdim >> 8;
+    maxdim |= maxdim >> 16;
+    maxdim++;
+
+    // Walk the Morton curve and skip tiles outside the grid.
+
+    for (int i = 0; i < maxdim * maxdim; i++)
+    {
+        int tx = 0;
+        int ty = 0;
+        int val = i;
+        int bit = 1;
+        while (val)
+        {
+            if (val & 1) tx |= bit;
+            if (val & 2) ty |= bit;
+            bit += bit;
+            val >>= 2;
+        }
+
+        if (tx < m_numTiles.x && ty < m_numTiles.y)
+            m_order.add(tx + ty * m_numTiles.x);
+    }
+}
+
+//------------------------------------------------------------------------
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2009-2011, NVIDIA Corporation
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of NVIDIA Corporation nor the
+ *        names of its contributors may be used to endorse or promote products
+ *        derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "base/Math.hpp"
+#include "base/Array.hpp"
+#include "base/Thread.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// CPU counterpart of PixelTable and fetchWorkFirst()/fetchWorkNext() in
+// Render.cu. Tiles are ordered along a Morton curve, and the curve is
+// split into one contiguous range per worker queue so that each worker
+// starts out in its own region of the screen. Workers fetch batches from
+// the head of their own queue, and once it runs dry, steal half of the
+// remaining tiles from the tail of another queue.
+//------------------------------------------------------------------------
+
+class TileScheduler
+{
+public:
+                        TileScheduler   (void);
+                        ~TileScheduler  (void);
+
+    void                reset           (const Vec2i& numTiles, int numQueues, int batchSize); // Call before each frame.
+    bool                fetchWork       (int queueIdx, int& first, int& num); // Thread-safe. Returns false when all tiles have been issued.
+
+    int                 getTile         (int orderIdx) const    { return m_order[orderIdx]; }
+    const Vec2i&        getNumTiles     (void) const            { return m_numTiles; }
+    int                 getNumQueues    (void) const            { return m_numQueues; }
+    int                 getNumSteals    (void) const;
+
+private:
+    struct Queue
+    {
+        Spinlock        lock;
+        S32             head;
+        S32             tail;
+        S32             numStolen;
+    };
+
+    bool                steal           (int queueIdx);
+    void                recalculate     (void);
+
+private:
+                        TileScheduler   (const TileScheduler&); // forbidden
+    TileScheduler&      operator=       (const TileScheduler&); // forbidden
+
+private:
+    Vec2i               m_numTiles;
+    S32                 m_batchSize;
+    Array<S32>          m_order;        // Morton index => tile index
+
+    Queue*              m_queues;
+    S32                 m_numQueues;
+};
+
+//------------------------------------------------------------------------
+}